@@ -68,7 +68,9 @@ $content = ob_get_contents();
 ob_end_clean();
 $content_length = strlen($content);
 
-echo $exit_code . "\n";
+http_response_code($exit_code);
+header("Content-Type: text/html; charset=UTF-8");
+header("Content-Length: " . $content_length);
 
 // Output content
 echo $content;
@@ -59,9 +59,11 @@ html_content = f"""<!DOCTYPE html>
 # Calculate content length
 content_length = len(html_content.encode('utf-8'))
 
-# Send exit_code
-print(f"{exit_code}\r\n", end="")
+# Send CGI headers
+print(f"Status: {exit_code}\r\n", end="")
+print("Content-Type: text/html; charset=utf-8\r\n", end="")
+print(f"Content-Length: {content_length}\r\n", end="")
 print("\r")
 
 # Send content
-print(html_content)
\ No newline at end of file
+print(html_content, end="")
\ No newline at end of file
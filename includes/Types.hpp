@@ -15,6 +15,8 @@
 
 #include "Webserv.hpp"
 
+class Connection;
+
 struct ClientRequest {
 	// Request line
 	std::string method;
@@ -37,6 +39,7 @@ struct ClientRequest {
 
 	// CGI request
 	std::string extension;
+	std::string script_path; // resolved by normalizePath, the location's is shared
 
 	public:
 	
@@ -49,4 +52,13 @@ struct ClientRequest {
 
 };
 
+/// A CGI request waiting for a cgi_max_concurrency slot of its location, or for
+/// the coalesced execution of an identical request (cgi_coalesce).
+struct QueuedCGI {
+	Connection *conn;
+	ClientRequest request;
+	time_t since;
+	std::string key; ///< coalescing key the request leads, empty if none
+};
+
 #endif
@@ -23,6 +23,7 @@
 #include <cstdlib> // for exit
 #include <cstring> // for strncmp
 #include <ctime>
+#include <deque>
 #include <dirent.h> // for directory listing
 #include <exception>
 #include <fcntl.h>
@@ -30,17 +31,24 @@
 #include <functional>
 #include <iostream>
 #include <iomanip>
+#include <list>
 #include <map> // for map
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h> // for TCP_DEFER_ACCEPT
+#include <set>
 #include <signal.h>
+#include <spawn.h>
 #include <sstream>
 #include <stdint.h> // for uint16_t
 #include <string>
 #include <sys/epoll.h>
+#include <sys/ioctl.h> // for FIONREAD
+#include <sys/signalfd.h>
 #include <sys/socket.h> // for send
 #include <sys/stat.h>
 #include <sys/types.h> // for pid_t
+#include <sys/un.h>    // for sockaddr_un
 #include <sys/wait.h>  // for waitpid
 #include <unistd.h>    // for pipe, dup2, fork, exec
 #include <utility>     // for makepair
@@ -0,0 +1,85 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   webserv_module.h                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/09 09:41:17 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/09 09:41:17 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+ * C ABI of the native handler modules loaded by the `handler` directive.
+ *
+ * A module is a shared object exporting `webserv_module`, returning a static
+ * ws_module whose abi_version is WS_MODULE_ABI. Its handle() runs in the
+ * server's event loop for every request of the location and must not block:
+ * it either builds the response and returns WS_DONE, returns WS_ASYNC and
+ * calls complete() later (from any thread), or returns an HTTP error status.
+ *
+ * The request view stays valid, and the response may be built, until
+ * complete() is called. If the client goes away first, cancel() is called;
+ * the module must still call complete() once it stopped using them.
+ */
+
+#ifndef WEBSERV_MODULE_H
+#define WEBSERV_MODULE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WS_MODULE_ABI 1
+
+#define WS_DONE 0    /* the response is built */
+#define WS_ASYNC 1   /* complete() will be called */
+
+typedef struct ws_response ws_response; /* opaque, owned by the server */
+
+typedef struct ws_request {
+	const char *method;
+	const char *uri;   /* path and query string */
+	const char *path;
+	const char *query; /* without the '?', empty if none */
+	const char *body;
+	size_t body_len;
+	const void *server; /* for header() */
+} ws_request;
+
+/* Services of the server, valid from init() to fini() */
+typedef struct ws_server_api {
+	/* Value of a request header (name in any case), NULL if absent */
+	const char *(*header)(const ws_request *req, const char *name);
+	void (*set_status)(ws_response *resp, int status);
+	void (*set_header)(ws_response *resp, const char *name, const char *value);
+	void (*write)(ws_response *resp, const void *data, size_t len);
+	/* Ends an asynchronous response, the only call allowed from another thread */
+	void (*complete)(ws_response *resp);
+} ws_server_api;
+
+typedef struct ws_module {
+	unsigned int abi_version; /* WS_MODULE_ABI */
+	const char *name;
+	/* Once at startup, 0 on success. Optional. */
+	int (*init)(const ws_server_api *api);
+	/* WS_DONE, WS_ASYNC, or an HTTP status (400-599) to answer with an error page */
+	int (*handle)(const ws_request *req, ws_response *resp);
+	/* The client of an asynchronous response went away. Optional. */
+	void (*cancel)(ws_response *resp);
+	/* Once at shutdown. Optional. */
+	void (*fini)(void);
+} ws_module;
+
+typedef const ws_module *(*ws_module_entry)(void);
+
+#define WS_MODULE_ENTRY "webserv_module"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
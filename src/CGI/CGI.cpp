@@ -13,27 +13,125 @@
 #include "CGI.hpp"
 
 CGI::CGI(ClientRequest &request, LocConfig *locConfig)
-    : script_path_(locConfig->getFullPath()) {
-	setEnv("SCRIPT_FILENAME", locConfig->getFullPath());
-	setEnv("SCRIPT_NAME", "/" + request.path);
-	setEnv("REQUEST_METHOD", request.method);
-	setEnv("QUERY_STRING", request.query);
-	if (request.extension == ".php")
-		setEnv("PHPRC", locConfig->getFullPath().substr(0, locConfig->getFullPath().size() - 11));
-	if (request.method == "POST") {
-		setEnv("CONTENT_TYPE", request.headers["content-type"]);
-		setEnv("CONTENT_LENGTH", request.headers["content-length"]);
-	}
-	if (request.method == "POST" || request.method == "DELETE") {
-		setEnv("UPLOAD_DIR", locConfig->getUploadPath());
-	}
-	setEnv("SERVER_SOFTWARE", "CustomCGI/1.0");
-	setEnv("GATEWAY_INTERFACE", "CGI/1.1");
-	setEnv("REDIRECT_STATUS", "200");
+    : base_env_(&locConfig->getCGIEnv()),
+      location_(locConfig),
+      script_path_(request.script_path),
+      output_fd_(-1),
+      input_fd_(-1),
+      pid_(-1),
+      input_offset_(0),
+      input_open_(false),
+      output_done_(false),
+      exited_(false),
+      exit_status_(0),
+      start_time_(time(NULL)),
+      spawn_time_(0),
+      last_output_(start_time_),
+      timed_out_(false),
+      signal_(0),
+      signal_time_(0),
+      streaming_(false),
+      capture_limit_(0),
+      capturing_(false) {
+	CGIUtils::buildEnv(env_, request, locConfig);
 	std::string interpreter = locConfig->getInterpreter(request.extension);
 	setInterpreter(interpreter);
 }
 
+CGI::~CGI() {
+	closeInput();
+	closeOutput();
+}
+
+/* EVENT LOOP I/O */
+
+// Writes the next slice of the body to stdin; -1 with errno set on error
+ssize_t CGI::writeInput() {
+	if (input_fd_ == -1 || !hasPendingInput())
+		return (0);
+	ssize_t written =
+	    write(input_fd_, input_.data() + input_offset_, input_.size() - input_offset_);
+	if (written > 0)
+		input_offset_ += written;
+	return (written);
+}
+
+// Appends what is readable on stdout (bounded per call so one script cannot
+// monopolize the loop) and returns the number of bytes read. EOF and read
+// errors both end the output.
+ssize_t CGI::readOutput() {
+	char buffer[4096];
+	ssize_t total = 0;
+	ssize_t bytes_read = -1;
+
+	while (total < 16 * static_cast<ssize_t>(sizeof(buffer)) &&
+	       (bytes_read = read(output_fd_, buffer, sizeof(buffer))) > 0) {
+		output_.append(buffer, bytes_read);
+		total += bytes_read;
+		if (capturing_ && capture_.size() + bytes_read > capture_limit_) {
+			capturing_ = false;
+			std::string().swap(capture_);
+		} else if (capturing_) {
+			capture_.append(buffer, bytes_read);
+		}
+	}
+	if (total > 0)
+		last_output_ = time(NULL);
+	if (bytes_read == 0 || (bytes_read == -1 && errno != EAGAIN && errno != EWOULDBLOCK))
+		output_done_ = true;
+	return (total);
+}
+
+void CGI::expectInput() { input_open_ = true; }
+
+void CGI::appendInput(const std::string &data) {
+	// Drop what the script already consumed before growing the buffer
+	input_.erase(0, input_offset_);
+	input_offset_ = 0;
+	input_.append(data);
+}
+
+void CGI::endInput() { input_open_ = false; }
+
+bool CGI::expectsInput() const { return (input_open_); }
+
+// Whatever was not written yet is lost, the script sees EOF
+void CGI::closeInput() {
+	if (input_fd_ != -1)
+		close(input_fd_);
+	input_fd_ = -1;
+	input_.clear();
+	input_offset_ = 0;
+	input_open_ = false;
+}
+
+void CGI::closeOutput() {
+	if (output_fd_ != -1)
+		close(output_fd_);
+	output_fd_ = -1;
+}
+
+void CGI::setExitStatus(int status) {
+	exited_ = true;
+	exit_status_ = status;
+}
+
+// Reaped and stdout released (EOF, error or forced close after a timeout)
+bool CGI::isComplete() const { return (exited_ && output_fd_ == -1); }
+
+bool CGI::outputDone() const { return (output_done_); }
+
+// Hands over what was read so far, the buffer only ever holds unforwarded output
+std::string CGI::takeOutput() {
+	std::string out;
+	out.swap(output_);
+	return (out);
+}
+
+void CGI::setStreaming() { streaming_ = true; }
+
+bool CGI::isStreaming() const { return (streaming_); }
+
 // Set or update an environment variable
 void CGI::setEnv(const std::string &key, const std::string &value) { env_[key] = value; }
 
@@ -49,32 +147,24 @@ std::string CGI::getEnv(const std::string &key) const {
 // Remove a variable if it exists
 void CGI::unsetEnv(const std::string &key) { env_.erase(key); }
 
-// Convert to a null-terminated char** suitable for execve
-char **CGI::toEnvp() const {
-	char **envp = new char *[env_.size() + 1];
-	size_t i = 0;
-
+// Null-terminated environment for execve. The location's prebuilt strings are
+// referenced in place, only per-request variables are formatted. The array
+// stays valid until the next call or the CGI's destruction.
+char **CGI::toEnvp() {
+	env_strings_.clear();
+	env_strings_.reserve(env_.size());
 	for (std::map<std::string, std::string>::const_iterator it = env_.begin(); it != env_.end();
-	     ++it, ++i) {
-		std::string var = it->first + "=" + it->second;
-		char *c_var = new char[var.size() + 1];
-		for (size_t j = 0; j < var.size(); ++j)
-			c_var[j] = var[j];
-		c_var[var.size()] = '\0';
-		envp[i] = c_var;
-	}
-	envp[env_.size()] = NULL;
-
-	return (envp);
-}
-
-// Static helper to free envp arrays created by toEnvp()
-void CGI::freeEnvp(char **envp) {
-	if (!envp)
-		return;
-	for (size_t i = 0; envp[i] != NULL; ++i)
-		delete[] envp[i];
-	delete[] envp;
+	     ++it)
+		env_strings_.push_back(it->first + "=" + it->second);
+
+	envp_.clear();
+	envp_.reserve(base_env_->size() + env_strings_.size() + 1);
+	for (size_t i = 0; i < base_env_->size(); ++i)
+		envp_.push_back(const_cast<char *>((*base_env_)[i].c_str()));
+	for (size_t i = 0; i < env_strings_.size(); ++i)
+		envp_.push_back(const_cast<char *>(env_strings_[i].c_str()));
+	envp_.push_back(NULL);
+	return (&envp_[0]);
 }
 
 /* SETTERS / GETTERS */
@@ -92,3 +182,68 @@ pid_t CGI::getPid() const { return (pid_); }
 void CGI::setOutputFd(int fd) { output_fd_ = fd; }
 
 int CGI::getOutputFd() const { return (output_fd_); }
+
+void CGI::setInputFd(int fd) { input_fd_ = fd; }
+
+int CGI::getInputFd() const { return (input_fd_); }
+
+void CGI::setInput(const std::string &body) {
+	input_ = body;
+	input_offset_ = 0;
+}
+
+bool CGI::hasPendingInput() const { return (input_offset_ < input_.size()); }
+
+const std::string &CGI::getOutput() const { return (output_); }
+
+bool CGI::hasExited() const { return (exited_); }
+
+int CGI::getExitStatus() const { return (exit_status_); }
+
+time_t CGI::getStartTime() const { return (start_time_); }
+
+void CGI::setSpawnTime(double when) { spawn_time_ = when; }
+
+double CGI::getSpawnTime() const { return (spawn_time_); }
+
+time_t CGI::getLastOutput() const { return (last_output_); }
+
+void CGI::touchOutput() { last_output_ = time(NULL); }
+
+LocConfig *CGI::getLocation() const { return (location_); }
+
+void CGI::setTimedOut() { timed_out_ = true; }
+
+bool CGI::timedOut() const { return (timed_out_); }
+
+void CGI::setSignal(int sig, time_t when) {
+	signal_ = sig;
+	signal_time_ = when;
+}
+
+int CGI::getSignal() const { return (signal_); }
+
+time_t CGI::getSignalTime() const { return (signal_time_); }
+
+void CGI::setCoalesceKey(const std::string &key) { coalesce_key_ = key; }
+
+const std::string &CGI::getCoalesceKey() const { return (coalesce_key_); }
+
+void CGI::setCacheKey(const std::string &key) { cache_key_ = key; }
+
+const std::string &CGI::getCacheKey() const { return (cache_key_); }
+
+void CGI::captureOutput(size_t limit) {
+	capture_limit_ = limit;
+	capturing_ = true;
+}
+
+bool CGI::capturing() const { return (capturing_); }
+
+bool CGI::takeCapture(std::string &output) {
+	if (!capturing_)
+		return (false);
+	output.swap(capture_);
+	capturing_ = false;
+	return (true);
+}
@@ -20,24 +20,76 @@
 #include "src/HttpServer/Structs/Response.hpp"
 #include "src/Utils/ServerUtils.hpp"
 
+/// A running CGI script, driven by the server's event loop.
+///
+/// The request body is fed to the script's stdin through a non-blocking pipe
+/// whenever it becomes writable (all at once, or appended as it arrives from
+/// the client with cgi_request_buffering off), stdout is drained as it becomes readable and
+/// the exit status is collected from SIGCHLD. The script is complete once its
+/// stdout reached EOF and the child was reaped.
 class CGI {
   private:
-	std::map<std::string, std::string> env_;
+	std::map<std::string, std::string> env_;   // per-request variables
+	const std::vector<std::string> *base_env_; // location's prebuilt "NAME=value" strings
+	std::vector<std::string> env_strings_;     // storage behind envp_
+	std::vector<char *> envp_;
+	LocConfig *location_;
 	std::string script_path_;
 	std::string interpreter_;
 	int output_fd_;
+	int input_fd_;
 	pid_t pid_;
 
+	std::string input_;  // request body for the script's stdin
+	size_t input_offset_;
+	bool input_open_;    // more of the body is still arriving from the client
+	std::string output_; // script output not forwarded yet
+	bool output_done_;
+	bool exited_;
+	int exit_status_;
+	time_t start_time_;
+	double spawn_time_;  // monotonic seconds, for the metrics
+	time_t last_output_;
+	bool timed_out_;
+	int signal_;         // last signal sent by the server, 0 if none
+	time_t signal_time_;
+	bool streaming_;     // headers sent, the body goes to the client's CGIStream
+	std::string coalesce_key_; // output is kept whole for the waiters of this key
+	std::string cache_key_;    // cgi_cache entry the output goes to
+	std::string capture_;      // copy of the whole output for the cache
+	size_t capture_limit_;
+	bool capturing_;           // cleared once the output outgrew capture_limit_
+
+	CGI(const CGI &);
+	CGI &operator=(const CGI &);
+
   public:
 	CGI(ClientRequest &request, LocConfig *locConfig);
-	~CGI(){};
+	~CGI();
+
+	// I/O, called from the event loop
+	ssize_t writeInput();
+	ssize_t readOutput();
+	/// Keeps stdin open after the start: the body is appended while it arrives.
+	void expectInput();
+	void appendInput(const std::string &data);
+	/// The whole body was appended, stdin can be closed once it is written.
+	void endInput();
+	bool expectsInput() const;
+	void closeInput();
+	void closeOutput();
+	void setExitStatus(int status);
+	bool isComplete() const;
+	bool outputDone() const;
+	std::string takeOutput();
+	void setStreaming();
+	bool isStreaming() const;
 
 	// ENV
 	void setEnv(const std::string &key, const std::string &value);
 	std::string getEnv(const std::string &key) const;
 	void unsetEnv(const std::string &key);
-	char **toEnvp() const;
-	static void freeEnvp(char **envp);
+	char **toEnvp();
 
 	// Getters/Setters
 	void setInterpreter(std::string &interpreter);
@@ -47,11 +99,56 @@ class CGI {
 	pid_t getPid() const;
 	void setOutputFd(int fd);
 	int getOutputFd() const;
+	void setInputFd(int fd);
+	int getInputFd() const;
+	void setInput(const std::string &body);
+	bool hasPendingInput() const;
+	const std::string &getOutput() const;
+	bool hasExited() const;
+	int getExitStatus() const;
+	time_t getStartTime() const;
+	void setSpawnTime(double when);
+	double getSpawnTime() const;
+	time_t getLastOutput() const;
+	void touchOutput();
+	LocConfig *getLocation() const;
+	void setTimedOut();
+	bool timedOut() const;
+	void setSignal(int sig, time_t when);
+	int getSignal() const;
+	time_t getSignalTime() const;
+	void setCoalesceKey(const std::string &key);
+	const std::string &getCoalesceKey() const;
+	void setCacheKey(const std::string &key);
+	const std::string &getCacheKey() const;
+	/// Keeps a copy of the output while it is forwarded, up to `limit` bytes.
+	void captureOutput(size_t limit);
+	bool capturing() const;
+	/// \returns False if nothing was captured or the output outgrew the limit.
+	bool takeCapture(std::string &output);
 };
 
 namespace CGIUtils {
+/// Fills the per-request meta-variables passed to a script, as environment (CGI) or
+/// params (FastCGI). The location's invariant ones come from LocConfig::getCGIEnv().
+void buildEnv(std::map<std::string, std::string> &env, ClientRequest &request,
+              LocConfig *locConfig);
+/// Adds the location's invariant variables to a map (FastCGI params).
+void addLocationEnv(std::map<std::string, std::string> &env, LocConfig *locConfig);
+/// Locates the blank line ending a script's header block (CRLF or bare LF).
+/// \param sep_len Set to the length of the separator.
+/// \returns Offset of the separator, or npos if the header block is incomplete.
+size_t findHeaderEnd(const std::string &output, size_t &sep_len);
+/// Applies a CGI header block (Status, Content-Type, Location, Content-Length and
+/// pass-through headers) to a response. Without a Status, Location implies 302.
+/// \returns False on an invalid Status or Content-Length.
+bool parseCGIHeaders(const std::string &headers, Response &resp);
+/// Turns a whole buffered output (CGI headers, blank line, body) into a response.
+/// \returns False if the output has no complete header block or invalid headers.
+bool parseCGIOutput(const std::string &output, Response &resp);
 uint16_t runCGIScript(ClientRequest &req, CGI &cgi);
-uint16_t createCGI(CGI *&cgi, ClientRequest &req, LocConfig *locConfig);
+/// \param stream_input The body is not in `req`, it is appended once the script runs.
+uint16_t createCGI(CGI *&cgi, ClientRequest &req, LocConfig *locConfig, bool stream_input);
 } // namespace CGIUtils
 
 #endif
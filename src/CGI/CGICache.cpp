@@ -0,0 +1,224 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGICache.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/08 10:14:52 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/08 10:14:52 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "CGICache.hpp"
+#include "src/Utils/StringUtils.hpp"
+
+CGICache::CGICache(size_t memory_size, const std::string &spill_dir, size_t disk_size)
+    : memory_size_(memory_size),
+      memory_used_(0),
+      spill_dir_(spill_dir),
+      disk_size_(disk_size),
+      disk_used_(0),
+      spill_seq_(0) {}
+
+CGICache::~CGICache() {
+	for (EntryIt it = entries_.begin(); it != entries_.end(); ++it) {
+		if (!it->second.file.empty())
+			unlink(it->second.file.c_str());
+	}
+}
+
+CGICache::Lookup CGICache::lookup(const std::string &key, time_t now, std::string &output,
+                                  bool &revalidate) {
+	revalidate = false;
+	EntryIt it = entries_.find(key);
+	if (it == entries_.end())
+		return (MISS);
+	Entry &entry = it->second;
+	if (now >= entry.stale_until) {
+		drop(it);
+		return (MISS);
+	}
+
+	if (entry.file.empty()) {
+		output = entry.output;
+		memory_lru_.splice(memory_lru_.begin(), memory_lru_, entry.lru);
+	} else {
+		if (!readSpilled(entry, output)) {
+			drop(it);
+			return (MISS);
+		}
+		disk_lru_.splice(disk_lru_.begin(), disk_lru_, entry.lru);
+	}
+
+	if (now < entry.expires)
+		return (HIT);
+	// Stale: the first client past the lifetime triggers the refresh, the others just get it
+	revalidate = !entry.revalidating;
+	entry.revalidating = true;
+	return (STALE);
+}
+
+void CGICache::store(const std::string &key, const std::string &output, time_t expires,
+                     time_t stale_until) {
+	remove(key);
+	if (output.size() > maxEntrySize())
+		return;
+	evictMemory(output.size());
+
+	memory_lru_.push_front(key);
+	Entry &entry = entries_[key];
+	entry.output = output;
+	entry.size = output.size();
+	entry.expires = expires;
+	entry.stale_until = stale_until;
+	entry.revalidating = false;
+	entry.lru = memory_lru_.begin();
+	memory_used_ += entry.size;
+}
+
+void CGICache::remove(const std::string &key) {
+	EntryIt it = entries_.find(key);
+	if (it != entries_.end())
+		drop(it);
+}
+
+void CGICache::revalidationFailed(const std::string &key) {
+	EntryIt it = entries_.find(key);
+	if (it != entries_.end())
+		it->second.revalidating = false;
+}
+
+size_t CGICache::maxEntrySize() const { return (memory_size_ / 8); }
+
+bool CGICache::freshness(const Response &resp, time_t now, time_t default_ttl, time_t &expires,
+                         time_t &stale_until) {
+	if (resp.status_code != 200)
+		return (false);
+
+	// Script headers keep their own case
+	std::string cache_control, expires_header;
+	for (std::map<std::string, std::string>::const_iterator it = resp.headers.begin();
+	     it != resp.headers.end(); ++it) {
+		std::string name = su::to_lower(it->first);
+		if (name == "set-cookie")
+			return (false);
+		if (name == "cache-control")
+			cache_control = su::to_lower(it->second);
+		else if (name == "expires")
+			expires_header = it->second;
+	}
+
+	long ttl = -1;
+	long stale = 0;
+	bool shared_max_age = false;
+	std::vector<std::string> directives = su::split(cache_control, ',');
+	for (size_t i = 0; i < directives.size(); ++i) {
+		std::string directive = su::trim(directives[i]);
+		std::string name = directive.substr(0, directive.find('='));
+		std::string value = directive.find('=') == std::string::npos
+		                        ? ""
+		                        : su::trim(directive.substr(directive.find('=') + 1));
+		long seconds;
+		if (name == "no-store" || name == "no-cache" || name == "private")
+			return (false);
+		if (!su::from_string(value, seconds) || seconds < 0)
+			continue;
+		if (name == "s-maxage") {
+			ttl = seconds;
+			shared_max_age = true;
+		} else if (name == "max-age" && !shared_max_age) {
+			ttl = seconds;
+		} else if (name == "stale-while-revalidate") {
+			stale = seconds;
+		}
+	}
+
+	if (ttl < 0 && !expires_header.empty()) {
+		struct tm tm;
+		std::memset(&tm, 0, sizeof(tm));
+		const char *end = strptime(expires_header.c_str(), "%a, %d %b %Y %H:%M:%S", &tm);
+		// An unparsable date means already expired
+		ttl = end ? static_cast<long>(timegm(&tm) - now) : 0;
+	}
+	if (ttl < 0)
+		ttl = default_ttl;
+	if (ttl <= 0)
+		return (false);
+	expires = now + ttl;
+	stale_until = expires + stale;
+	return (true);
+}
+
+/* EVICTION */
+
+// Makes room in memory: the least recently used entries move to disk, or go
+void CGICache::evictMemory(size_t needed) {
+	while (!memory_lru_.empty() && memory_used_ + needed > memory_size_) {
+		EntryIt it = entries_.find(memory_lru_.back());
+		if (!spill(it))
+			drop(it);
+	}
+}
+
+void CGICache::evictDisk(size_t needed) {
+	while (!disk_lru_.empty() && disk_used_ + needed > disk_size_)
+		drop(entries_.find(disk_lru_.back()));
+}
+
+bool CGICache::spill(EntryIt it) {
+	Entry &entry = it->second;
+	if (spill_dir_.empty() || entry.size > disk_size_)
+		return (false);
+	evictDisk(entry.size);
+
+	std::string path = spill_dir_ + "/webserv-cache-" + su::to_string(getpid()) + "-" +
+	                   su::to_string(++spill_seq_);
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd == -1)
+		return (false);
+	size_t offset = 0;
+	while (offset < entry.size) {
+		ssize_t written = write(fd, entry.output.data() + offset, entry.size - offset);
+		if (written <= 0)
+			break;
+		offset += written;
+	}
+	close(fd);
+	if (offset < entry.size) {
+		unlink(path.c_str());
+		return (false);
+	}
+
+	memory_lru_.erase(entry.lru);
+	memory_used_ -= entry.size;
+	std::string().swap(entry.output);
+	entry.file = path;
+	disk_lru_.push_front(it->first);
+	entry.lru = disk_lru_.begin();
+	disk_used_ += entry.size;
+	return (true);
+}
+
+bool CGICache::readSpilled(const Entry &entry, std::string &output) const {
+	std::ifstream file(entry.file.c_str(), std::ios::in | std::ios::binary);
+	if (!file)
+		return (false);
+	output.resize(entry.size);
+	if (entry.size && !file.read(&output[0], entry.size))
+		return (false);
+	return (true);
+}
+
+void CGICache::drop(EntryIt it) {
+	Entry &entry = it->second;
+	if (entry.file.empty()) {
+		memory_lru_.erase(entry.lru);
+		memory_used_ -= entry.size;
+	} else {
+		disk_lru_.erase(entry.lru);
+		disk_used_ -= entry.size;
+		unlink(entry.file.c_str());
+	}
+	entries_.erase(it);
+}
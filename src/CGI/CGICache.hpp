@@ -0,0 +1,91 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGICache.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/08 10:14:52 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/08 10:14:52 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGICACHE_HPP
+#define CGICACHE_HPP
+
+#include "includes/Webserv.hpp"
+#include "src/HttpServer/Structs/Response.hpp"
+
+/// Responses of a cgi_cache location, stored as the raw script output.
+///
+/// Entries live in memory up to the location's budget. The least recently
+/// used ones are spilled to files in the spill directory when there is one
+/// (with a budget of their own), dropped otherwise. An entry is fresh until
+/// `expires`, then served stale until `stale_until` while a single
+/// revalidation runs in the background.
+class CGICache {
+  public:
+	enum Lookup {
+		MISS,  ///< Not cached, or too old to be served
+		HIT,   ///< Fresh
+		STALE  ///< Past its lifetime, within stale-while-revalidate
+	};
+
+	CGICache(size_t memory_size, const std::string &spill_dir, size_t disk_size);
+	~CGICache();
+
+	/// \param output Receives the cached script output on HIT and STALE.
+	/// \param revalidate Set on the first STALE lookup: the caller refreshes the entry.
+	Lookup lookup(const std::string &key, time_t now, std::string &output, bool &revalidate);
+
+	/// Adds or replaces an entry, evicting the least recently used ones to make room.
+	void store(const std::string &key, const std::string &output, time_t expires,
+	           time_t stale_until);
+	void remove(const std::string &key);
+
+	/// The refresh of a stale entry failed, the next lookup may try again.
+	void revalidationFailed(const std::string &key);
+
+	/// Outputs larger than this are not cached (an eighth of the memory budget).
+	size_t maxEntrySize() const;
+
+	/// Works out how long a script's response may be cached: s-maxage or max-age
+	/// of Cache-Control, then Expires, then `default_ttl` (cgi_cache_valid). Only
+	/// 200 responses without Set-Cookie, no-store, no-cache or private are cached.
+	/// \returns False if the response must not be cached.
+	static bool freshness(const Response &resp, time_t now, time_t default_ttl, time_t &expires,
+	                      time_t &stale_until);
+
+  private:
+	struct Entry {
+		std::string output; // empty while spilled
+		std::string file;   // spill file, empty while in memory
+		size_t size;
+		time_t expires;
+		time_t stale_until;
+		bool revalidating;
+		std::list<std::string>::iterator lru; // position in memory_lru_ or disk_lru_
+	};
+	typedef std::map<std::string, Entry>::iterator EntryIt;
+
+	std::map<std::string, Entry> entries_;
+	std::list<std::string> memory_lru_; // most recently used first
+	std::list<std::string> disk_lru_;
+	size_t memory_size_;
+	size_t memory_used_;
+	std::string spill_dir_;
+	size_t disk_size_;
+	size_t disk_used_;
+	unsigned long spill_seq_;
+
+	CGICache(const CGICache &);
+	CGICache &operator=(const CGICache &);
+
+	void evictMemory(size_t needed);
+	void evictDisk(size_t needed);
+	bool spill(EntryIt it);
+	bool readSpilled(const Entry &entry, std::string &output) const;
+	void drop(EntryIt it);
+};
+
+#endif
@@ -12,123 +12,179 @@
 
 #include "CGI.hpp"
 
+void CGIUtils::buildEnv(std::map<std::string, std::string> &env, ClientRequest &request,
+                        LocConfig *locConfig) {
+	env["SCRIPT_FILENAME"] = request.script_path;
+	env["SCRIPT_NAME"] = "/" + request.path;
+	env["REQUEST_METHOD"] = request.method;
+	env["QUERY_STRING"] = request.query;
+	if (request.extension == ".php")
+		env["PHPRC"] = request.script_path.substr(0, request.script_path.size() - 11);
+	if (request.method == "POST") {
+		env["CONTENT_TYPE"] = request.headers["content-type"];
+		// Unknown for a chunked body streamed to the script, which then reads up to EOF
+		if (request.headers.find("content-length") != request.headers.end())
+			env["CONTENT_LENGTH"] = request.headers["content-length"];
+	}
+	if (request.method == "POST" || request.method == "DELETE") {
+		env["UPLOAD_DIR"] = locConfig->getUploadPath();
+	}
+}
+
+void CGIUtils::addLocationEnv(std::map<std::string, std::string> &env, LocConfig *locConfig) {
+	const std::vector<std::string> &base = locConfig->getCGIEnv();
+	for (size_t i = 0; i < base.size(); ++i) {
+		size_t eq = base[i].find('=');
+		env[base[i].substr(0, eq)] = base[i].substr(eq + 1);
+	}
+}
+
+size_t CGIUtils::findHeaderEnd(const std::string &output, size_t &sep_len) {
+	// No headers at all: the output starts with the blank line
+	if (output.compare(0, 2, "\r\n") == 0 || output.compare(0, 1, "\n") == 0) {
+		sep_len = (output[0] == '\r') ? 2 : 1;
+		return (0);
+	}
+	sep_len = 4;
+	size_t header_end = output.find("\r\n\r\n");
+	size_t lf_end = output.find("\n\n");
+	if (lf_end != std::string::npos && (header_end == std::string::npos || lf_end < header_end)) {
+		header_end = lf_end;
+		sep_len = 2;
+	}
+	return (header_end);
+}
+
+bool CGIUtils::parseCGIHeaders(const std::string &headers, Response &resp) {
+	uint16_t code = 200;
+	bool has_status = false;
+	bool has_location = false;
+	std::istringstream lines(headers);
+	std::string line;
+	while (std::getline(lines, line)) {
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		size_t colon = line.find(':');
+		if (line.empty() || colon == std::string::npos)
+			continue;
+		std::string name = su::trim(line.substr(0, colon));
+		std::string value = su::trim(line.substr(colon + 1));
+		std::string lname = su::to_lower(name);
+		if (lname == "status") {
+			std::istringstream ss(value);
+			unsigned int status;
+			if (!(ss >> status) || status < 100 || status > 599)
+				return (false);
+			code = status;
+			has_status = true;
+		} else if (lname == "content-type") {
+			resp.setContentType(value);
+		} else if (lname == "location") {
+			resp.setHeader("Location", value);
+			has_location = true;
+		} else if (lname == "content-length") {
+			if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+				return (false);
+			resp.setHeader("Content-Length", value);
+		} else if (lname != "transfer-encoding" && lname != "connection") {
+			resp.setHeader(name, value);
+		}
+	}
+	if (has_location && !has_status)
+		code = 302;
+	resp.setStatus(code);
+	return (true);
+}
+
+bool CGIUtils::parseCGIOutput(const std::string &output, Response &resp) {
+	size_t sep_len;
+	size_t header_end = findHeaderEnd(output, sep_len);
+	if (header_end == std::string::npos || !parseCGIHeaders(output.substr(0, header_end), resp))
+		return (false);
+
+	resp.body = output.substr(header_end + sep_len);
+	resp.setContentLength(resp.body.size());
+	return (true);
+}
+
 uint16_t CGIUtils::runCGIScript(ClientRequest &req, CGI &cgi) {
 	Logger logger;
 
-	// 2. Creates char **envp
+	// 2. Creates char **envp (points into the CGI, nothing to free)
 	char **envp = cgi.toEnvp();
-	if (!envp) {
-		logger.logWithPrefix(Logger::ERROR, "CGI", "Failed to create environment");
-		return (502);
-	}
 
-	// 3. Create pipes with error checking
+	// 3. Create pipes with error checking (close-on-exec, the child gets dup2'ed copies)
 	int input_pipe[2], output_pipe[2];
-	if (pipe(input_pipe) == -1) {
+	if (pipe2(input_pipe, O_CLOEXEC) == -1) {
 		logger.logWithPrefix(Logger::ERROR, "CGI", "Failed to create input pipe");
-		cgi.freeEnvp(envp);
 		return (502);
 	}
 
-	if (pipe(output_pipe) == -1) {
+	if (pipe2(output_pipe, O_CLOEXEC) == -1) {
 		logger.logWithPrefix(Logger::ERROR, "CGI", "Failed to create output pipe");
 		close(input_pipe[0]);
 		close(input_pipe[1]);
-		cgi.freeEnvp(envp);
 		return (502);
 	}
-	cgi.setOutputFd(output_pipe[0]);
 
-	// 4. Fork and execute
-	pid_t pid = fork();
-	cgi.setPid(pid);
-	if (pid == -1) {
-		logger.logWithPrefix(Logger::ERROR, "CGI", "Failed to fork process");
-		close(input_pipe[0]);
+	// 4. Spawn the interpreter. posix_spawn() shares the parent's memory until
+	// execve() instead of copying its page tables like fork(), so the cost does
+	// not grow with the server's footprint.
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, input_pipe[0], STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, output_pipe[1], STDOUT_FILENO);
+
+	// The server blocks SIGCHLD and ignores SIGPIPE, the script should not inherit that
+	posix_spawnattr_t attr;
+	sigset_t empty_mask, default_signals;
+	sigemptyset(&empty_mask);
+	sigemptyset(&default_signals);
+	sigaddset(&default_signals, SIGPIPE);
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &empty_mask);
+	posix_spawnattr_setsigdefault(&attr, &default_signals);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	pid_t pid = -1;
+	char *argv[] = {(char *)cgi.getInterpreter(), (char *)cgi.getScriptPath(), NULL};
+	int err = posix_spawn(&pid, cgi.getInterpreter(), &actions, &attr, argv, envp);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+
+	// 5. Parent process - close the child's pipe ends
+	close(input_pipe[0]);
+	close(output_pipe[1]);
+	if (err != 0) {
+		logger.logWithPrefix(Logger::ERROR, "CGI",
+		                     "Failed to spawn " + std::string(cgi.getInterpreter()) + ": " +
+		                         strerror(err));
 		close(input_pipe[1]);
 		close(output_pipe[0]);
-		close(output_pipe[1]);
-		cgi.freeEnvp(envp);
 		return (502);
 	}
+	cgi.setPid(pid);
 
-	if (pid == 0) {
-		// Child process
-		if (dup2(input_pipe[0], STDIN_FILENO) == -1 || dup2(output_pipe[1], STDOUT_FILENO) == -1)
-			exit(1);
-
-		// Close unused pipe ends
-		close(input_pipe[1]);
-		close(output_pipe[0]);
-		close(input_pipe[0]);
-		close(output_pipe[1]);
-
-		// Set alarm for timeout
-		alarm(10);
-
-		// Execute the CGI script
-		char *argv[] = {(char *)cgi.getInterpreter(), (char *)cgi.getScriptPath(), NULL};
-		execve(cgi.getInterpreter(), argv, envp);
-		logger.logWithPrefix(Logger::ERROR, "CGI", "Script not executable");
-		cgi.freeEnvp(envp);
-		exit(1);
-	}
-
-	// 5. Parent process - close unused pipe ends first
-	close(input_pipe[0]);
-	close(output_pipe[1]);
-
-	// Free environment in parent (child has its own copy after fork)
-	cgi.freeEnvp(envp);
-
-	// 6. Send POST data if any
-	if (req.method == "POST") {
-		logger.logWithPrefix(Logger::INFO, "CGI", "Handling POST request");
-		if (!req.body.empty()) {
-			size_t total_written = 0;
-			while (total_written < req.body.size()) {
-				ssize_t written = write(input_pipe[1], req.body.c_str() + total_written,
-				                        req.body.size() - total_written);
-				if (written <= 0) {
-					logger.logWithPrefix(Logger::WARNING, "CGI",
-					                     "Failed to write request body to CGI script");
-					close(input_pipe[1]);
-					return (502);
-				};
-				total_written += written;
-			}
-		}
-	}
-	close(input_pipe[1]);
-
-	// Check if execve failed
-	int status;
-	pid_t wait_result = waitpid(pid, &status, 0);
-	if (wait_result > 0) {
-		// Child exited immediately - execve likely failed
-		if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) {
-			logger.logWithPrefix(Logger::ERROR, "CGI", "CGI script timeout");
-			close(output_pipe[0]);
-			return (504);
-		} else if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
-			// Child exits sucessfully
-			return (0);
-		} else {
-			// Child exits with non-zero exit code OR killed by some other signal
-			logger.logWithPrefix(Logger::ERROR, "CGI", "CGI script failed to execute");
-			close(output_pipe[0]);
-			return (502);
-		}
-	} else if (wait_result == -1) {
-		// waitpid error
-		logger.logWithPrefix(Logger::ERROR, "CGI", "Error checking child process status");
-		close(output_pipe[0]);
-		return (502);
+	// 6. Only the parent ends are non-blocking, the event loop drives both pipes
+	fcntl(input_pipe[1], F_SETFL, fcntl(input_pipe[1], F_GETFL) | O_NONBLOCK);
+	fcntl(output_pipe[0], F_SETFL, fcntl(output_pipe[0], F_GETFL) | O_NONBLOCK);
+	cgi.setOutputFd(output_pipe[0]);
+	cgi.setInputFd(input_pipe[1]);
+
+	// POST data is written from EPOLLOUT, no body means immediate EOF on stdin
+	if (cgi.expectsInput()) {
+		LOG_DEBUG_PREFIX(logger, "CGI", "Streaming the request body");
+	} else if (req.method == "POST" && !req.body.empty()) {
+		LOG_DEBUG_PREFIX(logger, "CGI", "Handling POST request");
+		cgi.setInput(req.body);
+	} else {
+		cgi.closeInput();
 	}
 	return (0);
 }
 
-uint16_t CGIUtils::createCGI(CGI *&cgi, ClientRequest &req, LocConfig *locConfig) {
+uint16_t CGIUtils::createCGI(CGI *&cgi, ClientRequest &req, LocConfig *locConfig,
+                             bool stream_input) {
 	Logger logger;
 	// 1. Validate and construct script path
 	if (req.path.empty() || req.path.find("..") != std::string::npos) {
@@ -138,8 +194,13 @@ uint16_t CGIUtils::createCGI(CGI *&cgi, ClientRequest &req, LocConfig *locConfig
 
 	// Heap allocated
 	cgi = new CGI(req, locConfig);
+	if (stream_input)
+		cgi->expectInput();
 	uint16_t exit_code = runCGIScript(req, *cgi);
-	if (exit_code)
+	if (exit_code) {
+		delete cgi;
+		cgi = NULL;
 		return (exit_code);
+	}
 	return (0);
 }
@@ -0,0 +1,290 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FastCGI.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/03 09:12:37 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/03 09:12:37 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "FastCGI.hpp"
+#include "src/Utils/StringUtils.hpp"
+
+// FastCGI 1.0 record types and constants
+#define FCGI_VERSION_1 1
+#define FCGI_HEADER_LEN 8
+#define FCGI_BEGIN_REQUEST 1
+#define FCGI_END_REQUEST 3
+#define FCGI_PARAMS 4
+#define FCGI_STDIN 5
+#define FCGI_STDOUT 6
+#define FCGI_STDERR 7
+#define FCGI_RESPONDER 1
+#define FCGI_KEEP_CONN 1
+#define FCGI_REQUEST_COMPLETE 0
+#define FCGI_REQUEST_ID 1     // one request per connection at a time
+#define FCGI_MAX_CONTENT 65535
+
+FastCGI::FastCGI(const std::string &address, int fd, State state)
+    : client(NULL),
+      start_time(time(NULL)),
+      reused(false),
+      address_(address),
+      fd_(fd),
+      state_(state),
+      records_offset_(0),
+      ended_(false),
+      protocol_error_(false),
+      received_any_(false),
+      app_status_(0),
+      protocol_status_(FCGI_REQUEST_COMPLETE) {}
+
+FastCGI::~FastCGI() {
+	if (fd_ != -1)
+		close(fd_);
+}
+
+void FastCGI::beginRequest(const std::string &records) {
+	records_ = records;
+	records_offset_ = 0;
+	start_time = time(NULL);
+}
+
+ssize_t FastCGI::flush() {
+	if (!hasPendingOutput())
+		return (0);
+	ssize_t written = send(fd_, records_.data() + records_offset_, records_.size() - records_offset_,
+	                       MSG_NOSIGNAL);
+	if (written > 0)
+		records_offset_ += written;
+	return (written);
+}
+
+ssize_t FastCGI::receive() {
+	char buffer[16384];
+	ssize_t total = 0;
+	ssize_t bytes_read = -1;
+
+	// Bounded per call, like CGI::readOutput()
+	while (total < 4 * static_cast<ssize_t>(sizeof(buffer)) &&
+	       (bytes_read = recv(fd_, buffer, sizeof(buffer), 0)) > 0) {
+		in_.append(buffer, bytes_read);
+		total += bytes_read;
+		received_any_ = true;
+	}
+	int saved_errno = errno;
+	decodeRecords();
+	errno = saved_errno;
+	return (total > 0 ? total : bytes_read);
+}
+
+// Splits complete records off the input buffer
+void FastCGI::decodeRecords() {
+	while (!ended_ && !protocol_error_ && in_.size() >= FCGI_HEADER_LEN) {
+		const unsigned char *h = reinterpret_cast<const unsigned char *>(in_.data());
+		size_t content_len = (h[4] << 8) | h[5];
+		size_t record_len = FCGI_HEADER_LEN + content_len + h[6];
+		if (h[0] != FCGI_VERSION_1) {
+			protocol_error_ = true;
+			return;
+		}
+		if (in_.size() < record_len)
+			return;
+
+		const char *content = in_.data() + FCGI_HEADER_LEN;
+		switch (h[1]) {
+		case FCGI_STDOUT:
+			stdout_.append(content, content_len);
+			break;
+		case FCGI_STDERR:
+			stderr_.append(content, content_len);
+			break;
+		case FCGI_END_REQUEST:
+			if (content_len < 8) {
+				protocol_error_ = true;
+				return;
+			}
+			app_status_ = (static_cast<uint32_t>(static_cast<unsigned char>(content[0])) << 24) |
+			              (static_cast<unsigned char>(content[1]) << 16) |
+			              (static_cast<unsigned char>(content[2]) << 8) |
+			              static_cast<unsigned char>(content[3]);
+			protocol_status_ = static_cast<unsigned char>(content[4]);
+			ended_ = true;
+			break;
+		default: // management records are not expected on a responder connection
+			break;
+		}
+		in_.erase(0, record_len);
+	}
+}
+
+void FastCGI::reset() {
+	records_.clear();
+	records_offset_ = 0;
+	in_.clear();
+	stdout_.clear();
+	stderr_.clear();
+	ended_ = false;
+	received_any_ = false;
+	app_status_ = 0;
+	protocol_status_ = FCGI_REQUEST_COMPLETE;
+	client = NULL;
+	reused = true;
+	state_ = IDLE;
+}
+
+bool FastCGI::hasPendingOutput() const { return (records_offset_ < records_.size()); }
+
+bool FastCGI::requestEnded() const { return (ended_); }
+
+bool FastCGI::requestSucceeded() const {
+	return (ended_ && protocol_status_ == FCGI_REQUEST_COMPLETE);
+}
+
+bool FastCGI::protocolError() const { return (protocol_error_); }
+
+bool FastCGI::receivedAny() const { return (received_any_); }
+
+int FastCGI::getFd() const { return (fd_); }
+
+const std::string &FastCGI::getAddress() const { return (address_); }
+
+FastCGI::State FastCGI::getState() const { return (state_); }
+
+void FastCGI::setState(State state) { state_ = state; }
+
+const std::string &FastCGI::getRecords() const { return (records_); }
+
+const std::string &FastCGI::getStdout() const { return (stdout_); }
+
+std::string FastCGI::takeStderr() {
+	std::string err;
+	err.swap(stderr_);
+	return (err);
+}
+
+/* ENCODING */
+
+std::string FastCGIUtils::encodeRequest(const std::map<std::string, std::string> &params,
+                                        const std::string &body) {
+	std::string records;
+	const char begin[8] = {0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0};
+	appendRecord(records, FCGI_BEGIN_REQUEST, begin, sizeof(begin));
+
+	std::string pairs;
+	for (std::map<std::string, std::string>::const_iterator it = params.begin();
+	     it != params.end(); ++it)
+		appendNameValue(pairs, it->first, it->second);
+	if (!pairs.empty())
+		appendRecord(records, FCGI_PARAMS, pairs.data(), pairs.size());
+	appendRecord(records, FCGI_PARAMS, NULL, 0);
+
+	if (!body.empty())
+		appendRecord(records, FCGI_STDIN, body.data(), body.size());
+	appendRecord(records, FCGI_STDIN, NULL, 0);
+	return (records);
+}
+
+void FastCGIUtils::appendRecord(std::string &out, uint8_t type, const char *data, size_t len) {
+	do {
+		size_t content_len = std::min(len, static_cast<size_t>(FCGI_MAX_CONTENT));
+		size_t padding = (8 - content_len % 8) % 8;
+		char header[FCGI_HEADER_LEN] = {FCGI_VERSION_1,
+		                                static_cast<char>(type),
+		                                0,
+		                                FCGI_REQUEST_ID,
+		                                static_cast<char>((content_len >> 8) & 0xff),
+		                                static_cast<char>(content_len & 0xff),
+		                                static_cast<char>(padding),
+		                                0};
+		out.append(header, FCGI_HEADER_LEN);
+		if (content_len)
+			out.append(data, content_len);
+		out.append(padding, '\0');
+		data += content_len;
+		len -= content_len;
+	} while (len > 0);
+}
+
+static void appendLength(std::string &out, size_t len) {
+	if (len < 128) {
+		out += static_cast<char>(len);
+		return;
+	}
+	out += static_cast<char>(((len >> 24) & 0x7f) | 0x80);
+	out += static_cast<char>((len >> 16) & 0xff);
+	out += static_cast<char>((len >> 8) & 0xff);
+	out += static_cast<char>(len & 0xff);
+}
+
+void FastCGIUtils::appendNameValue(std::string &out, const std::string &name,
+                                   const std::string &value) {
+	appendLength(out, name.size());
+	appendLength(out, value.size());
+	out += name;
+	out += value;
+}
+
+/* CONNECTING */
+
+static int connectUnix(const std::string &path, bool &connecting) {
+	struct sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+		return (-1);
+	std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		return (-1);
+	if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0)
+		return (fd);
+	if (errno == EINPROGRESS || errno == EAGAIN) {
+		connecting = true;
+		return (fd);
+	}
+	close(fd);
+	return (-1);
+}
+
+static int connectInet(const std::string &host, const std::string &port, bool &connecting) {
+	struct addrinfo hints;
+	struct addrinfo *result = NULL;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0)
+		return (-1);
+
+	int fd = -1;
+	for (struct addrinfo *ai = result; ai != NULL; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		            ai->ai_protocol);
+		if (fd == -1)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		if (errno == EINPROGRESS) {
+			connecting = true;
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(result);
+	return (fd);
+}
+
+int FastCGIUtils::connectTo(const std::string &address, bool &connecting) {
+	connecting = false;
+	if (su::starts_with(address, "unix:"))
+		return (connectUnix(address.substr(5), connecting));
+	size_t colon = address.rfind(':');
+	if (colon == std::string::npos)
+		return (-1);
+	return (connectInet(address.substr(0, colon), address.substr(colon + 1), connecting));
+}
@@ -0,0 +1,102 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   FastCGI.hpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/03 09:12:37 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/03 09:12:37 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef FASTCGI_HPP
+#define FASTCGI_HPP
+
+#include "includes/Webserv.hpp"
+
+class Connection;
+
+/// One connection to a FastCGI application server (fastcgi_pass).
+///
+/// The connection carries one request at a time and is opened with
+/// FCGI_KEEP_CONN, so it can go back to the server's pool once the
+/// application answered with FCGI_END_REQUEST. Records are written and
+/// decoded as the socket becomes ready; nothing here blocks.
+class FastCGI {
+  public:
+	enum State {
+		CONNECTING, ///< Non-blocking connect() in progress
+		ACTIVE,     ///< A request is being sent or answered
+		IDLE        ///< Waiting in the pool for the next request
+	};
+
+	FastCGI(const std::string &address, int fd, State state);
+	~FastCGI();
+
+	/// Queues an encoded request (see FastCGIUtils::encodeRequest) for sending.
+	void beginRequest(const std::string &records);
+
+	/// Writes pending records. \returns Bytes written, or -1 with errno set.
+	ssize_t flush();
+
+	/// Reads and decodes available records.
+	/// \returns Bytes read, 0 if the application closed the connection, -1 with errno set.
+	ssize_t receive();
+
+	/// Makes the connection reusable once the request ended.
+	void reset();
+
+	bool hasPendingOutput() const;
+	bool requestEnded() const;
+	bool requestSucceeded() const;
+	bool protocolError() const;
+	bool receivedAny() const;
+
+	int getFd() const;
+	const std::string &getAddress() const;
+	State getState() const;
+	void setState(State state);
+	const std::string &getRecords() const;
+	const std::string &getStdout() const;
+	std::string takeStderr();
+
+	Connection *client;  ///< Connection waiting for the answer, NULL once detached
+	time_t start_time;   ///< When the current request was dispatched
+	bool reused;         ///< Taken from the pool rather than freshly connected
+
+  private:
+	std::string address_;
+	int fd_;
+	State state_;
+
+	std::string records_; // encoded request, kept for a retry
+	size_t records_offset_;
+	std::string in_;      // undecoded input
+	std::string stdout_;
+	std::string stderr_;
+	bool ended_;
+	bool protocol_error_;
+	bool received_any_;
+	uint32_t app_status_;
+	uint8_t protocol_status_;
+
+	FastCGI(const FastCGI &);
+	FastCGI &operator=(const FastCGI &);
+
+	void decodeRecords();
+};
+
+namespace FastCGIUtils {
+/// Encodes a whole responder request: BEGIN_REQUEST, PARAMS and STDIN streams.
+std::string encodeRequest(const std::map<std::string, std::string> &params,
+                          const std::string &body);
+/// Opens a non-blocking stream socket to `unix:/path` or `host:port`.
+/// \param connecting Set when the connect is still in progress (EINPROGRESS).
+/// \returns The socket, or -1 on failure.
+int connectTo(const std::string &address, bool &connecting);
+void appendRecord(std::string &out, uint8_t type, const char *data, size_t len);
+void appendNameValue(std::string &out, const std::string &name, const std::string &value);
+} // namespace FastCGIUtils
+
+#endif
@@ -14,6 +14,7 @@
 #define CONFIG__PARSER_HPP
 
 #include "includes/Webserv.hpp"
+#include "src/ConfigParser/Structs/Struct.hpp"
 #include "src/Logger/Logger.hpp"
 #include "src/Utils/StringUtils.hpp"
 
@@ -77,6 +78,7 @@ class ConfigParser {
   private:
 	Logger logg_;
 	std::vector<Validity> validDirectives_;
+	std::map<std::string, UpstreamConfig> upstreams_; // upstream blocks by name
 
 	// Core parsing methods - tree
 	bool parseTree(const std::string &filePath, ConfigNode &root);
@@ -97,8 +99,22 @@ class ConfigParser {
 	bool validateMethod(const ConfigNode &node);
 	bool validateMaxBody(const ConfigNode &node);
 	bool validateAutoIndex(const ConfigNode &node);
+	bool validateAutoIndexFormat(const ConfigNode &node);
+	bool validateAccessLog(const ConfigNode &node);
+	bool validateSlowLog(const ConfigNode &node);
+	bool validateCaptureTrace(const ConfigNode &node);
 	bool validateLocation(const ConfigNode &node);
 	bool validateCGI(const ConfigNode &node);
+	bool validateFastCGIPass(const ConfigNode &node);
+	bool validateHandler(const ConfigNode &node);
+	bool validateMetrics(const ConfigNode &node);
+	bool validateUpstream(const ConfigNode &node);
+	bool validateUpstreamServer(const ConfigNode &node);
+	bool validateProxyPass(const ConfigNode &node);
+	bool validateCount(const ConfigNode &node);
+	bool validateSwitch(const ConfigNode &node);
+	bool validateCGIRequestKey(const ConfigNode &node);
+	bool validateCGICache(const ConfigNode &node);
 	bool validateChunk(const ConfigNode &node);
 	bool validateUploadPath(const ConfigNode &node);
 	bool validateRoot(const ConfigNode &node);
@@ -119,12 +135,17 @@ class ConfigParser {
 	// handles the directives for the struct
 	void handleListen(const ConfigNode &node, ServerConfig &server);
 	void handleErrorPage(const ConfigNode &node, ServerConfig &server);
+	void handleAccessLog(const ConfigNode &node, ServerConfig &server);
+	void handleSlowLog(const ConfigNode &node, ServerConfig &server);
 	void handleRoot(const ConfigNode &node, LocConfig &location, const std::string &prefix);
 	void handleIndex(const ConfigNode &node, LocConfig &location);
 	void handleBodySize(const ConfigNode &node, LocConfig &location);
 	void handleLocationBlock(const ConfigNode &locNode, LocConfig &location, const std::string &prefix);
 	void handleReturn(const ConfigNode &node, LocConfig &location);
 	void handleCGI(const ConfigNode &node, LocConfig &location);
+	void handleCGICache(const ConfigNode &node, LocConfig &location);
+	bool handleUpstream(const ConfigNode &node);
+	void handleProxyPass(const ConfigNode &node, LocConfig &location);
 	void handleForInherit(const ConfigNode &node, LocConfig &location, const std::string &prefix);
 	
 	//  struct validation and refinments
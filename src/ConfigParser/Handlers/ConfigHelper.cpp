@@ -184,6 +184,8 @@ void ConfigParser::printLocationConfig(const LocConfig &loc, std::ostream &os) c
 	}
 
 	os << "    Autoindex: " << (loc.autoindex ? "on" : "off") << "\n";
+	if (loc.autoindex)
+		os << "    Autoindex format: " << loc.autoindex_format << "\n";
 	os << "    Exact match only: " << (loc.exact_match ? "on" : "off") << "\n";
 
 	if (!loc.allowed_methods.empty()) {
@@ -207,9 +209,54 @@ void ConfigParser::printLocationConfig(const LocConfig &loc, std::ostream &os) c
 			os << "      " << it->first << " -> " << it->second << "\n";
 		}
 	}
+
+	if (!loc.fastcgi_pass.empty())
+		os << "    FastCGI pass: " << loc.fastcgi_pass << "\n";
+
+	if (!loc.handler.empty())
+		os << "    Handler module: " << loc.handler << "\n";
+	if (!loc.metrics.empty())
+		os << "    Metrics: " << loc.metrics << (loc.metrics_local ? " (localhost)" : "") << "\n";
+
+	if (!loc.proxy_pass.empty()) {
+		const UpstreamConfig &up = loc.proxy_upstream;
+		os << "    Proxy pass: " << loc.proxy_pass << " (" << up.balance << ",";
+		for (size_t i = 0; i < up.servers.size(); ++i)
+			os << " " << up.servers[i].address << " w" << up.servers[i].weight;
+		os << ", " << up.keepalive << " kept alive)\n";
+	}
+
+	if (!loc.cgi_extensions.empty()) {
+		os << "    CGI limits: ";
+		if (loc.cgi_max_concurrency)
+			os << loc.cgi_max_concurrency << " running, " << loc.cgi_queue_size << " queued, ";
+		os << loc.cgi_timeout << "s";
+		if (loc.cgi_idle_timeout)
+			os << ", " << loc.cgi_idle_timeout << "s idle";
+		if (loc.cgi_splice)
+			os << ", splice";
+		if (!loc.cgi_request_buffering)
+			os << ", unbuffered body";
+		if (loc.cgi_coalesce) {
+			os << ", coalesced on";
+			for (size_t i = 0; i < loc.cgi_coalesce_key.size(); ++i)
+				os << " " << loc.cgi_coalesce_key[i];
+		}
+		if (loc.cgi_cache_size) {
+			os << ", cached " << su::humanReadableBytes(loc.cgi_cache_size);
+			if (!loc.cgi_cache_path.empty())
+				os << " + " << su::humanReadableBytes(loc.cgi_cache_disk_size) << " in "
+				   << loc.cgi_cache_path;
+			os << " on";
+			for (size_t i = 0; i < loc.cgi_cache_key.size(); ++i)
+				os << " " << loc.cgi_cache_key[i];
+		}
+		os << "\n";
+	}
 }
 void ConfigParser::printServerConfig(const ServerConfig &server, std::ostream &os) const {
-	os << "Server on " << server.getHost() << ":" << server.port << "\n";
+	os << "Server on " << server.getHost() << ":" << server.port << " (backlog " << server.backlog
+	   << (server.defer_accept ? ", deferred" : "") << ")\n";
 
 	if (!server.error_pages.empty()) {
 		os << "  Error pages:\n";
@@ -219,6 +266,17 @@ void ConfigParser::printServerConfig(const ServerConfig &server, std::ostream &o
 		}
 	}
 
+	if (!server.access_log.empty())
+		os << "  Access log: " << server.access_log << " (" << server.access_log_format << ")\n";
+	if (!server.slow_log.empty())
+		os << "  Slow log: " << server.slow_log << " (over " << server.slow_log_threshold * 1000
+		   << " ms)\n";
+	if (!server.capture_trace.empty())
+		os << "  Capture trace: " << server.capture_trace
+		   << (server.capture_bodies ? " (with bodies)" : "") << "\n";
+	if (server.server_timing)
+		os << "  Server-Timing: on\n";
+
 	if (!server.locations.empty()) {
 		for (size_t i = 0; i < server.locations.size(); ++i) {
 			printLocationConfig(server.locations[i], os);
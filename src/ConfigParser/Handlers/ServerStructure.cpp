@@ -15,6 +15,13 @@
 
 bool ConfigParser::convertTreeToStruct(const ConfigNode &tree, std::vector<ServerConfig> &servers, std::string &prefix) {
 
+	// Upstream blocks first, a proxy_pass can name one defined further down
+	for (std::vector<ConfigNode>::const_iterator node = tree.children_.begin();
+		 node != tree.children_.end(); ++node) {
+		if (node->name_ == "upstream" && !handleUpstream(*node))
+			return false;
+	}
+
 	for (std::vector<ConfigNode>::const_iterator node = tree.children_.begin();
 		 node != tree.children_.end(); ++node) {
 
@@ -36,6 +43,16 @@ bool ConfigParser::convertTreeToStruct(const ConfigNode &tree, std::vector<Serve
 					handleListen(*child, server);
 				else if (child->name_ == "error_page")
 					handleErrorPage(*child, server);
+				else if (child->name_ == "access_log")
+					handleAccessLog(*child, server);
+				else if (child->name_ == "server_timing")
+					server.server_timing = (child->args_[0] == "on");
+				else if (child->name_ == "slow_log")
+					handleSlowLog(*child, server);
+				else if (child->name_ == "capture_trace") {
+					server.capture_trace = addPrefix(child->args_[0], server.getPrefix());
+					server.capture_bodies = child->args_.size() > 1;
+				}
 
 
 				else if (child->name_ == "location") {
@@ -99,7 +116,7 @@ bool ConfigParser::convertTreeToStruct(const ConfigNode &tree, std::vector<Serve
 // SERVER-LEVEL DIRECTIVE HANDLERS
 ////
 
-// HOST AND PORT
+// HOST AND PORT, then the socket's backlog=N and deferred
 void ConfigParser::handleListen(const ConfigNode &node, ServerConfig &server) {
 	std::string value = node.args_[0];
 	if (value[0] == ':')
@@ -110,6 +127,12 @@ void ConfigParser::handleListen(const ConfigNode &node, ServerConfig &server) {
 		server.port = std::atoi(value.substr(colonPos + 1).c_str());
 	} else
 		server.port = std::atoi(value.c_str());
+	for (size_t i = 1; i < node.args_.size(); ++i) {
+		if (node.args_[i] == "deferred")
+			server.defer_accept = true;
+		else
+			server.backlog = std::atoi(node.args_[i].c_str() + 8); // "backlog="
+	}
 }
 
 // ERROR PAGES - map code - html
@@ -121,6 +144,25 @@ void ConfigParser::handleErrorPage(const ConfigNode &node, ServerConfig &server)
 	}
 }
 
+// ACCESS LOG - file and line format, nothing logged if off
+void ConfigParser::handleAccessLog(const ConfigNode &node, ServerConfig &server) {
+	if (node.args_[0] == "off")
+		return;
+	server.access_log = addPrefix(node.args_[0], server.getPrefix());
+	if (node.args_.size() > 1)
+		server.access_log_format = node.args_[1];
+}
+
+// SLOW LOG - file and threshold, "250ms" or "2s", milliseconds without a unit
+void ConfigParser::handleSlowLog(const ConfigNode &node, ServerConfig &server) {
+	const std::string &value = node.args_[1];
+	size_t unit = value.find_first_not_of("0123456789");
+	server.slow_log = addPrefix(node.args_[0], server.getPrefix());
+	server.slow_log_threshold = std::atof(value.c_str());
+	if (unit == std::string::npos || value.compare(unit, std::string::npos, "ms") == 0)
+		server.slow_log_threshold /= 1000;
+}
+
 // Root, Methods, Upload path, autoindex, CGI and max body size can be defined server level -> for inheritance
 void ConfigParser::handleForInherit(const ConfigNode &node, LocConfig &location, const std::string &prefix) {
 	if (node.name_ == "root")
@@ -154,6 +196,8 @@ void ConfigParser::handleLocationBlock(const ConfigNode &locNode, LocConfig &loc
 			handleRoot(*node, location, prefix);
 		else if (node->name_ == "autoindex")
 			location.autoindex = (node->args_[0] == "on");
+		else if (node->name_ == "autoindex_format")
+			location.autoindex_format = node->args_[0];
 		else if (node->name_ == "index")
 			handleIndex(*node, location);
 		else if (node->name_ == "upload_path")
@@ -162,6 +206,38 @@ void ConfigParser::handleLocationBlock(const ConfigNode &locNode, LocConfig &loc
 			handleReturn(*node, location);
 		else if (node->name_ == "cgi_ext")
 			handleCGI(*node, location);
+		else if (node->name_ == "fastcgi_pass")
+			location.fastcgi_pass = node->args_[0];
+		else if (node->name_ == "handler")
+			location.handler = node->args_[0];
+		else if (node->name_ == "metrics") {
+			location.metrics = node->args_[0];
+			location.metrics_local = node->args_.size() > 1;
+		}
+		else if (node->name_ == "proxy_pass")
+			handleProxyPass(*node, location);
+		else if (node->name_ == "cgi_max_concurrency")
+			location.cgi_max_concurrency = std::atoi(node->args_[0].c_str());
+		else if (node->name_ == "cgi_queue_size")
+			location.cgi_queue_size = std::atoi(node->args_[0].c_str());
+		else if (node->name_ == "cgi_timeout")
+			location.cgi_timeout = std::atoi(node->args_[0].c_str());
+		else if (node->name_ == "cgi_idle_timeout")
+			location.cgi_idle_timeout = std::atoi(node->args_[0].c_str());
+		else if (node->name_ == "cgi_splice")
+			location.cgi_splice = (node->args_[0] == "on");
+		else if (node->name_ == "cgi_request_buffering")
+			location.cgi_request_buffering = (node->args_[0] == "on");
+		else if (node->name_ == "cgi_coalesce")
+			location.cgi_coalesce = (node->args_[0] == "on");
+		else if (node->name_ == "cgi_coalesce_key")
+			location.cgi_coalesce_key = node->args_;
+		else if (node->name_ == "cgi_cache")
+			handleCGICache(*node, location);
+		else if (node->name_ == "cgi_cache_valid")
+			location.cgi_cache_valid = std::atoi(node->args_[0].c_str());
+		else if (node->name_ == "cgi_cache_key")
+			location.cgi_cache_key = node->args_;
 		else if (node->name_ == "client_max_body_size")
 			handleBodySize(*node, location);
 	}
@@ -237,6 +313,76 @@ void ConfigParser::handleBodySize(const ConfigNode &node, LocConfig &location) {
 	location.body_size_set = true;
 }
 
+// CGI cache: memory budget, spill directory, disk budget (8 times the memory by default)
+void ConfigParser::handleCGICache(const ConfigNode &node, LocConfig &location) {
+	su::parse_size(node.args_[0], location.cgi_cache_size);
+	location.cgi_cache_disk_size = 8 * location.cgi_cache_size;
+	if (node.args_.size() > 1)
+		location.cgi_cache_path = node.args_[1];
+	if (node.args_.size() > 2)
+		su::parse_size(node.args_[2], location.cgi_cache_disk_size);
+}
+
+// UPSTREAM block: its servers and balancing method, looked up by proxy_pass
+bool ConfigParser::handleUpstream(const ConfigNode &node) {
+	UpstreamConfig upstream;
+	upstream.name = node.args_[0];
+	for (std::vector<ConfigNode>::const_iterator child = node.children_.begin();
+		 child != node.children_.end(); ++child) {
+		if (child->name_ == "server") {
+			UpstreamServer server;
+			server.address = child->args_[0];
+			for (size_t i = 1; i < child->args_.size(); ++i) {
+				const std::string &param = child->args_[i];
+				unsigned int value = std::atoi(param.substr(param.find('=') + 1).c_str());
+				if (su::starts_with(param, "weight="))
+					server.weight = value;
+				else if (su::starts_with(param, "max_fails="))
+					server.max_fails = value;
+				else
+					server.fail_timeout = value;
+			}
+			upstream.servers.push_back(server);
+		} else if (child->name_ == "keepalive")
+			upstream.keepalive = std::atoi(child->args_[0].c_str());
+		else if (upstream.balance != "round_robin") {
+			logg_.logWithPrefix(Logger::ERROR, "Configuration file",
+								"Upstream " + upstream.name + " sets more than one balancing method" +
+									", line " + su::to_string(child->line_));
+			return false;
+		} else
+			upstream.balance = child->name_;
+	}
+	if (upstream.servers.empty() || upstreams_.count(upstream.name)) {
+		logg_.logWithPrefix(Logger::ERROR, "Configuration file",
+							"Upstream " + upstream.name +
+								(upstream.servers.empty() ? " has no server" : " is defined twice") +
+								", line " + su::to_string(node.line_));
+		return false;
+	}
+	upstreams_[upstream.name] = upstream;
+	return true;
+}
+
+// PROXY_PASS: an upstream block, or a single host:port (port 80 by default)
+void ConfigParser::handleProxyPass(const ConfigNode &node, LocConfig &location) {
+	const std::string &url = node.args_[0];
+	size_t slash = url.find('/', 7);
+	std::string authority = url.substr(7, slash - 7);
+	location.proxy_pass = url;
+	location.proxy_uri = slash == std::string::npos ? "" : url.substr(slash);
+
+	std::map<std::string, UpstreamConfig>::const_iterator it = upstreams_.find(authority);
+	if (it != upstreams_.end()) {
+		location.proxy_upstream = it->second;
+		return;
+	}
+	UpstreamServer server;
+	server.address = authority.find(':') == std::string::npos ? authority + ":80" : authority;
+	location.proxy_upstream = UpstreamConfig();
+	location.proxy_upstream.name = server.address;
+	location.proxy_upstream.servers.push_back(server);
+}
 
 
 ////////////////////
@@ -279,6 +425,7 @@ void ConfigParser::inheritGeneralConfig(ServerConfig &server, const LocConfig &f
 		// Inherit index only in base / default location
 		if (loc.path == "/" && loc.index.empty())
 			loc.index = forInheritance.index;
+		loc.prepareCGIEnv();
 	}
 }
 
@@ -32,11 +32,30 @@ void ConfigParser::initValidDirectives() {
 	    Validity("http", std::vector<std::string>(1, "main"), true, 0, 0, NULL));
 	validDirectives_.push_back(
 	    Validity("server", std::vector<std::string>(1, "http"), true, 0, 0, NULL));
+	validDirectives_.push_back(Validity("upstream", std::vector<std::string>(1, "http"), true, 1,
+	                                    1, &ConfigParser::validateUpstream));
+	// upstream only level
+	validDirectives_.push_back(Validity("server", std::vector<std::string>(1, "upstream"), true, 1,
+	                                    4, &ConfigParser::validateUpstreamServer));
+	validDirectives_.push_back(
+	    Validity("least_conn", std::vector<std::string>(1, "upstream"), false, 0, 0, NULL));
+	validDirectives_.push_back(
+	    Validity("ip_hash", std::vector<std::string>(1, "upstream"), false, 0, 0, NULL));
+	validDirectives_.push_back(Validity("keepalive", std::vector<std::string>(1, "upstream"), false,
+	                                    1, 1, &ConfigParser::validateCount));
 	// server only level
 	validDirectives_.push_back(Validity("listen", std::vector<std::string>(1, "server"), false, 1,
-	                                    1, &ConfigParser::validateListen));
+	                                    3, &ConfigParser::validateListen));
 	validDirectives_.push_back(Validity("error_page", std::vector<std::string>(1, "server"), true,
 	                                    2, SIZE_MAX, &ConfigParser::validateError));
+	validDirectives_.push_back(Validity("access_log", std::vector<std::string>(1, "server"), false,
+	                                    1, 2, &ConfigParser::validateAccessLog));
+	validDirectives_.push_back(Validity("server_timing", std::vector<std::string>(1, "server"),
+	                                    false, 1, 1, &ConfigParser::validateSwitch));
+	validDirectives_.push_back(Validity("slow_log", std::vector<std::string>(1, "server"), false,
+	                                    2, 2, &ConfigParser::validateSlowLog));
+	validDirectives_.push_back(Validity("capture_trace", std::vector<std::string>(1, "server"),
+	                                    false, 1, 2, &ConfigParser::validateCaptureTrace));
 	validDirectives_.push_back(Validity("client_max_body_size", makeVector("server", "location"),
 	                                    false, 1, 1, &ConfigParser::validateMaxBody));
 	validDirectives_.push_back(Validity("location", std::vector<std::string>(1, "server"), true, 1,
@@ -55,68 +74,117 @@ void ConfigParser::initValidDirectives() {
 	// location only level
 	validDirectives_.push_back(Validity("autoindex", std::vector<std::string>(1, "location"), false,
 	                                    1, 1, &ConfigParser::validateAutoIndex));
+	validDirectives_.push_back(Validity("autoindex_format", std::vector<std::string>(1, "location"),
+	                                    false, 1, 1, &ConfigParser::validateAutoIndexFormat));
 	validDirectives_.push_back(Validity("return", std::vector<std::string>(1, "location"), false, 1,
 	                                    2, &ConfigParser::validateReturn));
+	validDirectives_.push_back(Validity("fastcgi_pass", std::vector<std::string>(1, "location"),
+	                                    false, 1, 1, &ConfigParser::validateFastCGIPass));
+	validDirectives_.push_back(Validity("handler", std::vector<std::string>(1, "location"), false,
+	                                    1, 1, &ConfigParser::validateHandler));
+	validDirectives_.push_back(Validity("metrics", std::vector<std::string>(1, "location"), false,
+	                                    1, 2, &ConfigParser::validateMetrics));
+	validDirectives_.push_back(Validity("proxy_pass", std::vector<std::string>(1, "location"),
+	                                    false, 1, 1, &ConfigParser::validateProxyPass));
+	validDirectives_.push_back(Validity("cgi_max_concurrency", std::vector<std::string>(1, "location"),
+	                                    false, 1, 1, &ConfigParser::validateCount));
+	validDirectives_.push_back(Validity("cgi_queue_size", std::vector<std::string>(1, "location"),
+	                                    false, 1, 1, &ConfigParser::validateCount));
+	validDirectives_.push_back(Validity("cgi_timeout", std::vector<std::string>(1, "location"),
+	                                    false, 1, 1, &ConfigParser::validateCount));
+	validDirectives_.push_back(Validity("cgi_idle_timeout", std::vector<std::string>(1, "location"),
+	                                    false, 1, 1, &ConfigParser::validateCount));
+	validDirectives_.push_back(Validity("cgi_splice", std::vector<std::string>(1, "location"),
+	                                    false, 1, 1, &ConfigParser::validateSwitch));
+	validDirectives_.push_back(Validity("cgi_request_buffering",
+	                                    std::vector<std::string>(1, "location"), false, 1, 1,
+	                                    &ConfigParser::validateSwitch));
+	validDirectives_.push_back(Validity("cgi_coalesce", std::vector<std::string>(1, "location"),
+	                                    false, 1, 1, &ConfigParser::validateSwitch));
+	validDirectives_.push_back(Validity("cgi_coalesce_key",
+	                                    std::vector<std::string>(1, "location"), false, 1, SIZE_MAX,
+	                                    &ConfigParser::validateCGIRequestKey));
+	validDirectives_.push_back(Validity("cgi_cache", std::vector<std::string>(1, "location"),
+	                                    false, 1, 3, &ConfigParser::validateCGICache));
+	validDirectives_.push_back(Validity("cgi_cache_valid", std::vector<std::string>(1, "location"),
+	                                    false, 1, 1, &ConfigParser::validateCount));
+	validDirectives_.push_back(Validity("cgi_cache_key", std::vector<std::string>(1, "location"),
+	                                    false, 1, SIZE_MAX, &ConfigParser::validateCGIRequestKey));
 }
 
 // CHECK NB OF ARGS, CONTEXT, DUPLICATES, TAILORED VALIDITY FUNCTION
+// A name can have one rule per context (server block, server of an upstream)
 bool ConfigParser::validateDirective(const ConfigNode &node, const ConfigNode &parent) {
 
+	const Validity *rule = NULL;
+	bool known = false;
 	for (std::vector<Validity>::const_iterator it = validDirectives_.begin();
-	     it != validDirectives_.end(); ++it) {
-		if (it->name_ == node.name_) {
-			bool contextOK = false;
-			for (size_t i = 0; i < it->contexts_.size(); ++i) {
-				if (parent.name_ == it->contexts_[i]) {
-					contextOK = true;
-					break;
-				}
-			}
-			if (!contextOK) {
-				logg_.logWithPrefix(Logger::WARNING, "Configuration file",
-				                    "Directive '" + node.name_ + "' is not allowed in context '" +
-				                        parent.name_ + "' on line " + su::to_string(node.line_));
-				return false;
-			}
-			if (!it->repeatOK_) {
-				int count = 0;
-				for (size_t i = 0; i < parent.children_.size(); ++i) {
-					if (parent.children_[i].name_ == node.name_) {
-						count++;
-					}
-				}
-				if (count > 0) {
-					logg_.logWithPrefix(Logger::WARNING, "Configuration file",
-					                    "Directive '" + node.name_ +
-					                        "' cannot be repeated in context '" + parent.name_ +
-					                        "' on line " + su::to_string(node.line_));
-					return false;
-				}
-			}
-			if (node.args_.size() < it->min_args_ || node.args_.size() > it->max_args_) {
-				logg_.logWithPrefix(Logger::WARNING, "Configuration file",
-				                    "Directive '" + node.name_ + "' expects between " +
-				                        su::to_string(it->min_args_) + " and " +
-				                        su::to_string(it->max_args_) + " arguments, but got " +
-				                        su::to_string(node.args_.size()) + " on line " +
-				                        su::to_string(node.line_));
-				return false;
-			}
-			if (it->valid_f_ != NULL) {
-				if (!(this->*(it->valid_f_))(node))
-					return false;
+	     it != validDirectives_.end() && !rule; ++it) {
+		if (it->name_ != node.name_)
+			continue;
+		known = true;
+		if (std::find(it->contexts_.begin(), it->contexts_.end(), parent.name_) !=
+		    it->contexts_.end())
+			rule = &*it;
+	}
+	if (!known) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "Unknown directive: '" + node.name_ + "' on line " +
+		                        su::to_string(node.line_));
+		return false;
+	}
+	if (!rule) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "Directive '" + node.name_ + "' is not allowed in context '" +
+		                        parent.name_ + "' on line " + su::to_string(node.line_));
+		return false;
+	}
+	if (!rule->repeatOK_) {
+		int count = 0;
+		for (size_t i = 0; i < parent.children_.size(); ++i) {
+			if (parent.children_[i].name_ == node.name_) {
+				count++;
 			}
-			return true;
+		}
+		if (count > 0) {
+			logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+			                    "Directive '" + node.name_ + "' cannot be repeated in context '" +
+			                        parent.name_ + "' on line " + su::to_string(node.line_));
+			return false;
 		}
 	}
-	logg_.logWithPrefix(Logger::WARNING, "Configuration file",
-	                    "Unknown directive: '" + node.name_ + "' on line " +
-	                        su::to_string(node.line_));
-	return false;
+	if (node.args_.size() < rule->min_args_ || node.args_.size() > rule->max_args_) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "Directive '" + node.name_ + "' expects between " +
+		                        su::to_string(rule->min_args_) + " and " +
+		                        su::to_string(rule->max_args_) + " arguments, but got " +
+		                        su::to_string(node.args_.size()) + " on line " +
+		                        su::to_string(node.line_));
+		return false;
+	}
+	if (rule->valid_f_ != NULL) {
+		if (!(this->*(rule->valid_f_))(node))
+			return false;
+	}
+	return true;
 }
 
-// LISTEN: ipv4:port, or :port, or port ()
+// LISTEN: ipv4:port, or :port, or port (), then [backlog=N] [deferred]
 bool ConfigParser::validateListen(const ConfigNode &node) {
+	for (size_t i = 1; i < node.args_.size(); ++i) {
+		const std::string &param = node.args_[i];
+		if (param == "deferred")
+			continue;
+		if (param.compare(0, 8, "backlog=") == 0 && param.size() > 8 && param.size() <= 17 &&
+		    param.find_first_not_of("0123456789", 8) == std::string::npos &&
+		    std::atol(param.c_str() + 8) > 0)
+			continue;
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "Invalid 'listen' parameter " + param +
+		                        " (backlog=N or deferred) on line " + su::to_string(node.line_));
+		return false;
+	}
+
 	std::string value = node.args_[0];
 	std::string host;
 	std::string portStr;
@@ -331,6 +399,264 @@ bool ConfigParser::validateAutoIndex(const ConfigNode &node) {
 	return true;
 }
 
+bool ConfigParser::validateAutoIndexFormat(const ConfigNode &node) {
+	if (node.args_[0] != "html" && node.args_[0] != "json") {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "autoindex_format must be 'html' or 'json'. Value " + node.args_[0] +
+		                        " on line " + su::to_string(node.line_));
+		return false;
+	}
+	return true;
+}
+
+// ACCESS_LOG: path [combined|json], "off" disables it
+bool ConfigParser::validateAccessLog(const ConfigNode &node) {
+	if (node.args_[0] == "off" && node.args_.size() > 1) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "access_log off takes no format, line " + su::to_string(node.line_));
+		return false;
+	}
+	if (node.args_.size() > 1 && node.args_[1] != "combined" && node.args_[1] != "json") {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "access_log format must be 'combined' or 'json'. Value " +
+		                        node.args_[1] + " on line " + su::to_string(node.line_));
+		return false;
+	}
+	return true;
+}
+
+// METRICS: prometheus|status|connections [localhost]
+bool ConfigParser::validateMetrics(const ConfigNode &node) {
+	if (node.args_[0] != "prometheus" && node.args_[0] != "status" &&
+	    node.args_[0] != "connections") {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "metrics must be 'prometheus', 'status' or 'connections'. Value " +
+		                        node.args_[0] + " on line " + su::to_string(node.line_));
+		return false;
+	}
+	if (node.args_.size() > 1 && node.args_[1] != "localhost") {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "metrics can only be restricted to 'localhost'. Value " +
+		                        node.args_[1] + " on line " + su::to_string(node.line_));
+		return false;
+	}
+	return true;
+}
+
+// SLOW_LOG: path threshold, the threshold in ms or s
+bool ConfigParser::validateSlowLog(const ConfigNode &node) {
+	const std::string &value = node.args_[1];
+	size_t digits = std::min(value.find_first_not_of("0123456789"), value.size());
+	std::string unit = value.substr(digits);
+	if (digits == 0 || digits > 6 || (unit != "" && unit != "ms" && unit != "s")) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "slow_log threshold must be a number of ms or s. Value " + value +
+		                        " on line " + su::to_string(node.line_));
+		return false;
+	}
+	return true;
+}
+
+// CAPTURE_TRACE: path [bodies]
+bool ConfigParser::validateCaptureTrace(const ConfigNode &node) {
+	if (node.args_.size() > 1 && node.args_[1] != "bodies") {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "capture_trace can only add 'bodies'. Value " + node.args_[1] +
+		                        " on line " + su::to_string(node.line_));
+		return false;
+	}
+	return true;
+}
+
+// FASTCGI_PASS: unix:/path/to/socket or host:port
+bool ConfigParser::validateFastCGIPass(const ConfigNode &node) {
+	const std::string &value = node.args_[0];
+
+	if (su::starts_with(value, "unix:")) {
+		std::string path = value.substr(5);
+		if (path.empty() || path[0] != '/' || path.size() >= sizeof(((sockaddr_un *)0)->sun_path)) {
+			logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+			                    "fastcgi_pass: invalid unix socket path '" + path + "' on line " +
+			                        su::to_string(node.line_));
+			return false;
+		}
+		return true;
+	}
+
+	size_t colon = value.rfind(':');
+	if (colon == std::string::npos || colon == 0 || colon + 1 == value.size()) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "fastcgi_pass expects unix:/path or host:port. Value " + value +
+		                        " on line " + su::to_string(node.line_));
+		return false;
+	}
+	std::string portStr = value.substr(colon + 1);
+	for (size_t i = 0; i < portStr.size(); ++i) {
+		if (!std::isdigit(static_cast<unsigned char>(portStr[i]))) {
+			logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+			                    "fastcgi_pass: invalid port '" + portStr + "' on line " +
+			                        su::to_string(node.line_));
+			return false;
+		}
+	}
+	int port = std::atoi(portStr.c_str());
+	if (portStr.size() > 5 || port < 1 || port > 65535) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "fastcgi_pass: port out of range '" + portStr + "' on line " +
+		                        su::to_string(node.line_));
+		return false;
+	}
+	return true;
+}
+
+// HANDLER: path to a shared object, loaded when the server starts
+bool ConfigParser::validateHandler(const ConfigNode &node) {
+	const std::string &value = node.args_[0];
+	if (!su::ends_with(value, ".so") || value.find('"') != std::string::npos ||
+	    value.find('\'') != std::string::npos) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "handler expects the path of a .so module. Value " + value +
+		                        " on line " + su::to_string(node.line_));
+		return false;
+	}
+	return true;
+}
+
+// UPSTREAM: a name proxy_pass can refer to
+bool ConfigParser::validateUpstream(const ConfigNode &node) {
+	const std::string &name = node.args_[0];
+	if (name.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789._-") !=
+	    std::string::npos) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "Invalid upstream name: " + name + " on line " +
+		                        su::to_string(node.line_));
+		return false;
+	}
+	return true;
+}
+
+// SERVER (upstream): host:port, then weight=N, max_fails=N, fail_timeout=N[s]
+bool ConfigParser::validateUpstreamServer(const ConfigNode &node) {
+	const std::string &address = node.args_[0];
+	size_t colon = address.rfind(':');
+	std::string port = colon == std::string::npos ? "" : address.substr(colon + 1);
+	if (colon == 0 || port.empty() || port.size() > 5 ||
+	    port.find_first_not_of("0123456789") != std::string::npos ||
+	    std::atoi(port.c_str()) < 1 || std::atoi(port.c_str()) > 65535) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "Upstream server expects host:port. Value " + address + " on line " +
+		                        su::to_string(node.line_));
+		return false;
+	}
+	for (size_t i = 1; i < node.args_.size(); ++i) {
+		const std::string &param = node.args_[i];
+		size_t eq = param.find('=');
+		std::string name = param.substr(0, eq);
+		std::string value = eq == std::string::npos ? "" : param.substr(eq + 1);
+		if (name == "fail_timeout" && !value.empty() && su::back(value) == 's')
+			value.erase(value.size() - 1);
+		bool number = !value.empty() && value.size() <= 6 &&
+		              value.find_first_not_of("0123456789") == std::string::npos;
+		if (!number || (name != "weight" && name != "max_fails" && name != "fail_timeout") ||
+		    (name == "weight" && std::atoi(value.c_str()) == 0)) {
+			logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+			                    "Invalid upstream server parameter: " + param + " on line " +
+			                        su::to_string(node.line_));
+			return false;
+		}
+	}
+	return true;
+}
+
+// PROXY_PASS: http://upstream or http://host[:port], optionally followed by a URI
+bool ConfigParser::validateProxyPass(const ConfigNode &node) {
+	const std::string &value = node.args_[0];
+	bool valid = su::starts_with(value, "http://") && hasOKChar(value);
+	std::string authority = valid ? value.substr(7, value.find('/', 7) - 7) : "";
+	size_t colon = authority.rfind(':');
+	if (authority.empty() || colon == 0)
+		valid = false;
+	else if (colon != std::string::npos) {
+		std::string port = authority.substr(colon + 1);
+		valid = !port.empty() && port.size() <= 5 &&
+		        port.find_first_not_of("0123456789") == std::string::npos &&
+		        std::atoi(port.c_str()) >= 1 && std::atoi(port.c_str()) <= 65535;
+	}
+	if (!valid) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "proxy_pass expects http://upstream[/uri] or http://host:port[/uri]. "
+		                    "Value " + value + " on line " + su::to_string(node.line_));
+		return false;
+	}
+	return true;
+}
+
+// SERVER_TIMING, CGI_SPLICE, CGI_REQUEST_BUFFERING, CGI_COALESCE: on or off
+bool ConfigParser::validateSwitch(const ConfigNode &node) {
+	if (node.args_[0] != "on" && node.args_[0] != "off") {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    node.name_ + " must be 'on' or 'off'. Value " + node.args_[0] +
+		                        " on line " + su::to_string(node.line_));
+		return false;
+	}
+	return true;
+}
+
+// CGI_COALESCE_KEY, CGI_CACHE_KEY: method, uri or header:Name
+bool ConfigParser::validateCGIRequestKey(const ConfigNode &node) {
+	for (size_t i = 0; i < node.args_.size(); ++i) {
+		const std::string &part = node.args_[i];
+		if (part == "method" || part == "uri" ||
+		    (part.compare(0, 7, "header:") == 0 && part.size() > 7))
+			continue;
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    node.name_ + " expects method, uri or header:Name. Value " + part +
+		                        " on line " + su::to_string(node.line_));
+		return false;
+	}
+	return true;
+}
+
+// CGI_CACHE: memory size, then optionally an absolute spill directory and its size
+bool ConfigParser::validateCGICache(const ConfigNode &node) {
+	size_t size;
+	if (!su::parse_size(node.args_[0], size) || size == 0) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "cgi_cache expects a size. Value " + node.args_[0] + " on line " +
+		                        su::to_string(node.line_));
+		return false;
+	}
+	if (node.args_.size() > 1 && !su::starts_with(node.args_[1], "/")) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "cgi_cache spill directory must be absolute. Value " + node.args_[1] +
+		                        " on line " + su::to_string(node.line_));
+		return false;
+	}
+	if (node.args_.size() > 2 && !su::parse_size(node.args_[2], size)) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    "cgi_cache expects a disk size. Value " + node.args_[2] +
+		                        " on line " + su::to_string(node.line_));
+		return false;
+	}
+	return true;
+}
+
+// CGI_MAX_CONCURRENCY, CGI_QUEUE_SIZE, CGI_TIMEOUT, CGI_IDLE_TIMEOUT, CGI_CACHE_VALID,
+// KEEPALIVE (upstream): a count or seconds, 6 digits at most so that it fits an int
+bool ConfigParser::validateCount(const ConfigNode &node) {
+	const std::string &value = node.args_[0];
+	bool digits = !value.empty() && value.size() <= 6 &&
+	              value.find_first_not_of("0123456789") == std::string::npos;
+	if (!digits || (node.name_ == "cgi_timeout" && std::atoi(value.c_str()) == 0)) {
+		logg_.logWithPrefix(Logger::WARNING, "Configuration file",
+		                    node.name_ + " expects a number" +
+		                        (node.name_ == "cgi_timeout" ? " above 0" : "") + ". Value " +
+		                        value + " on line " + su::to_string(node.line_));
+		return false;
+	}
+	return true;
+}
+
 bool ConfigParser::validateCGI(const ConfigNode &node) {
 
 	// CGI expects pairs: extension interpreter_path extension interpreter_path
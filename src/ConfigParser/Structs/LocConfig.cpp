@@ -94,3 +94,61 @@ std::string LocConfig::getInterpreter(const std::string &ext) const {
         return "";
 }
 
+bool LocConfig::hasFastCGIPass() const {
+    return !fastcgi_pass.empty();
+}
+
+const std::string &LocConfig::getFastCGIPass() const {
+    return fastcgi_pass;
+}
+
+bool LocConfig::hasHandler() const {
+    return !handler.empty();
+}
+
+bool LocConfig::hasMetrics() const {
+    return !metrics.empty();
+}
+
+const std::string &LocConfig::getHandler() const {
+    return handler;
+}
+
+bool LocConfig::hasProxyPass() const {
+    return !proxy_pass.empty();
+}
+
+const UpstreamConfig &LocConfig::getUpstream() const {
+    return proxy_upstream;
+}
+
+size_t LocConfig::getCGIMaxConcurrency() const {
+    return cgi_max_concurrency;
+}
+
+size_t LocConfig::getCGIQueueSize() const {
+    return cgi_queue_size;
+}
+
+time_t LocConfig::getCGITimeout() const {
+    return cgi_timeout;
+}
+
+time_t LocConfig::getCGIIdleTimeout() const {
+    return cgi_idle_timeout;
+}
+
+// Built once when the configuration is loaded, CGI requests only add their own variables
+void LocConfig::prepareCGIEnv() {
+    cgi_env.clear();
+    if (cgi_extensions.empty() && fastcgi_pass.empty())
+        return;
+    cgi_env.push_back("SERVER_SOFTWARE=CustomCGI/1.0");
+    cgi_env.push_back("GATEWAY_INTERFACE=CGI/1.1");
+    cgi_env.push_back("REDIRECT_STATUS=200");
+}
+
+const std::vector<std::string> &LocConfig::getCGIEnv() const {
+    return cgi_env;
+}
+
@@ -28,6 +28,14 @@ int ServerConfig::getPort() const {
     return port; 
 }
 
+int ServerConfig::getBacklog() const { 
+    return backlog; 
+}
+
+bool ServerConfig::defersAccept() const { 
+    return defer_accept; 
+}
+
 int ServerConfig::getServerFD() const { 
     return server_fd; 
 }
@@ -61,6 +69,34 @@ std::string ServerConfig::getErrorPage(uint16_t status) const {
     return (it != error_pages.end()) ? it->second : "";
 }
 
+const std::string &ServerConfig::getAccessLog() const { 
+    return access_log; 
+}
+
+const std::string &ServerConfig::getAccessLogFormat() const { 
+    return access_log_format; 
+}
+
+bool ServerConfig::hasServerTiming() const { 
+    return server_timing; 
+}
+
+const std::string &ServerConfig::getSlowLog() const { 
+    return slow_log; 
+}
+
+double ServerConfig::getSlowLogThreshold() const { 
+    return slow_log_threshold; 
+}
+
+const std::string &ServerConfig::getCaptureTrace() const { 
+    return capture_trace; 
+}
+
+bool ServerConfig::captureBodies() const { 
+    return capture_bodies; 
+}
+
 // The default location
 LocConfig *ServerConfig::defaultLocation() {
     for (std::vector<LocConfig>::iterator it = locations.begin(); it != locations.end(); ++it) {
@@ -114,3 +150,14 @@ const ServerConfig *ServerConfig::find(const std::vector<ServerConfig> &servers,
     return NULL;
 }
 
+bool ConfigSnapshot::owns(const LocConfig *loc) {
+    for (std::vector<ServerConfig>::iterator it = servers.begin(); it != servers.end(); ++it) {
+        std::vector<LocConfig> &locations = it->getLocations();
+        for (size_t i = 0; i < locations.size(); ++i) {
+            if (&locations[i] == loc) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
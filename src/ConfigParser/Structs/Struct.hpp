@@ -26,6 +26,31 @@ class ServerConfig;
 class LocConfig;
 class WebServer;
 
+/// A `server` of an upstream block.
+struct UpstreamServer {
+	std::string address;    // host:port
+	unsigned int weight;
+	unsigned int max_fails; // failures within fail_timeout that mark it down, 0 for never
+	time_t fail_timeout;    // seconds the failures are counted over and the server stays down
+
+	UpstreamServer()
+	    : weight(1),
+	      max_fails(1),
+	      fail_timeout(10) {}
+};
+
+/// An upstream block, or the single server a proxy_pass names directly.
+struct UpstreamConfig {
+	std::string name;
+	std::string balance; // "round_robin", "least_conn" or "ip_hash"
+	size_t keepalive;    // idle connections kept per server
+	std::vector<UpstreamServer> servers;
+
+	UpstreamConfig()
+	    : balance("round_robin"),
+	      keepalive(16) {}
+};
+
 
 class LocConfig {
 	friend class ConfigParser;
@@ -42,9 +67,31 @@ class LocConfig {
 	bool body_size_set;
 	std::string root;
 	bool autoindex;
+	std::string autoindex_format;
 	std::string index;
 	std::string upload_path;
 	std::map<std::string, std::string> cgi_extensions;
+	std::string fastcgi_pass;
+	std::string handler;        // native handler module (.so) answering the location
+	std::string metrics;        // "prometheus", "status" or "connections" if it serves metrics
+	bool metrics_local;         // metrics only answered to loopback clients
+	std::string proxy_pass;     // http://upstream[/uri] the location is forwarded to
+	std::string proxy_uri;      // replaces the location path in forwarded URIs, empty for none
+	UpstreamConfig proxy_upstream; // servers behind proxy_pass
+	size_t cgi_max_concurrency; // scripts running at once, 0 for no limit
+	size_t cgi_queue_size;      // requests waiting for a slot
+	time_t cgi_timeout;         // seconds a script may run
+	time_t cgi_idle_timeout;    // seconds a script may stay silent, 0 for no limit
+	bool cgi_splice;            // splice() bodies with a Content-Length to the client
+	bool cgi_request_buffering; // read the whole request body before starting the script
+	bool cgi_coalesce;          // identical concurrent GETs share one execution
+	std::vector<std::string> cgi_coalesce_key; // "method", "uri" or "header:Name"
+	size_t cgi_cache_size;      // bytes of cached responses in memory, 0 for no cache
+	std::string cgi_cache_path; // directory evicted responses are spilled to, empty for none
+	size_t cgi_cache_disk_size; // bytes of spilled responses
+	time_t cgi_cache_valid;     // seconds a response without Cache-Control/Expires is cached
+	std::vector<std::string> cgi_cache_key; // same parts as cgi_coalesce_key
+	std::vector<std::string> cgi_env; // request-independent CGI variables, "NAME=value"
 
   public:
 	LocConfig()
@@ -52,7 +99,23 @@ class LocConfig {
 		  return_code(0),
 		  client_max_body_size(1048576),
 		  body_size_set(false),
-		  autoindex(false)  {}
+		  autoindex(false),
+		  autoindex_format("html"),
+		  metrics_local(false),
+		  cgi_max_concurrency(0),
+		  cgi_queue_size(16),
+		  cgi_timeout(10),
+		  cgi_idle_timeout(0),
+		  cgi_splice(false),
+		  cgi_request_buffering(true),
+		  cgi_coalesce(false),
+		  cgi_cache_size(0),
+		  cgi_cache_disk_size(0),
+		  cgi_cache_valid(0) {
+		cgi_coalesce_key.push_back("method");
+		cgi_coalesce_key.push_back("uri");
+		cgi_cache_key = cgi_coalesce_key;
+	}
 
 	// GETTERS & SETTERS
 	std::string getPath() const;
@@ -67,6 +130,19 @@ class LocConfig {
 	std::string getAllowedMethodsString();
 	bool acceptExtension(const std::string &ext) const;
 	std::string getInterpreter(const std::string &ext) const;
+	bool hasFastCGIPass() const;
+	void prepareCGIEnv();
+	const std::vector<std::string> &getCGIEnv() const;
+	const std::string &getFastCGIPass() const;
+	bool hasHandler() const;
+	bool hasMetrics() const;
+	const std::string &getHandler() const;
+	bool hasProxyPass() const;
+	const UpstreamConfig &getUpstream() const;
+	size_t getCGIMaxConcurrency() const;
+	size_t getCGIQueueSize() const;
+	time_t getCGITimeout() const;
+	time_t getCGIIdleTimeout() const;
 	void setExact(bool is_exact);
 	void setFullPath(const std::string &path);
 
@@ -79,7 +155,16 @@ class ServerConfig {
   private:
 	std::string host;
 	int port;
+	int backlog;       // listen queue length, backlog= of the listen directive
+	bool defer_accept; // deferred: woken only once the client sent data
 	std::map<uint16_t, std::string> error_pages;
+	std::string access_log;        // file of the access_log directive, empty if none
+	std::string access_log_format; // "combined" or "json"
+	bool server_timing;            // phase durations sent in a Server-Timing header
+	std::string slow_log;          // file of the requests slower than slow_log_threshold
+	double slow_log_threshold;     // seconds
+	std::string capture_trace;     // file the received requests are recorded to, empty if none
+	bool capture_bodies;           // request bodies recorded too, not only their size
 	std::vector<LocConfig> locations;
 	std::string prefix_;
 	int server_fd;
@@ -87,12 +172,21 @@ class ServerConfig {
   public:
 	ServerConfig()
 	    : host("0.0.0.0"),
-	      port(8080)  {}
+	      port(8080),
+	      backlog(SOMAXCONN),
+	      defer_accept(false),
+	      access_log_format("combined"),
+	      server_timing(false),
+	      slow_log_threshold(0),
+	      capture_bodies(false),
+	      server_fd(-1)  {}
 
 		  
 	// GETTERS
 	const std::string &getHost() const ;
 	int getPort() const;
+	int getBacklog() const;
+	bool defersAccept() const;
 	int getServerFD() const;
 	const std::string &getPrefix() const;
 	void setServerFD(int fd);
@@ -101,6 +195,13 @@ class ServerConfig {
 	bool hasErrorPage(uint16_t status) const;
 	std::vector<LocConfig> &getLocations();
 	std::string getErrorPage(uint16_t status) const;
+	const std::string &getAccessLog() const;
+	const std::string &getAccessLogFormat() const;
+	bool hasServerTiming() const;
+	const std::string &getSlowLog() const;
+	double getSlowLogThreshold() const;
+	const std::string &getCaptureTrace() const;
+	bool captureBodies() const;
 
 
 	// The default location
@@ -116,4 +217,19 @@ class ServerConfig {
 
 };
 
+/// The servers of one load of the configuration. A reload (SIGHUP) replaces
+/// the latest one, the connections and scripts started under an earlier one
+/// finish with it.
+struct ConfigSnapshot {
+	std::vector<ServerConfig> servers;
+	size_t refs; // connections and CGI scripts using it, plus one while it is the latest
+
+	explicit ConfigSnapshot(const std::vector<ServerConfig> &servers)
+	    : servers(servers),
+	      refs(1) {}
+
+	/// Whether a location is one of its servers'.
+	bool owns(const LocConfig *loc);
+};
+
 #endif
@@ -10,25 +10,288 @@
 /*                                                                            */
 /* ************************************************************************** */
 
+#include "src/CGI/CGICache.hpp"
 #include "src/HttpServer/HttpServer.hpp"
 #include "src/HttpServer/Structs/Connection.hpp"
 #include "src/HttpServer/Structs/Response.hpp"
 #include "src/HttpServer/Structs/WebServer.hpp"
+#include "src/Utils/Probes.hpp"
+#include "src/Utils/ServerUtils.hpp"
 
 uint16_t WebServer::handleCGIRequest(ClientRequest &req, Connection *conn) {
-    Logger _lggr;
+    LocConfig *loc = conn->locConfig;
+    if (loc->cgi_cache_size && req.method == "GET" && serveCachedCGI(req, conn))
+        return (0);
+    noteUpstreamStart(conn);
+    if (!loc->cgi_coalesce || req.method != "GET")
+        return (admitCGI(req, conn, ""));
 
+    // An identical request is in flight: wait for its response instead of running the script
+    std::string key = requestKey(req, loc->cgi_coalesce_key);
+    std::map<std::string, std::vector<QueuedCGI> >::iterator it = _cgi_waiters.find(key);
+    if (it != _cgi_waiters.end()) {
+        QueuedCGI waiter;
+        waiter.conn = conn;
+        waiter.request = req;
+        waiter.since = getCurrentTime();
+        it->second.push_back(waiter);
+        LOG_DEBUG_PREFIX(_lggr, "CGI",
+                 "Coalesced request for " + req.uri + " (" +
+                     su::to_string(it->second.size()) + " waiting)");
+        epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLRDHUP);
+        return (0);
+    }
+    _cgi_waiters[key]; // in flight from now on, also while queued for a slot
+    uint16_t code = admitCGI(req, conn, key);
+    if (code || conn->response_ready)
+        _cgi_waiters.erase(key);
+    return (code);
+}
+
+uint16_t WebServer::admitCGI(ClientRequest &req, Connection *conn, const std::string &key) {
+    LocConfig *loc = conn->locConfig;
+    size_t limit = loc->getCGIMaxConcurrency();
+    if (!limit || _cgi_running[loc] < limit)
+        return (startCGI(req, conn, key));
+
+    // Every slot is taken: wait in line, or come back later if the line is full too
+    std::deque<QueuedCGI> &queue = _cgi_queue[loc];
+    if (queue.size() >= loc->getCGIQueueSize()) {
+        _lggr.logWithPrefix(Logger::WARNING, "CGI", "Queue full for location " + loc->getPath());
+        prepareResponse(conn, Response::serviceUnavailable(conn, CGI_RETRY_AFTER));
+        return (0);
+    }
+    QueuedCGI entry;
+    entry.conn = conn;
+    entry.request = req;
+    entry.since = getCurrentTime();
+    entry.key = key;
+    queue.push_back(entry);
+    LOG_DEBUG_PREFIX(_lggr, "CGI",
+             "Queued request for " + loc->getPath() + " (" +
+                 su::to_string(queue.size()) + " waiting)");
+    epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLRDHUP);
+    return (0);
+}
+
+uint16_t WebServer::startCGI(ClientRequest &req, Connection *conn, const std::string &key) {
     CGI *cgi = NULL;
-    uint16_t exit_code = CGIUtils::createCGI(cgi, req, conn->locConfig);
+    uint16_t exit_code = CGIUtils::createCGI(cgi, req, conn->locConfig, conn->body_streaming);
+    if (exit_code)
+        return (exit_code);
+    cgi->setCoalesceKey(key);
+    LocConfig *loc = conn->locConfig;
+    if (loc->cgi_cache_size && req.method == "GET") {
+        cgi->setCacheKey(requestKey(req, loc->cgi_cache_key));
+        cgi->captureOutput(cgiCache(loc)->maxEntrySize());
+    }
+    exit_code = registerCGI(cgi, conn);
     if (exit_code)
         return (exit_code);
 
-    _cgi_pool[cgi->getOutputFd()] = std::make_pair(cgi, conn);
+    if (conn->body_streaming) {
+        conn->body_sink = cgi;
+        epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLIN | EPOLLRDHUP);
+        pumpCGIBody(conn); // what arrived with the headers or while queued
+        return (0);
+    }
+    // Nothing to send until the script is done, only watch for the peer going away
+    epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLRDHUP);
+    return (0);
+}
+
+uint16_t WebServer::registerCGI(CGI *cgi, Connection *conn) {
+    std::pair<CGI *, Connection *> entry = std::make_pair(cgi, conn);
+    _cgi_children[cgi->getPid()] = entry;
+    _cgi_running[cgi->getLocation()]++; // until the child is reaped
+    retainConfig(configOf(cgi->getLocation()));
+    cgi->setSpawnTime(monotonicTime());
+    _metrics.cgiSpawned();
+    WEBSERV_PROBE2(cgi__spawn, cgi->getPid(), conn ? conn->fd : -1);
+
+    _cgi_pool[cgi->getOutputFd()] = entry;
     if (!epollManage(EPOLL_CTL_ADD, cgi->getOutputFd(), EPOLLIN)) {
         _lggr.error("EPollManage for CGI request failed.");
+        _cgi_pool.erase(cgi->getOutputFd());
+        cgi->closeOutput();
+        cgi->closeInput();
+        kill(cgi->getPid(), SIGKILL);
+        _cgi_children[cgi->getPid()].second = NULL; // reaped later, nobody to answer
         return (502);
     }
-
+    if (cgi->getInputFd() != -1) {
+        _cgi_pool[cgi->getInputFd()] = entry;
+        // A streamed body is only watched while part of it waits for the pipe
+        if (cgi->hasPendingInput() && !epollManage(EPOLL_CTL_ADD, cgi->getInputFd(), EPOLLOUT)) {
+            _cgi_pool.erase(cgi->getInputFd());
+            cgi->closeInput();
+        }
+    }
     return (0);
 }
 
+// The script's path and the cgi_coalesce_key or cgi_cache_key parts of the request
+std::string WebServer::requestKey(const ClientRequest &req,
+                                  const std::vector<std::string> &parts) {
+    std::string key = req.script_path;
+    for (size_t i = 0; i < parts.size(); ++i) {
+        key += '\n';
+        if (parts[i] == "method") {
+            key += req.method;
+        } else if (parts[i] == "uri") {
+            key += req.uri;
+        } else {
+            std::map<std::string, std::string>::const_iterator h =
+                req.headers.find(su::to_lower(parts[i].substr(7)));
+            if (h != req.headers.end())
+                key += h->second;
+        }
+    }
+    return (key);
+}
+
+CGICache *WebServer::cgiCache(LocConfig *loc) {
+    CGICache *&cache = _cgi_caches[loc];
+    if (!cache)
+        cache = new CGICache(loc->cgi_cache_size, loc->cgi_cache_path, loc->cgi_cache_disk_size);
+    return (cache);
+}
+
+// A cached response answers without running the script, a stale one is refreshed meanwhile
+bool WebServer::serveCachedCGI(ClientRequest &req, Connection *conn) {
+    LocConfig *loc = conn->locConfig;
+    std::string key = requestKey(req, loc->cgi_cache_key);
+    std::string output;
+    bool revalidate;
+    CGICache::Lookup found = cgiCache(loc)->lookup(key, getCurrentTime(), output, revalidate);
+
+    Response resp;
+    if (found == CGICache::MISS || !CGIUtils::parseCGIOutput(output, resp))
+        return (false);
+    resp.setHeader("X-Cache", found == CGICache::HIT ? "HIT" : "STALE");
+    prepareResponse(conn, resp);
+    if (revalidate)
+        revalidateCGI(req, loc, key);
+    return (true);
+}
+
+void WebServer::revalidateCGI(ClientRequest &req, LocConfig *loc, const std::string &key) {
+    CGICache *cache = cgiCache(loc);
+    size_t limit = loc->getCGIMaxConcurrency();
+    CGI *cgi = NULL;
+    // No slot to spare: the stale copy keeps being served, a later request tries again
+    if ((limit && _cgi_running[loc] >= limit) || CGIUtils::createCGI(cgi, req, loc, false)) {
+        cache->revalidationFailed(key);
+        return;
+    }
+    cgi->setCacheKey(key);
+    cgi->captureOutput(cache->maxEntrySize());
+    LOG_DEBUG_PREFIX(_lggr, "CGI", "Revalidating cached " + req.uri);
+    registerCGI(cgi, NULL); // a failure is handled once the killed child is reaped
+}
+
+// With cgi_request_buffering off, a POST to an existing script does not wait for its body
+bool WebServer::streamsCGIBody(const ClientRequest &req, Connection *conn) {
+    LocConfig *loc = conn->locConfig;
+    if (loc->cgi_request_buffering || loc->hasFastCGIPass() || req.method != "POST")
+        return (false);
+    if (!req.chunked_encoding && req.content_length <= 0)
+        return (false);
+    // Directories, redirects and errors go through the usual routing
+    if (req.path.empty() || su::back(req.path) == '/' || checkFileType(req.script_path) != ISREG)
+        return (false);
+    return (loc->acceptExtension(getExtension(req.script_path)));
+}
+
+void WebServer::startCGIBody(Connection *conn, const std::string &received) {
+    markPhase(conn, Connection::HANDLER_START);
+    conn->body_streaming = true;
+    conn->body_sink = NULL;
+    conn->body_paused = false;
+    conn->body_bytes_read = 0;
+    conn->chunk_size = 0;
+    conn->chunk_bytes_read = 0;
+    conn->read_buffer = received;
+    conn->state = conn->chunked ? Connection::READING_CHUNK_SIZE : Connection::READING_BODY;
+
+    // Not the location's path: if the request queues, others are validated meanwhile
+    ClientRequest req = conn->parsed_request;
+    req.extension = getExtension(req.script_path);
+    LOG_DEBUG_PREFIX(_lggr, "CGI", "Streaming the request body to " + req.path);
+    uint16_t code = handleCGIRequest(req, conn);
+    if (code)
+        failCGIBody(conn, code);
+    else if (conn->response_ready) // no slot left
+        epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+}
+
+// Passes on the body bytes received so far, de-chunked, and stops reading the
+// socket while the script's stdin is full
+void WebServer::pumpCGIBody(Connection *conn) {
+    CGI *cgi = conn->body_sink;
+    if (!cgi)
+        return; // still queued, the bytes wait in read_buffer
+
+    std::string data;
+    bool done = false;
+    if (conn->chunked) {
+        uint16_t code = decodeChunkedBody(conn, data, done);
+        if (code) {
+            failCGIBody(conn, code);
+            return;
+        }
+    } else {
+        // Bytes past Content-Length would be a pipelined request, they are dropped
+        data = conn->read_buffer.substr(0, conn->content_length - conn->body_bytes_read);
+        conn->read_buffer.clear();
+        conn->body_bytes_read += data.size();
+        done = (static_cast<ssize_t>(conn->body_bytes_read) == conn->content_length);
+    }
+    feedCGIInput(cgi, data, done);
+
+    if (done) {
+        LOG_DEBUG_PREFIX(_lggr, "CGI",
+                 "Streamed a request body of " + su::to_string(conn->body_bytes_read) +
+                     " bytes");
+        conn->body_streaming = false;
+        conn->body_sink = NULL;
+        conn->body_paused = false;
+        conn->read_buffer.clear();
+        conn->state = Connection::REQUEST_COMPLETE;
+        conn->request_count++;
+        epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLRDHUP);
+    } else if (cgi->hasPendingInput() && !conn->body_paused) {
+        conn->body_paused = true;
+        epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLRDHUP);
+    }
+}
+
+// The script drained its stdin, or the upstream its socket: read the client again
+void WebServer::resumeRequestBody(Connection *conn) {
+    conn->body_paused = false;
+    conn->updateActivity();
+    epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLIN | EPOLLRDHUP);
+}
+
+// A response is ready before the whole body was read (early answer from the script or
+// upstream, error, timeout): the script gets EOF and the connection closes after it
+void WebServer::abandonRequestBody(Connection *conn) {
+    if (conn->body_sink)
+        releaseCGIFd(conn->body_sink->getInputFd());
+    conn->body_streaming = false;
+    conn->body_sink = NULL;
+    conn->body_upstream = NULL;
+    conn->body_paused = false;
+    conn->read_buffer.clear();
+    conn->state = Connection::REQUEST_COMPLETE;
+    conn->should_close = true;
+}
+
+// The body is invalid or too large: answer that and stop the script
+void WebServer::failCGIBody(Connection *conn, uint16_t code) {
+    abandonRequestBody(conn);
+    detachCGI(conn);
+    prepareResponse(conn, Response(code, conn));
+    epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+}
+
@@ -17,7 +17,7 @@
 #include "src/HttpServer/HttpServer.hpp"
 
 bool WebServer::processChunkSize(Connection *conn) {
-	_lggr.debug("In processChunkSize");
+	LOG_DEBUG(_lggr, "In processChunkSize");
 	size_t crlf_pos = findCRLF(conn->read_buffer);
 	if (crlf_pos == std::string::npos) {
 		// Need more data to read chunk size
@@ -50,7 +50,7 @@ bool WebServer::processChunkSize(Connection *conn) {
 	}
 	
 	conn->chunk_size = static_cast<size_t>(size);
-	_lggr.debug("Chunk size: " + su::to_string(conn->chunk_size));
+	LOG_DEBUG(_lggr, "Chunk size: " + su::to_string(conn->chunk_size));
 
 	conn->chunk_bytes_read = 0;
 	
@@ -58,7 +58,7 @@ bool WebServer::processChunkSize(Connection *conn) {
 	// MAX BODY SIZE - vs CHUNKDATA + new chunk size
 	if (!conn->locConfig->infiniteBodySize() && conn->locConfig->getMaxBodySize() > 0) {
 		size_t total_body_size = conn->chunk_data.length() + conn->chunk_size;
-		_lggr.debug("Chunk_data.length +  next chunk: " + su::to_string(total_body_size));
+		LOG_DEBUG(_lggr, "Chunk_data.length +  next chunk: " + su::to_string(total_body_size));
 
 		if (static_cast<size_t>(total_body_size) > conn->locConfig->getMaxBodySize()) {
 			_lggr.error("Chunked body size (" + su::to_string(total_body_size) + 
@@ -84,7 +84,7 @@ bool WebServer::processChunkData(Connection *conn) {
 	size_t available_data = conn->read_buffer.length();
 	size_t bytes_needed = conn->chunk_size - conn->chunk_bytes_read;
 	if (available_data < bytes_needed + 2) { // +2 for trailing CRLF
-		_lggr.debug("Not enough data available, waiting for more");
+		LOG_DEBUG(_lggr, "Not enough data available, waiting for more");
 		return false;
 	}
 
@@ -117,7 +117,8 @@ bool WebServer::processChunkData(Connection *conn) {
 
 	// Remove trailing CRLF
 	conn->read_buffer = conn->read_buffer.substr(2);
-	_lggr.debug("Chunk data processed successfully: " + su::to_string(conn->chunk_size) + " bytes");
+	LOG_DEBUG(_lggr, "Chunk data processed successfully: " + su::to_string(conn->chunk_size) +
+	                     " bytes");
 
 	conn->chunk_bytes_read = 0;
 	return processChunkSize(conn);
@@ -137,7 +138,7 @@ bool WebServer::processTrailer(Connection *conn) {
 	// If trailer line is empty, we're done
 	if (trailer_line.empty()) {
 		conn->state = Connection::CHUNK_COMPLETE;
-		_lggr.debug("Trailer line is empty, chunk complete");
+		LOG_DEBUG(_lggr, "Trailer line is empty, chunk complete");
 		reconstructChunkedRequest(conn);
 		return true;
 	}
@@ -157,13 +158,13 @@ void WebServer::reconstructChunkedRequest(Connection *conn) {
 		if (line_end != std::string::npos) {
 			// Remove the Transfer-Encoding line
 			reconstructed_request.erase(te_pos, line_end - te_pos + 2);
-			_lggr.debug("Removed Transfer-Encoding header from reconstruction");
+			LOG_DEBUG(_lggr, "Removed Transfer-Encoding header from reconstruction");
 		}
 	}
 
 	// Final check: total reconstructed body is < MaxBody
-	_lggr.debug("Final chunked body size (" + su::to_string(conn->chunk_data.length()) + 
-			") vs max body size (" + su::to_string(conn->locConfig->getMaxBodySize()) + ")");
+	LOG_DEBUG(_lggr, "Final chunked body size (" + su::to_string(conn->chunk_data.length()) + 
+			     ") vs max body size (" + su::to_string(conn->locConfig->getMaxBodySize()) + ")");
 	if (!conn->locConfig->infiniteBodySize() && conn->locConfig->getMaxBodySize() > 0) {
 		if (static_cast<size_t>(conn->chunk_data.length()) > conn->locConfig->getMaxBodySize()) {
 			_lggr.error("Final chunked body size (" + su::to_string(conn->chunk_data.length()) + 
@@ -181,19 +182,118 @@ void WebServer::reconstructChunkedRequest(Connection *conn) {
 		std::string content_length_header =
 			"\r\nContent-Length: " + su::to_string(conn->chunk_data.length()) + "\r\n";
 		reconstructed_request.insert(final_crlf, content_length_header);
-		_lggr.debug("Added Content-Length header: " + su::to_string(conn->chunk_data.length()));
+		LOG_DEBUG(_lggr, "Added Content-Length header: " + su::to_string(conn->chunk_data.length()));
 	}
 
 	// Store the reconstructed request but don't overwrite read_buffer yet
 	// The body will be handled separately in processRequest()
 	conn->read_buffer = reconstructed_request + conn->chunk_data;
 
-	_lggr.debug("Chunked request reconstruction completed successfully");
-	_lggr.debug("Reconstructed request, total body size: " +
-				su::to_string(conn->chunk_data.length()));
+	LOG_DEBUG(_lggr, "Chunked request reconstruction completed successfully");
+	LOG_DEBUG(_lggr, "Reconstructed request, total body size: " +
+				     su::to_string(conn->chunk_data.length()));
 	
 	// Debug: show first part of reconstructed request
 	std::string debug_preview = conn->read_buffer.substr(0, std::min(size_t(200), conn->read_buffer.size()));
-	_lggr.debug("Reconstructed request preview: " + debug_preview);
+	LOG_DEBUG(_lggr, "Reconstructed request preview: " + debug_preview);
 }
 
+uint16_t WebServer::decodeChunkedBody(Connection *conn, std::string &out, bool &done) {
+	std::string &in = conn->read_buffer;
+	size_t pos = 0;
+
+	while (!done && pos < in.size()) {
+		if (conn->state == Connection::READING_CHUNK_DATA) {
+			size_t n = std::min(conn->chunk_size - conn->chunk_bytes_read, in.size() - pos);
+			out.append(in, pos, n);
+			pos += n;
+			conn->chunk_bytes_read += n;
+			conn->body_bytes_read += n;
+			if (conn->chunk_bytes_read == conn->chunk_size)
+				conn->state = Connection::READING_CHUNK_TRAILER;
+			continue;
+		}
+		if (conn->state == Connection::READING_CHUNK_TRAILER) {
+			if (in.size() - pos < 2)
+				break;
+			if (in.compare(pos, 2, "\r\n") != 0) {
+				_lggr.error("Invalid chunk format: no trailing CRLF");
+				return (400);
+			}
+			pos += 2;
+			conn->state = Connection::READING_CHUNK_SIZE;
+			continue;
+		}
+
+		// Chunk size line, or a trailer field after the last chunk
+		size_t crlf_pos = in.find("\r\n", pos);
+		if (crlf_pos == std::string::npos) {
+			if (in.size() - pos > CHUNK_LINE_MAX) {
+				_lggr.error("Chunk size or trailer line too long");
+				return (400);
+			}
+			break;
+		}
+		std::string line = in.substr(pos, crlf_pos - pos);
+		pos = crlf_pos + 2;
+		if (conn->state == Connection::READING_TRAILER) {
+			done = line.empty();
+			continue;
+		}
+
+		line = su::trim(line.substr(0, line.find(';')));
+		char *end;
+		errno = 0;
+		long size = std::strtol(line.c_str(), &end, 16);
+		if (end == line.c_str() || *end != '\0' || errno == ERANGE || size < 0) {
+			_lggr.error("Invalid chunk size: " + line);
+			return (400);
+		}
+		if (!conn->locConfig->infiniteBodySize() && conn->locConfig->getMaxBodySize() > 0 &&
+		    conn->body_bytes_read + size > conn->locConfig->getMaxBodySize()) {
+			_lggr.error("Chunked body size would exceed max body size (" +
+			            su::to_string(conn->locConfig->getMaxBodySize()) + ")");
+			return (413);
+		}
+		conn->chunk_size = static_cast<size_t>(size);
+		conn->chunk_bytes_read = 0;
+		conn->state = size ? Connection::READING_CHUNK_DATA : Connection::READING_TRAILER;
+	}
+	in.erase(0, pos);
+	return (0);
+}
+
+Connection *chunked::newConnection(ServerConfig &server, LocConfig *loc, const std::string &head) {
+	Connection *conn = new Connection(-1);
+	conn->servConfig = &server;
+	conn->locConfig = loc;
+	conn->headers_buffer = head;
+	conn->chunked = true;
+	return (conn);
+}
+
+void chunked::deleteConnection(Connection *conn) { delete conn; }
+
+size_t chunked::reassemble(WebServer &ws, Connection *conn, const std::string &body) {
+	conn->read_buffer = body;
+	conn->chunk_data.clear();
+	conn->chunk_size = 0;
+	conn->chunk_bytes_read = 0;
+	conn->state = Connection::READING_CHUNK_SIZE;
+	ws.processChunkSize(conn);
+	return (conn->state == Connection::CHUNK_COMPLETE ? conn->chunk_data.size() : 0);
+}
+
+size_t chunked::decode(WebServer &ws, Connection *conn, const std::string &body,
+                       std::string &out) {
+	conn->read_buffer = body;
+	conn->chunk_size = 0;
+	conn->chunk_bytes_read = 0;
+	conn->body_bytes_read = 0;
+	conn->state = Connection::READING_CHUNK_SIZE;
+	out.clear();
+	bool done = false;
+	if (ws.decodeChunkedBody(conn, out, done) != 0 || !done)
+		return (0);
+	return (out.size());
+}
@@ -14,6 +14,7 @@
 #include "src/HttpServer/Structs/Connection.hpp"
 #include "src/HttpServer/Structs/Response.hpp"
 #include "src/HttpServer/Structs/WebServer.hpp"
+#include "src/Logger/TraceCapture.hpp"
 
 void WebServer::handleClientEvent(int fd, uint32_t event_mask) {
     std::map<int, Connection *>::iterator conn_it = _connections.find(fd);
@@ -31,24 +32,34 @@ void WebServer::handleClientEvent(int fd, uint32_t event_mask) {
                     closeConnection(conn);
             } else {
                 _lggr.error("Response is not ready to be sent back to the client");
-                _lggr.debug("Error for clinet " + conn->toString());
+                LOG_DEBUG(_lggr, "Error for clinet " + conn->toString());
             }
-            if (!conn->keep_persistent_connection || conn->should_close)
+            if (_connections.find(fd) == _connections.end())
+                return;
+            // Only close once the whole response (including streamed bodies) went out
+            if (!conn->response_ready && (!conn->keep_persistent_connection || conn->should_close))
                 closeConnection(conn);
         }
+        // Peer hung up while a script works for it: closing stops the script
+        if ((event_mask & EPOLLRDHUP) && !(event_mask & (EPOLLIN | EPOLLOUT))) {
+            LOG(_lggr, Logger::WARNING,
+                "Client (fd: " + su::to_string(fd) + ") hung up before the response");
+            closeConnection(conn);
+            return;
+        }
         if (event_mask & (EPOLLERR | EPOLLHUP)) {
             _lggr.error("Error/hangup event for fd: " + su::to_string(fd));
             closeConnection(conn);
         }
     } else {
-        _lggr.debug("Ignoring event for unknown fd: " + su::to_string(fd));
+        LOG_DEBUG(_lggr, "Ignoring event for unknown fd: " + su::to_string(fd));
         epollManage(EPOLL_CTL_DEL, fd, 0);
         close(fd);
     }
 }
 
 void WebServer::handleClientRecv(Connection *conn) {
-    _lggr.debug("Updated last activity for FD " + su::to_string(conn->fd));
+    LOG_DEBUG(_lggr, "Updated last activity for FD " + su::to_string(conn->fd));
     conn->updateActivity();
 
     char buffer[BUFFER_SIZE];
@@ -60,7 +71,7 @@ void WebServer::handleClientRecv(Connection *conn) {
             return;
         }
     } else if (bytes_read == 0) {
-        _lggr.warn("Client (fd: " + su::to_string(conn->fd) + ") closed connection");
+        LOG_DEBUG(_lggr, "Client (fd: " + su::to_string(conn->fd) + ") closed connection");
         conn->keep_persistent_connection = false;
         closeConnection(conn);
         return;
@@ -75,19 +86,34 @@ ssize_t WebServer::receiveData(int client_fd, char *buffer, size_t buffer_size)
     errno = 0;
     ssize_t bytes_read = recv(client_fd, buffer, buffer_size, 0);
 
-    _lggr.logWithPrefix(Logger::DEBUG, "recv", "Bytes received: " + su::to_string(bytes_read));
+    LOG_DEBUG_PREFIX(_lggr, "recv", "Bytes received: " + su::to_string(bytes_read));
     if (bytes_read > 0) {
         buffer[bytes_read] = '\0';
     }
 
-    _lggr.logWithPrefix(Logger::DEBUG, "recv", "Data: " + std::string(buffer));
+    LOG_DEBUG_PREFIX(_lggr, "recv",
+                     "Data: " + std::string(buffer, bytes_read > 0 ? bytes_read : 0));
 
     return bytes_read;
 }
 
 bool WebServer::processReceivedData(Connection *conn, const char *buffer, ssize_t bytes_read) {
-            
+    _metrics.received(bytes_read);
+    if (conn->capture)
+        conn->capture->received(conn->fd, buffer, bytes_read, monotonicTime());
+
+    // Unbuffered body: straight on to the script or upstream, which answers by itself
+    if (conn->body_streaming) {
+        conn->read_buffer.append(buffer, bytes_read);
+        if (conn->body_upstream)
+            pumpProxyBody(conn);
+        else
+            pumpCGIBody(conn);
+        return true;
+    }
+
     if (conn->state == Connection::READING_HEADERS) {
+        noteRequestStart(conn);
         conn->read_buffer += std::string(buffer, bytes_read);
     }
 
@@ -97,7 +123,7 @@ bool WebServer::processReceivedData(Connection *conn, const char *buffer, ssize_
                                reinterpret_cast<const unsigned char *>(buffer + bytes_read));
         conn->body_bytes_read += bytes_read;
 
-        _lggr.debug("Read " + su::to_string(conn->body_bytes_read) + " bytes of body so far");
+        LOG_DEBUG(_lggr, "Read " + su::to_string(conn->body_bytes_read) + " bytes of body so far");
     }
 
     else {
@@ -107,12 +133,12 @@ bool WebServer::processReceivedData(Connection *conn, const char *buffer, ssize_
         }
     }
 
-    _lggr.debug("Checking if request was completed");
+    LOG_DEBUG(_lggr, "Checking if request was completed");
     if (isRequestComplete(conn)) {
         if (!epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT)) {
             return false;
         }
-        _lggr.debug("Request was completed");
+        LOG_DEBUG(_lggr, "Request was completed");
         if (conn->should_close)
             return false;
         return handleCompleteRequest(conn);
@@ -14,38 +14,56 @@
 #include "src/HttpServer/HttpServer.hpp"
 #include "src/HttpServer/Structs/Response.hpp"
 #include "src/HttpServer/Structs/WebServer.hpp"
+#include "src/Logger/TraceCapture.hpp"
+#include "src/Utils/Probes.hpp"
 
+// A burst drains in a few wakeups; the budget lets the other events in between
 void WebServer::handleNewConnection(ServerConfig *sc) {
-	struct sockaddr_in client_addr;
-	socklen_t client_len = sizeof(client_addr);
-
-	int client_fd = accept(sc->getServerFD(), (struct sockaddr *)&client_addr, &client_len);
-	if (client_fd == -1) {
-		return;
-	}
-
-	if (!setNonBlocking(client_fd)) {
-		close(client_fd);
-		return;
-	}
+	for (int accepted = 0; accepted < ACCEPT_BUDGET;) {
+		struct sockaddr_in client_addr;
+		socklen_t client_len = sizeof(client_addr);
+
+		// Non-blocking from the start, and close-on-exec: a binary started by SIGUSR2
+		// must not hold the client sockets open
+		int client_fd = accept4(sc->getServerFD(), (struct sockaddr *)&client_addr, &client_len,
+		                        SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (client_fd == -1) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			return; // EAGAIN: none left, or out of fds until some close
+		}
+		++accepted;
 
-	Connection *conn = addConnection(client_fd, sc);
+		Connection *conn = addConnection(client_fd, sc);
+		conn->client_addr = inet_ntoa(client_addr.sin_addr);
+		_metrics.connectionOpened();
 
-	if (!epollManage(EPOLL_CTL_ADD, client_fd, EPOLLIN)) {
-		closeConnection(conn);
+		if (!epollManage(EPOLL_CTL_ADD, client_fd, EPOLLIN)) {
+			closeConnection(conn);
+			continue;
+		}
+		LOG_DEBUG(_lggr, "New connection from " + conn->client_addr + ":" +
+		                     su::to_string<unsigned short>(ntohs(client_addr.sin_port)) +
+		                     " (fd: " + su::to_string<int>(client_fd) + ")");
 	}
-
-	_lggr.info("New connection from " + std::string(inet_ntoa(client_addr.sin_addr)) + ":" +
-	           su::to_string<unsigned short>(ntohs(client_addr.sin_port)) +
-	           " (fd: " + su::to_string<int>(client_fd) + ")");
 }
 
 Connection *WebServer::addConnection(int client_fd, ServerConfig *sc) {
 	Connection *conn = new Connection(client_fd);
 	conn->servConfig = sc;
+	conn->config = _config;
+	retainConfig(_config);
+	conn->phases[Connection::ACCEPTED] = monotonicTime();
 	_connections[client_fd] = conn;
+	std::map<std::string, TraceCapture *>::iterator capture =
+	    _captures.find(sc->getCaptureTrace());
+	if (capture != _captures.end()) {
+		conn->capture = capture->second;
+		conn->capture->opened(client_fd, conn->phases[Connection::ACCEPTED]);
+	}
+	WEBSERV_PROBE1(connection__accept, client_fd);
 
-	_lggr.debug("Added connection tracking for fd: " + su::to_string(client_fd));
+	LOG_DEBUG(_lggr, "Added connection tracking for fd: " + su::to_string(client_fd));
 	return conn;
 }
 
@@ -60,15 +78,32 @@ void WebServer::cleanupExpiredConnections() {
 
 	std::vector<Connection *> expired;
 
+	// A script running, queued or coalesced for the client is bounded by cgi_timeout and
+	// cgi_idle_timeout instead, which may be longer
+	std::set<Connection *> scripted;
+	for (std::map<pid_t, std::pair<CGI *, Connection *> >::iterator it = _cgi_children.begin();
+	     it != _cgi_children.end(); ++it)
+		scripted.insert(it->second.second);
+	for (std::map<LocConfig *, std::deque<QueuedCGI> >::iterator it = _cgi_queue.begin();
+	     it != _cgi_queue.end(); ++it)
+		for (size_t i = 0; i < it->second.size(); ++i)
+			scripted.insert(it->second[i].conn);
+	for (std::map<std::string, std::vector<QueuedCGI> >::iterator it = _cgi_waiters.begin();
+	     it != _cgi_waiters.end(); ++it)
+		for (size_t i = 0; i < it->second.size(); ++i)
+			scripted.insert(it->second[i].conn);
+
 	// Collect expired connections
 	for (std::map<int, Connection *>::iterator it = _connections.begin(); it != _connections.end();
 	     ++it) {
 
 		Connection *conn = it->second;
+		if (scripted.count(conn))
+			continue;
 		if (conn->isExpired(time(NULL), CONNECTION_TO)) {
 			conn->keep_persistent_connection = false;
 			expired.push_back(conn);
-			_lggr.info("Connection expired for fd: " + su::to_string(conn->fd));
+			LOG(_lggr, Logger::INFO, "Connection expired for fd: " + su::to_string(conn->fd));
 		}
 	}
 
@@ -83,10 +118,14 @@ void WebServer::handleConnectionTimeout(int client_fd) {
 	if (it != _connections.end()) {
 		Connection *conn = it->second;
 
-		prepareResponse(conn, Response(408, conn));
+		_metrics.timedOut(Metrics::CLIENT);
+		// A response under way is cut short, there is no room for another one
+		if (!conn->response_ready)
+			prepareResponse(conn, Response(408, conn));
 
-		_lggr.info("Connection timed out for fd: " + su::to_string(client_fd) + " (idle for " +
-		           su::to_string(getCurrentTime() - conn->last_activity) + " seconds)");
+		LOG(_lggr, Logger::INFO,
+		    "Connection timed out for fd: " + su::to_string(client_fd) + " (idle for " +
+		        su::to_string(getCurrentTime() - conn->last_activity) + " seconds)");
 		closeConnection(conn);
 	}
 }
@@ -95,20 +134,29 @@ void WebServer::closeConnection(Connection *conn) {
 	if (!conn)
 		return;
 
-	_lggr.debug("Closing connection for fd: " + su::to_string(conn->fd));
+	LOG_DEBUG(_lggr, "Closing connection for fd: " + su::to_string(conn->fd));
 
 	std::map<int, Connection *>::iterator it = _connections.find(conn->fd);
 	if (it == _connections.end()) {
-		_lggr.debug("Connection already closed for fd: " + su::to_string(conn->fd));
+		LOG_DEBUG(_lggr, "Connection already closed for fd: " + su::to_string(conn->fd));
 		return;
 	}
 	if (it->second != conn) {
 		_lggr.error("Connection object mismatch for fd: " + su::to_string(conn->fd));
 		return;
 	}
+	recordRequest(conn); // a request left unanswered or cut short
+	if (conn->capture)
+		conn->capture->closed(conn->fd, monotonicTime());
+	_metrics.connectionClosed();
+	detachCGI(conn);
+	detachFastCGI(conn);
+	detachModule(conn);
+	detachProxy(conn);
 	epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
 	close(conn->fd);
 	_connections.erase(it);
-	_lggr.debug("Connection cleanup completed for fd: " + su::to_string(conn->fd));
+	LOG_DEBUG(_lggr, "Connection cleanup completed for fd: " + su::to_string(conn->fd));
+	releaseConfig(conn->config);
 	delete conn;
 }
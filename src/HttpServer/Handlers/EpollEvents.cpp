@@ -21,10 +21,18 @@ void WebServer::processEpollEvents(const struct epoll_event *events, int event_c
         const int fd = events[i].data.fd;
 
         if (isListeningSocket(fd)) {
-            ServerConfig *sc = ServerConfig::find(_confs, fd);
+            ServerConfig *sc = ServerConfig::find(_config->servers, fd);
             handleNewConnection(sc);
+        } else if (fd == _signal_fd) {
+            handleSignals();
+        } else if (fd == _module_fd) {
+            handleModuleCompletions();
         } else if (isCGIFd(fd)) {
-            handleCGIOutput(fd);
+            handleCGIEvent(fd, event_mask);
+        } else if (isFastCGIFd(fd)) {
+            handleFastCGIEvent(fd, event_mask);
+        } else if (isProxyFd(fd)) {
+            handleProxyEvent(fd, event_mask);
         } else {
             handleClientEvent(fd, event_mask);
         }
@@ -32,7 +40,9 @@ void WebServer::processEpollEvents(const struct epoll_event *events, int event_c
 }
 
 bool WebServer::isListeningSocket(int fd) const {
-    for (std::vector<ServerConfig>::const_iterator it = _confs.begin(); it != _confs.end(); ++it) {
+    const std::vector<ServerConfig> &servers = _config->servers;
+    for (std::vector<ServerConfig>::const_iterator it = servers.begin(); it != servers.end();
+         ++it) {
         if (fd == it->getServerFD()) {
             return true;
         }
@@ -18,7 +18,7 @@
 
 bool WebServer::matchLocation(ClientRequest &req, Connection *conn) {
 	// initialize the correct locConfig // default "/"
-	_lggr.debug("Path to match : " + req.path);
+	LOG_DEBUG(_lggr, "Path to match : " + req.path);
 	LocConfig *match = findBestMatch(req.path, conn->servConfig->getLocations(), _lggr);
 	if (!match) {
 		_lggr.error("[Resp] No matched location for : " + req.path);
@@ -27,14 +27,14 @@ bool WebServer::matchLocation(ClientRequest &req, Connection *conn) {
 	}
 	conn->locConfig = match;
 	conn->locConfig->setFullPath("");
-	_lggr.debug("[Resp] Matched location : " + conn->locConfig->path);
+	LOG_DEBUG(_lggr, "[Resp] Matched location : " + conn->locConfig->path);
 	return true;
 }
 
 bool WebServer::normalizePath(ClientRequest &req, Connection *conn) {
 
 	// normalisation
-	_lggr.debug("full_path: " + req.path);
+	LOG_DEBUG(_lggr, "full_path: " + req.path);
 	std::string full_path = buildFullPath(req.path, conn->locConfig);
 	std::string root_full_path = buildFullPath("", conn->locConfig);
 	char resolved[PATH_MAX];
@@ -43,9 +43,9 @@ bool WebServer::normalizePath(ClientRequest &req, Connection *conn) {
 	if (su::back(normal_full_path) != '/')
 		normal_full_path += "/";
 
-	_lggr.debug("full_path: " + full_path);
-	_lggr.debug("normal_full_path: " + normal_full_path);
-	_lggr.debug("root_full_path: " + root_full_path);
+	LOG_DEBUG(_lggr, "full_path: " + full_path);
+	LOG_DEBUG(_lggr, "normal_full_path: " + normal_full_path);
+	LOG_DEBUG(_lggr, "root_full_path: " + root_full_path);
 
 	// std::string temp_full_path = normal_full_path + "/";
 	if (normal_full_path.compare(0, root_full_path.size(), root_full_path) != 0) {
@@ -53,12 +53,13 @@ bool WebServer::normalizePath(ClientRequest &req, Connection *conn) {
 		prepareResponse(conn, Response::forbidden(conn));
 		return false;
 	}
-	_lggr.debug("[Resp] Normalized full path is safe : " + normal_full_path);
+	LOG_DEBUG(_lggr, "[Resp] Normalized full path is safe : " + normal_full_path);
 	
 	// this should maybe be in the connection info, not in the locConfig
 	if (su::back(req.path) != '/' && su::back(normal_full_path) == '/')
 		normal_full_path = normal_full_path.substr(0, normal_full_path.length() - 1);
 	conn->locConfig->setFullPath(normal_full_path);
+	req.script_path = normal_full_path;
 	return true;
 }
 
@@ -67,14 +68,14 @@ bool WebServer::processValidRequestChecks(ClientRequest &req, Connection *conn)
 
 	// check if RETURN directive in the matched location
 	if (conn->locConfig->hasReturn() && conn->locConfig->path == req.path) {
-		_lggr.info("[Resp] The matched location has a return directive.");
+		LOG(_lggr, Logger::INFO, "[Resp] The matched location has a return directive.");
 		uint16_t code = conn->locConfig->return_code;
 		std::string target = conn->locConfig->return_target;
 		prepareResponse(conn, respReturnDirective(conn, code, target));
 		return false;
 	}
 
-	_lggr.debug("[Resp] No return directive (or no exact match)");
+	LOG_DEBUG(_lggr, "[Resp] No return directive (or no exact match)");
 	
 	// method allowed?
 	if (!conn->locConfig->hasMethod(req.method)) {
@@ -83,8 +84,8 @@ bool WebServer::processValidRequestChecks(ClientRequest &req, Connection *conn)
 		prepareResponse(conn, Response::methodNotAllowed(conn, conn->locConfig->getAllowedMethodsString()));
 		return false;
 	}
-	_lggr.debug("[Resp] Method " + req.method + " is allowed (allowed: " 
-		         + conn->locConfig->getAllowedMethodsString() + ")");
+	LOG_DEBUG(_lggr, "[Resp] Method " + req.method + " is allowed (allowed: " 
+		              + conn->locConfig->getAllowedMethodsString() + ")");
 
 	if (req.content_length == -1 && req.chunked_encoding == false && req.method != "GET") {
 		_lggr.error("No content length, not chunked");
@@ -104,7 +105,7 @@ bool WebServer::processValidRequestChecks(ClientRequest &req, Connection *conn)
 		return false;
 	}
 	if (req.content_length == -1) {
-		_lggr.logWithPrefix(Logger::DEBUG, "HTTP", "No request content length -> ok.");
+		LOG_DEBUG_PREFIX(_lggr, "HTTP", "No request content length -> ok.");
 	} else {
 		_lggr.logWithPrefix(
 		    Logger::DEBUG, "HTTP",
@@ -19,8 +19,10 @@
 bool WebServer::handleCompleteRequest(Connection *conn) {
     processRequest(conn);
 
-    _lggr.debug("Request was processed. Read buffer will be cleaned");
+    LOG_DEBUG(_lggr, "Request was processed. Read buffer will be cleaned");
     conn->read_buffer.clear();
+    conn->body_data.clear(); // or the next body on the connection is appended to this one
+    conn->body_bytes_read = 0;
     conn->request_count++;
     conn->updateActivity();
     return true;
@@ -31,18 +33,18 @@ bool WebServer::isRequestComplete(Connection *conn) {
     switch (conn->state) {
 
     case Connection::READING_HEADERS:
-        _lggr.debug("isRequestComplete->READING_HEADERS");
+        LOG_DEBUG(_lggr, "isRequestComplete->READING_HEADERS");
         return isHeadersComplete(conn);
 
     case Connection::READING_BODY:
-        _lggr.debug("isRequestComplete->READING_BODY");
-        _lggr.debug(
-            su::to_string(conn->content_length - static_cast<ssize_t>(conn->body_data.size())) +
-            " bytes left to receive");
+        LOG_DEBUG(_lggr, "isRequestComplete->READING_BODY");
+        LOG_DEBUG(_lggr, su::to_string(conn->content_length -
+                                       static_cast<ssize_t>(conn->body_data.size())) +
+                             " bytes left to receive");
 
         if (static_cast<ssize_t>(conn->body_data.size()) == conn->content_length) {
-            _lggr.debug("Read full content-length: " + su::to_string(conn->body_data.size()) +
-                        " bytes received");
+            LOG_DEBUG(_lggr, "Read full content-length: " + su::to_string(conn->body_data.size()) +
+                             " bytes received");
             conn->state = Connection::REQUEST_COMPLETE;
             reconstructRequest(conn);
             return true;
@@ -50,24 +52,24 @@ bool WebServer::isRequestComplete(Connection *conn) {
         return false;
 
     case Connection::READING_CHUNK_SIZE:
-        _lggr.debug("isRequestComplete->READING_CHUNK_SIZE");
+        LOG_DEBUG(_lggr, "isRequestComplete->READING_CHUNK_SIZE");
         return processChunkSize(conn);
 
     case Connection::READING_CHUNK_DATA:
-        _lggr.debug("isRequestComplete->READING_CHUNK_DATA");
+        LOG_DEBUG(_lggr, "isRequestComplete->READING_CHUNK_DATA");
         return processChunkData(conn);
 
     case Connection::READING_TRAILER:
-        _lggr.debug("isRequestComplete->READING_TRAILER");
+        LOG_DEBUG(_lggr, "isRequestComplete->READING_TRAILER");
         return processTrailer(conn);
 
     case Connection::REQUEST_COMPLETE:
     case Connection::CHUNK_COMPLETE:
-        _lggr.debug("isRequestComplete->REQUEST_COMPLETE");
+        LOG_DEBUG(_lggr, "isRequestComplete->REQUEST_COMPLETE");
         return true;
 
     default:
-        _lggr.debug("isRequestComplete->default");
+        LOG_DEBUG(_lggr, "isRequestComplete->default");
         return false;
     }
 }
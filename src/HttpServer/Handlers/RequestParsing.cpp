@@ -14,20 +14,22 @@
 #include "src/HttpServer/Structs/Connection.hpp"
 #include "src/HttpServer/Structs/Response.hpp"
 #include "src/HttpServer/Structs/WebServer.hpp"
+#include "src/Utils/Probes.hpp"
 #include "src/Utils/ServerUtils.hpp"
 
 bool WebServer::isHeadersComplete(Connection *conn) {
-    _lggr.debug("isHeadersComplete");
+    LOG_DEBUG(_lggr, "isHeadersComplete");
     std::string temp = conn->read_buffer;
     size_t header_end = conn->read_buffer.find("\r\n\r\n");
     if (header_end == std::string::npos) {
-        _lggr.debug("[HEADER CHECK] INCOMPLETE returning false");
+        LOG_DEBUG(_lggr, "[HEADER CHECK] INCOMPLETE returning false");
         return false;
     }
 
     // Headers are complete
     std::string headers = conn->read_buffer.substr(0, header_end + 4);
     std::string remaining_data = conn->read_buffer.substr(header_end + 4);
+    noteRequestHead(conn, headers);
 
     // Header request for early headers error detection
     ClientRequest req;
@@ -35,9 +37,11 @@ bool WebServer::isHeadersComplete(Connection *conn) {
 
     // On error: REQUEST_COMPLETE, Prepare Response
     uint16_t error_code = RequestParsingUtils::parseRequestHeaders(headers, req, _lggr);
-    _lggr.debug("[HEADER CHECK] Status post header request parsing : " + su::to_string(error_code));
+    LOG_DEBUG(_lggr,
+              "[HEADER CHECK] Status post header request parsing : " + su::to_string(error_code));
     if (error_code != 0) {
         _lggr.logWithPrefix(Logger::ERROR, "BAD REQUEST", "Malformed or invalid headers");
+        _metrics.parseError();
         prepareResponse(conn, Response(error_code, conn));
         conn->state = Connection::REQUEST_COMPLETE;
         conn->should_close = true;
@@ -50,6 +54,8 @@ bool WebServer::isHeadersComplete(Connection *conn) {
         conn->should_close = true;
         return true;
     }
+    markPhase(conn, Connection::ROUTED);
+    WEBSERV_PROBE2(location__matched, conn->fd, conn->locConfig->path.c_str());
     // Return, Method, Max body
     if (!processValidRequestChecks(req, conn)) {
         conn->state = Connection::REQUEST_COMPLETE;
@@ -62,6 +68,18 @@ bool WebServer::isHeadersComplete(Connection *conn) {
     conn->chunked = req.chunked_encoding;
     conn->content_length = req.content_length;
 
+    // The upstream gets the request now, the body follows while it arrives
+    if (conn->locConfig->hasProxyPass()) {
+        startProxyRequest(conn, remaining_data);
+        return false;
+    }
+
+    // The script starts now and reads the body while it arrives
+    if (streamsCGIBody(req, conn)) {
+        startCGIBody(conn, remaining_data);
+        return false;
+    }
+
     if (!conn->chunked) { // Store remaining data as binary body data for Content-Length requests
 
         if (!remaining_data.empty() && conn->content_length > 0) {
@@ -71,9 +89,10 @@ bool WebServer::isHeadersComplete(Connection *conn) {
                                                                            remaining_data.size()));
             conn->body_bytes_read = conn->body_data.size();
         }
-        _lggr.debug("Request POST HEADER content length: " + su::to_string(conn->content_length));
-        _lggr.debug("Request POST HEADER remaining data size: " +
-                    su::to_string(remaining_data.size()));
+        LOG_DEBUG(_lggr,
+                  "Request POST HEADER content length: " + su::to_string(conn->content_length));
+        LOG_DEBUG(_lggr, "Request POST HEADER remaining data size: " +
+                         su::to_string(remaining_data.size()));
 
         // ERROR handling if Body present when it should not
         if (conn->content_length <= 0 && conn->body_bytes_read != 0) {
@@ -96,7 +115,7 @@ bool WebServer::isHeadersComplete(Connection *conn) {
             if (static_cast<ssize_t>(conn->body_data.size()) == conn->content_length) {
                 conn->state = Connection::REQUEST_COMPLETE;
                 // req.body = reconstructRequest(conn);
-                _lggr.debug("1 req.body" + req.body);
+                LOG_DEBUG(_lggr, "1 req.body" + req.body);
                 return true;
             }
             if (static_cast<ssize_t>(conn->body_data.size()) > conn->content_length) {
@@ -143,8 +162,8 @@ bool WebServer::reconstructRequest(Connection *conn) {
         reconstructed_request.append(reinterpret_cast<const char *>(&conn->body_data[0]),
                                      body_size);
 
-        _lggr.debug("Reconstructed request with " + su::to_string(body_size) +
-                    " bytes of body data");
+        LOG_DEBUG(_lggr, "Reconstructed request with " + su::to_string(body_size) +
+                         " bytes of body data");
     }
 
     conn->read_buffer = reconstructed_request;
@@ -161,9 +180,9 @@ bool WebServer::reconstructRequest(Connection *conn) {
 
 // Deprecated
 bool WebServer::parseRequest(Connection *conn, ClientRequest &req) {
-    _lggr.debug("Parsing request: " + conn->read_buffer);
+    LOG_DEBUG(_lggr, "Parsing request: " + conn->read_buffer);
     uint16_t error_code = RequestParsingUtils::parseRequest(conn->read_buffer, req, _lggr);
-    _lggr.debug("Error code post request parsing : " + su::to_string(error_code));
+    LOG_DEBUG(_lggr, "Error code post request parsing : " + su::to_string(error_code));
     if (error_code != 0) {
         _lggr.error("Parsing of the request failed.");
         prepareResponse(conn, Response(error_code, conn));
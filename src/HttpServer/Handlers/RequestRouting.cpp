@@ -17,7 +17,7 @@
 #include "src/Utils/ServerUtils.hpp"
 
 void WebServer::processRequest(Connection *conn) {
-    _lggr.info("Processing request from fd: " + su::to_string(conn->fd));
+    LOG(_lggr, Logger::INFO, "Processing request from fd: " + su::to_string(conn->fd));
 
     ClientRequest req = conn->parsed_request;
 
@@ -25,23 +25,23 @@ void WebServer::processRequest(Connection *conn) {
     if (req.chunked_encoding) {
         // For chunked requests, use the reconstructed chunk data
         req.body = conn->chunk_data;
-        _lggr.debug("Using chunked body data: " + su::to_string(req.body.length()) + " bytes");
+        LOG_DEBUG(_lggr, "Using chunked body data: " + su::to_string(req.body.length()) + " bytes");
     } else if (!req.chunked_encoding && conn->headers_buffer.size() <= conn->read_buffer.size()) {
         req.body = conn->read_buffer.substr(conn->headers_buffer.size());
     } else {
-        _lggr.debug("No body data or headers not properly parsed");
+        LOG_DEBUG(_lggr, "No body data or headers not properly parsed");
         req.body = "";
     }
 
-    _lggr.debug("req.body: " + req.body);
-    _lggr.debug("req.headers: " + conn->headers_buffer);
-    _lggr.debug("req.uri: " + req.uri);
+    LOG_DEBUG(_lggr, "req.body: " + req.body);
+    LOG_DEBUG(_lggr, "req.headers: " + conn->headers_buffer);
+    LOG_DEBUG(_lggr, "req.uri: " + req.uri);
 
     // For chunked requests: use of chunk_data length for content verification
     size_t actual_body_size = req.chunked_encoding ? conn->chunk_data.size() : req.body.size();
 
-    _lggr.debug("[Resp] Payload vs content size: " + su::to_string(req.content_length) +
-                ", payload size: " + su::to_string(actual_body_size));
+    LOG_DEBUG(_lggr, "[Resp] Payload vs content size: " + su::to_string(req.content_length) +
+                     ", payload size: " + su::to_string(actual_body_size));
 
     // Only verify content-length for non-chunked requests
     if (!req.chunked_encoding && req.content_length >= 0 &&
@@ -52,20 +52,34 @@ void WebServer::processRequest(Connection *conn) {
         return;
     }
 
-    _lggr.debug("FD " + su::to_string(req.clfd) + " ClientRequest {" + req.toString() + "}");
+    LOG_DEBUG(_lggr, "FD " + su::to_string(req.clfd) + " ClientRequest {" + req.toString() + "}");
     // process the request
     processValidRequest(req, conn);
 }
 
 void WebServer::processValidRequest(ClientRequest &req, Connection *conn) {
+    markPhase(conn, Connection::HANDLER_START);
+    if (conn->locConfig->hasMetrics()) {
+        prepareResponse(conn, respMetrics(conn));
+        return;
+    }
+
+    // A handler module answers the whole location, files or not
+    if (conn->locConfig->hasHandler()) {
+        uint16_t exit_code = handleModuleRequest(req, conn);
+        if (exit_code)
+            prepareResponse(conn, Response(exit_code, conn));
+        return;
+    }
 
-    const std::string &full_path = conn->locConfig->getFullPath();
-    _lggr.debug("[Resp] The matched location is an exact match: " +
-                su::to_string(conn->locConfig->is_exact_()));
+    const std::string &full_path = req.script_path;
+    LOG_DEBUG(_lggr, "[Resp] The matched location is an exact match: " +
+                     su::to_string(conn->locConfig->is_exact_()));
 
     // File system check
     FileType file_type = checkFileType(full_path);
-    _lggr.debug("[Resp] checkFileType for " + full_path + " is " + fileTypeToString(file_type));
+    LOG_DEBUG(_lggr,
+              "[Resp] checkFileType for " + full_path + " is " + fileTypeToString(file_type));
 
     if (file_type == NOT_FOUND_404 && su::back(full_path) == '/') {
         std::string pathWithoutSlash = full_path.substr(0, full_path.length() - 1);
@@ -80,7 +94,7 @@ void WebServer::processValidRequest(ClientRequest &req, Connection *conn) {
         return;
 
     // we redirect if uri is missing the / (and vice versa), not the resolved path
-    bool end_slash = (!req.uri.empty() && su::back(req.uri) == '/');
+    bool end_slash = (!req.path.empty() && su::back(req.path) == '/');
     // Route based on file type and request format
     if (file_type == ISDIR) {
         handleDirectoryRequest(req, conn, end_slash);
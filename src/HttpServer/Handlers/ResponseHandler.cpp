@@ -14,6 +14,7 @@
 #include "src/HttpServer/Structs/Connection.hpp"
 #include "src/HttpServer/Structs/Response.hpp"
 #include "src/HttpServer/Structs/WebServer.hpp"
+#include "src/Utils/Probes.hpp"
 
 ssize_t WebServer::prepareResponse(Connection *conn, const Response &resp) {
 	if (conn->response_ready) {
@@ -23,34 +24,87 @@ ssize_t WebServer::prepareResponse(Connection *conn, const Response &resp) {
 		_lggr.error("Trying to prepare response: " + resp.toShortString());
 		return -1;
 	}
-	_lggr.debug("Saving a response [" + su::to_string(resp.status_code) + "] for fd " +
-	            su::to_string(conn->fd));
-	_lggr.debug("Response :" + resp.toShortString());
+	if (conn->body_streaming)
+		abandonRequestBody(conn);
+	LOG_DEBUG(_lggr, "Saving a response [" + su::to_string(resp.status_code) + "] for fd " +
+	                 su::to_string(conn->fd));
+	LOG_DEBUG(_lggr, "Response :" + resp.toShortString());
 	conn->response = resp;
 	conn->response_ready = true;
+	conn->updateActivity(); // CONNECTION_TO counts again from the answer, however long it took
+	markPhase(conn, Connection::RESPONSE_READY);
+	WEBSERV_PROBE2(response__prepared, conn->fd, resp.status_code);
 	return conn->response.toString().size();
 }
 
 bool WebServer::sendResponse(Connection *conn) {
-	std::string raw_response;
+	if (!conn->response_started) {
+		LOG_DEBUG(_lggr, "Sending response [" + conn->response.toShortString() +
+		                 "] back to fd: " + su::to_string(conn->fd));
+		markPhase(conn, Connection::FIRST_SENT);
+		if (conn->upstream_start)
+			conn->upstream_time = conn->phases[Connection::FIRST_SENT] - conn->upstream_start;
+		if (conn->servConfig->hasServerTiming())
+			conn->response.setHeader("Server-Timing", phaseTimings(*conn, true));
+		if (conn->cgi_response != "") {
+			conn->send_buffer = conn->cgi_response;
+			conn->cgi_response = "";
+		} else {
+			conn->send_buffer = conn->response.toString();
+			conn->response.reset();
+		}
+		conn->send_offset = 0;
+		conn->response_started = true;
+		conn->sent_status = std::atoi(conn->send_buffer.c_str() + 9); // "HTTP/1.1 200"
+	}
 
-	_lggr.debug("Current state of response [" + conn->response.toShortString());
-	_lggr.debug("Sending response [" + conn->response.toShortString() +
-	            "] back to fd: " + su::to_string(conn->fd));
-	std::cout << conn->response.toShortString() << "] back to fd: " << su::to_string(conn->fd) << std::endl;
-	
-	if (conn->cgi_response != "") {
-		raw_response = conn->cgi_response;
-		conn->cgi_response = "";
-	} else {
-		raw_response = conn->response.toString();
-		conn->response.reset();
+	// Refill from the body stream once everything queued so far was sent
+	if (conn->send_offset == conn->send_buffer.size() && conn->body_stream) {
+		conn->send_buffer.clear();
+		conn->send_offset = 0;
+		size_t moved = 0;
+		ResponseStream::Status status =
+		    conn->body_stream->direct()
+		        ? conn->body_stream->transfer(conn->fd, moved)
+		        : conn->body_stream->fill(conn->send_buffer, STREAM_CHUNK_SIZE);
+		conn->bytes_sent += moved;
+		_metrics.sent(moved);
+		if (moved)
+			conn->updateActivity();
+		if (status == ResponseStream::FAILED) {
+			_lggr.error("Response stream failed for fd: " + su::to_string(conn->fd));
+			return false;
+		}
+		if (status == ResponseStream::DONE) {
+			delete conn->body_stream;
+			conn->body_stream = NULL;
+		}
+		if (status == ResponseStream::PENDING && conn->send_buffer.empty()) {
+			epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLRDHUP);
+			return true;
+		}
 	}
-	bool send_success = send(conn->fd, raw_response.c_str(), raw_response.size(), MSG_NOSIGNAL) != -1;
-	if (!send_success) {
-		return false;
+
+	size_t pending = conn->send_buffer.size() - conn->send_offset;
+	if (pending > 0) {
+		ssize_t sent = send(conn->fd, conn->send_buffer.data() + conn->send_offset, pending,
+		                    MSG_NOSIGNAL);
+		if (sent == -1)
+			return false;
+		conn->send_offset += sent;
+		conn->bytes_sent += sent;
+		_metrics.sent(sent);
+		conn->updateActivity(); // a slow reader is not an idle one
+		if (conn->send_offset < conn->send_buffer.size() || conn->body_stream)
+			return true; // wait for the next EPOLLOUT
+	} else if (conn->body_stream) {
+		return true;
 	}
 
+	markPhase(conn, Connection::LAST_SENT);
+	WEBSERV_PROBE3(response__sent, conn->fd, conn->sent_status, conn->bytes_sent);
+	recordRequest(conn);
+	conn->resetResponseState();
 	epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLIN);
 	conn->response_ready = false;
 	conn->state = Connection::READING_HEADERS;
@@ -59,32 +113,32 @@ bool WebServer::sendResponse(Connection *conn) {
 
 // Serving the index file or listing if possible
 Response WebServer::respDirectoryRequest(Connection *conn, const std::string &fullDirPath) {
-	_lggr.debug("Handling directory request: " + fullDirPath);
+	LOG_DEBUG(_lggr, "Handling directory request: " + fullDirPath);
 
 	// Try to serve index file
 	if (!conn->locConfig->index.empty()) {
 		std::string fullIndexPath = fullDirPath + conn->locConfig->index;
-		_lggr.debug("Trying index file: " + fullIndexPath);
+		LOG_DEBUG(_lggr, "Trying index file: " + fullIndexPath);
 		if (checkFileType(fullIndexPath.c_str()) == ISREG) {
-			_lggr.debug("Found index file, serving: " + fullIndexPath);
+			LOG_DEBUG(_lggr, "Found index file, serving: " + fullIndexPath);
 			return respFileRequest(conn, fullIndexPath);
 		}
 	}
 
 	// Handle autoindex
 	if (conn->locConfig->autoindex) {
-		_lggr.debug("Autoindex on, generating directory listing");
+		LOG_DEBUG(_lggr, "Autoindex on, generating directory listing");
 		return generateDirectoryListing(conn, fullDirPath);
 	}
 
 	// No index file and no autoindex
-	_lggr.debug("No index file, autoindex disabled");
+	LOG_DEBUG(_lggr, "No index file, autoindex disabled");
 	return Response::notFound(conn);
 }
 
 // serving the file if found
 Response WebServer::respFileRequest(Connection *conn, const std::string &fullFilePath) {
-	_lggr.debug("Handling file request: " + fullFilePath);
+	LOG_DEBUG(_lggr, "Handling file request: " + fullFilePath);
 	// Read file content
 	std::string content = getFileContent(fullFilePath);
 	// this check is redondant as it has already been checked
@@ -96,13 +150,13 @@ Response WebServer::respFileRequest(Connection *conn, const std::string &fullFil
 	Response resp(200, content);
 	resp.setContentType(detectContentType(fullFilePath));
 	resp.setContentLength(content.length());
-	_lggr.debug("Successfully serving file: " + fullFilePath + " (" +
-	            su::to_string(content.length()) + " bytes)");
+	LOG_DEBUG(_lggr, "Successfully serving file: " + fullFilePath + " (" +
+	                 su::to_string(content.length()) + " bytes)");
 	return resp;
 }
 
 Response WebServer::respReturnDirective(Connection *conn, uint16_t code, std::string target) {
-	_lggr.debug("Handling return directive '" + su::to_string(code) + "' to " + target);
+	LOG_DEBUG(_lggr, "Handling return directive '" + su::to_string(code) + "' to " + target);
 
 	if (code > 399)
 		return Response(code, conn);
@@ -123,7 +177,7 @@ Response WebServer::respReturnDirective(Connection *conn, uint16_t code, std::st
 	resp.body = html.str();
 	resp.setContentType("text/html");
 	resp.setContentLength(resp.body.length());
-	_lggr.debug("Generated redirect response");
+	LOG_DEBUG(_lggr, "Generated redirect response");
 
 	return resp;
 }
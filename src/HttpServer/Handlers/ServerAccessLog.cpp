@@ -0,0 +1,251 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerAccessLog.cpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/12 09:41:17 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/12 09:41:17 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "src/HttpServer/HttpServer.hpp"
+#include "src/HttpServer/Structs/Connection.hpp"
+#include "src/HttpServer/Structs/WebServer.hpp"
+#include "src/Logger/AccessLog.hpp"
+#include "src/Logger/TraceCapture.hpp"
+#include "src/Utils/Probes.hpp"
+
+// The slow logs and the captures are buffered, flushed and reopened along with
+// the access logs
+bool WebServer::openAccessLogs(std::vector<ServerConfig> &servers) {
+	for (std::vector<ServerConfig>::iterator sc = servers.begin(); sc != servers.end(); ++sc) {
+		const std::string &trace = sc->getCaptureTrace();
+		if (!trace.empty() && !_captures.count(trace)) {
+			TraceCapture *capture = new TraceCapture(trace, sc->captureBodies());
+			if (!capture->open()) {
+				_lggr.logWithPrefix(Logger::ERROR, "Capture",
+				                    "Failed to open " + trace + ": " + strerror(errno));
+				delete capture;
+				return (false);
+			}
+			_captures[trace] = capture;
+		}
+		const std::string paths[] = {sc->getAccessLog(), sc->getSlowLog()};
+		for (size_t i = 0; i < 2; ++i) {
+			if (paths[i].empty() || _access_logs.count(paths[i]))
+				continue;
+			AccessLog *log = new AccessLog(paths[i]);
+			if (!log->open()) {
+				_lggr.logWithPrefix(Logger::ERROR, "Access log",
+				                    "Failed to open " + paths[i] + ": " + strerror(errno));
+				delete log;
+				return (false);
+			}
+			_access_logs[paths[i]] = log;
+		}
+	}
+	return (true);
+}
+
+void WebServer::noteRequestStart(Connection *conn) {
+	markPhase(conn, Connection::FIRST_BYTE);
+}
+
+// Value of a header in the raw block, matched case-insensitively
+static std::string headerValue(const std::string &headers, const char *name) {
+	size_t len = strlen(name);
+	size_t pos = headers.find("\r\n");
+	while (pos != std::string::npos && pos + 2 < headers.size()) {
+		size_t start = pos + 2;
+		pos = headers.find("\r\n", start);
+		if (pos == std::string::npos || pos - start <= len || headers[start + len] != ':' ||
+		    strncasecmp(headers.c_str() + start, name, len) != 0)
+			continue;
+		size_t value = headers.find_first_not_of(" \t", start + len + 1);
+		return (value < pos ? headers.substr(value, pos - value) : "");
+	}
+	return ("");
+}
+
+// The location of the previous request is forgotten until this one matches its own
+void WebServer::noteRequestHead(Connection *conn, const std::string &headers) {
+	if (conn->config && conn->config != _config)
+		rebindConnection(conn);
+	conn->locConfig = NULL;
+	conn->request_line = headers.substr(0, headers.find("\r\n"));
+	markPhase(conn, Connection::FIRST_BYTE);
+	markPhase(conn, Connection::HEADERS_DONE);
+	WEBSERV_PROBE2(request__parsed, conn->fd, conn->request_line.c_str());
+	if (conn->servConfig->getAccessLog().empty())
+		return;
+	conn->referer = headerValue(headers, "Referer");
+	conn->user_agent = headerValue(headers, "User-Agent");
+}
+
+void WebServer::noteUpstreamStart(Connection *conn) {
+	if (conn->upstream_start == 0)
+		conn->upstream_start = monotonicTime();
+}
+
+// Quotes and control characters as \xHH (combined) or JSON escapes
+static void appendEscaped(std::string &out, const std::string &value, bool json) {
+	static const char hex[] = "0123456789ABCDEF";
+	for (size_t i = 0; i < value.size(); ++i) {
+		unsigned char c = value[i];
+		if (json && (c == '"' || c == '\\')) {
+			out += '\\';
+			out += c;
+		} else if (c < 0x20 || c == 0x7f || (!json && (c == '"' || c == '\\'))) {
+			out += json ? "\\u00" : "\\x";
+			out += hex[c >> 4];
+			out += hex[c & 15];
+		} else {
+			out += c;
+		}
+	}
+}
+
+// Local time with its UTC offset, formatted once per second for each format
+static const std::string &accessTime(bool json) {
+	static time_t stamped[2] = {0, 0};
+	static std::string stamp[2];
+	time_t now = time(NULL);
+	if (stamped[json] != now) {
+		struct tm local;
+		localtime_r(&now, &local);
+		long offset = local.tm_gmtoff / 60;
+		char buf[64];
+		size_t len = strftime(buf, sizeof(buf), json ? "%Y-%m-%dT%H:%M:%S" : "%d/%b/%Y:%H:%M:%S ",
+		                      &local);
+		snprintf(buf + len, sizeof(buf) - len, "%c%02ld%02ld", offset < 0 ? '-' : '+',
+		         labs(offset) / 60, labs(offset) % 60);
+		stamp[json] = buf;
+		stamped[json] = now;
+	}
+	return (stamp[json]);
+}
+
+static std::string seconds(double value) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.3f", value);
+	return (buf);
+}
+
+static void jsonField(std::string &line, const char *name, const std::string &value) {
+	line += line.size() > 1 ? ",\"" : "\"";
+	line += name;
+	line += "\":\"";
+	appendEscaped(line, value, true);
+	line += '"';
+}
+
+// combined: addr - - [time] "request" status bytes "referer" "agent" rt=.. urt=.. rc=..
+std::string WebServer::accessLine(const Connection &conn, uint16_t status, double request_time,
+                                  bool json) {
+	if (json)
+		return (jsonAccessLine(conn, status, request_time));
+	std::string line = conn.client_addr + " - - [" + accessTime(false) + "] \"";
+	appendEscaped(line, conn.request_line, false);
+	line += "\" " + su::to_string(status) + " " + su::to_string(conn.bytes_sent) + " \"";
+	appendEscaped(line, conn.referer.empty() ? "-" : conn.referer, false);
+	line += "\" \"";
+	appendEscaped(line, conn.user_agent.empty() ? "-" : conn.user_agent, false);
+	line += "\" rt=" + seconds(request_time) + " urt=" +
+	        (conn.upstream_time < 0 ? "-" : seconds(conn.upstream_time)) +
+	        " rc=" + su::to_string(conn.request_count);
+	return (line);
+}
+
+std::string WebServer::jsonAccessLine(const Connection &conn, uint16_t status,
+                                      double request_time) {
+	const std::string &request = conn.request_line;
+	size_t method_end = request.find(' ');
+	size_t uri_end = request.rfind(' ');
+	std::string method = request.substr(0, method_end);
+	std::string uri = method_end == std::string::npos || uri_end <= method_end
+	                      ? ""
+	                      : request.substr(method_end + 1, uri_end - method_end - 1);
+
+	std::string line = "{";
+	jsonField(line, "time", accessTime(true));
+	jsonField(line, "client", conn.client_addr);
+	jsonField(line, "method", method);
+	jsonField(line, "uri", uri);
+	line += ",\"status\":" + su::to_string(status);
+	line += ",\"bytes\":" + su::to_string(conn.bytes_sent);
+	line += ",\"request_time\":" + seconds(request_time);
+	line += ",\"upstream_time\":" +
+	        (conn.upstream_time < 0 ? std::string("null") : seconds(conn.upstream_time));
+	line += ",\"requests\":" + su::to_string(conn.request_count);
+	jsonField(line, "referer", conn.referer);
+	jsonField(line, "user_agent", conn.user_agent);
+	line += "}";
+	return (line);
+}
+
+void WebServer::logAccess(Connection *conn, uint16_t status, double request_time) {
+	std::map<std::string, AccessLog *>::iterator it =
+	    _access_logs.find(conn->servConfig->getAccessLog());
+	if (it == _access_logs.end())
+		return;
+	bool json = conn->servConfig->getAccessLogFormat() == "json";
+	it->second->append(accessLine(*conn, status, request_time, json));
+}
+
+// [time] addr "request" status wait=.. read=.. ... total=.. (milliseconds)
+void WebServer::logSlowRequest(Connection *conn, uint16_t status, double request_time) {
+	if (request_time < conn->servConfig->getSlowLogThreshold())
+		return;
+	std::map<std::string, AccessLog *>::iterator it =
+	    _access_logs.find(conn->servConfig->getSlowLog());
+	if (it == _access_logs.end())
+		return;
+	std::string line = "[" + accessTime(false) + "] " + conn->client_addr + " \"";
+	appendEscaped(line, conn->request_line, false);
+	line += "\" " + su::to_string(status) + " " + phaseTimings(*conn, false);
+	it->second->append(line);
+}
+
+// Writes the buffers that waited long enough, the others fill up further
+void WebServer::flushAccessLogs() {
+	time_t now = getCurrentTime();
+	for (std::map<std::string, AccessLog *>::iterator it = _access_logs.begin();
+	     it != _access_logs.end(); ++it)
+		it->second->tick(now);
+	for (std::map<std::string, TraceCapture *>::iterator it = _captures.begin();
+	     it != _captures.end(); ++it)
+		it->second->tick(now);
+}
+
+// SIGUSR1: the files were moved away by logrotate or similar
+void WebServer::reopenAccessLogs() {
+	for (std::map<std::string, AccessLog *>::iterator it = _access_logs.begin();
+	     it != _access_logs.end(); ++it) {
+		if (it->second->reopen())
+			LOG_PREFIX(_lggr, Logger::INFO, "Access log", "Reopened " + it->first);
+		else
+			_lggr.logWithPrefix(Logger::ERROR, "Access log",
+			                    "Failed to reopen " + it->first + ": " + strerror(errno));
+	}
+	for (std::map<std::string, TraceCapture *>::iterator it = _captures.begin();
+	     it != _captures.end(); ++it) {
+		if (it->second->reopen())
+			LOG_PREFIX(_lggr, Logger::INFO, "Capture", "Started a new trace in " + it->first);
+		else
+			_lggr.logWithPrefix(Logger::ERROR, "Capture",
+			                    "Failed to reopen " + it->first + ": " + strerror(errno));
+	}
+}
+
+void WebServer::closeAccessLogs() {
+	for (std::map<std::string, AccessLog *>::iterator it = _access_logs.begin();
+	     it != _access_logs.end(); ++it)
+		delete it->second; // flushes
+	_access_logs.clear();
+	for (std::map<std::string, TraceCapture *>::iterator it = _captures.begin();
+	     it != _captures.end(); ++it)
+		delete it->second;
+	_captures.clear();
+}
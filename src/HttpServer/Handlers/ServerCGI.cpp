@@ -6,79 +6,535 @@
 /*   By: htharrau <htharrau@student.42.fr>          +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/08/08 11:38:44 by jalombar          #+#    #+#             */
-/*   Updated: 2025/08/23 23:43:00 by htharrau         ###   ########.fr       */
+/*   Updated: 2025/09/04 16:02:11 by htharrau         ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
+#include "src/CGI/CGICache.hpp"
 #include "src/HttpServer/HttpServer.hpp"
+#include "src/HttpServer/Structs/CGIStream.hpp"
 #include "src/HttpServer/Structs/Connection.hpp"
 #include "src/HttpServer/Structs/Response.hpp"
 #include "src/HttpServer/Structs/WebServer.hpp"
+#include "src/Utils/Probes.hpp"
 
-void printCGIResponse(const std::string &cgi_output) {
-	std::istringstream response_stream(cgi_output);
-	std::string line;
-	bool in_body = false;
+void WebServer::handleCGIEvent(int fd, uint32_t event_mask) {
+	std::map<int, std::pair<CGI *, Connection *> >::iterator it = _cgi_pool.find(fd);
+	if (it == _cgi_pool.end())
+		return;
 
-	std::cout << "PRINTING CGI OUTPUT: \n";
-	while (std::getline(response_stream, line)) {
-		if (!line.empty() && line[line.size() - 1] == '\r')
-			line.erase(line.size() - 1);
+	CGI *cgi = it->second.first;
+	if (fd == cgi->getInputFd())
+		handleCGIInput(cgi, it->second.second, event_mask);
+	else
+		handleCGIOutput(cgi, it->second.second, event_mask);
 
-		if (!in_body && line.empty()) {
-			in_body = true;
-			std::cout << std::endl;
-			continue;
-		}
+	if (cgi->isComplete())
+		finalizeCGI(cgi->getPid());
+}
 
-		std::cout << line << std::endl;
+// stdin became writable: feed the next slice of the request body
+void WebServer::handleCGIInput(CGI *cgi, Connection *conn, uint32_t event_mask) {
+	errno = 0;
+	ssize_t written = cgi->writeInput();
+	if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+	if (written < 0 || (event_mask & EPOLLERR)) {
+		_lggr.logWithPrefix(Logger::WARNING, "CGI",
+		                    "Failed to write request body to CGI script: " +
+		                        std::string(strerror(errno)));
 	}
+	if (written < 0 || (!cgi->hasPendingInput() && !cgi->expectsInput()))
+		releaseCGIFd(cgi->getInputFd());
+	else if (!cgi->hasPendingInput()) // the rest of the body is still on its way
+		epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, cgi->getInputFd(), NULL);
+
+	if (conn && conn->body_paused && conn->body_sink == cgi && !cgi->hasPendingInput())
+		resumeRequestBody(conn);
 }
 
-bool WebServer::prepareCGIResponse(CGI *cgi, Connection *conn) {
-	Logger logger;
-	std::string cgi_output;
-	char buffer[4096];
-	ssize_t bytes_read;
-	int resp_code = 200;
+// Appends a slice of a streamed body, written right away while the pipe takes it
+void WebServer::feedCGIInput(CGI *cgi, const std::string &data, bool last) {
+	if (cgi->getInputFd() == -1)
+		return; // the script stopped reading, the rest is dropped
+	bool idle = !cgi->hasPendingInput();
+	cgi->appendInput(data);
+	if (last)
+		cgi->endInput();
+	if (!idle)
+		return; // EPOLLOUT is already watched
 
-	while ((bytes_read = read(cgi->getOutputFd(), buffer, sizeof(buffer))) > 0) {
-		cgi_output.append(buffer, bytes_read);
-		if (cgi_output.size() > 5) {
-			std::string s = cgi_output.substr(2, 3);
-			std::stringstream ss(s);
-			ss >> resp_code;
-			if (resp_code > 201) {
-				close(cgi->getOutputFd());
-				return (prepareResponse(conn, Response(resp_code)));
+	errno = 0;
+	ssize_t written = cgi->writeInput();
+	if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+		_lggr.logWithPrefix(Logger::WARNING, "CGI",
+		                    "Failed to write request body to CGI script: " +
+		                        std::string(strerror(errno)));
+		releaseCGIFd(cgi->getInputFd());
+	} else if (cgi->hasPendingInput()) {
+		epollManage(EPOLL_CTL_ADD, cgi->getInputFd(), EPOLLOUT);
+	} else if (!cgi->expectsInput()) {
+		releaseCGIFd(cgi->getInputFd());
+	}
+}
+
+// stdout became readable (or hung up): pass the output on as it arrives
+void WebServer::handleCGIOutput(CGI *cgi, Connection *conn, uint32_t event_mask) {
+	(void)event_mask;
+	if (conn && cgi->isStreaming()) {
+		CGIStream *stream = static_cast<CGIStream *>(conn->body_stream);
+		if (stream->direct()) {
+			// The body is spliced into the socket, wake the client up instead of reading
+			epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, cgi->getOutputFd(), NULL);
+			stream->pause();
+			epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+			return;
+		}
+	}
+	cgi->readOutput();
+	if (!cgi->getCoalesceKey().empty() && cgi->getOutput().size() > CGI_COALESCE_MAX)
+		uncoalesceCGI(cgi, conn);
+	// A coalesced output is kept whole, finalizeCGI() hands it to every waiter
+	if (cgi->getCoalesceKey().empty()) {
+		if (conn)
+			forwardCGIOutput(cgi, conn);
+		else
+			cgi->takeOutput(); // nobody to answer, keep the script from blocking
+	}
+	if (cgi->outputDone())
+		releaseCGIFd(cgi->getOutputFd());
+}
+
+void WebServer::forwardCGIOutput(CGI *cgi, Connection *conn) {
+	if (!cgi->isStreaming()) {
+		size_t sep_len;
+		if (CGIUtils::findHeaderEnd(cgi->getOutput(), sep_len) == std::string::npos) {
+			if (cgi->getOutput().size() > CGI_MAX_HEADER_SIZE) {
+				_lggr.logWithPrefix(Logger::ERROR, "CGI", "CGI response headers too large");
+				failCGIResponse(cgi, conn, 502);
 			}
+			return;
 		}
+		if (!startCGIResponse(cgi, conn))
+			return;
 	}
 
-	// Close cgi script fd
-	close(cgi->getOutputFd());
+	CGIStream *stream = static_cast<CGIStream *>(conn->body_stream);
+	std::string output = cgi->takeOutput();
+	if (!output.empty()) {
+		stream->append(output);
+		conn->updateActivity();
+	}
+	// Backpressure: leave the rest in the pipe until the client drained the stream
+	if (stream->buffered() >= CGIStream::HIGH_WATER && !stream->paused() && !cgi->outputDone()) {
+		epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, cgi->getOutputFd(), NULL);
+		stream->pause();
+	}
+	if (stream->waiting())
+		epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+}
+
+bool WebServer::startCGIResponse(CGI *cgi, Connection *conn) {
+	std::string output = cgi->takeOutput();
+	size_t sep_len;
+	size_t header_end = CGIUtils::findHeaderEnd(output, sep_len);
 
-	if (bytes_read == -1) {
-		logger.logWithPrefix(Logger::ERROR, "CGI", "Error reading from CGI script");
+	Response resp;
+	if (!CGIUtils::parseCGIHeaders(output.substr(0, header_end), resp)) {
+		_lggr.logWithPrefix(Logger::ERROR, "CGI", "Invalid response headers from CGI script");
+		failCGIResponse(cgi, conn, 502);
 		return (false);
 	}
-	std::string resp_body = cgi_output.substr(7);
-	//printCGIResponse(resp_body);
-	return (prepareResponse(conn, Response(resp_code, resp_body)) > 0);
+
+	ssize_t length = -1;
+	if (resp.status_code == 204 || resp.status_code == 304) {
+		length = 0; // no body allowed
+	} else if (resp.headers.find("Content-Length") != resp.headers.end()) {
+		std::istringstream ss(resp.headers["Content-Length"]);
+		ss >> length;
+	} else {
+		resp.setHeader("Transfer-Encoding", "chunked");
+	}
+	if (!cgi->getCacheKey().empty())
+		resp.setHeader("X-Cache", "MISS");
+
+	delete conn->body_stream;
+	// A body kept for cgi_cache has to go through the server
+	int splice_fd = conn->locConfig->cgi_splice && !cgi->capturing() ? cgi->getOutputFd() : -1;
+	CGIStream *stream = new CGIStream(*this, cgi->getPid(), length, splice_fd);
+	conn->body_stream = stream;
+	cgi->setStreaming();
+	stream->append(output.substr(header_end + sep_len));
+	prepareResponse(conn, resp);
+	epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+	return (true);
 }
 
-void WebServer::handleCGIOutput(int fd) {
-	std::map<int, std::pair<CGI *, Connection *> >::iterator it = _cgi_pool.find(fd);
-	if (it == _cgi_pool.end())
+void WebServer::resumeCGIOutput(pid_t pid) {
+	std::map<pid_t, std::pair<CGI *, Connection *> >::iterator it = _cgi_children.find(pid);
+	if (it == _cgi_children.end() || it->second.first->getOutputFd() == -1)
+		return;
+	// The script was waiting on us, its idle time starts over
+	it->second.first->touchOutput();
+	epollManage(EPOLL_CTL_ADD, it->second.first->getOutputFd(), EPOLLIN);
+}
+
+// Answers with an error, or cuts the body short if the headers are out already
+void WebServer::failCGIResponse(CGI *cgi, Connection *conn, uint16_t code) {
+	if (cgi->isStreaming()) {
+		CGIStream *stream = static_cast<CGIStream *>(conn->body_stream);
+		stream->finish(false);
+		if (stream->waiting())
+			epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+	} else {
+		prepareResponse(conn, Response(code, conn));
+		epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+	}
+	cgi->takeOutput();
+
+	std::map<pid_t, std::pair<CGI *, Connection *> >::iterator child =
+	    _cgi_children.find(cgi->getPid());
+	if (child != _cgi_children.end())
+		child->second.second = NULL;
+	for (std::map<int, std::pair<CGI *, Connection *> >::iterator it = _cgi_pool.begin();
+	     it != _cgi_pool.end(); ++it) {
+		if (it->second.first == cgi)
+			it->second.second = NULL;
+	}
+}
+
+// SIGCHLD arrived on the signalfd: reap every child that exited
+void WebServer::handleChildExit() {
+	int status;
+	pid_t pid;
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		if (pid == _upgrade_pid) {
+			upgradeFailed(status);
+			continue;
+		}
+		std::map<pid_t, std::pair<CGI *, Connection *> >::iterator it = _cgi_children.find(pid);
+		if (it == _cgi_children.end())
+			continue;
+		LOG_DEBUG_PREFIX(_lggr, "CGI", "Reaped CGI child " + su::to_string(pid));
+		it->second.first->setExitStatus(status);
+		WEBSERV_PROBE2(cgi__exit, pid, status);
+		if (it->second.first->isComplete())
+			finalizeCGI(pid);
+	}
+}
+
+// Script exited and its output is complete: answer the client and forget it
+void WebServer::finalizeCGI(pid_t pid) {
+	std::map<pid_t, std::pair<CGI *, Connection *> >::iterator it = _cgi_children.find(pid);
+	if (it == _cgi_children.end())
 		return;
 
 	CGI *cgi = it->second.first;
 	Connection *conn = it->second.second;
+	_cgi_children.erase(it);
+	releaseCGIFd(cgi->getInputFd());
+	releaseCGIFd(cgi->getOutputFd());
 
-	_cgi_pool.erase(it);
-	epollManage(EPOLL_CTL_DEL, fd, 0);
-	prepareCGIResponse(cgi, conn);
+	if (!cgi->getCoalesceKey().empty()) {
+		answerCoalescedCGI(cgi, conn);
+	} else if (conn) {
+		int status = cgi->getExitStatus();
+		bool succeeded = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+		if (succeeded && cgi->isStreaming()) {
+			CGIStream *stream = static_cast<CGIStream *>(conn->body_stream);
+			stream->finish(true);
+			if (stream->waiting())
+				epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+		} else {
+			// Child exits with non-zero exit code OR killed by some signal
+			_lggr.logWithPrefix(Logger::ERROR, "CGI",
+			                    succeeded ? "Incomplete output from CGI script"
+			                              : "CGI script failed to execute");
+			failCGIResponse(cgi, conn, 502);
+		}
+	}
+	if (!cgi->getCacheKey().empty())
+		cacheCGIOutput(cgi);
+	LocConfig *loc = cgi->getLocation();
+	_metrics.cgiFinished(loc, monotonicTime() - cgi->getSpawnTime());
 	delete cgi;
+	releaseCGISlot(loc);
+	releaseConfig(configOf(loc));
+}
+
+void WebServer::releaseCGIFd(int fd) {
+	if (fd == -1)
+		return;
+	std::map<int, std::pair<CGI *, Connection *> >::iterator it = _cgi_pool.find(fd);
+	if (it == _cgi_pool.end())
+		return;
+
+	CGI *cgi = it->second.first;
+	_cgi_pool.erase(it);
+	epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	if (fd == cgi->getInputFd())
+		cgi->closeInput();
+	else
+		cgi->closeOutput();
+}
+
+// Runs from the main loop: scripts past their timeouts are stopped and answered with 504
+void WebServer::checkCGITimeouts() {
+	time_t now = getCurrentTime();
+	std::vector<pid_t> expired;
+
+	for (std::map<pid_t, std::pair<CGI *, Connection *> >::iterator it = _cgi_children.begin();
+	     it != _cgi_children.end(); ++it) {
+		CGI *cgi = it->second.first;
+		if (cgi->getSignal() == SIGTERM && !cgi->hasExited() &&
+		    now - cgi->getSignalTime() >= CGI_KILL_GRACE) {
+			_lggr.logWithPrefix(Logger::WARNING, "CGI",
+			                    "CGI child " + su::to_string(it->first) +
+			                        " ignored SIGTERM, killing it");
+			kill(it->first, SIGKILL);
+			cgi->setSignal(SIGKILL, now);
+		}
+		if (cgi->timedOut() || cgi->getSignal())
+			continue;
+
+		LocConfig *loc = cgi->getLocation();
+		Connection *conn = it->second.second;
+		// A script blocked on a slow client, either way, is not idle
+		bool paused = conn && (conn->body_streaming ||
+		                       (cgi->isStreaming() &&
+		                        static_cast<CGIStream *>(conn->body_stream)->paused()));
+		std::string reason;
+		if (now - cgi->getStartTime() >= loc->getCGITimeout())
+			reason = "after " + su::to_string(loc->getCGITimeout()) + "s";
+		else if (loc->getCGIIdleTimeout() && !paused &&
+		         now - cgi->getLastOutput() >= loc->getCGIIdleTimeout())
+			reason = "silent for " + su::to_string(loc->getCGIIdleTimeout()) + "s";
+		else
+			continue;
+		_lggr.logWithPrefix(Logger::WARNING, "CGI",
+		                    "Stopping CGI child " + su::to_string(it->first) + " " + reason);
+		cgi->setTimedOut();
+		_metrics.timedOut(Metrics::CGI);
+		expired.push_back(it->first);
+	}
+	for (size_t i = 0; i < expired.size(); ++i) {
+		std::pair<CGI *, Connection *> entry = _cgi_children[expired[i]];
+		if (entry.second)
+			failCGIResponse(entry.first, entry.second, 504);
+		if (!entry.first->getCoalesceKey().empty()) {
+			answerCGIWaiters(entry.first->getCoalesceKey(), NULL, 504);
+			entry.first->setCoalesceKey("");
+		}
+		terminateCGI(entry.first);
+		if (entry.first->isComplete())
+			finalizeCGI(expired[i]);
+	}
+
+	// Requests that waited a whole cgi_timeout for a slot give up
+	for (std::map<LocConfig *, std::deque<QueuedCGI> >::iterator it = _cgi_queue.begin();
+	     it != _cgi_queue.end(); ++it) {
+		std::deque<QueuedCGI> &queue = it->second;
+		while (!queue.empty() && now - queue.front().since >= it->first->getCGITimeout()) {
+			QueuedCGI entry = queue.front();
+			queue.pop_front();
+			_lggr.logWithPrefix(Logger::WARNING, "CGI",
+			                    "No free slot for " + it->first->getPath() + " after " +
+			                        su::to_string(it->first->getCGITimeout()) + "s");
+			prepareResponse(entry.conn, Response::serviceUnavailable(entry.conn, CGI_RETRY_AFTER));
+			epollManage(EPOLL_CTL_MOD, entry.conn->fd, EPOLLOUT);
+			if (!entry.key.empty())
+				answerCGIWaiters(entry.key, NULL, 503);
+		}
+	}
+}
+
+void WebServer::terminateCGI(CGI *cgi) {
+	// Descendants may keep the pipes open, stop waiting for them
+	releaseCGIFd(cgi->getInputFd());
+	releaseCGIFd(cgi->getOutputFd());
+	// A reaped pid may already belong to another process
+	if (!cgi->hasExited() && !cgi->getSignal()) {
+		kill(cgi->getPid(), SIGTERM);
+		cgi->setSignal(SIGTERM, getCurrentTime());
+	}
+}
+
+void WebServer::releaseCGISlot(LocConfig *loc) {
+	size_t &running = _cgi_running[loc];
+	if (running > 0)
+		--running;
+
+	std::deque<QueuedCGI> &queue = _cgi_queue[loc];
+	size_t limit = loc->getCGIMaxConcurrency();
+	while (!queue.empty() && (!limit || running < limit)) {
+		QueuedCGI entry = queue.front();
+		queue.pop_front();
+		LOG_DEBUG_PREFIX(_lggr, "CGI",
+		         "Starting queued request after " +
+		             su::to_string(getCurrentTime() - entry.since) + "s");
+		uint16_t code = startCGI(entry.request, entry.conn, entry.key);
+		if (code) {
+			prepareResponse(entry.conn, Response(code, entry.conn));
+			epollManage(EPOLL_CTL_MOD, entry.conn->fd, EPOLLOUT);
+			if (!entry.key.empty())
+				answerCGIWaiters(entry.key, NULL, code);
+		}
+	}
+}
+
+// The connection is going away: nobody is left to answer, stop its scripts
+void WebServer::detachCGI(Connection *conn) {
+	std::vector<std::string> leaderless; // coalesced requests whose leader was still queued
+	for (std::map<LocConfig *, std::deque<QueuedCGI> >::iterator it = _cgi_queue.begin();
+	     it != _cgi_queue.end(); ++it) {
+		std::deque<QueuedCGI> &queue = it->second;
+		for (std::deque<QueuedCGI>::iterator q = queue.begin(); q != queue.end();) {
+			if (q->conn == conn) {
+				if (!q->key.empty())
+					leaderless.push_back(q->key);
+				q = queue.erase(q);
+			} else {
+				++q;
+			}
+		}
+	}
+	for (std::map<std::string, std::vector<QueuedCGI> >::iterator it = _cgi_waiters.begin();
+	     it != _cgi_waiters.end(); ++it) {
+		std::vector<QueuedCGI> &waiters = it->second;
+		for (std::vector<QueuedCGI>::iterator w = waiters.begin(); w != waiters.end();) {
+			if (w->conn == conn)
+				w = waiters.erase(w);
+			else
+				++w;
+		}
+	}
+
+	std::vector<pid_t> orphaned;
+	for (std::map<pid_t, std::pair<CGI *, Connection *> >::iterator it = _cgi_children.begin();
+	     it != _cgi_children.end(); ++it) {
+		if (it->second.second != conn)
+			continue;
+		it->second.second = NULL;
+		orphaned.push_back(it->first);
+	}
+	for (std::map<int, std::pair<CGI *, Connection *> >::iterator it = _cgi_pool.begin();
+	     it != _cgi_pool.end(); ++it) {
+		if (it->second.second == conn)
+			it->second.second = NULL;
+	}
+	for (size_t i = 0; i < orphaned.size(); ++i) {
+		CGI *cgi = _cgi_children[orphaned[i]].first;
+		if (!cgi->getCoalesceKey().empty()) {
+			std::map<std::string, std::vector<QueuedCGI> >::iterator waiting =
+			    _cgi_waiters.find(cgi->getCoalesceKey());
+			if (waiting != _cgi_waiters.end() && !waiting->second.empty())
+				continue; // still answers the identical requests
+			if (waiting != _cgi_waiters.end())
+				_cgi_waiters.erase(waiting);
+			cgi->setCoalesceKey("");
+		}
+		LOG_DEBUG_PREFIX(_lggr, "CGI",
+		         "Client gone, stopping CGI child " + su::to_string(orphaned[i]));
+		terminateCGI(cgi);
+		if (cgi->isComplete())
+			finalizeCGI(orphaned[i]);
+	}
+	for (size_t i = 0; i < leaderless.size(); ++i)
+		redispatchCGIWaiters(leaderless[i], true);
+}
+
+void WebServer::answerCoalescedCGI(CGI *cgi, Connection *conn) {
+	int status = cgi->getExitStatus();
+	Response resp;
+	uint16_t code = 0;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		_lggr.logWithPrefix(Logger::ERROR, "CGI", "CGI script failed to execute");
+		code = 502;
+	} else if (!CGIUtils::parseCGIOutput(cgi->getOutput(), resp)) {
+		_lggr.logWithPrefix(Logger::ERROR, "CGI", "Invalid response headers from CGI script");
+		code = 502;
+	} else if (!cgi->getCacheKey().empty()) {
+		resp.setHeader("X-Cache", "MISS");
+	}
+	if (conn) {
+		prepareResponse(conn, code ? Response(code, conn) : resp);
+		epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+	}
+	answerCGIWaiters(cgi->getCoalesceKey(), code ? NULL : &resp, code);
+	cgi->setCoalesceKey("");
+}
+
+void WebServer::answerCGIWaiters(const std::string &key, const Response *resp, uint16_t code) {
+	std::map<std::string, std::vector<QueuedCGI> >::iterator it = _cgi_waiters.find(key);
+	if (it == _cgi_waiters.end())
+		return;
+	std::vector<QueuedCGI> waiters;
+	waiters.swap(it->second);
+	_cgi_waiters.erase(it);
+	if (!waiters.empty())
+		LOG_DEBUG_PREFIX(_lggr, "CGI",
+		         "Answering " + su::to_string(waiters.size()) +
+		             " coalesced requests");
+	for (size_t i = 0; i < waiters.size(); ++i) {
+		Connection *conn = waiters[i].conn;
+		prepareResponse(conn, resp ? *resp : Response(code, conn));
+		epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+	}
+}
+
+void WebServer::redispatchCGIWaiters(const std::string &key, bool coalesce) {
+	std::map<std::string, std::vector<QueuedCGI> >::iterator it = _cgi_waiters.find(key);
+	if (it == _cgi_waiters.end())
+		return;
+	std::vector<QueuedCGI> waiters;
+	waiters.swap(it->second);
+	_cgi_waiters.erase(it);
+	for (size_t i = 0; i < waiters.size(); ++i) {
+		Connection *conn = waiters[i].conn;
+		uint16_t code = coalesce ? handleCGIRequest(waiters[i].request, conn)
+		                         : admitCGI(waiters[i].request, conn, "");
+		if (code)
+			prepareResponse(conn, Response(code, conn));
+		if (conn->response_ready)
+			epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+	}
+}
+
+void WebServer::uncoalesceCGI(CGI *cgi, Connection *conn) {
+	std::string key = cgi->getCoalesceKey();
+	cgi->setCoalesceKey("");
+	LOG_DEBUG_PREFIX(_lggr, "CGI",
+	         "Output of CGI child " + su::to_string(cgi->getPid()) +
+	             " too large to coalesce");
+	redispatchCGIWaiters(key, false);
+	if (!conn)
+		terminateCGI(cgi); // it only ran for the waiters
+}
+
+// A complete output replaces the cached one, unless its headers forbid caching
+void WebServer::cacheCGIOutput(CGI *cgi) {
+	LocConfig *loc = cgi->getLocation();
+	CGICache *cache = cgiCache(loc);
+	const std::string &key = cgi->getCacheKey();
+	int status = cgi->getExitStatus();
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !cgi->outputDone()) {
+		cache->revalidationFailed(key); // a stale copy is still served until it runs out
+		return;
+	}
+
+	std::string output;
+	Response resp;
+	time_t now = getCurrentTime();
+	time_t expires, stale_until;
+	if (cgi->takeCapture(output) && CGIUtils::parseCGIOutput(output, resp) &&
+	    CGICache::freshness(resp, now, loc->cgi_cache_valid, expires, stale_until)) {
+		cache->store(key, output, expires, stale_until);
+		LOG_DEBUG_PREFIX(_lggr, "CGI",
+		         "Cached " + su::to_string(output.size()) + " bytes for " +
+		             su::to_string(expires - now) + "s");
+	} else {
+		cache->remove(key);
+	}
 }
 
 bool WebServer::isCGIFd(int fd) const { return (_cgi_pool.find(fd) != _cgi_pool.end()); }
@@ -0,0 +1,227 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerFastCGI.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/03 10:02:15 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/03 10:02:15 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "src/HttpServer/HttpServer.hpp"
+#include "src/HttpServer/Structs/Connection.hpp"
+#include "src/HttpServer/Structs/Response.hpp"
+#include "src/HttpServer/Structs/WebServer.hpp"
+
+uint16_t WebServer::handleFastCGIRequest(ClientRequest &req, Connection *conn) {
+	std::map<std::string, std::string> params;
+	CGIUtils::buildEnv(params, req, conn->locConfig);
+	CGIUtils::addLocationEnv(params, conn->locConfig);
+
+	std::string records = FastCGIUtils::encodeRequest(params, req.body);
+	noteUpstreamStart(conn);
+	if (!dispatchFastCGI(conn->locConfig->getFastCGIPass(), records, conn, true))
+		return (502);
+
+	// Nothing to send until the application answered, only watch for the peer going away
+	epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLRDHUP);
+	return (0);
+}
+
+FastCGI *WebServer::dispatchFastCGI(const std::string &address, const std::string &records,
+                                    Connection *conn, bool allow_reuse) {
+	FastCGI *fcgi = NULL;
+	std::vector<int> &idle = _fcgi_idle[address];
+
+	if (allow_reuse && !idle.empty()) {
+		fcgi = _fcgi_conns[idle.back()];
+		idle.pop_back();
+		fcgi->setState(FastCGI::ACTIVE);
+		if (!epollManage(EPOLL_CTL_MOD, fcgi->getFd(), EPOLLOUT)) {
+			closeFastCGI(fcgi);
+			return (dispatchFastCGI(address, records, conn, false));
+		}
+	} else {
+		bool connecting = false;
+		int fd = FastCGIUtils::connectTo(address, connecting);
+		if (fd == -1) {
+			_lggr.logWithPrefix(Logger::ERROR, "FastCGI",
+			                    "Failed to connect to " + address + ": " + strerror(errno));
+			return (NULL);
+		}
+		fcgi = new FastCGI(address, fd, connecting ? FastCGI::CONNECTING : FastCGI::ACTIVE);
+		_fcgi_conns[fd] = fcgi;
+		if (!epollManage(EPOLL_CTL_ADD, fd, EPOLLOUT)) {
+			_fcgi_conns.erase(fd);
+			delete fcgi;
+			return (NULL);
+		}
+		LOG_DEBUG_PREFIX(_lggr, "FastCGI", "New connection to " + address);
+	}
+
+	fcgi->client = conn;
+	fcgi->beginRequest(records);
+	return (fcgi);
+}
+
+void WebServer::handleFastCGIEvent(int fd, uint32_t event_mask) {
+	std::map<int, FastCGI *>::iterator it = _fcgi_conns.find(fd);
+	if (it == _fcgi_conns.end())
+		return;
+	FastCGI *fcgi = it->second;
+
+	// Idle connections only report the application closing them
+	if (fcgi->getState() == FastCGI::IDLE) {
+		LOG_DEBUG_PREFIX(_lggr, "FastCGI", "Idle connection to " + fcgi->getAddress() +
+		                                       " closed by the application");
+		closeFastCGI(fcgi);
+		return;
+	}
+
+	if (fcgi->getState() == FastCGI::CONNECTING) {
+		int err = 0;
+		socklen_t len = sizeof(err);
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err != 0) {
+			_lggr.logWithPrefix(Logger::ERROR, "FastCGI",
+			                    "Failed to connect to " + fcgi->getAddress() + ": " +
+			                        strerror(err ? err : errno));
+			failFastCGI(fcgi, 502);
+			return;
+		}
+		fcgi->setState(FastCGI::ACTIVE);
+	}
+
+	if ((event_mask & EPOLLOUT) && fcgi->hasPendingOutput()) {
+		errno = 0;
+		if (fcgi->flush() < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			failFastCGI(fcgi, 502);
+			return;
+		}
+		if (!fcgi->hasPendingOutput())
+			epollManage(EPOLL_CTL_MOD, fd, EPOLLIN);
+	}
+
+	if (event_mask & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+		errno = 0;
+		ssize_t bytes_read = fcgi->receive();
+		bool would_block = (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+
+		std::string err = fcgi->takeStderr();
+		if (!err.empty())
+			_lggr.logWithPrefix(Logger::WARNING, "FastCGI", su::trim(err));
+
+		if (fcgi->requestEnded()) {
+			finishFastCGI(fcgi);
+		} else if (fcgi->protocolError()) {
+			_lggr.logWithPrefix(Logger::ERROR, "FastCGI",
+			                    "Malformed record from " + fcgi->getAddress());
+			failFastCGI(fcgi, 502);
+		} else if (bytes_read == 0 || (bytes_read < 0 && !would_block)) {
+			failFastCGI(fcgi, 502);
+		}
+	}
+}
+
+void WebServer::finishFastCGI(FastCGI *fcgi) {
+	Connection *conn = fcgi->client;
+
+	if (conn) {
+		Response resp;
+		if (!fcgi->requestSucceeded()) {
+			_lggr.logWithPrefix(Logger::ERROR, "FastCGI", "Application rejected the request");
+			prepareResponse(conn, Response::badGateway(conn));
+		} else if (!CGIUtils::parseCGIOutput(fcgi->getStdout(), resp)) {
+			_lggr.logWithPrefix(Logger::ERROR, "FastCGI", "Invalid response from application");
+			prepareResponse(conn, Response::badGateway(conn));
+		} else {
+			prepareResponse(conn, resp);
+		}
+		epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+	}
+
+	// Back to the pool, unless it is full
+	std::vector<int> &idle = _fcgi_idle[fcgi->getAddress()];
+	if (idle.size() >= FASTCGI_KEEPALIVE) {
+		closeFastCGI(fcgi);
+		return;
+	}
+	fcgi->reset();
+	if (!epollManage(EPOLL_CTL_MOD, fcgi->getFd(), EPOLLIN | EPOLLRDHUP)) {
+		closeFastCGI(fcgi);
+		return;
+	}
+	idle.push_back(fcgi->getFd());
+}
+
+void WebServer::failFastCGI(FastCGI *fcgi, uint16_t code) {
+	Connection *conn = fcgi->client;
+	std::string address = fcgi->getAddress();
+	std::string records = fcgi->getRecords();
+	// The application may drop a kept-alive connection at any time: try once more
+	bool retry = conn && fcgi->reused && !fcgi->receivedAny();
+
+	closeFastCGI(fcgi);
+	if (retry) {
+		LOG_DEBUG_PREFIX(_lggr, "FastCGI",
+		         "Pooled connection to " + address + " was closed, reconnecting");
+		if (dispatchFastCGI(address, records, conn, false))
+			return;
+	}
+	if (conn) {
+		_lggr.logWithPrefix(Logger::ERROR, "FastCGI", "Request to " + address + " failed");
+		prepareResponse(conn, Response(code, conn));
+		epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+	}
+}
+
+void WebServer::closeFastCGI(FastCGI *fcgi) {
+	int fd = fcgi->getFd();
+	std::vector<int> &idle = _fcgi_idle[fcgi->getAddress()];
+	std::vector<int>::iterator pos = std::find(idle.begin(), idle.end(), fd);
+	if (pos != idle.end())
+		idle.erase(pos);
+
+	epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	_fcgi_conns.erase(fd);
+	delete fcgi;
+}
+
+// Runs from the main loop: requests past CGI_TIMEOUT are dropped and answered with 504
+void WebServer::checkFastCGITimeouts() {
+	time_t now = getCurrentTime();
+	std::vector<FastCGI *> expired;
+
+	for (std::map<int, FastCGI *>::iterator it = _fcgi_conns.begin(); it != _fcgi_conns.end();
+	     ++it) {
+		FastCGI *fcgi = it->second;
+		if (fcgi->getState() != FastCGI::IDLE && now - fcgi->start_time >= CGI_TIMEOUT)
+			expired.push_back(fcgi);
+	}
+	for (size_t i = 0; i < expired.size(); ++i) {
+		Connection *conn = expired[i]->client;
+		_lggr.logWithPrefix(Logger::ERROR, "FastCGI",
+		                    "Request to " + expired[i]->getAddress() + " timed out");
+		_metrics.timedOut(Metrics::FASTCGI);
+		closeFastCGI(expired[i]);
+		if (conn) {
+			prepareResponse(conn, Response::gatewayTimeout(conn));
+			epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+		}
+	}
+}
+
+// The connection is going away: abort its request by dropping the upstream connection
+void WebServer::detachFastCGI(Connection *conn) {
+	std::vector<FastCGI *> orphaned;
+	for (std::map<int, FastCGI *>::iterator it = _fcgi_conns.begin(); it != _fcgi_conns.end();
+	     ++it) {
+		if (it->second->client == conn)
+			orphaned.push_back(it->second);
+	}
+	for (size_t i = 0; i < orphaned.size(); ++i)
+		closeFastCGI(orphaned[i]);
+}
+
+bool WebServer::isFastCGIFd(int fd) const { return (_fcgi_conns.find(fd) != _fcgi_conns.end()); }
@@ -0,0 +1,152 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerMetrics.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/15 10:12:03 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/15 10:12:03 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "src/HttpServer/HttpServer.hpp"
+#include "src/HttpServer/Structs/Connection.hpp"
+#include "src/HttpServer/Structs/Response.hpp"
+#include "src/HttpServer/Structs/WebServer.hpp"
+
+// Once per request: on the last byte of the response, or when the connection
+// closes first (499 if no response was started). Timed from its first byte.
+void WebServer::recordRequest(Connection *conn) {
+	if (conn->request_line.empty())
+		return;
+	uint16_t status = conn->sent_status ? conn->sent_status : 499;
+	double start = conn->phases[Connection::FIRST_BYTE];
+	double request_time = monotonicTime() - start;
+	double first_sent = conn->phases[Connection::FIRST_SENT];
+	double ttfb = first_sent ? first_sent - start : -1;
+	_metrics.request(conn->servConfig, conn->locConfig, status, request_time, ttfb,
+	                 conn->bytes_sent);
+	logAccess(conn, status, request_time);
+	logSlowRequest(conn, status, request_time);
+	conn->resetAccessRecord();
+}
+
+// stub_status: a snapshot of the connections, like nginx's
+std::string WebServer::stubStatus() const {
+	size_t reading = 0;
+	size_t writing = 0;
+	for (std::map<int, Connection *>::const_iterator it = _connections.begin();
+	     it != _connections.end(); ++it) {
+		if (!it->second->request_line.empty())
+			++writing; // head received, not answered yet
+		else if (!it->second->read_buffer.empty())
+			++reading;
+	}
+	std::ostringstream out;
+	out << "Active connections: " << _metrics.getActive() << "\n"
+	    << "server accepts handled requests\n"
+	    << " " << _metrics.getAccepted() << " " << _metrics.getAccepted() << " "
+	    << _metrics.getRequests() << "\n"
+	    << "Reading: " << reading << " Writing: " << writing
+	    << " Waiting: " << _connections.size() - reading - writing << "\n";
+	return (out.str());
+}
+
+static std::string jsonString(const std::string &value) {
+	std::string out = "\"";
+	for (size_t i = 0; i < value.size(); ++i) {
+		unsigned char c = value[i];
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if (c < 0x20 || c == 0x7f) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out += buf;
+		} else {
+			out += c;
+		}
+	}
+	return (out + "\"");
+}
+
+// Value of a key in a query string, empty if absent
+static std::string queryValue(const std::string &query, const std::string &key) {
+	size_t pos = 0;
+	while (pos <= query.size()) {
+		size_t end = std::min(query.find('&', pos), query.size());
+		if (query.compare(pos, key.size() + 1, key + "=") == 0)
+			return (query.substr(pos + key.size() + 1, end - pos - key.size() - 1));
+		pos = end + 1;
+	}
+	return ("");
+}
+
+// The live connections as JSON. Filters: state=NAME[,NAME...] keeps those
+// states, idle=N those without activity for N seconds or more.
+std::string WebServer::connectionTable(const std::string &query) {
+	std::string states = queryValue(query, "state");
+	std::string idle_arg = queryValue(query, "idle");
+	long min_idle = idle_arg.empty() ? -1 : std::atol(idle_arg.c_str());
+	time_t now = getCurrentTime();
+
+	std::map<const Connection *, pid_t> cgi_pids;
+	for (std::map<pid_t, std::pair<CGI *, Connection *> >::const_iterator it =
+	         _cgi_children.begin();
+	     it != _cgi_children.end(); ++it)
+		if (it->second.second)
+			cgi_pids[it->second.second] = it->first;
+
+	std::ostringstream out;
+	size_t shown = 0;
+	out << "{\"connections\":[";
+	for (std::map<int, Connection *>::const_iterator it = _connections.begin();
+	     it != _connections.end(); ++it) {
+		Connection *conn = it->second;
+		std::string state = conn->stateToString(conn->state);
+		long idle = static_cast<long>(now - conn->last_activity);
+		if (!states.empty() && ("," + states + ",").find("," + state + ",") == std::string::npos)
+			continue;
+		if (idle < min_idle)
+			continue;
+		std::map<const Connection *, pid_t>::iterator cgi = cgi_pids.find(conn);
+		out << (shown++ ? "," : "") << "\n{\"fd\":" << conn->fd
+		    << ",\"peer\":" << jsonString(conn->client_addr) << ",\"state\":\"" << state
+		    << "\",\"buffered_in\":" << conn->read_buffer.size() + conn->body_data.size()
+		    << ",\"buffered_out\":" << conn->send_buffer.size() - conn->send_offset
+		    << ",\"requests\":" << conn->request_count << ",\"idle\":" << idle
+		    << ",\"request\":"
+		    << (conn->request_line.empty() ? "null" : jsonString(conn->request_line))
+		    << ",\"location\":"
+		    << (conn->locConfig ? jsonString(conn->locConfig->path) : "null")
+		    << ",\"cgi_pid\":"
+		    << (cgi == cgi_pids.end() ? "null" : su::to_string(cgi->second)) << "}";
+	}
+	out << "\n],\"shown\":" << shown << ",\"total\":" << _connections.size() << "}\n";
+	return (out.str());
+}
+
+Response WebServer::respMetrics(Connection *conn) {
+	LocConfig *loc = conn->locConfig;
+	if (loc->metrics_local && conn->client_addr.compare(0, 4, "127.") != 0) {
+		LOG_PREFIX(_lggr, Logger::INFO, "Metrics", "Refused " + conn->client_addr);
+		return (Response::forbidden(conn));
+	}
+	std::string body;
+	if (loc->metrics == "status") {
+		body = stubStatus();
+	} else if (loc->metrics == "connections") {
+		body = connectionTable(conn->parsed_request.query);
+	} else {
+		body.reserve(16384);
+		_metrics.render(body);
+	}
+	Response resp(200, body);
+	resp.setContentType(loc->metrics == "status"        ? "text/plain"
+	                    : loc->metrics == "connections" ? "application/json"
+	                                                    : "text/plain; version=0.0.4; charset=utf-8");
+	resp.setContentLength(body.size());
+	resp.setHeader("Cache-Control", "no-store");
+	return (resp);
+}
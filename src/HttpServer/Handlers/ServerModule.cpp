@@ -0,0 +1,160 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerModule.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/09 09:41:17 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/09 09:41:17 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "src/HttpServer/HttpServer.hpp"
+#include "src/HttpServer/Structs/Connection.hpp"
+#include "src/HttpServer/Structs/Response.hpp"
+#include "src/HttpServer/Structs/WebServer.hpp"
+#include "src/Modules/HandlerModule.hpp"
+
+bool WebServer::loadHandlerModules(std::vector<ServerConfig> &servers) {
+	for (std::vector<ServerConfig>::iterator sc = servers.begin(); sc != servers.end(); ++sc) {
+		std::vector<LocConfig> &locations = sc->getLocations();
+		for (std::vector<LocConfig>::iterator loc = locations.begin(); loc != locations.end();
+		     ++loc) {
+			if (!loc->hasHandler() || _modules.count(loc->getHandler()))
+				continue;
+			std::string error;
+			HandlerModule *module = HandlerModule::load(loc->getHandler(), error);
+			if (!module) {
+				_lggr.logWithPrefix(Logger::ERROR, "Module",
+				                    "Failed to load " + loc->getHandler() + ": " + error);
+				return false;
+			}
+			_modules[loc->getHandler()] = module;
+			_lggr.logWithPrefix(Logger::INFO, "Module",
+			                    std::string("Loaded ") + module->getName() + " from " +
+			                        loc->getHandler());
+		}
+	}
+	if (_modules.empty() || _module_fd != -1)
+		return true;
+
+	// Only the read end is non-blocking: complete() must never lose a response
+	int fds[2];
+	if (pipe2(fds, O_CLOEXEC) == -1) {
+		_lggr.error("Failed to create the module completion pipe: " +
+		            std::string(strerror(errno)));
+		return false;
+	}
+	_module_fd = fds[0];
+	_module_notify_fd = fds[1];
+	fcntl(_module_fd, F_SETFL, fcntl(_module_fd, F_GETFL) | O_NONBLOCK);
+	return epollManage(EPOLL_CTL_ADD, _module_fd, EPOLLIN);
+}
+
+uint16_t WebServer::handleModuleRequest(ClientRequest &req, Connection *conn) {
+	HandlerModule *module = _modules[conn->locConfig->getHandler()];
+	ws_response *call = new ws_response(req, conn, module, _module_notify_fd);
+	noteUpstreamStart(conn);
+
+	int result = module->handle(call);
+	if (result == WS_DONE) {
+		answerModuleCall(call);
+		delete call;
+		return (0);
+	}
+	if (result == WS_ASYNC) {
+		_module_calls.insert(call);
+		// Nothing to send until complete(), only watch for the peer going away
+		epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLRDHUP);
+		return (0);
+	}
+	delete call;
+	if (result < 400 || result > 599) {
+		_lggr.logWithPrefix(Logger::ERROR, "Module",
+		                    std::string(module->getName()) + " returned " +
+		                        su::to_string(result));
+		return (500);
+	}
+	return (static_cast<uint16_t>(result));
+}
+
+// The completion pipe is readable: each complete() wrote one ws_response pointer
+void WebServer::handleModuleCompletions() {
+	ws_response *done[64];
+	ssize_t bytes_read;
+	while ((bytes_read = read(_module_fd, done, sizeof(done))) > 0) {
+		for (size_t i = 0; i < bytes_read / sizeof(done[0]); ++i) {
+			std::set<ws_response *>::iterator it = _module_calls.find(done[i]);
+			if (it == _module_calls.end())
+				continue; // completed twice, or after a synchronous answer
+			_module_calls.erase(it);
+			if (done[i]->conn) {
+				answerModuleCall(done[i]);
+				epollManage(EPOLL_CTL_MOD, done[i]->conn->fd, EPOLLOUT);
+			}
+			delete done[i];
+		}
+	}
+}
+
+void WebServer::answerModuleCall(ws_response *call) {
+	Response &resp = call->resp;
+	if (resp.status_code != 204 && resp.status_code != 304)
+		resp.setContentLength(resp.body.size());
+	prepareResponse(call->conn, resp);
+}
+
+// Runs from the main loop: asynchronous responses past MODULE_TIMEOUT are answered with 504
+void WebServer::checkModuleTimeouts() {
+	time_t now = getCurrentTime();
+	for (std::set<ws_response *>::iterator it = _module_calls.begin(); it != _module_calls.end();
+	     ++it) {
+		ws_response *call = *it;
+		if (!call->conn || now - call->start_time < MODULE_TIMEOUT)
+			continue;
+		_lggr.logWithPrefix(Logger::ERROR, "Module",
+		                    std::string(call->module->getName()) + " did not complete " +
+		                        call->request.uri);
+		_metrics.timedOut(Metrics::MODULE);
+		prepareResponse(call->conn, Response::gatewayTimeout(call->conn));
+		epollManage(EPOLL_CTL_MOD, call->conn->fd, EPOLLOUT);
+		call->conn = NULL; // kept until the module completes it
+		call->module->cancel(call);
+	}
+}
+
+// The connection is going away: its pending responses are cancelled, not freed
+void WebServer::detachModule(Connection *conn) {
+	for (std::set<ws_response *>::iterator it = _module_calls.begin(); it != _module_calls.end();
+	     ++it) {
+		if ((*it)->conn != conn)
+			continue;
+		(*it)->conn = NULL;
+		(*it)->module->cancel(*it);
+	}
+}
+
+void WebServer::unloadHandlerModules() {
+	for (std::set<ws_response *>::iterator it = _module_calls.begin(); it != _module_calls.end();
+	     ++it) {
+		if ((*it)->conn)
+			(*it)->module->cancel(*it);
+	}
+	// fini() stops whatever still works on the pending responses
+	for (std::map<std::string, HandlerModule *>::iterator it = _modules.begin();
+	     it != _modules.end(); ++it)
+		delete it->second;
+	_modules.clear();
+	for (std::set<ws_response *>::iterator it = _module_calls.begin(); it != _module_calls.end();
+	     ++it)
+		delete *it;
+	_module_calls.clear();
+
+	if (_module_fd != -1) {
+		close(_module_fd);
+		close(_module_notify_fd);
+		_module_fd = -1;
+		_module_notify_fd = -1;
+	}
+}
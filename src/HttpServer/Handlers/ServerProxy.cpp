@@ -0,0 +1,528 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerProxy.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/10 10:12:41 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/10 10:12:41 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "src/HttpServer/HttpServer.hpp"
+#include "src/HttpServer/Structs/Connection.hpp"
+#include "src/HttpServer/Structs/ProxyStream.hpp"
+#include "src/HttpServer/Structs/Response.hpp"
+#include "src/HttpServer/Structs/WebServer.hpp"
+#include "src/Proxy/Proxy.hpp"
+#include "src/Proxy/Upstream.hpp"
+
+// Hop-by-hop headers, and the ones the proxy writes itself
+static bool isHopHeader(const std::string &name) {
+	static const char *hop[] = {"connection", "keep-alive",        "proxy-connection",
+	                            "te",         "trailer",           "transfer-encoding",
+	                            "upgrade",    "content-length",    "expect",
+	                            "host",       "x-forwarded-proto", "x-real-ip"};
+	std::string lower = su::to_lower(name);
+	for (size_t i = 0; i < sizeof(hop) / sizeof(hop[0]); ++i) {
+		if (lower == hop[i])
+			return (true);
+	}
+	return (false);
+}
+
+// The parser decoded the URI: encode it again for the request line
+static std::string encodeURI(const std::string &uri) {
+	static const char *hex = "0123456789ABCDEF";
+	std::string out;
+	for (size_t i = 0; i < uri.size(); ++i) {
+		unsigned char c = uri[i];
+		if (std::isalnum(c) || std::strchr("-._~!$&'()*+,;=:@/?", c))
+			out += c;
+		else {
+			out += '%';
+			out += hex[c >> 4];
+			out += hex[c & 15];
+		}
+	}
+	return (out);
+}
+
+static std::string peerAddress(int fd) {
+	struct sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+	char host[INET6_ADDRSTRLEN];
+
+	if (getpeername(fd, reinterpret_cast<struct sockaddr *>(&addr), &len) == -1)
+		return ("");
+	if (addr.ss_family == AF_INET)
+		inet_ntop(AF_INET, &reinterpret_cast<struct sockaddr_in *>(&addr)->sin_addr, host,
+		          sizeof(host));
+	else if (addr.ss_family == AF_INET6)
+		inet_ntop(AF_INET6, &reinterpret_cast<struct sockaddr_in6 *>(&addr)->sin6_addr, host,
+		          sizeof(host));
+	else
+		return ("");
+	return (host);
+}
+
+void WebServer::startProxyRequest(Connection *conn, const std::string &received) {
+	markPhase(conn, Connection::HANDLER_START);
+	ClientRequest &req = conn->parsed_request;
+	bool has_body = conn->chunked || conn->content_length > 0;
+
+	Upstream *up = upstream(conn->locConfig);
+	noteUpstreamStart(conn);
+	Proxy *proxy = dispatchProxy(up, peerAddress(conn->fd), std::vector<int>(), conn);
+	if (!proxy) {
+		conn->read_buffer.clear();
+		conn->state = Connection::REQUEST_COMPLETE;
+		conn->should_close = has_body; // the body was not read
+		prepareResponse(conn, Response::badGateway(conn));
+		epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+		return;
+	}
+	LOG_DEBUG_PREFIX(_lggr, "Proxy",
+	         req.method + " " + req.uri + " to " + proxy->getAddress());
+	proxy->beginRequest(proxyRequestHead(req, conn), has_body);
+
+	if (has_body) {
+		conn->body_streaming = true;
+		conn->body_sink = NULL;
+		conn->body_upstream = proxy;
+		conn->body_paused = false;
+		conn->body_bytes_read = 0;
+		conn->chunk_size = 0;
+		conn->chunk_bytes_read = 0;
+		conn->read_buffer = received;
+		conn->state = conn->chunked ? Connection::READING_CHUNK_SIZE : Connection::READING_BODY;
+		epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLIN | EPOLLRDHUP);
+		pumpProxyBody(conn);
+	} else {
+		conn->read_buffer.clear();
+		conn->state = Connection::REQUEST_COMPLETE;
+		conn->request_count++;
+		// Nothing to send until the upstream answered, only watch for the peer going away
+		epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLRDHUP);
+	}
+	watchProxy(proxy);
+}
+
+std::string WebServer::proxyRequestHead(const ClientRequest &req, Connection *conn) {
+	LocConfig *loc = conn->locConfig;
+	std::string uri = req.uri;
+	if (!loc->proxy_uri.empty() && su::starts_with(uri, loc->getPath()))
+		uri = loc->proxy_uri + uri.substr(loc->getPath().size());
+
+	std::ostringstream head;
+	head << req.method << " " << encodeURI(uri) << " HTTP/1.1\r\n";
+
+	std::map<std::string, std::string>::const_iterator host = req.headers.find("host");
+	head << "Host: " << (host != req.headers.end() ? host->second : loc->getUpstream().name)
+	     << "\r\n";
+	std::string client_ip = peerAddress(conn->fd);
+	std::string forwarded = client_ip;
+	for (std::map<std::string, std::string>::const_iterator it = req.headers.begin();
+	     it != req.headers.end(); ++it) {
+		if (it->first == "x-forwarded-for")
+			forwarded = it->second + ", " + client_ip;
+		else if (!isHopHeader(it->first))
+			head << it->first << ": " << it->second << "\r\n";
+	}
+	head << "X-Forwarded-For: " << forwarded << "\r\n";
+	head << "X-Real-IP: " << client_ip << "\r\n";
+	head << "X-Forwarded-Proto: http\r\n";
+
+	if (req.chunked_encoding)
+		head << "Transfer-Encoding: chunked\r\n";
+	else if (req.content_length > 0 || req.method == "POST")
+		head << "Content-Length: " << (req.content_length > 0 ? req.content_length : 0) << "\r\n";
+	head << "\r\n";
+	return (head.str());
+}
+
+Upstream *WebServer::upstream(LocConfig *loc) {
+	Upstream *&up = _upstreams[loc->getUpstream().name];
+	if (!up)
+		up = new Upstream(loc->getUpstream());
+	return (up);
+}
+
+Proxy *WebServer::dispatchProxy(Upstream *up, const std::string &client_ip,
+                                const std::vector<int> &tried, Connection *conn) {
+	std::vector<int> skipped = tried;
+	time_t now = getCurrentTime();
+	int peer;
+
+	while ((peer = up->pick(client_ip, skipped, now)) != -1) {
+		const std::string &address = up->getAddress(peer);
+		std::vector<int> &idle = _proxy_idle[address];
+		Proxy *proxy;
+
+		if (!idle.empty()) {
+			proxy = _proxy_conns[idle.back()];
+			idle.pop_back();
+			proxy->setState(Proxy::ACTIVE);
+		} else {
+			bool connecting = false;
+			int fd = FastCGIUtils::connectTo(address, connecting);
+			if (fd == -1) {
+				_lggr.logWithPrefix(Logger::ERROR, "Proxy",
+				                    "Failed to connect to " + address + ": " + strerror(errno));
+				if (up->failed(peer, now))
+					_lggr.logWithPrefix(Logger::WARNING, "Proxy", address + " marked down");
+				skipped.push_back(peer);
+				continue;
+			}
+			proxy = new Proxy(address, fd, connecting ? Proxy::CONNECTING : Proxy::ACTIVE);
+			_proxy_conns[fd] = proxy;
+			if (!epollManage(EPOLL_CTL_ADD, fd, EPOLLOUT)) {
+				_proxy_conns.erase(fd);
+				delete proxy;
+				return (NULL);
+			}
+			proxy->events = EPOLLOUT;
+			LOG_DEBUG_PREFIX(_lggr, "Proxy", "New connection to " + address);
+		}
+
+		proxy->client = conn;
+		proxy->upstream = up;
+		proxy->peer = peer;
+		proxy->tried = skipped;
+		proxy->client_ip = client_ip;
+		up->acquire(peer);
+		return (proxy);
+	}
+	_lggr.logWithPrefix(Logger::ERROR, "Proxy", "No live server left in upstream " + up->getName());
+	return (NULL);
+}
+
+void WebServer::handleProxyEvent(int fd, uint32_t event_mask) {
+	std::map<int, Proxy *>::iterator it = _proxy_conns.find(fd);
+	if (it == _proxy_conns.end())
+		return;
+	Proxy *proxy = it->second;
+
+	// Idle connections only report the upstream closing them
+	if (proxy->getState() == Proxy::IDLE) {
+		LOG_DEBUG_PREFIX(_lggr, "Proxy", "Idle connection to " + proxy->getAddress() +
+		                                     " closed by the upstream");
+		closeProxy(proxy);
+		return;
+	}
+
+	if (proxy->getState() == Proxy::CONNECTING) {
+		int err = 0;
+		socklen_t len = sizeof(err);
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 || err != 0) {
+			_lggr.logWithPrefix(Logger::ERROR, "Proxy",
+			                    "Failed to connect to " + proxy->getAddress() + ": " +
+			                        strerror(err ? err : errno));
+			failProxy(proxy, 502, true);
+			return;
+		}
+		proxy->setState(Proxy::ACTIVE);
+	}
+
+	if ((event_mask & EPOLLOUT) && proxy->pendingOutput()) {
+		errno = 0;
+		if (proxy->flush() < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			failProxy(proxy, 502, false);
+			return;
+		}
+		Connection *conn = proxy->client;
+		if (conn && conn->body_paused && conn->body_upstream == proxy &&
+		    proxy->pendingOutput() <= Proxy::BODY_LOW_WATER)
+			resumeRequestBody(conn);
+	}
+
+	// Not read while paused: a hangup meanwhile cuts the response short
+	if (proxy->paused && (event_mask & (EPOLLHUP | EPOLLERR))) {
+		failProxy(proxy, 502, false);
+		return;
+	}
+	if (!proxy->paused && (event_mask & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+		errno = 0;
+		ssize_t bytes_read = proxy->receive();
+		bool would_block = (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+
+		if (proxy->protocolError()) {
+			_lggr.logWithPrefix(Logger::ERROR, "Proxy",
+			                    "Malformed response from " + proxy->getAddress());
+			failProxy(proxy, 502, false);
+			return;
+		}
+		if (proxy->headersComplete())
+			forwardProxyResponse(proxy);
+		if (proxy->responseEnded()) {
+			finishProxy(proxy);
+			return;
+		}
+		if (bytes_read == 0 || (bytes_read < 0 && !would_block)) {
+			failProxy(proxy, 502, false);
+			return;
+		}
+	}
+	watchProxy(proxy);
+}
+
+void WebServer::forwardProxyResponse(Proxy *proxy) {
+	Connection *conn = proxy->client;
+	if (!proxy->streaming)
+		startProxyResponse(proxy, conn);
+
+	ProxyStream *stream = static_cast<ProxyStream *>(conn->body_stream);
+	std::string body = proxy->takeBody();
+	if (!body.empty()) {
+		stream->append(body);
+		conn->updateActivity();
+	}
+	// Backpressure: leave the rest in the socket until the client drained the stream
+	if (stream->buffered() >= ProxyStream::HIGH_WATER && !stream->paused() &&
+	    !proxy->responseEnded()) {
+		stream->pause();
+		proxy->paused = true;
+	}
+	if (stream->waiting())
+		epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+}
+
+void WebServer::startProxyResponse(Proxy *proxy, Connection *conn) {
+	Response resp;
+	resp.setStatus(proxy->getStatus());
+
+	// Repeated headers are folded into one (Response keeps one value per name)
+	const std::vector<std::pair<std::string, std::string> > &headers = proxy->getHeaders();
+	for (size_t i = 0; i < headers.size(); ++i) {
+		std::string name = su::to_lower(headers[i].first);
+		if (name == "connection" || name == "keep-alive" || name == "transfer-encoding" ||
+		    name == "content-length" || name == "trailer" || name == "upgrade")
+			continue;
+		std::map<std::string, std::string>::iterator it = resp.headers.find(headers[i].first);
+		if (it != resp.headers.end())
+			it->second += ", " + headers[i].second;
+		else
+			resp.setHeader(headers[i].first, headers[i].second);
+	}
+
+	ssize_t length = proxy->getContentLength();
+	if (proxy->getStatus() == 204 || proxy->getStatus() == 304)
+		length = 0; // no body allowed
+	else if (length >= 0)
+		resp.setContentLength(length);
+	else
+		resp.setHeader("Transfer-Encoding", "chunked");
+
+	delete conn->body_stream;
+	conn->body_stream = new ProxyStream(*this, proxy->getFd(), length);
+	proxy->streaming = true;
+	prepareResponse(conn, resp);
+	epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+}
+
+void WebServer::resumeProxyOutput(int fd) {
+	std::map<int, Proxy *>::iterator it = _proxy_conns.find(fd);
+	if (it == _proxy_conns.end() || !it->second->paused)
+		return;
+	it->second->paused = false;
+	watchProxy(it->second);
+}
+
+// Level-triggered: the response is always read unless paused, the request
+// written while bytes of it are queued
+void WebServer::watchProxy(Proxy *proxy) {
+	uint32_t events = 0;
+	if (proxy->getState() == Proxy::CONNECTING || proxy->pendingOutput())
+		events |= EPOLLOUT;
+	if (proxy->getState() != Proxy::CONNECTING && !proxy->paused)
+		events |= EPOLLIN;
+	if (events != proxy->events && epollManage(EPOLL_CTL_MOD, proxy->getFd(), events))
+		proxy->events = events;
+}
+
+void WebServer::finishProxy(Proxy *proxy) {
+	Connection *conn = proxy->client;
+	ProxyStream *stream = static_cast<ProxyStream *>(conn->body_stream);
+	stream->finish(true);
+	if (stream->waiting())
+		epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+	if (conn->body_upstream == proxy) // answered before the whole body was sent
+		conn->body_upstream = NULL;
+	proxy->upstream->succeeded(proxy->peer);
+
+	// Back to the pool, unless the exchange left it unusable or the pool is full
+	std::vector<int> &idle = _proxy_idle[proxy->getAddress()];
+	if (!proxy->reusable() || idle.size() >= proxy->upstream->getKeepalive()) {
+		closeProxy(proxy);
+		return;
+	}
+	proxy->upstream->release(proxy->peer);
+	proxy->reset();
+	if (!epollManage(EPOLL_CTL_MOD, proxy->getFd(), EPOLLIN | EPOLLRDHUP)) {
+		closeProxy(proxy);
+		return;
+	}
+	proxy->events = EPOLLIN | EPOLLRDHUP;
+	idle.push_back(proxy->getFd());
+}
+
+void WebServer::failProxy(Proxy *proxy, uint16_t code, bool connect_failed) {
+	Connection *conn = proxy->client;
+	Upstream *up = proxy->upstream;
+	// The upstream may drop a kept-alive connection at any time: not the server's fault
+	bool stale = !connect_failed && code == 502 && proxy->reused && !proxy->receivedAny();
+
+	if (!stale && up->failed(proxy->peer, getCurrentTime()))
+		_lggr.logWithPrefix(Logger::WARNING, "Proxy", proxy->getAddress() + " marked down");
+
+	if (conn && !proxy->streaming && proxy->replayable() && (connect_failed || stale)) {
+		std::vector<int> tried = proxy->tried;
+		if (!stale)
+			tried.push_back(proxy->peer);
+		Proxy *next = dispatchProxy(up, proxy->client_ip, tried, conn);
+		if (next) {
+			LOG_DEBUG_PREFIX(_lggr, "Proxy",
+			         "Retrying the request of " + proxy->getAddress() + " on " +
+			             next->getAddress());
+			next->adopt(*proxy);
+			if (conn->body_upstream == proxy)
+				conn->body_upstream = next;
+			closeProxy(proxy);
+			watchProxy(next);
+			return;
+		}
+	}
+
+	bool streaming = proxy->streaming;
+	std::string address = proxy->getAddress();
+	if (conn && conn->body_upstream == proxy)
+		conn->body_upstream = NULL;
+	closeProxy(proxy);
+	if (!conn)
+		return;
+	_lggr.logWithPrefix(Logger::ERROR, "Proxy", "Request to " + address + " failed");
+	if (streaming) {
+		// The status line is gone already: cut the body short, the client sees it
+		ProxyStream *stream = static_cast<ProxyStream *>(conn->body_stream);
+		stream->finish(false);
+		if (stream->waiting())
+			epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+	} else {
+		prepareResponse(conn, Response(code, conn));
+		epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+	}
+}
+
+void WebServer::closeProxy(Proxy *proxy) {
+	int fd = proxy->getFd();
+	std::vector<int> &idle = _proxy_idle[proxy->getAddress()];
+	std::vector<int>::iterator pos = std::find(idle.begin(), idle.end(), fd);
+	if (pos != idle.end())
+		idle.erase(pos);
+	if (proxy->upstream)
+		proxy->upstream->release(proxy->peer);
+
+	epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	_proxy_conns.erase(fd);
+	delete proxy;
+}
+
+// Passes on the body bytes received so far, re-chunked if the client sent
+// chunks, and stops reading the socket while too much waits for the upstream
+void WebServer::pumpProxyBody(Connection *conn) {
+	Proxy *proxy = conn->body_upstream;
+
+	std::string data;
+	bool done = false;
+	if (conn->chunked) {
+		std::string decoded;
+		uint16_t code = decodeChunkedBody(conn, decoded, done);
+		if (code) {
+			failProxyBody(conn, code);
+			return;
+		}
+		if (!decoded.empty())
+			ResponseStream::appendChunk(data, decoded);
+		if (done)
+			ResponseStream::appendLastChunk(data);
+	} else {
+		// Bytes past Content-Length would be a pipelined request, they are dropped
+		data = conn->read_buffer.substr(0, conn->content_length - conn->body_bytes_read);
+		conn->read_buffer.clear();
+		conn->body_bytes_read += data.size();
+		done = (static_cast<ssize_t>(conn->body_bytes_read) == conn->content_length);
+	}
+	proxy->sendBody(data, done);
+	watchProxy(proxy);
+
+	if (done) {
+		LOG_DEBUG_PREFIX(_lggr, "Proxy",
+		         "Streamed a request body of " + su::to_string(conn->body_bytes_read) +
+		             " bytes");
+		conn->body_streaming = false;
+		conn->body_upstream = NULL;
+		conn->body_paused = false;
+		conn->read_buffer.clear();
+		conn->state = Connection::REQUEST_COMPLETE;
+		conn->request_count++;
+		if (!conn->response_ready)
+			epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLRDHUP);
+	} else if (proxy->pendingOutput() >= Proxy::BODY_HIGH_WATER && !conn->body_paused) {
+		conn->body_paused = true;
+		epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLRDHUP);
+	}
+}
+
+// The body is invalid or too large: answer that and drop the upstream request
+void WebServer::failProxyBody(Connection *conn, uint16_t code) {
+	abandonRequestBody(conn);
+	detachProxy(conn);
+	prepareResponse(conn, Response(code, conn));
+	epollManage(EPOLL_CTL_MOD, conn->fd, EPOLLOUT);
+}
+
+// Runs from the main loop: connects past PROXY_CONNECT_TIMEOUT are retried on
+// another server, exchanges silent for PROXY_TIMEOUT are answered with 504
+void WebServer::checkProxyTimeouts() {
+	time_t now = getCurrentTime();
+	std::vector<Proxy *> connects;
+	std::vector<Proxy *> expired;
+
+	for (std::map<int, Proxy *>::iterator it = _proxy_conns.begin(); it != _proxy_conns.end();
+	     ++it) {
+		Proxy *proxy = it->second;
+		if (proxy->getState() == Proxy::CONNECTING && now - proxy->start_time >= PROXY_CONNECT_TIMEOUT)
+			connects.push_back(proxy);
+		else if (proxy->getState() == Proxy::ACTIVE && !proxy->paused &&
+		         now - proxy->last_activity >= PROXY_TIMEOUT)
+			expired.push_back(proxy);
+	}
+	for (size_t i = 0; i < connects.size(); ++i) {
+		_lggr.logWithPrefix(Logger::ERROR, "Proxy",
+		                    "Connection to " + connects[i]->getAddress() + " timed out");
+		_metrics.timedOut(Metrics::PROXY);
+		failProxy(connects[i], 504, true);
+	}
+	for (size_t i = 0; i < expired.size(); ++i) {
+		_lggr.logWithPrefix(Logger::ERROR, "Proxy",
+		                    "Request to " + expired[i]->getAddress() + " timed out");
+		_metrics.timedOut(Metrics::PROXY);
+		failProxy(expired[i], 504, false);
+	}
+}
+
+// The connection is going away: abort its request by dropping the upstream connection
+void WebServer::detachProxy(Connection *conn) {
+	std::vector<Proxy *> orphaned;
+	for (std::map<int, Proxy *>::iterator it = _proxy_conns.begin(); it != _proxy_conns.end();
+	     ++it) {
+		if (it->second->client == conn)
+			orphaned.push_back(it->second);
+	}
+	for (size_t i = 0; i < orphaned.size(); ++i)
+		closeProxy(orphaned[i]);
+	conn->body_upstream = NULL;
+}
+
+bool WebServer::isProxyFd(int fd) const { return (_proxy_conns.find(fd) != _proxy_conns.end()); }
@@ -0,0 +1,212 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerReload.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/26 10:41:17 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/26 10:41:17 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "src/CGI/CGICache.hpp"
+#include "src/ConfigParser/ConfigParser.hpp"
+#include "src/HttpServer/HttpServer.hpp"
+#include "src/HttpServer/Structs/Connection.hpp"
+#include "src/HttpServer/Structs/WebServer.hpp"
+#include "src/Proxy/Proxy.hpp"
+#include "src/Proxy/Upstream.hpp"
+
+// SIGHUP. Nothing changes unless the whole file is usable: parsed and validated,
+// its modules loaded, its logs and listening sockets opened
+void WebServer::reloadConfig() {
+	if (_drain_deadline) {
+		_lggr.logWithPrefix(Logger::WARNING, "Reload", "SIGHUP ignored, not serving anymore");
+		return;
+	}
+	_lggr.logWithPrefix(Logger::INFO, "Reload", "SIGHUP, loading " + config_file);
+	std::vector<ServerConfig> servers;
+	std::string prefix = _root_prefix_path;
+	ConfigParser parser(log_level);
+	if (config_file.empty() || !parser.loadConfig(config_file, servers, prefix, log_level) ||
+	    servers.empty()) {
+		_lggr.logWithPrefix(Logger::ERROR, "Reload",
+		                    "Invalid configuration, the one in use is kept");
+		return;
+	}
+	ConfigSnapshot *config = new ConfigSnapshot(servers);
+	if (!loadHandlerModules(config->servers) || !openAccessLogs(config->servers) ||
+	    !openListeners(config->servers)) {
+		_lggr.logWithPrefix(Logger::ERROR, "Reload",
+		                    "Configuration not applied, the one in use is kept");
+		delete config;
+		return;
+	}
+
+	// The sockets of the addresses still served were handed over, the others close:
+	// connections waiting in their backlog are reset
+	std::vector<ServerConfig> &current = _config->servers;
+	for (std::vector<ServerConfig>::iterator it = current.begin(); it != current.end(); ++it) {
+		if (it->getServerFD() != -1 &&
+		    !ServerConfig::find(config->servers, it->getHost(), it->getPort())) {
+			epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, it->getServerFD(), NULL);
+			close(it->getServerFD());
+			_lggr.logWithPrefix(Logger::INFO, it->getHost() + ":" + su::to_string(it->getPort()),
+			                    "No longer served, stopped listening");
+		}
+		it->setServerFD(-1);
+	}
+	for (std::vector<ServerConfig>::iterator it = config->servers.begin();
+	     it != config->servers.end(); ++it)
+		_metrics.addServer(*it);
+	retireUpstreams(config->servers);
+
+	ConfigSnapshot *old = _config;
+	_config = config;
+	_retired_configs.push_back(old);
+	releaseConfig(old); // no longer the latest
+	_lggr.logWithPrefix(Logger::INFO, "Reload",
+	                    "Configuration reloaded, " + su::to_string(_retired_configs.size()) +
+	                        " earlier one(s) still in use");
+	freeRetiredUpstreams();
+}
+
+bool WebServer::openListeners(std::vector<ServerConfig> &servers) {
+	std::vector<ServerConfig> &current = _config->servers;
+	std::vector<int> opened;
+	for (std::vector<ServerConfig>::iterator it = servers.begin(); it != servers.end(); ++it) {
+		const ServerConfig *same = ServerConfig::find(current, it->getHost(), it->getPort());
+		if (same) {
+			it->setServerFD(same->getServerFD());
+			applyListenOptions(*it); // the backlog or deferred may have changed
+			continue;
+		}
+		it->setServerFD(-1);
+		if (initializeSingleServer(*it)) {
+			opened.push_back(it->getServerFD());
+			continue;
+		}
+		if (it->getServerFD() != -1)
+			close(it->getServerFD()); // created, not bound
+		for (size_t i = 0; i < opened.size(); ++i) {
+			epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, opened[i], NULL);
+			close(opened[i]);
+		}
+		return (false);
+	}
+	return (true);
+}
+
+// Unless the new configuration has no server on the address the connection came
+// in on: it then keeps its configuration until it closes
+void WebServer::rebindConnection(Connection *conn) {
+	ServerConfig *sc = ServerConfig::find(_config->servers, conn->servConfig->getHost(),
+	                                      conn->servConfig->getPort());
+	if (!sc)
+		return;
+	ConfigSnapshot *old = conn->config;
+	conn->servConfig = sc;
+	conn->config = _config;
+	retainConfig(_config);
+	releaseConfig(old);
+	LOG_DEBUG_PREFIX(_lggr, "Reload",
+	                 "Connection " + su::to_string(conn->fd) + " moved to the new configuration");
+}
+
+ConfigSnapshot *WebServer::configOf(const LocConfig *loc) {
+	if (_config->owns(loc))
+		return (_config);
+	for (size_t i = 0; i < _retired_configs.size(); ++i)
+		if (_retired_configs[i]->owns(loc))
+			return (_retired_configs[i]);
+	return (NULL);
+}
+
+void WebServer::retainConfig(ConfigSnapshot *config) {
+	if (config)
+		++config->refs;
+}
+
+// Its locations' concurrency counts, queues and cgi_cache go with it
+void WebServer::releaseConfig(ConfigSnapshot *config) {
+	if (!config || --config->refs > 0)
+		return;
+	std::vector<ConfigSnapshot *>::iterator pos =
+	    std::find(_retired_configs.begin(), _retired_configs.end(), config);
+	if (pos != _retired_configs.end())
+		_retired_configs.erase(pos);
+	for (std::vector<ServerConfig>::iterator sc = config->servers.begin();
+	     sc != config->servers.end(); ++sc) {
+		_metrics.removeServer(*sc);
+		std::vector<LocConfig> &locations = sc->getLocations();
+		for (size_t i = 0; i < locations.size(); ++i) {
+			LocConfig *loc = &locations[i];
+			_cgi_running.erase(loc);
+			_cgi_queue.erase(loc);
+			std::map<LocConfig *, CGICache *>::iterator cache = _cgi_caches.find(loc);
+			if (cache != _cgi_caches.end()) {
+				delete cache->second;
+				_cgi_caches.erase(cache);
+			}
+		}
+	}
+	delete config;
+	LOG_DEBUG_PREFIX(_lggr, "Reload", "Earlier configuration freed");
+	freeRetiredUpstreams();
+}
+
+static bool sameUpstream(const UpstreamConfig &a, const UpstreamConfig &b) {
+	if (a.balance != b.balance || a.keepalive != b.keepalive ||
+	    a.servers.size() != b.servers.size())
+		return (false);
+	for (size_t i = 0; i < a.servers.size(); ++i) {
+		const UpstreamServer &x = a.servers[i];
+		const UpstreamServer &y = b.servers[i];
+		if (x.address != y.address || x.weight != y.weight || x.max_fails != y.max_fails ||
+		    x.fail_timeout != y.fail_timeout)
+			return (false);
+	}
+	return (true);
+}
+
+// An unchanged upstream keeps its balancer, with the health and the active
+// requests of its servers
+void WebServer::retireUpstreams(std::vector<ServerConfig> &servers) {
+	std::map<std::string, const UpstreamConfig *> configs;
+	for (std::vector<ServerConfig>::iterator sc = servers.begin(); sc != servers.end(); ++sc) {
+		std::vector<LocConfig> &locations = sc->getLocations();
+		for (size_t i = 0; i < locations.size(); ++i)
+			if (locations[i].hasProxyPass())
+				configs[locations[i].getUpstream().name] = &locations[i].getUpstream();
+	}
+	for (std::map<std::string, Upstream *>::iterator it = _upstreams.begin();
+	     it != _upstreams.end();) {
+		std::map<std::string, const UpstreamConfig *>::iterator conf = configs.find(it->first);
+		if (conf != configs.end() && sameUpstream(*conf->second, it->second->getConfig())) {
+			++it;
+			continue;
+		}
+		_retired_upstreams.push_back(it->second);
+		_upstreams.erase(it++);
+	}
+}
+
+// Pooled connections hold no balancer, only those carrying a request do
+void WebServer::freeRetiredUpstreams() {
+	if (_retired_upstreams.empty())
+		return;
+	std::set<Upstream *> used;
+	for (std::map<int, Proxy *>::iterator it = _proxy_conns.begin(); it != _proxy_conns.end();
+	     ++it)
+		if (it->second->upstream)
+			used.insert(it->second->upstream);
+	for (size_t i = 0; i < _retired_upstreams.size();) {
+		if (used.count(_retired_upstreams[i])) {
+			++i;
+			continue;
+		}
+		delete _retired_upstreams[i];
+		_retired_upstreams.erase(_retired_upstreams.begin() + i);
+	}
+}
@@ -0,0 +1,57 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerTiming.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/16 11:20:45 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/16 11:20:45 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "src/HttpServer/HttpServer.hpp"
+#include "src/HttpServer/Structs/Connection.hpp"
+#include "src/HttpServer/Structs/WebServer.hpp"
+
+static std::string milliseconds(double seconds) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.3f", seconds * 1000);
+	return (buf);
+}
+
+// A phase is only recorded the first time it is reached
+void WebServer::markPhase(Connection *conn, Connection::Phase phase) {
+	if (!conn->phases[phase])
+		conn->phases[phase] = monotonicTime();
+}
+
+// header: "read;dur=0.051, route;dur=0.012, ..." up to the response head,
+// otherwise "read=0.051 route=0.012 ..." for every phase reached (ms)
+std::string WebServer::phaseTimings(const Connection &conn, bool header) {
+	// Named after the time spent reaching the phase from the previous one reached
+	static const char *names[Connection::PHASES] = {
+	    "", "wait", "read", "route", "body", "handler", "queue", "send"};
+	int last = header ? Connection::FIRST_SENT : Connection::LAST_SENT;
+	std::string out;
+	double previous = 0;
+	for (int i = Connection::ACCEPTED; i <= last; ++i) {
+		if (!conn.phases[i])
+			continue;
+		if (previous) {
+			out += out.empty() ? "" : header ? ", " : " ";
+			out += names[i];
+			out += (header ? ";dur=" : "=") + milliseconds(conn.phases[i] - previous);
+		}
+		previous = conn.phases[i];
+	}
+	std::string sep = out.empty() ? "" : header ? ", " : " ";
+	if (conn.upstream_time >= 0)
+		out += sep + "upstream" + (header ? ";dur=" : "=") + milliseconds(conn.upstream_time);
+	sep = out.empty() ? "" : header ? ", " : " ";
+	double start = conn.phases[Connection::FIRST_BYTE];
+	double end = previous;
+	if (start && end)
+		out += sep + "total" + (header ? ";dur=" : "=") + milliseconds(end - start);
+	return (out);
+}
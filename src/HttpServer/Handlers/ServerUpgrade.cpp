@@ -0,0 +1,231 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerUpgrade.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/29 09:12:44 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/29 09:12:44 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "src/HttpServer/HttpServer.hpp"
+#include "src/HttpServer/Structs/Connection.hpp"
+#include "src/HttpServer/Structs/WebServer.hpp"
+
+extern char **environ;
+
+// Variables of a handover, not passed on to the next one
+static bool handoverVariable(const char *entry) {
+	static const char *names[] = {"LISTEN_FDS=", "LISTEN_PID=", "LISTEN_FDNAMES=",
+	                              "WEBSERV_UPGRADE_FROM="};
+	for (size_t i = 0; i < sizeof(names) / sizeof(*names); ++i)
+		if (strncmp(entry, names[i], strlen(names[i])) == 0)
+			return (true);
+	return (false);
+}
+
+// SIGUSR2. The binary at argv[0] starts with the listening sockets as fds 3 and
+// up, like systemd's socket activation; once it listens it sends SIGQUIT here
+void WebServer::upgradeBinary() {
+	if (_drain_deadline || _upgrade_pid != -1 || argv.empty()) {
+		_lggr.logWithPrefix(Logger::WARNING, "Upgrade",
+		                    _upgrade_pid != -1 ? "SIGUSR2 ignored, an upgrade is under way"
+		                    : _drain_deadline  ? "SIGUSR2 ignored, not serving anymore"
+		                                       : "SIGUSR2 ignored, the command line is unknown");
+		return;
+	}
+	std::vector<int> fds;
+	std::vector<ServerConfig> &servers = _config->servers;
+	for (std::vector<ServerConfig>::iterator it = servers.begin(); it != servers.end(); ++it)
+		if (it->getServerFD() != -1 &&
+		    std::find(fds.begin(), fds.end(), it->getServerFD()) == fds.end())
+			fds.push_back(it->getServerFD());
+
+	std::vector<std::string> env;
+	for (char **entry = environ; *entry; ++entry)
+		if (!handoverVariable(*entry))
+			env.push_back(*entry);
+	env.push_back("LISTEN_FDS=" + su::to_string(fds.size()));
+	env.push_back("WEBSERV_UPGRADE_FROM=" + su::to_string(getpid()));
+	std::vector<char *> envp;
+	for (size_t i = 0; i < env.size(); ++i)
+		envp.push_back(const_cast<char *>(env[i].c_str()));
+	envp.push_back(NULL);
+	std::vector<char *> args;
+	for (size_t i = 0; i < argv.size(); ++i)
+		args.push_back(const_cast<char *>(argv[i].c_str()));
+	args.push_back(NULL);
+
+	// Through spare numbers above all of them first: a listener may sit where
+	// another one goes. dup2() leaves the copies open across execve()
+	int spare = LISTEN_FDS_START + static_cast<int>(fds.size());
+	for (size_t i = 0; i < fds.size(); ++i)
+		spare = std::max(spare, fds[i] + 1);
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	for (size_t i = 0; i < fds.size(); ++i)
+		posix_spawn_file_actions_adddup2(&actions, fds[i], spare + i);
+	for (size_t i = 0; i < fds.size(); ++i) {
+		posix_spawn_file_actions_adddup2(&actions, spare + i, LISTEN_FDS_START + i);
+		posix_spawn_file_actions_addclose(&actions, spare + i);
+	}
+
+	posix_spawnattr_t attr;
+	sigset_t empty_mask, default_signals;
+	sigemptyset(&empty_mask);
+	sigemptyset(&default_signals);
+	sigaddset(&default_signals, SIGPIPE);
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &empty_mask);
+	posix_spawnattr_setsigdefault(&attr, &default_signals);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	pid_t pid = -1;
+	int err = posix_spawnp(&pid, args[0], &actions, &attr, &args[0], &envp[0]);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+	if (err != 0) {
+		_lggr.logWithPrefix(Logger::ERROR, "Upgrade",
+		                    "Failed to start " + argv[0] + ": " + strerror(err));
+		return;
+	}
+	_upgrade_pid = pid;
+	_lggr.logWithPrefix(Logger::INFO, "Upgrade",
+	                    "SIGUSR2, started " + argv[0] + " as process " + su::to_string(pid) +
+	                        " with " + su::to_string(fds.size()) + " listening socket(s)");
+}
+
+// The new binary did not take over (SIGCHLD before SIGQUIT)
+void WebServer::upgradeFailed(int status) {
+	_upgrade_pid = -1;
+	_lggr.logWithPrefix(Logger::ERROR, "Upgrade",
+	                    "New binary exited with " +
+	                        (WIFEXITED(status) ? "status " + su::to_string(WEXITSTATUS(status))
+	                                           : "signal " + su::to_string(WTERMSIG(status))) +
+	                        " before taking over, still serving");
+}
+
+// Sockets from systemd (LISTEN_PID is this process) or from the process upgrading
+// to this binary, its parent. Anything else in the environment is stale
+void WebServer::takeInheritedSockets() {
+	const char *fds = getenv("LISTEN_FDS");
+	const char *pid = getenv("LISTEN_PID");
+	const char *from = getenv("WEBSERV_UPGRADE_FROM");
+	_upgrade_parent = from ? std::atoi(from) : -1;
+	if (_upgrade_parent != getppid())
+		_upgrade_parent = -1;
+	bool ours = pid ? std::atoi(pid) == getpid() : _upgrade_parent != -1;
+	int count = fds && ours ? std::atoi(fds) : 0;
+	for (int fd = LISTEN_FDS_START; fd < LISTEN_FDS_START + count; ++fd) {
+		if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1)
+			continue; // not open
+		_inherited_fds.push_back(fd);
+	}
+	unsetenv("LISTEN_FDS");
+	unsetenv("LISTEN_PID");
+	unsetenv("LISTEN_FDNAMES");
+	unsetenv("WEBSERV_UPGRADE_FROM");
+	if (!_inherited_fds.empty())
+		_lggr.logWithPrefix(Logger::INFO, "Upgrade",
+		                    "Inherited " + su::to_string(_inherited_fds.size()) +
+		                        " listening socket(s)");
+}
+
+static bool sameAddress(const struct sockaddr_storage &local, const struct sockaddr *addr) {
+	if (local.ss_family != addr->sa_family)
+		return (false);
+	if (addr->sa_family == AF_INET) {
+		const struct sockaddr_in *a = reinterpret_cast<const struct sockaddr_in *>(&local);
+		const struct sockaddr_in *b = reinterpret_cast<const struct sockaddr_in *>(addr);
+		return (a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr);
+	}
+	if (addr->sa_family == AF_INET6) {
+		const struct sockaddr_in6 *a = reinterpret_cast<const struct sockaddr_in6 *>(&local);
+		const struct sockaddr_in6 *b = reinterpret_cast<const struct sockaddr_in6 *>(addr);
+		return (a->sin6_port == b->sin6_port &&
+		        memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(a->sin6_addr)) == 0);
+	}
+	return (false);
+}
+
+int WebServer::adoptSocket(const struct addrinfo *addr_info) {
+	for (std::vector<int>::iterator it = _inherited_fds.begin(); it != _inherited_fds.end();
+	     ++it) {
+		struct sockaddr_storage local;
+		socklen_t len = sizeof(local);
+		int listening = 0;
+		socklen_t optlen = sizeof(listening);
+		if (getsockname(*it, reinterpret_cast<struct sockaddr *>(&local), &len) == -1 ||
+		    !sameAddress(local, addr_info->ai_addr) ||
+		    getsockopt(*it, SOL_SOCKET, SO_ACCEPTCONN, &listening, &optlen) == -1 || !listening)
+			continue;
+		int fd = *it;
+		_inherited_fds.erase(it);
+		return (fd);
+	}
+	return (-1);
+}
+
+// After the servers took theirs. The process upgrading to this one drains now
+void WebServer::releaseInheritedSockets() {
+	for (size_t i = 0; i < _inherited_fds.size(); ++i) {
+		_lggr.logWithPrefix(Logger::WARNING, "Upgrade",
+		                    "Inherited fd " + su::to_string(_inherited_fds[i]) +
+		                        " matches no listen directive, closed");
+		close(_inherited_fds[i]);
+	}
+	_inherited_fds.clear();
+	if (_upgrade_parent == -1)
+		return;
+	kill(_upgrade_parent, SIGQUIT);
+	_lggr.logWithPrefix(Logger::INFO, "Upgrade",
+	                    "Took over from process " + su::to_string(_upgrade_parent));
+	_upgrade_parent = -1;
+}
+
+// SIGQUIT: the listeners close (a new binary holds its own copies), idle
+// connections too, the others after their response
+void WebServer::startDraining() {
+	if (_drain_deadline)
+		return;
+	_drain_deadline = getCurrentTime() + DRAIN_TIMEOUT;
+	std::vector<ServerConfig> &servers = _config->servers;
+	for (std::vector<ServerConfig>::iterator it = servers.begin(); it != servers.end(); ++it) {
+		if (it->getServerFD() == -1)
+			continue;
+		epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, it->getServerFD(), NULL);
+		close(it->getServerFD());
+		it->setServerFD(-1);
+	}
+
+	std::vector<Connection *> idle;
+	for (std::map<int, Connection *>::iterator it = _connections.begin(); it != _connections.end();
+	     ++it) {
+		Connection *conn = it->second;
+		conn->keep_persistent_connection = false;
+		if (conn->request_line.empty() && conn->read_buffer.empty() && !conn->response_ready)
+			idle.push_back(conn);
+	}
+	for (size_t i = 0; i < idle.size(); ++i)
+		closeConnection(idle[i]);
+	_lggr.logWithPrefix(Logger::INFO, "Upgrade",
+	                    "SIGQUIT, stopped accepting; draining " +
+	                        su::to_string(_connections.size()) + " connection(s) for up to " +
+	                        su::to_string(static_cast<int>(DRAIN_TIMEOUT)) + "s");
+}
+
+void WebServer::checkDrain() {
+	if (!_drain_deadline)
+		return;
+	if (_connections.empty()) {
+		_lggr.logWithPrefix(Logger::INFO, "Upgrade", "Connections drained, exiting");
+		_running = false;
+	} else if (getCurrentTime() >= _drain_deadline) {
+		_lggr.logWithPrefix(Logger::WARNING, "Upgrade",
+		                    "Drain deadline reached, closing " +
+		                        su::to_string(_connections.size()) + " connection(s)");
+		_running = false;
+	}
+}
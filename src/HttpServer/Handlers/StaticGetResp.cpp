@@ -12,6 +12,7 @@
 
 #include "src/HttpServer/HttpServer.hpp"
 #include "src/HttpServer/Structs/Connection.hpp"
+#include "src/HttpServer/Structs/DirectoryListing.hpp"
 #include "src/HttpServer/Structs/Response.hpp"
 #include "src/HttpServer/Structs/WebServer.hpp"
 #include "src/Utils/ServerUtils.hpp"
@@ -38,12 +39,13 @@ bool WebServer::handleFileSystemErrors(FileType file_type, const std::string &fu
 
 void WebServer::handleDirectoryRequest(ClientRequest &req, Connection *conn, bool end_slash) {
 
-	const std::string full_path = conn->locConfig->getFullPath();
+	const std::string full_path = req.script_path;
 
-	_lggr.debug("Directory request: " + full_path);
+	LOG_DEBUG(_lggr, "Directory request: " + full_path);
 
 	if (!end_slash) {
-		_lggr.info("Directory request without trailing slash, redirecting to : " + req.path + "/");
+		LOG(_lggr, Logger::INFO,
+		    "Directory request without trailing slash, redirecting to : " + req.path + "/");
 		std::string redirectPath = req.path + "/";
 		prepareResponse(conn, respReturnDirective(conn, 301, redirectPath));
 		return;
@@ -55,22 +57,34 @@ void WebServer::handleDirectoryRequest(ClientRequest &req, Connection *conn, boo
 
 void WebServer::handleFileRequest(ClientRequest &req, Connection *conn, bool end_slash) {
 
-	const std::string full_path = conn->locConfig->getFullPath();
-	_lggr.debug("File request: " + full_path);
+	const std::string full_path = req.script_path;
+	LOG_DEBUG(_lggr, "File request: " + full_path);
 
 	// Trailing '/'? Redirect
 	if (end_slash) { //&& !conn->locConfig->is_exact_()
-		_lggr.info("File request with trailing slash, redirecting: " + req.path);
+		LOG(_lggr, Logger::INFO, "File request with trailing slash, redirecting: " + req.path);
 		std::string redirectPath = req.path.substr(0, req.path.length() - 1);
 		prepareResponse(conn, respReturnDirective(conn, 301, redirectPath));
 		return;
 	}
 	
-	// HANDLE CGI
+	// HANDLE FASTCGI
 	std::string extension = getExtension(full_path);
+	if (conn->locConfig->hasFastCGIPass()) {
+		LOG_DEBUG(_lggr, "FastCGI request, application at " + conn->locConfig->getFastCGIPass());
+		req.extension = extension;
+		uint16_t exit_code = handleFastCGIRequest(req, conn);
+		if (exit_code) {
+			_lggr.error("Handling the FastCGI request failed.");
+			prepareResponse(conn, Response(exit_code, conn));
+		}
+		return;
+	}
+
+	// HANDLE CGI
 	if (conn->locConfig->acceptExtension(extension)) {
 		std::string interpreter = conn->locConfig->getInterpreter(extension);
-		_lggr.debug("CGI request, interpreter location : " + interpreter);
+		LOG_DEBUG(_lggr, "CGI request, interpreter location : " + interpreter);
 		req.extension = extension;
 		uint16_t exit_code = handleCGIRequest(req, conn);
 		if (exit_code) {
@@ -82,7 +96,7 @@ void WebServer::handleFileRequest(ClientRequest &req, Connection *conn, bool end
 
 	// HANDLE STATIC GET RESPONSE
 	if (req.method == "GET") {
-		_lggr.debug("Static file GET request");
+		LOG_DEBUG(_lggr, "Static file GET request");
 		prepareResponse(conn, respFileRequest(conn, full_path));
 		return;
 	} else {
@@ -93,8 +107,45 @@ void WebServer::handleFileRequest(ClientRequest &req, Connection *conn, bool end
 	}
 }
 
+// Reads `key` from a query string of the form a=1&b=2
+static bool queryParam(const std::string &query, const std::string &key, std::string &value) {
+	std::vector<std::string> pairs = su::split(query, '&');
+	for (size_t i = 0; i < pairs.size(); ++i) {
+		size_t eq = pairs[i].find('=');
+		if (eq != std::string::npos && pairs[i].substr(0, eq) == key) {
+			value = pairs[i].substr(eq + 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+// ?page= and ?limit= for autoindex; false on malformed values
+static bool parsePagination(const std::string &query, size_t &page, size_t &limit) {
+	std::string page_str, limit_str;
+	bool has_page = queryParam(query, "page", page_str);
+	bool has_limit = queryParam(query, "limit", limit_str);
+
+	page = 1;
+	limit = 0;
+	if (has_page && (!su::from_string(page_str, page) || page < 1))
+		return false;
+	if (has_limit && (!su::from_string(limit_str, limit) || limit < 1 ||
+	                  limit > AUTOINDEX_MAX_LIMIT))
+		return false;
+	if (has_page && !has_limit)
+		limit = AUTOINDEX_PAGE_LIMIT;
+	return true;
+}
+
 Response WebServer::generateDirectoryListing(Connection *conn, const std::string &fullDirPath) {
-    _lggr.debug("Generating directory listing for: " + fullDirPath);
+    LOG_DEBUG(_lggr, "Generating directory listing for: " + fullDirPath);
+
+    size_t page, limit;
+    if (!parsePagination(conn->parsed_request.query, page, limit)) {
+        _lggr.error("Invalid autoindex pagination: " + conn->parsed_request.query);
+        return Response::badRequest(conn);
+    }
 
     // Open directory
     DIR *dir = opendir(fullDirPath.c_str());
@@ -104,77 +155,17 @@ Response WebServer::generateDirectoryListing(Connection *conn, const std::string
         return Response::notFound(conn);
     }
 
-    // Generate HTML content
-    std::ostringstream htmlContent;
-    struct dirent *entry;
-    htmlContent << "<!DOCTYPE html>\n"
-                << "<html lang=\"en\">\n"
-                << "<head>\n"
-                << "<meta charset=\"UTF-8\">\n"
-                << "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
-                << "<title>Directory Listing - " << fullDirPath << "</title>\n"
-                << "<link rel=\"stylesheet\" href=\"/styles.css\">\n"
-                << "</head>\n<body>\n"
-                << "<div class=\"container\">\n"
-                << "<h1 class=\"title\">Directory Listing</h1>\n"
-                << "<p class=\"subtitle\">" << fullDirPath << "</p>\n"
-                << "<table>\n<tr><th>Name</th><th>Type</th><th>Size</th></tr>\n";
-
-    while ((entry = readdir(dir)) != NULL) {
-        std::string filename = entry->d_name;
-        if (filename == ".")
-            continue;
-
-        std::string fullPath = fullDirPath;
-        if (su::back(fullPath) != '/')
-            fullPath += "/";
-        fullPath += filename;
-
-        struct stat fileStat;
-        htmlContent << "<tr><td><a href=\"" << filename;
-        if (stat(fullPath.c_str(), &fileStat) == 0) {
-            if (S_ISDIR(fileStat.st_mode)) {
-                htmlContent << "/\" class=\"dir\">";
-            } else {
-                htmlContent << "\" class=\"file\">";
-            }
-            htmlContent << filename << "</a></td><td>";
-            if (S_ISDIR(fileStat.st_mode))
-                htmlContent << "<span class=\"dir\">Directory</span>";
-            else if (S_ISREG(fileStat.st_mode))
-                htmlContent << "<span class=\"file\">File</span>";
-            else
-                htmlContent << "Other";
-
-            htmlContent << "</td><td class=\"size\">";
-            if (S_ISREG(fileStat.st_mode))
-                htmlContent << su::to_string(fileStat.st_size);
-            else
-                htmlContent << "-";
-            htmlContent << "</td></tr>\n";
-        } else {
-            htmlContent << "\">" << filename << "</a></td><td>Unknown</td><td>-</td></tr>\n";
-        }
-    }
+    // The listing itself is produced by sendResponse() while readdir() advances
+    bool json = (conn->locConfig->autoindex_format == "json");
+    delete conn->body_stream;
+    conn->body_stream = new DirectoryListing(
+        dir, fullDirPath, json ? DirectoryListing::JSON : DirectoryListing::HTML, page, limit);
+
+    Response resp(200);
+    resp.setContentType(json ? "application/json" : "text/html");
+    resp.setHeader("Transfer-Encoding", "chunked");
 
-    htmlContent << "</table>\n"
-                << "<footer>Generated by WebServer " << __WEBSERV_VERSION__ << "</footer>\n"
-                << "</div>\n"
-                << "<div class=\"floating-elements\">\n"
-                << "<div class=\"floating-element\"></div>\n"
-                << "<div class=\"floating-element\"></div>\n"
-                << "<div class=\"floating-element\"></div>\n"
-                << "</div>\n"
-                << "</body>\n</html>";
-
-    closedir(dir);
-
-    // Create response
-    std::string body = htmlContent.str();
-    Response resp(200, body);
-    resp.setContentType("text/html");
-    resp.setContentLength(body.length());
-
-    _lggr.debug("Generated directory listing (" + su::to_string(body.length()) + " bytes)");
+    LOG_DEBUG(_lggr, "Streaming directory listing (page " + su::to_string(page) + ", limit " +
+                     su::to_string(limit) + ")");
     return resp;
 }
@@ -15,6 +15,7 @@
 
 #include "includes/Webserv.hpp"
 #include "src/CGI/CGI.hpp"
+#include "src/CGI/FastCGI.hpp"
 #include "src/ConfigParser/Structs/Struct.hpp"
 #include "src/Logger/Logger.hpp"
 #include "src/RequestParser/RequestParser.hpp"
@@ -26,6 +27,20 @@
 #define KEEP_ALIVE_TO 5 // seconds
 #define MAX_KEEP_ALIVE_REQS 100
 #define MAX_EVENTS 4096
+#define STREAM_CHUNK_SIZE 16384    // bytes produced per body stream refill
+#define AUTOINDEX_PAGE_LIMIT 100   // default entries per autoindex page
+#define AUTOINDEX_MAX_LIMIT 10000  // upper bound for ?limit=
+#define CGI_TIMEOUT 10             // seconds a FastCGI request may take
+#define MODULE_TIMEOUT 10          // seconds a handler module may take to complete a response
+#define CGI_KILL_GRACE 2           // seconds between SIGTERM and SIGKILL
+#define CGI_RETRY_AFTER 2          // Retry-After of a 503 from a full CGI queue
+#define CGI_MAX_HEADER_SIZE 8192   // bytes of CGI response headers accepted
+#define CGI_COALESCE_MAX 1048576   // bytes of coalesced output held for the waiters
+#define CHUNK_LINE_MAX 4096        // bytes of a chunk size or trailer line, streamed bodies
+#define FASTCGI_KEEPALIVE 16       // idle connections kept per fastcgi_pass address
+#define PROXY_CONNECT_TIMEOUT 5    // seconds a proxy_pass connect() may take
+#define PROXY_TIMEOUT 60           // seconds an upstream may stay silent
+#define PROXY_MAX_HEADER_SIZE 16384 // bytes of upstream response headers accepted
 
 #ifndef uint16_t
 #define uint16_t unsigned short
@@ -0,0 +1,120 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIStream.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/04 11:20:41 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/04 11:20:41 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "CGIStream.hpp"
+#include "src/HttpServer/HttpServer.hpp"
+#include "src/HttpServer/Structs/WebServer.hpp"
+
+CGIStream::CGIStream(WebServer &server, pid_t pid, ssize_t content_length, int splice_fd)
+    : server_(server),
+      pid_(pid),
+      chunked_(content_length < 0),
+      remaining_(content_length < 0 ? 0 : content_length),
+      splice_fd_(content_length > 0 ? splice_fd : -1),
+      paused_(false),
+      waiting_(false),
+      finished_(false),
+      complete_(false) {}
+
+ResponseStream::Status CGIStream::fill(std::string &out, size_t budget) {
+	if (!pending_.empty()) {
+		size_t len = std::min(budget, pending_.size());
+		if (chunked_)
+			ResponseStream::appendChunk(out, pending_.substr(0, len));
+		else
+			out.append(pending_, 0, len);
+		pending_.erase(0, len);
+		waiting_ = false;
+		if (pending_.size() <= LOW_WATER)
+			resume();
+		return (MORE);
+	}
+	if (!finished_) {
+		waiting_ = true;
+		return (PENDING);
+	}
+	// A truncated body can only be signalled by closing the connection
+	if (!complete_)
+		return (FAILED);
+	if (chunked_)
+		ResponseStream::appendLastChunk(out);
+	return (DONE);
+}
+
+bool CGIStream::direct() const {
+	return (splice_fd_ != -1 && pending_.empty() && remaining_ > 0 && !finished_);
+}
+
+ResponseStream::Status CGIStream::transfer(int fd, size_t &sent) {
+	size_t moved = 0;
+	waiting_ = false;
+	while (remaining_ > 0 && moved < SPLICE_BUDGET) {
+		size_t len = std::min(remaining_, SPLICE_BUDGET - moved);
+		ssize_t spliced =
+		    splice(splice_fd_, NULL, fd, NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (spliced > 0) {
+			remaining_ -= spliced;
+			moved += spliced;
+			sent += spliced;
+		} else if (spliced == 0) {
+			splice_fd_ = -1; // EOF, the server reads it and reaps the script
+			break;
+		} else if (errno == EAGAIN) {
+			int queued = 0;
+			if (ioctl(splice_fd_, FIONREAD, &queued) == 0 && queued > 0)
+				return (MORE); // the socket is full, wait for EPOLLOUT
+			break;             // the pipe is empty, wait for the script
+		} else {
+			return (FAILED);
+		}
+	}
+	if (remaining_ > 0 && moved >= SPLICE_BUDGET)
+		return (MORE);
+
+	// Hand the pipe back to the server, which notices new data, EOF and the exit
+	resume();
+	waiting_ = true;
+	return (PENDING);
+}
+
+void CGIStream::append(const std::string &data) {
+	if (chunked_) {
+		pending_ += data;
+		return;
+	}
+	// Anything past the announced length would corrupt the next response
+	size_t len = std::min(remaining_, data.size());
+	pending_.append(data, 0, len);
+	remaining_ -= len;
+}
+
+void CGIStream::finish(bool complete) {
+	finished_ = true;
+	complete_ = complete && (chunked_ || remaining_ == 0);
+	paused_ = false;
+	splice_fd_ = -1;
+}
+
+void CGIStream::pause() { paused_ = true; }
+
+size_t CGIStream::buffered() const { return (pending_.size()); }
+
+bool CGIStream::paused() const { return (paused_); }
+
+bool CGIStream::waiting() const { return (waiting_); }
+
+void CGIStream::resume() {
+	if (!paused_)
+		return;
+	paused_ = false;
+	server_.resumeCGIOutput(pid_);
+}
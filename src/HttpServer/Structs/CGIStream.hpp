@@ -0,0 +1,77 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   CGIStream.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/04 11:20:41 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/04 11:20:41 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CGISTREAM_HPP
+#define CGISTREAM_HPP
+
+#include "ResponseStream.hpp"
+#include "includes/Webserv.hpp"
+
+class WebServer;
+
+/// Body of a CGI response, forwarded while the script is still writing it.
+///
+/// The server appends the script's output as it is read from the pipe; fill()
+/// hands it to the connection, framed as chunks unless the script announced a
+/// Content-Length. Once more than HIGH_WATER bytes wait for the client, the
+/// server stops reading the pipe (pause()) and the stream resumes it when the
+/// client caught up, so a slow client throttles the script instead of the
+/// server's memory.
+///
+/// With a splice fd (cgi_splice, Content-Length only, nothing to reframe) the
+/// body is moved from the script's stdout into the socket by splice() once
+/// the bytes read together with the headers went out.
+class CGIStream : public ResponseStream {
+  public:
+	/// \param content_length Length announced by the script, -1 to send chunks.
+	/// \param splice_fd The script's stdout to splice() from, -1 to copy.
+	CGIStream(WebServer &server, pid_t pid, ssize_t content_length, int splice_fd);
+
+	Status fill(std::string &out, size_t budget);
+	bool direct() const;
+	Status transfer(int fd, size_t &sent);
+
+	/// Queues body bytes read from the script.
+	void append(const std::string &data);
+	/// The script is gone. \param complete False if it failed or timed out.
+	void finish(bool complete);
+	/// Marks the script's stdout as no longer read.
+	void pause();
+
+	size_t buffered() const;
+	bool paused() const;
+	/// True if the last fill() found nothing to send (the client's EPOLLOUT is off).
+	bool waiting() const;
+
+	static const size_t HIGH_WATER = 65536; // buffered bytes that pause the pipe
+	static const size_t LOW_WATER = 16384;  // buffered bytes that resume it
+	static const size_t SPLICE_BUDGET = 1048576; // bytes spliced per transfer() call
+
+  private:
+	WebServer &server_;
+	pid_t pid_;
+	bool chunked_;
+	size_t remaining_; // bytes still expected with a Content-Length
+	int splice_fd_;    // -1 once the pipe hit EOF or the script is gone
+	std::string pending_;
+	bool paused_;
+	bool waiting_;
+	bool finished_;
+	bool complete_;
+
+	CGIStream(const CGIStream &);
+	CGIStream &operator=(const CGIStream &);
+
+	void resume();
+};
+
+#endif
@@ -16,18 +16,57 @@
 
 Connection::Connection(int socket_fd)
     : fd(socket_fd),
+      servConfig(NULL),
+      locConfig(NULL),
+      config(NULL),
       keep_persistent_connection(true),
       body_bytes_read(0),
       content_length(-1),
       chunked(false),
       chunk_size(0),
       chunk_bytes_read(0),
+      body_streaming(false),
+      body_sink(NULL),
+      body_upstream(NULL),
+      body_paused(false),
 	  cgi_response(""),
       response_ready(false),
+      send_offset(0),
+      response_started(false),
+      body_stream(NULL),
       request_count(0),
       should_close(0),
+      upstream_start(0),
+      upstream_time(-1),
+      sent_status(0),
+      bytes_sent(0),
+      capture(NULL),
       state(READING_HEADERS) {
 	updateActivity();
+	for (int i = 0; i < PHASES; ++i)
+		phases[i] = 0;
+}
+
+Connection::~Connection() { delete body_stream; }
+
+void Connection::resetResponseState() {
+	send_buffer.clear();
+	send_offset = 0;
+	response_started = false;
+	delete body_stream;
+	body_stream = NULL;
+}
+
+void Connection::resetAccessRecord() {
+	request_line.clear();
+	referer.clear();
+	user_agent.clear();
+	for (int i = 0; i < PHASES; ++i)
+		phases[i] = 0;
+	upstream_start = 0;
+	upstream_time = -1;
+	sent_status = 0;
+	bytes_sent = 0;
 }
 
 void Connection::updateActivity() { last_activity = time(NULL); }
@@ -45,6 +84,8 @@ std::string Connection::stateToString(Connection::State state) {
 	switch (state) {
 		case Connection::READING_HEADERS:
 			return "READING_HEADERS";
+		case Connection::READING_BODY:
+			return "READING_BODY";
 		case Connection::READING_CHUNK_SIZE:
 			return "READING_CHUNK_SIZE";
 		case Connection::READING_CHUNK_DATA:
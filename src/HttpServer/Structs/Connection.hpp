@@ -14,12 +14,30 @@
 #define CONNECTION_HPP
 
 #include "Response.hpp"
+#include "ResponseStream.hpp"
 #include "includes/Types.hpp"
 #include "includes/Webserv.hpp"
 #include "src/ConfigParser/Structs/Struct.hpp"
 
 class WebServer;
 class Response;
+class CGI;
+class Proxy;
+class TraceCapture;
+class Connection;
+
+/// The request body decoders of WebServer run on a connection of their own,
+/// outside the event loop (tests/bench/microbench.cpp). Each call decodes
+/// `body` whole, from its first chunk size line.
+namespace chunked {
+/// A connection that received `head` with a chunked body, for `loc` of `server`.
+Connection *newConnection(ServerConfig &server, LocConfig *loc, const std::string &head);
+void deleteConnection(Connection *conn);
+/// Buffered path (static uploads). \returns The reassembled body's size, 0 if invalid.
+size_t reassemble(WebServer &ws, Connection *conn, const std::string &body);
+/// Streaming path (CGI and proxy_pass). \returns The decoded size, 0 if invalid.
+size_t decode(WebServer &ws, Connection *conn, const std::string &body, std::string &out);
+} // namespace chunked
 
 /// Represents a client connection to the web server.
 ///
@@ -33,11 +51,16 @@ class Response;
 /// keep-alive functionality.
 class Connection {
 	friend class WebServer;
+	friend Connection *chunked::newConnection(ServerConfig &, LocConfig *, const std::string &);
+	friend void chunked::deleteConnection(Connection *);
+	friend size_t chunked::reassemble(WebServer &, Connection *, const std::string &);
+	friend size_t chunked::decode(WebServer &, Connection *, const std::string &, std::string &);
 
 	int fd;
 
 	ServerConfig *servConfig;
 	LocConfig *locConfig;
+	ConfigSnapshot *config; // servConfig's, referenced until the connection closes
 
 	time_t last_activity;
 	bool keep_persistent_connection;
@@ -56,12 +79,47 @@ class Connection {
 
 	ClientRequest parsed_request;
 
+	bool body_streaming;  // the body goes to a CGI script's stdin or upstream as it arrives
+	CGI *body_sink;       // that script, NULL while it waits for a slot
+	Proxy *body_upstream; // or that proxy_pass connection
+	bool body_paused;     // the script's stdin is full, the socket is not read
+
 	Response response;
 	std::string cgi_response;
 	bool response_ready;
+
+	std::string send_buffer;     // serialized bytes not yet accepted by the socket
+	size_t send_offset;          // bytes of send_buffer already sent
+	bool response_started;       // status line and headers are in send_buffer
+	ResponseStream *body_stream; // streamed body of the current response, owned
 	int request_count;
 	bool should_close;
 
+	/// Boundaries in the life of a request, in the order they are reached.
+	enum Phase {
+		ACCEPTED,       ///< Connection accepted, first request only
+		FIRST_BYTE,     ///< First byte of the request read
+		HEADERS_DONE,   ///< Header block complete
+		ROUTED,         ///< Location matched and path normalized
+		HANDLER_START,  ///< Body read (or streamed), the handler takes over
+		RESPONSE_READY, ///< Response (or its head) prepared
+		FIRST_SENT,     ///< Response head queued to the socket
+		LAST_SENT,      ///< Last byte sent
+		PHASES
+	};
+
+	// Record of the current request for the metrics, the access_log and the slow_log
+	std::string client_addr;  // peer address, taken at accept()
+	std::string request_line; // as received, empty once recorded
+	std::string referer;      // these two only if the server writes an access_log
+	std::string user_agent;
+	double phases[PHASES]; // monotonic seconds each phase was reached, 0 if not (yet)
+	double upstream_start; // script, application, module or upstream called, 0 if none
+	double upstream_time;  // until it answered, -1 if none
+	uint16_t sent_status;  // of the response started, 0 before
+	size_t bytes_sent;     // head and body
+	TraceCapture *capture; // capture_trace file of the server, NULL if none
+
 	/// Represents the current state of request processing.
 	enum State {
 		READING_HEADERS,  ///< Reading request headers
@@ -80,6 +138,8 @@ class Connection {
 	/// \param socket_fd The file descriptor for the client socket.
 	Connection(int socket_fd);
 
+	~Connection();
+
 	/// Updates the last activity timestamp to the current time.
 	void updateActivity();
 
@@ -103,6 +163,12 @@ class Connection {
 
 	void resetForNewRequest(); // reset locConfig body_bytes_read, ...
 
+	/// Drops the send buffer and any attached body stream once a response is done.
+	void resetResponseState();
+
+	/// Forgets the record of a request once it was counted and logged.
+	void resetAccessRecord();
+
   public:
 	ServerConfig *getServerConfig() const { return servConfig; }
 };
@@ -0,0 +1,215 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   DirectoryListing.cpp                               :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: htharrau <htharrau@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/02 10:44:19 by htharrau          #+#    #+#             */
+/*   Updated: 2025/09/02 10:44:19 by htharrau         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "DirectoryListing.hpp"
+#include "src/HttpServer/HttpServer.hpp"
+
+DirectoryListing::DirectoryListing(DIR *dir, const std::string &dir_path, Format format,
+                                   size_t page, size_t limit)
+    : dir_(dir),
+      dir_path_(dir_path),
+      format_(format),
+      page_(page),
+      limit_(limit),
+      to_skip_(limit > 0 && page > 1 ? (page - 1) * limit : 0),
+      emitted_(0),
+      started_(false),
+      has_more_(false) {}
+
+DirectoryListing::~DirectoryListing() {
+	if (dir_)
+		closedir(dir_);
+}
+
+ResponseStream::Status DirectoryListing::fill(std::string &out, size_t budget) {
+	std::string body;
+	bool finished = false;
+
+	if (!started_) {
+		appendHead(body);
+		started_ = true;
+	}
+
+	// Entries of previous pages are only read, never stat()ed
+	for (size_t i = 0; to_skip_ > 0 && i < SKIP_BATCH; ++i) {
+		if (nextEntry() == NULL) {
+			to_skip_ = 0;
+			finished = true;
+		} else {
+			--to_skip_;
+		}
+	}
+	if (to_skip_ > 0) {
+		ResponseStream::appendChunk(out, body);
+		return MORE;
+	}
+
+	while (!finished && body.size() < budget) {
+		struct dirent *entry = nextEntry();
+		if (limit_ > 0 && emitted_ == limit_) {
+			has_more_ = (entry != NULL);
+			finished = true;
+		} else if (entry == NULL) {
+			finished = true;
+		} else {
+			appendEntry(body, entry);
+			++emitted_;
+		}
+	}
+
+	if (finished)
+		appendTail(body);
+	ResponseStream::appendChunk(out, body);
+	if (!finished)
+		return MORE;
+	ResponseStream::appendLastChunk(out);
+	return DONE;
+}
+
+struct dirent *DirectoryListing::nextEntry() {
+	struct dirent *entry;
+	while ((entry = readdir(dir_)) != NULL) {
+		if (std::strcmp(entry->d_name, ".") != 0)
+			return entry;
+	}
+	return NULL;
+}
+
+void DirectoryListing::appendHead(std::string &body) const {
+	std::ostringstream head;
+	if (format_ == JSON) {
+		head << "{\"path\":\"" << jsonEscape(dir_path_) << "\",\"page\":" << (limit_ ? page_ : 1)
+		     << ",\"limit\":" << limit_ << ",\"entries\":[";
+	} else {
+		head << "<!DOCTYPE html>\n"
+		     << "<html lang=\"en\">\n"
+		     << "<head>\n"
+		     << "<meta charset=\"UTF-8\">\n"
+		     << "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0\">\n"
+		     << "<title>Directory Listing - " << htmlEscape(dir_path_) << "</title>\n"
+		     << "<link rel=\"stylesheet\" href=\"/styles.css\">\n"
+		     << "</head>\n<body>\n"
+		     << "<div class=\"container\">\n"
+		     << "<h1 class=\"title\">Directory Listing</h1>\n"
+		     << "<p class=\"subtitle\">" << htmlEscape(dir_path_) << "</p>\n"
+		     << "<table>\n<tr><th>Name</th><th>Type</th><th>Size</th></tr>\n";
+	}
+	body += head.str();
+}
+
+void DirectoryListing::appendEntry(std::string &body, const struct dirent *entry) {
+	std::string filename = entry->d_name;
+	struct stat fileStat;
+	bool known = (fstatat(dirfd(dir_), entry->d_name, &fileStat, 0) == 0);
+	bool is_dir = known && S_ISDIR(fileStat.st_mode);
+	bool is_reg = known && S_ISREG(fileStat.st_mode);
+
+	if (format_ == JSON) {
+		body += (emitted_ > 0) ? ",\n{\"name\":\"" : "\n{\"name\":\"";
+		body += jsonEscape(filename);
+		body += "\",\"type\":\"";
+		body += !known ? "unknown" : is_dir ? "directory" : is_reg ? "file" : "other";
+		body += "\",\"size\":";
+		body += is_reg ? su::to_string(fileStat.st_size) : "null";
+		body += "}";
+		return;
+	}
+
+	std::string name = htmlEscape(filename);
+	if (!known) {
+		body += "<tr><td><a href=\"" + name + "\">" + name +
+		        "</a></td><td>Unknown</td><td>-</td></tr>\n";
+		return;
+	}
+	body += "<tr><td><a href=\"" + name + (is_dir ? "/\" class=\"dir\">" : "\" class=\"file\">");
+	body += name + "</a></td><td>";
+	if (is_dir)
+		body += "<span class=\"dir\">Directory</span>";
+	else if (is_reg)
+		body += "<span class=\"file\">File</span>";
+	else
+		body += "Other";
+	body += "</td><td class=\"size\">";
+	body += is_reg ? su::to_string(fileStat.st_size) : "-";
+	body += "</td></tr>\n";
+}
+
+void DirectoryListing::appendTail(std::string &body) const {
+	std::ostringstream tail;
+	if (format_ == JSON) {
+		tail << "\n],\"has_more\":" << (has_more_ ? "true" : "false") << "}\n";
+		body += tail.str();
+		return;
+	}
+	tail << "</table>\n";
+	if (limit_ > 0 && (page_ > 1 || has_more_)) {
+		tail << "<p class=\"pagination\">";
+		if (page_ > 1)
+			tail << "<a href=\"?page=" << page_ - 1 << "&limit=" << limit_ << "\">Previous</a> ";
+		tail << "Page " << page_;
+		if (has_more_)
+			tail << " <a href=\"?page=" << page_ + 1 << "&limit=" << limit_ << "\">Next</a>";
+		tail << "</p>\n";
+	}
+	tail << "<footer>Generated by WebServer " << __WEBSERV_VERSION__ << "</footer>\n"
+	     << "</div>\n"
+	     << "<div class=\"floating-elements\">\n"
+	     << "<div class=\"floating-element\"></div>\n"
+	     << "<div class=\"floating-element\"></div>\n"
+	     << "<div class=\"floating-element\"></div>\n"
+	     << "</div>\n"
+	     << "</body>\n</html>";
+	body += tail.str();
+}
+
+std::string DirectoryListing::htmlEscape(const std::string &str) {
+	std::string escaped;
+	escaped.reserve(str.size());
+	for (size_t i = 0; i < str.size(); ++i) {
+		switch (str[i]) {
+		case '&':
+			escaped += "&amp;";
+			break;
+		case '<':
+			escaped += "&lt;";
+			break;
+		case '>':
+			escaped += "&gt;";
+			break;
+		case '"':
+			escaped += "&quot;";
+			break;
+		default:
+			escaped += str[i];
+		}
+	}
+	return escaped;
+}
+
+std::string DirectoryListing::jsonEscape(const std::string &str) {
+	std::string escaped;
+	escaped.reserve(str.size());
+	for (size_t i = 0; i < str.size(); ++i) {
+		unsigned char c = static_cast<unsigned char>(str[i]);
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += str[i];
+		} else if (c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			escaped += buf;
+		} else {
+			escaped += str[i];
+		}
+	}
+	return escaped;
+}
@@ -0,0 +1,62 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   DirectoryListing.hpp                               :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: htharrau <htharrau@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/02 10:31:07 by htharrau          #+#    #+#             */
+/*   Updated: 2025/09/02 10:31:07 by htharrau         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef DIRECTORYLISTING_HPP
+#define DIRECTORYLISTING_HPP
+
+#include "ResponseStream.hpp"
+#include "includes/Webserv.hpp"
+
+/// Autoindex page produced while readdir() advances.
+///
+/// The listing is emitted as chunked transfer encoding, one chunk per fill()
+/// call, so neither time-to-first-byte nor memory depend on the directory size.
+/// With a non-zero limit only the entries of the requested page are emitted.
+class DirectoryListing : public ResponseStream {
+  public:
+	enum Format { HTML, JSON };
+
+	/// Takes ownership of `dir`, which is closed on destruction.
+	/// \param page 1-based page number (ignored when limit is 0).
+	/// \param limit Entries per page, 0 lists the whole directory.
+	DirectoryListing(DIR *dir, const std::string &dir_path, Format format, size_t page,
+	                 size_t limit);
+	~DirectoryListing();
+
+	Status fill(std::string &out, size_t budget);
+
+	static const size_t SKIP_BATCH = 4096; // entries skipped per fill() call
+
+  private:
+	DIR *dir_;
+	std::string dir_path_;
+	Format format_;
+	size_t page_;
+	size_t limit_;
+	size_t to_skip_;
+	size_t emitted_;
+	bool started_;
+	bool has_more_;
+
+	DirectoryListing(const DirectoryListing &);
+	DirectoryListing &operator=(const DirectoryListing &);
+
+	struct dirent *nextEntry();
+	void appendHead(std::string &body) const;
+	void appendEntry(std::string &body, const struct dirent *entry);
+	void appendTail(std::string &body) const;
+
+	static std::string htmlEscape(const std::string &str);
+	static std::string jsonEscape(const std::string &str);
+};
+
+#endif
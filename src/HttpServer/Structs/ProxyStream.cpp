@@ -0,0 +1,81 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ProxyStream.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/10 10:04:52 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/10 10:04:52 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "ProxyStream.hpp"
+#include "src/HttpServer/HttpServer.hpp"
+#include "src/HttpServer/Structs/WebServer.hpp"
+
+ProxyStream::ProxyStream(WebServer &server, int fd, ssize_t content_length)
+    : server_(server),
+      fd_(fd),
+      chunked_(content_length < 0),
+      remaining_(content_length < 0 ? 0 : content_length),
+      paused_(false),
+      waiting_(false),
+      finished_(false),
+      complete_(false) {}
+
+ResponseStream::Status ProxyStream::fill(std::string &out, size_t budget) {
+	if (!pending_.empty()) {
+		size_t len = std::min(budget, pending_.size());
+		if (chunked_)
+			ResponseStream::appendChunk(out, pending_.substr(0, len));
+		else
+			out.append(pending_, 0, len);
+		pending_.erase(0, len);
+		waiting_ = false;
+		if (pending_.size() <= LOW_WATER)
+			resume();
+		return (MORE);
+	}
+	if (!finished_) {
+		waiting_ = true;
+		return (PENDING);
+	}
+	// A truncated body can only be signalled by closing the connection
+	if (!complete_)
+		return (FAILED);
+	if (chunked_)
+		ResponseStream::appendLastChunk(out);
+	return (DONE);
+}
+
+void ProxyStream::append(const std::string &data) {
+	if (chunked_) {
+		pending_ += data;
+		return;
+	}
+	size_t len = std::min(remaining_, data.size());
+	pending_.append(data, 0, len);
+	remaining_ -= len;
+}
+
+void ProxyStream::finish(bool complete) {
+	finished_ = true;
+	complete_ = complete && (chunked_ || remaining_ == 0);
+	paused_ = false;
+}
+
+void ProxyStream::pause() { paused_ = true; }
+
+size_t ProxyStream::buffered() const { return (pending_.size()); }
+
+bool ProxyStream::paused() const { return (paused_); }
+
+bool ProxyStream::waiting() const { return (waiting_); }
+
+void ProxyStream::resume() {
+	if (!paused_)
+		return;
+	paused_ = false;
+	server_.resumeProxyOutput(fd_);
+}
@@ -0,0 +1,67 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ProxyStream.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/10 10:04:52 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/10 10:04:52 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef PROXYSTREAM_HPP
+#define PROXYSTREAM_HPP
+
+#include "ResponseStream.hpp"
+#include "includes/Webserv.hpp"
+
+class WebServer;
+
+/// Body of a proxied response, forwarded while the upstream is still sending it.
+///
+/// Works like CGIStream: the server appends the decoded body as it is read
+/// from the upstream socket, fill() frames it as chunks unless the upstream
+/// announced a Content-Length, and the socket is no longer read while more
+/// than HIGH_WATER bytes wait for the client.
+class ProxyStream : public ResponseStream {
+  public:
+	/// \param fd The upstream connection, resumed once the client caught up.
+	/// \param content_length Length announced by the upstream, -1 to send chunks.
+	ProxyStream(WebServer &server, int fd, ssize_t content_length);
+
+	Status fill(std::string &out, size_t budget);
+
+	/// Queues body bytes read from the upstream.
+	void append(const std::string &data);
+	/// The upstream is done. \param complete False if the body was cut short.
+	void finish(bool complete);
+	/// Marks the upstream connection as no longer read.
+	void pause();
+
+	size_t buffered() const;
+	bool paused() const;
+	/// True if the last fill() found nothing to send (the client's EPOLLOUT is off).
+	bool waiting() const;
+
+	static const size_t HIGH_WATER = 65536; // buffered bytes that pause the upstream
+	static const size_t LOW_WATER = 16384;  // buffered bytes that resume it
+
+  private:
+	WebServer &server_;
+	int fd_;
+	bool chunked_;
+	size_t remaining_; // bytes still expected with a Content-Length
+	std::string pending_;
+	bool paused_;
+	bool waiting_;
+	bool finished_;
+	bool complete_;
+
+	ProxyStream(const ProxyStream &);
+	ProxyStream &operator=(const ProxyStream &);
+
+	void resume();
+};
+
+#endif
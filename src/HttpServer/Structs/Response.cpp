@@ -107,6 +107,12 @@ Response Response::notImplemented() { return Response(501); }
 
 Response Response::badGateway() { return Response(502); }
 
+Response Response::serviceUnavailable(unsigned int retry_after) {
+	Response resp(503);
+	resp.setHeader("Retry-After", su::to_string(retry_after));
+	return resp;
+}
+
 Response Response::gatewayTimeout() { return Response(504); }
 
 Response Response::HttpNotSupported() { return Response(505); }
@@ -135,6 +141,12 @@ Response Response::notImplemented(Connection *conn) { return Response(501, conn)
 
 Response Response::badGateway(Connection *conn) { return Response(502, conn); }
 
+Response Response::serviceUnavailable(Connection *conn, unsigned int retry_after) {
+	Response resp(503, conn);
+	resp.setHeader("Retry-After", su::to_string(retry_after));
+	return resp;
+}
+
 Response Response::gatewayTimeout(Connection *conn) { return Response(504, conn); }
 
 Response Response::HttpNotSupported(Connection *conn) { return Response(505, conn); }
@@ -63,6 +63,7 @@ class Response {
 	static Response notImplemented();
 	static Response forbidden();
 	static Response badGateway();
+	static Response serviceUnavailable(unsigned int retry_after);
 	static Response gatewayTimeout();
 	static Response HttpNotSupported();
 
@@ -75,6 +76,7 @@ class Response {
 	static Response notImplemented(Connection *conn);
 	static Response forbidden(Connection *conn);
 	static Response badGateway(Connection *conn);
+	static Response serviceUnavailable(Connection *conn, unsigned int retry_after);
 	static Response gatewayTimeout(Connection *conn);
 	static Response HttpNotSupported(Connection *conn);
 
@@ -0,0 +1,64 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ResponseStream.hpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: htharrau <htharrau@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/02 10:12:41 by htharrau          #+#    #+#             */
+/*   Updated: 2025/09/02 10:12:41 by htharrau         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef RESPONSESTREAM_HPP
+#define RESPONSESTREAM_HPP
+
+#include "includes/Webserv.hpp"
+
+/// Producer for response bodies that are generated while the response is sent.
+///
+/// A stream is attached to a Connection next to a header-only Response. Every
+/// time the connection's send buffer is drained, sendResponse() asks the stream
+/// for more wire data (already framed, e.g. as HTTP chunks).
+class ResponseStream {
+  public:
+	enum Status {
+		MORE,    ///< More data will follow, call fill() again
+		PENDING, ///< Nothing available yet, the producer re-arms EPOLLOUT itself
+		DONE,    ///< Body complete, terminating data already appended
+		FAILED   ///< Unrecoverable error, the connection has to be closed
+	};
+
+	virtual ~ResponseStream() {}
+
+	/// Appends roughly up to `budget` bytes of wire data to `out`.
+	virtual Status fill(std::string &out, size_t budget) = 0;
+
+	/// True while the stream writes to the socket itself (see transfer()).
+	virtual bool direct() const { return false; }
+
+	/// Moves body data into the socket without copying it through the server,
+	/// called instead of fill() while direct() holds. Adds the bytes moved to `sent`.
+	virtual Status transfer(int fd, size_t &sent) {
+		(void)fd;
+		(void)sent;
+		return FAILED;
+	}
+
+	/// Frames `data` as a single chunk of a chunked transfer-encoded body.
+	static void appendChunk(std::string &out, const std::string &data) {
+		if (data.empty())
+			return;
+		std::ostringstream size;
+		size << std::hex << data.size();
+		out += size.str();
+		out += "\r\n";
+		out += data;
+		out += "\r\n";
+	}
+
+	/// Appends the terminating zero-length chunk.
+	static void appendLastChunk(std::string &out) { out += "0\r\n\r\n"; }
+};
+
+#endif
@@ -12,39 +12,54 @@
 
 #include "WebServer.hpp"
 #include "Logger/Logger.hpp"
+#include "src/CGI/CGICache.hpp"
 #include "src/ConfigParser/Structs/Struct.hpp"
 #include "src/HttpServer/HttpServer.hpp"
 #include "src/HttpServer/Structs/Connection.hpp"
 #include "src/HttpServer/Structs/Response.hpp"
+#include "src/Proxy/Proxy.hpp"
+#include "src/Proxy/Upstream.hpp"
 
 bool WebServer::_running;
 static bool interrupted = false;
 
 WebServer::WebServer(std::vector<ServerConfig> &confs)
     : _epoll_fd(-1),
-      _backlog(SOMAXCONN),
-      _confs(confs),
+      _signal_fd(-1),
+      _module_fd(-1),
+      _module_notify_fd(-1),
+      _config(new ConfigSnapshot(confs)),
+      _upgrade_parent(-1),
+      _upgrade_pid(-1),
+      _drain_deadline(0),
       _lggr("ws.log", Logger::DEBUG, true) {
+	_lggr.setBuffered(true);
 	_lggr.info("An instance of the Webserver was created.");
 }
 
 // DEPRECATED?
 WebServer::WebServer(std::vector<ServerConfig> &confs, std::string &prefix_path, int log_level)
     : _epoll_fd(-1),
-      _backlog(SOMAXCONN),
+      _signal_fd(-1),
+      _module_fd(-1),
+      _module_notify_fd(-1),
       _root_prefix_path(prefix_path),
-      _confs(confs),
+      _config(new ConfigSnapshot(confs)),
+      _upgrade_parent(-1),
+      _upgrade_pid(-1),
+      _drain_deadline(0),
       _lggr("ws.log",
             log_level == 0 ? Logger::ERROR
                            : (log_level == 1     ? Logger::WARNING
                               : (log_level == 2) ? Logger::INFO
                                                  : Logger::DEBUG),
             true) {
+	_lggr.setBuffered(true);
 	_lggr.info("An instance of the Webserver was created.");
 }
 
 WebServer::~WebServer() {
-	_lggr.debug("Destroying Webserver instance.");
+	LOG_DEBUG(_lggr, "Destroying Webserver instance.");
 	cleanup();
 }
 
@@ -53,7 +68,7 @@ bool WebServer::initialize() {
 		return false;
 	}
 
-	if (_confs.empty()) {
+	if (_config->servers.empty()) {
 		_lggr.error("No server configurations provided. Cannot initialize WebServer");
 		return false;
 	}
@@ -61,12 +76,28 @@ bool WebServer::initialize() {
 	if (!createEpollInstance()) {
 		return false;
 	}
+	takeInheritedSockets();
 
-	for (std::vector<ServerConfig>::iterator it = _confs.begin(); it != _confs.end(); ++it) {
+	if (!setupChildReaper()) {
+		return false;
+	}
+
+	if (!loadHandlerModules(_config->servers)) {
+		return false;
+	}
+
+	if (!openAccessLogs(_config->servers)) {
+		return false;
+	}
+
+	std::vector<ServerConfig> &servers = _config->servers;
+	for (std::vector<ServerConfig>::iterator it = servers.begin(); it != servers.end(); ++it) {
 		if (!initializeSingleServer(*it)) {
 			return false;
 		}
+		_metrics.addServer(*it);
 	}
+	releaseInheritedSockets();
 
 	_running = true;
 	return true;
@@ -76,7 +107,7 @@ void WebServer::run() {
 	struct epoll_event events[MAX_EVENTS];
 	_last_cleanup = getCurrentTime();
 
-	_lggr.debug("Server running. Waiting for connections...");
+	LOG_DEBUG(_lggr, "Server running. Waiting for connections...");
 
 	while (_running) {
 		int event_count = epoll_wait(_epoll_fd, events, MAX_EVENTS, 100);
@@ -91,14 +122,21 @@ void WebServer::run() {
 
 		if (event_count > 0) {
 			processEpollEvents(events, event_count);
-			// _lggr.debug("Processed " + su::to_string(event_count) + " events");
+			// LOG_DEBUG(_lggr, "Processed " + su::to_string(event_count) + " events");
 			if (event_count == MAX_EVENTS) {
 				_lggr.warn("Hit MAX_EVENTS limit (" + su::to_string(MAX_EVENTS) +
 				           "), may have more events pending");
 			}
 		}
 
+		checkCGITimeouts();
+		checkFastCGITimeouts();
+		checkModuleTimeouts();
+		checkProxyTimeouts();
 		cleanupExpiredConnections();
+		checkDrain();
+		flushAccessLogs();
+		_lggr.flush(); // what this iteration logged, one write per output
 	}
 
 	//for (std::vector<ServerConfig>::iterator it = _confs.begin(); it != _confs.end(); ++it) {
@@ -115,7 +153,7 @@ void sigint_handler(int sig) {
 }
 
 bool WebServer::setupSignalHandlers() {
-	_lggr.debug("Setting up signal handlers");
+	LOG_DEBUG(_lggr, "Setting up signal handlers");
 
 	if (signal(SIGINT, &sigint_handler) == SIG_ERR) {
 		_lggr.error("Failed to set SIGINT handler");
@@ -127,12 +165,71 @@ bool WebServer::setupSignalHandlers() {
 		return false;
 	}
 
+	// A script exiting before reading its stdin must not kill the server
+	if (signal(SIGPIPE, SIG_IGN) == SIG_ERR) {
+		_lggr.error("Failed to ignore SIGPIPE");
+		return false;
+	}
+
 	interrupted = false;
 	return true;
 }
 
+bool WebServer::setupChildReaper() {
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGCHLD);
+	sigaddset(&mask, SIGUSR1);
+	sigaddset(&mask, SIGHUP);
+	sigaddset(&mask, SIGUSR2);
+	sigaddset(&mask, SIGQUIT);
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+		_lggr.error("Failed to block SIGCHLD: " + std::string(strerror(errno)));
+		return false;
+	}
+
+	_signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (_signal_fd == -1) {
+		_lggr.error("Failed to create signalfd: " + std::string(strerror(errno)));
+		return false;
+	}
+	return epollManage(EPOLL_CTL_ADD, _signal_fd, EPOLLIN);
+}
+
+// Several signals of a kind may be merged into one entry, the handlers check for more work
+void WebServer::handleSignals() {
+	struct signalfd_siginfo info;
+	bool child = false;
+	bool reopen = false;
+	bool reload = false;
+	bool upgrade = false;
+	bool drain = false;
+	while (read(_signal_fd, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info))) {
+		if (info.ssi_signo == SIGCHLD)
+			child = true;
+		else if (info.ssi_signo == SIGUSR1)
+			reopen = true;
+		else if (info.ssi_signo == SIGHUP)
+			reload = true;
+		else if (info.ssi_signo == SIGUSR2)
+			upgrade = true;
+		else if (info.ssi_signo == SIGQUIT)
+			drain = true;
+	}
+	if (child)
+		handleChildExit();
+	if (reopen)
+		reopenAccessLogs();
+	if (reload)
+		reloadConfig();
+	if (drain)
+		startDraining();
+	if (upgrade)
+		upgradeBinary();
+}
+
 bool WebServer::createEpollInstance() {
-	_epoll_fd = epoll_create1(0);
+	_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
 	if (_epoll_fd == -1) {
 		_lggr.error("Failed to create epoll instance");
 		return false;
@@ -160,8 +257,9 @@ bool WebServer::resolveAddress(const ServerConfig &config, struct addrinfo **res
 }
 
 bool WebServer::createAndConfigureSocket(ServerConfig &config, const struct addrinfo *addr_info) {
-	config.setServerFD(
-	    socket(addr_info->ai_family, addr_info->ai_socktype, addr_info->ai_protocol));
+	// Close-on-exec: a CGI script must not keep a listener open after a reload drops it
+	config.setServerFD(socket(addr_info->ai_family, addr_info->ai_socktype | SOCK_CLOEXEC,
+	                          addr_info->ai_protocol));
 	if (config.getServerFD() == -1) {
 		_lggr.logWithPrefix(Logger::ERROR,
 		                    config.getHost() + ":" + su::to_string<int>(config.getPort()),
@@ -192,7 +290,7 @@ bool WebServer::setSocketOptions(int socket_fd, const std::string &host, const i
 }
 
 bool WebServer::setNonBlocking(int fd) {
-	_lggr.debug("Setting fd [" + su::to_string(fd) + "] as non-blocking");
+	LOG_DEBUG(_lggr, "Setting fd [" + su::to_string(fd) + "] as non-blocking");
 
 	int flags = fcntl(fd, F_GETFL, 0);
 	if (flags == -1) {
@@ -216,13 +314,27 @@ bool WebServer::bindAndListen(const ServerConfig &config, const struct addrinfo
 		return false;
 	}
 
-	if (listen(config.getServerFD(), _backlog) == -1) {
+	return applyListenOptions(config);
+}
+
+// listen() again only changes the backlog, for a socket inherited or kept by a reload
+bool WebServer::applyListenOptions(const ServerConfig &config) {
+	if (listen(config.getServerFD(), config.getBacklog()) == -1) {
 		_lggr.logWithPrefix(Logger::ERROR,
 		                    config.getHost() + ":" + su::to_string<int>(config.getPort()),
 		                    "Failed to listen on socket");
 		return false;
 	}
 
+	// Seconds a connection that sent nothing waits in the kernel before accept() sees it
+	int defer = config.defersAccept() ? DEFER_ACCEPT_TIMEOUT : 0;
+	if (setsockopt(config.getServerFD(), IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer, sizeof(defer)) ==
+	    -1) {
+		_lggr.logWithPrefix(Logger::ERROR,
+		                    config.getHost() + ":" + su::to_string<int>(config.getPort()),
+		                    "Failed to set TCP_DEFER_ACCEPT option");
+		return false;
+	}
 	return true;
 }
 
@@ -240,11 +352,11 @@ bool WebServer::epollManage(int op, int socket_fd, uint32_t events) {
 		            "), but encountered an error (" + std::string(strerror(errno)) + ")");
 		return false;
 	}
-	_lggr.debug("Fd: " + su::to_string(socket_fd) +
-	            std::string(op == EPOLL_CTL_ADD   ? " added to epoll instance with mask "
-	                        : op == EPOLL_CTL_MOD ? " modified with new mask "
-	                                              : " deleted from epoll instance.") +
-	            std::string(op == EPOLL_CTL_DEL ? "" : "(" + describeEpollEvents(events) + ")"));
+	LOG_DEBUG(_lggr, "Fd: " + su::to_string(socket_fd) +
+	                 std::string(op == EPOLL_CTL_ADD   ? " added to epoll instance with mask "
+	                             : op == EPOLL_CTL_MOD ? " modified with new mask "
+	                                                   : " deleted from epoll instance.") +
+	                 std::string(op == EPOLL_CTL_DEL ? "" : "(" + describeEpollEvents(events) + ")"));
 
 	return true;
 }
@@ -256,30 +368,37 @@ bool WebServer::initializeSingleServer(ServerConfig &config) {
 		return false;
 	}
 
-	if (!createAndConfigureSocket(config, addr_info)) {
-		freeaddrinfo(addr_info);
-		return false;
-	}
-
-	if (!bindAndListen(config, addr_info)) {
+	// Handed over by systemd or the binary this one replaces: already bound and listening
+	int inherited = adoptSocket(addr_info);
+	if (inherited != -1) {
+		config.setServerFD(inherited);
+		if (!setNonBlocking(inherited) || !applyListenOptions(config)) {
+			freeaddrinfo(addr_info);
+			return false;
+		}
+	} else if (!createAndConfigureSocket(config, addr_info) ||
+	           !bindAndListen(config, addr_info)) {
 		freeaddrinfo(addr_info);
 		return false;
 	}
 
-	if (!epollManage(EPOLL_CTL_ADD, config.getServerFD(), EPOLLIN)) {
+	// Exclusive: when several event loops watch the socket (the old and the new process
+	// of an upgrade), a connection wakes one of them only
+	if (!epollManage(EPOLL_CTL_ADD, config.getServerFD(), EPOLLIN | EPOLLEXCLUSIVE)) {
 		freeaddrinfo(addr_info);
 		return false;
 	}
 
 	freeaddrinfo(addr_info);
 	_lggr.logWithPrefix(Logger::INFO, config.getHost() + ":" + su::to_string<int>(config.getPort()),
-	                    "Server initialized!");
+	                    inherited != -1 ? "Server initialized on an inherited socket!"
+	                                    : "Server initialized!");
 
 	return true;
 }
 
 void WebServer::cleanup() {
-	_lggr.debug("Performing server cleanup...");
+	LOG_DEBUG(_lggr, "Performing server cleanup...");
 
 	// Close all client connections
 	for (std::map<int, Connection *>::iterator it = _connections.begin(); it != _connections.end();
@@ -289,73 +408,68 @@ void WebServer::cleanup() {
 	}
 	_connections.clear();
 
-	for (std::vector<ServerConfig>::iterator it = _confs.begin(); it != _confs.end(); ++it) {
-		if (it->getServerFD() != -1) {
-			close(it->getServerFD());
-			it->setServerFD(-1);
-		}
+	// Scripts still running are killed, nobody is left to answer
+	for (std::map<pid_t, std::pair<CGI *, Connection *> >::iterator it = _cgi_children.begin();
+	     it != _cgi_children.end(); ++it) {
+		kill(it->first, SIGKILL);
+		waitpid(it->first, NULL, 0);
+		delete it->second.first;
 	}
+	_cgi_children.clear();
+	_cgi_pool.clear();
 
-	if (_epoll_fd != -1) {
-		close(_epoll_fd);
-		_epoll_fd = -1;
-	}
+	for (std::map<LocConfig *, CGICache *>::iterator it = _cgi_caches.begin();
+	     it != _cgi_caches.end(); ++it)
+		delete it->second; // unlinks the spilled entries
+	_cgi_caches.clear();
 
-	_lggr.info("Server cleanup completed");
-}
+	for (std::map<int, FastCGI *>::iterator it = _fcgi_conns.begin(); it != _fcgi_conns.end();
+	     ++it)
+		delete it->second;
+	_fcgi_conns.clear();
+	_fcgi_idle.clear();
 
-std::string getCurrentWorkingDirectory() {
-	char cwd[PATH_MAX];
-	if (getcwd(cwd, sizeof(cwd)) == NULL) {
-		std::cerr << "Warning: could not resolve current working directory." << std::endl;
-		return "";
-	}
-	std::string dir(cwd);
-	return dir;
-}
+	for (std::map<int, Proxy *>::iterator it = _proxy_conns.begin(); it != _proxy_conns.end();
+	     ++it)
+		delete it->second;
+	_proxy_conns.clear();
+	_proxy_idle.clear();
+	for (std::map<std::string, Upstream *>::iterator it = _upstreams.begin();
+	     it != _upstreams.end(); ++it)
+		delete it->second;
+	_upstreams.clear();
+	for (size_t i = 0; i < _retired_upstreams.size(); ++i)
+		delete _retired_upstreams[i];
+	_retired_upstreams.clear();
 
-int main(int argc, char *argv[]) {
-	ArgumentParser ap;
-	ServerArgs args;
+	unloadHandlerModules();
+	closeAccessLogs();
 
-	try {
-		args = ap.parseArgs(argc, argv);
-		if (args.show_help) {
-			ap.printUsage(argv[0]);
-			return 0;
-		}
-		if (args.show_version) {
-			std::cout << __WEBSERV_VERSION__ << std::endl;
-			return 0;
-		}
-		if (args.prefix_path.empty()) {
-			args.prefix_path = getCurrentWorkingDirectory();
-		}
-		std::cout << "prefix_path: " << args.prefix_path << std::endl;
-	} catch (const std::exception &e) {
-		std::cerr << "Error: " << e.what() << std::endl;
-		std::cerr << "Use --help for usage information." << std::endl;
-		return 1;
+	if (_signal_fd != -1) {
+		close(_signal_fd);
+		_signal_fd = -1;
 	}
 
-	ConfigParser configparser(args.log_level);
-	std::vector<ServerConfig> servers;
-
-	if (!configparser.loadConfig(args.config_file, servers, args.prefix_path, args.log_level)) {
-		std::cerr << "Error: Failed to open or parse configuration file '" << args.config_file
-		          << "'" << std::endl;
-		std::cerr << "Please check the configuration file syntax and try again." << std::endl;
-		return 1;
+	// The retired configurations' servers gave their sockets to the latest one
+	if (_config) {
+		std::vector<ServerConfig> &servers = _config->servers;
+		for (std::vector<ServerConfig>::iterator it = servers.begin(); it != servers.end(); ++it) {
+			if (it->getServerFD() != -1) {
+				close(it->getServerFD());
+				it->setServerFD(-1);
+			}
+		}
 	}
+	for (size_t i = 0; i < _retired_configs.size(); ++i)
+		delete _retired_configs[i];
+	_retired_configs.clear();
+	delete _config;
+	_config = NULL;
 
-	WebServer webserv(servers, args.prefix_path, args.log_level);
-
-    webserv.log_level = args.log_level;
-	if (!webserv.initialize()) {
-		std::cerr << "Failed to initialize web server." << std::endl;
-		return 1;
+	if (_epoll_fd != -1) {
+		close(_epoll_fd);
+		_epoll_fd = -1;
 	}
 
-	webserv.run();
-	return 0;
+	_lggr.info("Server cleanup completed");
 }
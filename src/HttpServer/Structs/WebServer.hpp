@@ -20,11 +20,20 @@
 #include "src/ConfigParser/Structs/Struct.hpp"
 #include "src/HttpServer/HttpServer.hpp"
 #include "src/Logger/Logger.hpp"
+#include "src/Metrics/Metrics.hpp"
 #include "src/Utils/ServerUtils.hpp"
 
 class ServerConfig; // Still needed to break potential circular dependencies
 class Connection;
 class CGI;
+class CGICache;
+class FastCGI;
+class HandlerModule;
+class Proxy;
+class Upstream;
+class AccessLog;
+class TraceCapture;
+struct ws_response;
 
 /// HTTP web server implementation using epoll for event-driven I/O.
 ///
@@ -56,25 +65,91 @@ class WebServer {
 	/// Global flag indicating if the server should continue running.
 	static bool _running;
 	int log_level;
+	std::string config_file;       // loaded again on SIGHUP
+	std::vector<std::string> argv; // started again on SIGUSR2
 
   private:
 	int _epoll_fd;
-	int _backlog;
+	int _signal_fd; // SIGCHLD, SIGUSR1, SIGUSR2, SIGHUP and SIGQUIT through the epoll loop
+	int _module_fd;        // read end of the handler modules' completion pipe
+	int _module_notify_fd; // write end, passed to the modules' responses
 	std::string _root_prefix_path;
 
-	std::vector<ServerConfig> _confs;
+	/// @brief Latest configuration, new connections and requests get its servers
+	ConfigSnapshot *_config;
+
+	/// @brief Configurations replaced by a reload, until nothing uses them anymore
+	std::vector<ConfigSnapshot *> _retired_configs;
 	std::vector<ServerConfig> _have_pending_conn;
 
+	/// @brief Listening sockets from LISTEN_FDS not taken by a server yet
+	std::vector<int> _inherited_fds;
+	pid_t _upgrade_parent; // process upgrading to this one, told to drain once listening
+	pid_t _upgrade_pid;    // new binary started by SIGUSR2, -1 if none
+	time_t _drain_deadline; // exit time once SIGQUIT stopped accepting, 0 before
+
 	static const int CONNECTION_TO = 30;   // seconds
+	static const int DRAIN_TIMEOUT = 30;   // seconds
+	static const int LISTEN_FDS_START = 3; // systemd's SD_LISTEN_FDS_START
+	static const int ACCEPT_BUDGET = 64;       // connections accepted per listener wakeup
+	static const int DEFER_ACCEPT_TIMEOUT = 5; // seconds, listen ... deferred
 	static const int CLEANUP_INTERVAL = 5; // seconds
 	static const int BUFFER_SIZE = 4096 * 3;
 
 	Logger _lggr;
 	static std::map<uint16_t, std::string> err_messages;
 
-	/// @brief List of all CGI Objects
+	/// @brief CGI pipe fds registered in epoll, mapped to their script
 	std::map<int, std::pair<CGI *, Connection *> > _cgi_pool;
 
+	/// @brief Running CGI scripts by pid, owns the CGI objects
+	std::map<pid_t, std::pair<CGI *, Connection *> > _cgi_children;
+
+	/// @brief Scripts running per location, bounded by cgi_max_concurrency
+	std::map<LocConfig *, size_t> _cgi_running;
+
+	/// @brief Requests waiting for a free slot per location, oldest first
+	std::map<LocConfig *, std::deque<QueuedCGI> > _cgi_queue;
+
+	/// @brief Coalesced executions in flight by key, with the identical requests waiting on them
+	std::map<std::string, std::vector<QueuedCGI> > _cgi_waiters;
+
+	/// @brief Response caches of the cgi_cache locations, created on first use
+	std::map<LocConfig *, CGICache *> _cgi_caches;
+
+	/// @brief FastCGI upstream connections by fd, busy or idle
+	std::map<int, FastCGI *> _fcgi_conns;
+
+	/// @brief Idle keep-alive FastCGI connections per fastcgi_pass address
+	std::map<std::string, std::vector<int> > _fcgi_idle;
+
+	/// @brief Native handler modules by shared object path, loaded at startup
+	std::map<std::string, HandlerModule *> _modules;
+
+	/// @brief Requests handed to a module that did not complete yet
+	std::set<ws_response *> _module_calls;
+
+	/// @brief proxy_pass upstream connections by fd, busy or idle
+	std::map<int, Proxy *> _proxy_conns;
+
+	/// @brief Idle keep-alive upstream connections per server address
+	std::map<std::string, std::vector<int> > _proxy_idle;
+
+	/// @brief Balancers of the upstream blocks by name, created on first use
+	std::map<std::string, Upstream *> _upstreams;
+
+	/// @brief Balancers a reload changed, until no upstream connection uses them
+	std::vector<Upstream *> _retired_upstreams;
+
+	/// @brief Files of the access_log directives by path, opened at startup
+	std::map<std::string, AccessLog *> _access_logs;
+
+	/// @brief Files of the capture_trace directives by path
+	std::map<std::string, TraceCapture *> _captures;
+
+	/// @brief Counters and histograms served by the metrics locations
+	Metrics _metrics;
+
 	// Connection management arguments
 	std::map<int, Connection *> _connections;
 	time_t _last_cleanup;
@@ -88,6 +163,16 @@ class WebServer {
 	/// \returns True on success, false on failure.
 	bool setupSignalHandlers();
 
+	/// Blocks SIGCHLD, SIGUSR1, SIGUSR2, SIGHUP and SIGQUIT and routes them through a
+	/// signalfd watched by epoll.
+	/// \returns True on success, false on failure.
+	bool setupChildReaper();
+
+	/// Reads the signals queued on the signalfd: reaps children on SIGCHLD,
+	/// reopens the access logs on SIGUSR1, reloads the configuration on SIGHUP,
+	/// starts the binary again on SIGUSR2 and drains on SIGQUIT.
+	void handleSignals();
+
 	/// Creates and configures the main epoll instance.
 	/// \returns True on success, false on failure.
 	bool createEpollInstance();
@@ -123,6 +208,10 @@ class WebServer {
 	/// \returns True on successful bind and listen, false otherwise.
 	bool bindAndListen(const ServerConfig &config, const struct addrinfo *addr_info);
 
+	/// Sets the backlog and TCP_DEFER_ACCEPT of the listen directive on its socket.
+	/// \returns True on success, false on failure.
+	bool applyListenOptions(const ServerConfig &config);
+
 	/// Manages epoll events for file descriptors.
 	/// \param op The epoll operation (EPOLL_CTL_ADD, EPOLL_CTL_MOD, EPOLL_CTL_DEL).
 	/// \param socket_fd The file descriptor to manage.
@@ -152,7 +241,40 @@ class WebServer {
 	bool reconstructRequest(Connection *conn);
 
 
+	/// Answers a request from cgi_cache, runs its script, or attaches it to an identical
+	/// one in flight (cgi_coalesce).
 	uint16_t handleCGIRequest(ClientRequest &req, Connection *conn);
+	/// Starts the script, queues it for a cgi_max_concurrency slot or answers 503.
+	/// \param key Coalescing key the request leads, empty if none.
+	uint16_t admitCGI(ClientRequest &req, Connection *conn, const std::string &key);
+	/// Spawns the script of a request admitted by admitCGI().
+	uint16_t startCGI(ClientRequest &req, Connection *conn, const std::string &key);
+	/// Tracks a spawned script and watches its pipes.
+	/// \param conn Client to answer, NULL for a background revalidation.
+	/// \returns 0, or 502 if its stdout could not be watched (the script is killed).
+	uint16_t registerCGI(CGI *cgi, Connection *conn);
+	/// The script's path followed by the request's `parts` (method, uri, header:Name).
+	std::string requestKey(const ClientRequest &req, const std::vector<std::string> &parts);
+	CGICache *cgiCache(LocConfig *loc);
+	/// Answers a GET from cgi_cache, fresh or stale, and refreshes a stale entry.
+	/// \returns False on a miss, the script has to run.
+	bool serveCachedCGI(ClientRequest &req, Connection *conn);
+	/// Runs a script without client to refresh a stale cache entry.
+	void revalidateCGI(ClientRequest &req, LocConfig *loc, const std::string &key);
+	/// Whether the body of a request is piped to its script while it arrives
+	/// (cgi_request_buffering off) rather than read whole first.
+	bool streamsCGIBody(const ClientRequest &req, Connection *conn);
+	/// Starts, or queues, the script right after the headers.
+	/// \param received Body bytes that came with the headers.
+	void startCGIBody(Connection *conn, const std::string &received);
+	/// Moves the body in read_buffer to the script's stdin, pausing the socket while it is full.
+	void pumpCGIBody(Connection *conn);
+	/// Reads the client again once the script or upstream took the body sent so far.
+	void resumeRequestBody(Connection *conn);
+	/// Stops reading a streamed body (to a script or upstream) once a response is prepared,
+	/// the connection closes after it.
+	void abandonRequestBody(Connection *conn);
+	void failCGIBody(Connection *conn, uint16_t code);
 	// bool handleCGIRequest(ClientRequest &req, Connection *conn);
 
 	/// Handles cases where request size exceeds limits.
@@ -192,6 +314,9 @@ class WebServer {
 	/// \returns Current time as time_t.
 	time_t getCurrentTime() const;
 
+	/// Seconds on the monotonic clock, for durations.
+	double monotonicTime() const;
+
 	/// Reads file content from filesystem.
 	/// \param path The filesystem path to the file.
 	/// \returns File content as string, or empty string on error.
@@ -220,16 +345,218 @@ class WebServer {
 	/// \param conn The connection that received chunked data.
 	void reconstructChunkedRequest(Connection *conn);
 
+	/// Decodes the chunks available in read_buffer without waiting for whole ones,
+	/// for a body streamed to a CGI script. Consumed bytes leave read_buffer.
+	/// \param out Receives the decoded data.
+	/// \param done Set once the last chunk and the trailer were read.
+	/// \returns 0, or the error status (400, 413) to answer with.
+	uint16_t decodeChunkedBody(Connection *conn, std::string &out, bool &done);
+
 	/* Handlers/ServerCGI.cpp */
-	bool prepareCGIResponse(CGI *cgi, Connection *conn);
-	void handleCGIOutput(int fd);
+	/// Dispatches readiness of a CGI pipe (stdin or stdout of a script).
+	/// \param fd The pipe file descriptor.
+	/// \param event_mask The epoll event mask indicating event types.
+	void handleCGIEvent(int fd, uint32_t event_mask);
+	void handleCGIInput(CGI *cgi, Connection *conn, uint32_t event_mask);
+	/// Appends streamed body bytes to a script's stdin.
+	/// \param last The body is complete, stdin is closed once it is written.
+	void feedCGIInput(CGI *cgi, const std::string &data, bool last);
+	void handleCGIOutput(CGI *cgi, Connection *conn, uint32_t event_mask);
+
+	/// Moves new script output towards the client: waits for the complete header
+	/// block, then feeds the CGIStream and pauses the pipe while the client lags.
+	void forwardCGIOutput(CGI *cgi, Connection *conn);
+
+	/// Sends the response headers of a script and attaches its body stream.
+	/// \returns False if the headers were invalid and a 502 was prepared instead.
+	bool startCGIResponse(CGI *cgi, Connection *conn);
+
+	/// Puts a paused script's stdout back into epoll once its client caught up.
+	void resumeCGIOutput(pid_t pid);
+
+	/// Answers a script's client with an error (or cuts a streamed body short)
+	/// and drops the rest of the output.
+	void failCGIResponse(CGI *cgi, Connection *conn, uint16_t code);
+
+	/// Reaps exited CGI children after SIGCHLD was read from the signalfd.
+	void handleChildExit();
+
+	/// Answers the client of a finished script and destroys the CGI object.
+	/// \param pid The pid of the script.
+	void finalizeCGI(pid_t pid);
+
+	/// Removes a CGI pipe from epoll and closes it.
+	void releaseCGIFd(int fd);
+
+	/// Enforces cgi_timeout and cgi_idle_timeout (SIGTERM, then SIGKILL after
+	/// CGI_KILL_GRACE) and drops queued requests waiting longer than cgi_timeout.
+	void checkCGITimeouts();
+
+	/// Closes a script's pipes and sends SIGTERM, unless it already exited.
+	void terminateCGI(CGI *cgi);
+
+	/// Frees a concurrency slot of a location and starts the queued requests it admits.
+	void releaseCGISlot(LocConfig *loc);
+
+	/// Unlinks a closing connection from its queued requests and kills its scripts.
+	void detachCGI(Connection *conn);
+	/// Answers a finished coalesced execution: its client and every waiter get the same response.
+	void answerCoalescedCGI(CGI *cgi, Connection *conn);
+	/// Gives the waiters of a key a response, or an error page for `code` if `resp` is NULL.
+	void answerCGIWaiters(const std::string &key, const Response *resp, uint16_t code);
+	/// Runs the waiters of a key again, as coalesced requests or each on its own.
+	void redispatchCGIWaiters(const std::string &key, bool coalesce);
+	/// Output past CGI_COALESCE_MAX: the leader streams it, its waiters run their own scripts.
+	void uncoalesceCGI(CGI *cgi, Connection *conn);
+	/// Stores the output of a finished script in cgi_cache when its headers allow it.
+	void cacheCGIOutput(CGI *cgi);
 	bool isCGIFd(int fd) const;
 
+	/* Handlers/ServerFastCGI.cpp */
+
+	/// Forwards a request to the location's fastcgi_pass application server.
+	/// \returns 0 if the request was dispatched, an HTTP error code otherwise.
+	uint16_t handleFastCGIRequest(ClientRequest &req, Connection *conn);
+
+	/// Sends encoded records over a pooled (if allowed) or fresh connection.
+	/// \returns The connection carrying the request, NULL if none could be opened.
+	FastCGI *dispatchFastCGI(const std::string &address, const std::string &records,
+	                         Connection *conn, bool allow_reuse);
+	void handleFastCGIEvent(int fd, uint32_t event_mask);
+
+	/// Answers the client and returns the connection to the pool.
+	void finishFastCGI(FastCGI *fcgi);
+
+	/// Retries a request whose pooled connection turned out to be dead, or fails it.
+	void failFastCGI(FastCGI *fcgi, uint16_t code);
+	void closeFastCGI(FastCGI *fcgi);
+	void checkFastCGITimeouts();
+	void detachFastCGI(Connection *conn);
+	bool isFastCGIFd(int fd) const;
+
+	/* Handlers/ServerProxy.cpp */
+
+	/// Sends the head of a proxy_pass request upstream, the body follows while it arrives.
+	/// \param received Body bytes that came with the headers.
+	void startProxyRequest(Connection *conn, const std::string &received);
+
+	/// The request line and headers sent upstream, with the X-Forwarded-* ones added.
+	std::string proxyRequestHead(const ClientRequest &req, Connection *conn);
+	Upstream *upstream(LocConfig *loc);
+
+	/// Picks a server and takes a pooled connection to it, or opens one. Servers that
+	/// refuse the connection are counted as failed and the next one is tried.
+	/// \returns The connection, NULL if no server is left.
+	Proxy *dispatchProxy(Upstream *up, const std::string &client_ip,
+	                     const std::vector<int> &tried, Connection *conn);
+	void handleProxyEvent(int fd, uint32_t event_mask);
+
+	/// Moves the decoded response body towards the client, pausing the upstream while it lags.
+	void forwardProxyResponse(Proxy *proxy);
+
+	/// Sends the response headers of the upstream and attaches its body stream.
+	void startProxyResponse(Proxy *proxy, Connection *conn);
+
+	/// Puts a paused upstream connection back into epoll once its client caught up.
+	void resumeProxyOutput(int fd);
+
+	/// Registers the events a connection waits for, if they changed.
+	void watchProxy(Proxy *proxy);
+
+	/// Completes the response and returns the connection to the pool.
+	void finishProxy(Proxy *proxy);
+
+	/// Retries a request on another server (connect failure or dead pooled
+	/// connection) if it can still be replayed, or answers it with `code`.
+	/// \param connect_failed The server could not be reached at all.
+	void failProxy(Proxy *proxy, uint16_t code, bool connect_failed);
+	void closeProxy(Proxy *proxy);
+
+	/// Moves the body in read_buffer upstream, pausing the socket while too much is queued.
+	void pumpProxyBody(Connection *conn);
+	void failProxyBody(Connection *conn, uint16_t code);
+
+	/// Enforces PROXY_CONNECT_TIMEOUT and PROXY_TIMEOUT, both answered with 504.
+	void checkProxyTimeouts();
+	void detachProxy(Connection *conn);
+	bool isProxyFd(int fd) const;
+
+	/* Handlers/ServerAccessLog.cpp */
+
+	/// Opens the file of every access_log, slow_log and capture_trace directive
+	/// of the servers, unless already open.
+	/// \returns False if one cannot be opened.
+	bool openAccessLogs(std::vector<ServerConfig> &servers);
+
+	/// Starts the record of a request when its first byte arrives.
+	void noteRequestStart(Connection *conn);
+
+	/// Keeps the request line of a complete header block, and Referer and
+	/// User-Agent if the server writes an access log.
+	void noteRequestHead(Connection *conn, const std::string &headers);
+
+	/// A CGI script, FastCGI application, module or upstream takes the request.
+	void noteUpstreamStart(Connection *conn);
+
+	/// Writes the access_log line of a finished request, if the server has a log.
+	void logAccess(Connection *conn, uint16_t status, double request_time);
+	static std::string accessLine(const Connection &conn, uint16_t status, double request_time,
+	                              bool json);
+	static std::string jsonAccessLine(const Connection &conn, uint16_t status,
+	                                  double request_time);
+
+	/// Writes the phases of a request that took slow_log's threshold or longer.
+	void logSlowRequest(Connection *conn, uint16_t status, double request_time);
+	void flushAccessLogs();
+	void reopenAccessLogs();
+	void closeAccessLogs();
+
+	/* Handlers/ServerTiming.cpp */
+
+	/// Timestamps the first time a request reaches this phase of its lifecycle.
+	void markPhase(Connection *conn, Connection::Phase phase);
+
+	/// Time spent reaching each phase from the previous one, in milliseconds, as a
+	/// Server-Timing value up to the response head or for the slow log.
+	static std::string phaseTimings(const Connection &conn, bool header);
+
+	/* Handlers/ServerMetrics.cpp */
+
+	/// Counts a finished or abandoned request and writes its access_log line.
+	void recordRequest(Connection *conn);
+
+	/// Answers a metrics location: Prometheus text, the stub_status summary or
+	/// the table of live connections.
+	Response respMetrics(Connection *conn);
+	std::string stubStatus() const;
+	std::string connectionTable(const std::string &query);
+
+	/* Handlers/ServerModule.cpp */
+
+	/// Loads the handler modules of the servers' locations not loaded yet, and
+	/// opens their completion pipe.
+	/// \returns False if a module could not be loaded.
+	bool loadHandlerModules(std::vector<ServerConfig> &servers);
+
+	/// Hands a request to the location's handler module.
+	/// \returns 0 if answered or pending, an HTTP error code otherwise.
+	uint16_t handleModuleRequest(ClientRequest &req, Connection *conn);
+
+	/// Answers the asynchronous responses the modules completed.
+	void handleModuleCompletions();
+
+	/// Sends a built module response to its client, if still there.
+	void answerModuleCall(ws_response *call);
+	void checkModuleTimeouts();
+	void detachModule(Connection *conn);
+	void unloadHandlerModules();
+
 	/* Handlers/Connection.cpp */
 
 	void updateConnectionActivity(int client_fd);
 
-	/// Accepts a new client connection and adds it to the connection pool.
+	/// Accepts the waiting client connections, up to ACCEPT_BUDGET, and adds them
+	/// to the connection pool.
 	/// \param sc Pointer to the server configuration that received the connection.
 	void handleNewConnection(ServerConfig *sc);
 
@@ -250,6 +577,55 @@ class WebServer {
 	/// \param conn Pointer to the connection to close.
 	void closeConnection(Connection *conn);
 
+	/* Handlers/ServerReload.cpp */
+
+	/// Loads config_file again (SIGHUP). If it is valid, its servers take the new
+	/// connections and requests; otherwise the configuration in use stays.
+	void reloadConfig();
+
+	/// Gives every server its listening socket: the one of the latest configuration's
+	/// server on the same host:port, or a new one.
+	/// \returns False if one cannot be opened, those opened are closed again.
+	bool openListeners(std::vector<ServerConfig> &servers);
+
+	/// A kept-alive connection takes the latest configuration between two requests.
+	void rebindConnection(Connection *conn);
+
+	/// The configuration a location belongs to, NULL if none.
+	ConfigSnapshot *configOf(const LocConfig *loc);
+	void retainConfig(ConfigSnapshot *config);
+
+	/// Frees a replaced configuration, and the state of its locations, once unused.
+	void releaseConfig(ConfigSnapshot *config);
+
+	/// Moves the balancers the new configuration changes or drops out of _upstreams.
+	void retireUpstreams(std::vector<ServerConfig> &servers);
+	void freeRetiredUpstreams();
+
+	/* Handlers/ServerUpgrade.cpp */
+
+	/// Starts argv again (SIGUSR2) with the listening sockets as LISTEN_FDS. It
+	/// sends SIGQUIT once it listens, this process keeps serving until then.
+	void upgradeBinary();
+	void upgradeFailed(int status);
+
+	/// Keeps the listening sockets passed by systemd or by an upgrading process.
+	void takeInheritedSockets();
+
+	/// Takes the inherited socket listening on an address.
+	/// \returns Its fd, -1 if none.
+	int adoptSocket(const struct addrinfo *addr_info);
+
+	/// Closes the inherited sockets no server took, and tells the process that
+	/// upgraded to this one to drain.
+	void releaseInheritedSockets();
+
+	/// Stops accepting (SIGQUIT) and lets the connections finish their request.
+	void startDraining();
+
+	/// Ends the event loop once drained, or at DRAIN_TIMEOUT.
+	void checkDrain();
+
 	/* Handlers/DirectoryReq.cpp */
 
 	/// Prepares response data when a directory is requested
@@ -0,0 +1,64 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   AccessLog.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/12 09:41:17 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/12 09:41:17 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "AccessLog.hpp"
+
+AccessLog::AccessLog(const std::string &path) : path_(path), fd_(-1), flushed_(time(NULL)) {}
+
+AccessLog::~AccessLog() {
+	flush();
+	if (fd_ != -1)
+		close(fd_);
+}
+
+bool AccessLog::open() {
+	int fd = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1)
+		return (false);
+	if (fd_ != -1)
+		close(fd_);
+	fd_ = fd;
+	return (true);
+}
+
+void AccessLog::append(const std::string &line) {
+	buffer_ += line;
+	buffer_ += '\n';
+	if (buffer_.size() >= FLUSH_SIZE)
+		flush();
+}
+
+void AccessLog::tick(time_t now) {
+	if (!buffer_.empty() && now - flushed_ >= FLUSH_INTERVAL)
+		flush();
+}
+
+void AccessLog::flush() {
+	flushed_ = time(NULL);
+	size_t offset = 0;
+	while (fd_ != -1 && offset < buffer_.size()) {
+		ssize_t written = write(fd_, buffer_.data() + offset, buffer_.size() - offset);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			break; // disk full or gone: the lines are dropped, serving goes on
+		offset += written;
+	}
+	buffer_.clear();
+}
+
+bool AccessLog::reopen() {
+	flush();
+	return (open());
+}
+
+const std::string &AccessLog::getPath() const { return (path_); }
@@ -0,0 +1,61 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   AccessLog.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/12 09:41:17 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/12 09:41:17 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef ACCESSLOG_HPP
+#define ACCESSLOG_HPP
+
+#include "includes/Webserv.hpp"
+
+/// One file of the access_log directive, shared by the servers naming it.
+///
+/// Lines are kept in memory and written with a single write() once
+/// FLUSH_SIZE bytes are pending or FLUSH_INTERVAL seconds passed, so a busy
+/// server does not pay one system call per request. reopen() swaps in a new
+/// file of the same name after it was moved away (log rotation on SIGUSR1).
+class AccessLog {
+  public:
+	explicit AccessLog(const std::string &path);
+	~AccessLog();
+
+	/// Opens the file for appending, creating it if needed.
+	/// \returns False if it cannot be opened, errno is set.
+	bool open();
+
+	/// Queues one line, the newline is added.
+	void append(const std::string &line);
+
+	/// Writes what is queued if the buffer is old enough.
+	void tick(time_t now);
+
+	/// Writes what is queued.
+	void flush();
+
+	/// Flushes, then opens the path again.
+	/// \returns False if it cannot be opened, the old file is kept then.
+	bool reopen();
+
+	const std::string &getPath() const;
+
+  private:
+	static const size_t FLUSH_SIZE = 32768;
+	static const time_t FLUSH_INTERVAL = 1; // seconds
+
+	std::string path_;
+	int fd_;
+	std::string buffer_;
+	time_t flushed_; // time of the last flush
+
+	AccessLog(const AccessLog &);
+	AccessLog &operator=(const AccessLog &);
+};
+
+#endif
@@ -15,6 +15,38 @@
 
 #include "includes/Webserv.hpp"
 
+// Level-gated logging: the message expression is only evaluated when its
+// level is enabled. The debug ones compile to nothing with
+// WEBSERV_NO_DEBUG_LOG (make RELEASE=1).
+#define LOG(lggr, level, message)                                                                \
+	do {                                                                                           \
+		if ((lggr).isLevelEnabled(level))                                                          \
+			(lggr).log(level, message);                                                            \
+	} while (0)
+
+#define LOG_PREFIX(lggr, level, prefix, message)                                                 \
+	do {                                                                                           \
+		if ((lggr).isLevelEnabled(level))                                                          \
+			(lggr).logWithPrefix(level, prefix, message);                                          \
+	} while (0)
+
+#ifdef WEBSERV_NO_DEBUG_LOG
+// Still type-checked, but dead code the compiler drops
+#define LOG_DEBUG(lggr, message)                                                                 \
+	do {                                                                                           \
+		if (0)                                                                                     \
+			(lggr).log(Logger::DEBUG, message);                                                    \
+	} while (0)
+#define LOG_DEBUG_PREFIX(lggr, prefix, message)                                                  \
+	do {                                                                                           \
+		if (0)                                                                                     \
+			(lggr).logWithPrefix(Logger::DEBUG, prefix, message);                                  \
+	} while (0)
+#else
+#define LOG_DEBUG(lggr, message) LOG(lggr, Logger::DEBUG, message)
+#define LOG_DEBUG_PREFIX(lggr, prefix, message) LOG_PREFIX(lggr, Logger::DEBUG, prefix, message)
+#endif
+
 class Logger {
   public:
 	enum LogLevel { DEBUG = 0, INFO = 1, WARNING = 2, ERROR = 3, CRITICAL = 4 };
@@ -23,7 +55,9 @@ class Logger {
 	    : minLevel(minLogLevel),
 	      consoleOutput(enableConsole),
 	      fileOutput(false),
-	      logFileName(filename) {
+	      buffered(false),
+	      logFileName(filename),
+	      stampTime(0) {
 
 		if (!filename.empty()) {
 			logFile.open(filename.c_str(), std::ios::app);
@@ -36,6 +70,7 @@ class Logger {
 	}
 
 	~Logger() {
+		flush();
 		if (logFile.is_open()) {
 			logFile.close();
 		}
@@ -50,6 +85,25 @@ class Logger {
 	// Enable/disable file output
 	void setFileOutput(bool enable) { fileOutput = enable && logFile.is_open(); }
 
+	// Buffered: lines are kept in memory until flush(), or until FLUSH_THRESHOLD
+	// bytes are pending, and written with one write() per output
+	void setBuffered(bool enable) {
+		if (!enable)
+			flush();
+		buffered = enable;
+	}
+
+	// Writes the buffered lines
+	void flush() {
+		writeAll(STDOUT_FILENO, outBuffer);
+		writeAll(STDERR_FILENO, errBuffer);
+		if (!fileBuffer.empty() && logFile.is_open()) {
+			logFile.write(fileBuffer.data(), fileBuffer.size());
+			logFile.flush();
+		}
+		fileBuffer.clear();
+	}
+
 	// Main logging function
 	void log(LogLevel level, const std::string &message) {
 		if (level < minLevel) {
@@ -57,20 +111,25 @@ class Logger {
 		}
 
 		std::string formattedMessage = formatMessage(level, message);
+		formattedMessage += '\n';
 
 		// Output to console
 		if (consoleOutput) {
 			if (level >= ERROR) {
-				std::cerr << formattedMessage << std::endl;
+				errBuffer += formattedMessage;
 			} else {
-				std::cout << formattedMessage << std::endl;
+				outBuffer += formattedMessage;
 			}
 		}
 
 		// Output to file
 		if (fileOutput && logFile.is_open()) {
-			logFile << formattedMessage << std::endl;
-			logFile.flush(); // Ensure immediate write
+			fileBuffer += formattedMessage;
+		}
+
+		if (!buffered || level == CRITICAL ||
+		    outBuffer.size() + errBuffer.size() + fileBuffer.size() >= FLUSH_THRESHOLD) {
+			flush();
 		}
 	}
 
@@ -87,6 +146,9 @@ class Logger {
 
 	// Log with custom prefix (useful for different modules)
 	void logWithPrefix(LogLevel level, const std::string &prefix, const std::string &message) {
+		if (level < minLevel) {
+			return;
+		}
 		std::stringstream ss;
 		ss << "[" << prefix << "] " << message;
 		log(level, ss.str());
@@ -99,23 +161,46 @@ class Logger {
 	bool isLevelEnabled(LogLevel level) const { return level >= minLevel; }
 
   private:
+	static const size_t FLUSH_THRESHOLD = 65536;
+
 	std::ofstream logFile;
 	LogLevel minLevel;
 	bool consoleOutput;
 	bool fileOutput;
+	bool buffered;
 	std::string logFileName;
+	std::string outBuffer;
+	std::string errBuffer;
+	std::string fileBuffer;
+	time_t stampTime; // second of stamp, formatted once per second
+	std::string stamp;
+
+	Logger(const Logger &);
+	Logger &operator=(const Logger &);
+
+	static void writeAll(int fd, std::string &buffer) {
+		size_t offset = 0;
+		while (offset < buffer.size()) {
+			ssize_t written = write(fd, buffer.data() + offset, buffer.size() - offset);
+			if (written < 0 && errno == EINTR)
+				continue;
+			if (written <= 0)
+				break; // nowhere to report it, the lines are dropped
+			offset += written;
+		}
+		buffer.clear();
+	}
 
 	// Get current timestamp as string
-	std::string getCurrentTime() const {
-		time_t rawtime;
-		struct tm *timeinfo;
-		char buffer[80];
-
-		time(&rawtime);
-		timeinfo = localtime(&rawtime);
-
-		strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", timeinfo);
-		return std::string(buffer);
+	const std::string &getCurrentTime() {
+		time_t rawtime = time(NULL);
+		if (rawtime != stampTime || stamp.empty()) {
+			char buffer[80];
+			strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", localtime(&rawtime));
+			stamp = buffer;
+			stampTime = rawtime;
+		}
+		return stamp;
 	}
 
 	// Convert log level to string
@@ -137,7 +222,7 @@ class Logger {
 	}
 
 	// Format the log message
-	std::string formatMessage(LogLevel level, const std::string &message) const {
+	std::string formatMessage(LogLevel level, const std::string &message) {
 		std::stringstream ss;
 		ss << "[" << getCurrentTime() << "] "
 		   << "[" << levelToString(level) << "] " << message;
@@ -0,0 +1,205 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   TraceCapture.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/24 14:02:51 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/24 14:02:51 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "TraceCapture.hpp"
+#include "src/Utils/StringUtils.hpp"
+
+static double monotonic() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec + now.tv_nsec / 1e9);
+}
+
+TraceCapture::TraceCapture(const std::string &path, bool bodies)
+    : path_(path), bodies_(bodies), fd_(-1), flushed_(time(NULL)), start_(0), next_id_(1) {}
+
+TraceCapture::~TraceCapture() {
+	flush();
+	if (fd_ != -1)
+		close(fd_);
+}
+
+bool TraceCapture::open() {
+	int fd = ::open(path_.c_str(), O_WRONLY | O_TRUNC | O_CREAT | O_CLOEXEC, 0644);
+	if (fd == -1)
+		return (false);
+	flush();
+	if (fd_ != -1)
+		close(fd_);
+	fd_ = fd;
+	start_ = monotonic();
+	buffer_ = "WSTRACE1";
+	number(static_cast<unsigned long>(time(NULL)));
+	return (true);
+}
+
+void TraceCapture::opened(int fd, double now) {
+	Stream &s = streams_[fd];
+	s = Stream();
+	s.id = next_id_++;
+	record('C', s.id);
+	number(micros(now));
+}
+
+void TraceCapture::received(int fd, const char *data, size_t len, double now) {
+	std::map<int, Stream>::iterator it = streams_.find(fd);
+	if (it == streams_.end())
+		return;
+	Stream &s = it->second;
+	while (len > 0 && s.state != IGNORED) {
+		size_t used;
+		if (s.state == IN_BODY || s.state == IN_CHUNK) {
+			used = std::min(len, static_cast<size_t>(s.remaining));
+			body(s, data, used);
+			s.remaining -= used;
+			if (s.remaining == 0 && s.state == IN_BODY)
+				endRequest(s, now);
+			else if (s.remaining == 0) {
+				s.state = IN_CHUNK_END;
+				s.remaining = 2;
+			}
+		} else if (s.state == IN_CHUNK_END) {
+			used = std::min(len, static_cast<size_t>(s.remaining));
+			s.remaining -= used;
+			if (s.remaining == 0)
+				s.state = IN_CHUNK_SIZE;
+		} else {
+			if (s.state == IN_HEAD && s.line.empty())
+				s.first = now;
+			const char *nl = static_cast<const char *>(memchr(data, '\n', len));
+			used = nl ? nl - data + 1 : len;
+			s.line.append(data, used);
+			if (s.line.size() > MAX_LINE)
+				s.state = IGNORED; // not HTTP, or a head the server refuses anyway
+			else if (nl)
+				lineDone(s, now);
+		}
+		data += used;
+		len -= used;
+	}
+	if (buffer_.size() >= FLUSH_SIZE)
+		flush();
+}
+
+// A request under way is left out
+void TraceCapture::closed(int fd, double now) {
+	std::map<int, Stream>::iterator it = streams_.find(fd);
+	if (it == streams_.end())
+		return;
+	record('X', it->second.id);
+	number(micros(now));
+	streams_.erase(it);
+}
+
+void TraceCapture::lineDone(Stream &s, double now) {
+	if (s.state == IN_HEAD) {
+		if (s.line == "\r\n" || s.line == "\n") {
+			s.line.clear(); // stray CRLF between requests
+		} else if (s.line.size() >= 4 &&
+		           s.line.compare(s.line.size() - 4, 4, "\r\n\r\n") == 0) {
+			headDone(s);
+			if (s.state == IN_HEAD)
+				endRequest(s, now); // no body
+		}
+		return;
+	}
+	if (s.state == IN_CHUNK_SIZE) {
+		char *end;
+		s.remaining = std::strtoul(s.line.c_str(), &end, 16);
+		if (end == s.line.c_str())
+			s.state = IGNORED;
+		else
+			s.state = s.remaining ? IN_CHUNK : IN_TRAILER;
+	} else if (s.state == IN_TRAILER && (s.line == "\r\n" || s.line == "\n")) {
+		endRequest(s, now);
+	}
+	s.line.clear();
+}
+
+// Writes the head, then follows its body as the server would
+void TraceCapture::headDone(Stream &s) {
+	record('R', s.id);
+	number(micros(s.first));
+	number(s.line.size());
+	buffer_ += s.line;
+
+	std::string lower = su::to_lower(s.line);
+	size_t te = lower.find("\r\ntransfer-encoding:");
+	size_t cl = lower.find("\r\ncontent-length:");
+	s.size = 0;
+	if (te != std::string::npos && lower.find("chunked", te) < lower.find("\r\n", te + 2))
+		s.state = IN_CHUNK_SIZE;
+	else if (cl != std::string::npos &&
+	         (s.remaining = std::strtoul(lower.c_str() + cl + 17, NULL, 10)) > 0)
+		s.state = IN_BODY;
+	s.line.clear();
+}
+
+void TraceCapture::body(Stream &s, const char *data, size_t len) {
+	s.size += len;
+	if (!bodies_)
+		return;
+	record('B', s.id);
+	number(len);
+	buffer_.append(data, len);
+}
+
+void TraceCapture::endRequest(Stream &s, double now) {
+	record('E', s.id);
+	number(micros(now));
+	number(s.size);
+	s.state = IN_HEAD;
+	s.line.clear();
+	s.size = 0;
+	s.first = 0;
+}
+
+void TraceCapture::record(char type, unsigned long conn) {
+	buffer_ += type;
+	number(conn);
+}
+
+// Unsigned LEB128: 7 bits a byte, the high bit set on all but the last
+void TraceCapture::number(unsigned long value) {
+	do {
+		unsigned char byte = value & 0x7f;
+		value >>= 7;
+		buffer_ += static_cast<char>(value ? byte | 0x80 : byte);
+	} while (value);
+}
+
+unsigned long TraceCapture::micros(double now) const {
+	return (now > start_ ? static_cast<unsigned long>((now - start_) * 1e6) : 0);
+}
+
+void TraceCapture::tick(time_t now) {
+	if (!buffer_.empty() && now - flushed_ >= FLUSH_INTERVAL)
+		flush();
+}
+
+void TraceCapture::flush() {
+	flushed_ = time(NULL);
+	size_t offset = 0;
+	while (fd_ != -1 && offset < buffer_.size()) {
+		ssize_t written = write(fd_, buffer_.data() + offset, buffer_.size() - offset);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			break; // disk full or gone: the records are dropped, serving goes on
+		offset += written;
+	}
+	buffer_.clear();
+}
+
+// The connections go on in the new file, their 'C' (and the 'R' of a request
+// under way) left in the old one
+bool TraceCapture::reopen() { return (open()); }
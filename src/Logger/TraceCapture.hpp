@@ -0,0 +1,92 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   TraceCapture.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/24 14:02:51 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/24 14:02:51 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef TRACECAPTURE_HPP
+#define TRACECAPTURE_HPP
+
+#include "includes/Webserv.hpp"
+
+/// One file of the capture_trace directive: the requests received by the
+/// servers naming it, replayed by `loadgen -R`.
+///
+/// The bytes read from each client are framed on their own (head, then a
+/// Content-Length or chunked body), whatever the server makes of them. The
+/// file starts with "WSTRACE1" and the start of the capture in unix seconds,
+/// followed by records of one type byte and unsigned LEB128 numbers:
+///
+///     'C' conn time            connection accepted
+///     'R' conn time len head   request line and headers, time of the first byte
+///     'B' conn len data        body bytes, de-chunked ("bodies" captures only)
+///     'E' conn time size       end of the request body, and its size
+///     'X' conn time            connection closed
+///
+/// Connections are numbered from 1, times are microseconds since the start.
+/// A request cut short by the client has no 'E'. Records are buffered and
+/// written like the access logs; reopen() starts a new trace.
+class TraceCapture {
+  public:
+	TraceCapture(const std::string &path, bool bodies);
+	~TraceCapture();
+
+	/// Creates or truncates the file and writes the header.
+	/// \returns False if it cannot be opened, errno is set.
+	bool open();
+
+	void opened(int fd, double now);
+	/// Frames bytes read from fd; now is monotonic seconds like the phases.
+	void received(int fd, const char *data, size_t len, double now);
+	void closed(int fd, double now);
+
+	/// Writes what is queued if the buffer is old enough.
+	void tick(time_t now);
+	void flush();
+	bool reopen();
+
+  private:
+	enum State { IN_HEAD, IN_BODY, IN_CHUNK_SIZE, IN_CHUNK, IN_CHUNK_END, IN_TRAILER, IGNORED };
+
+	struct Stream {
+		Stream() : id(0), state(IN_HEAD), remaining(0), size(0), first(0) {}
+		unsigned long id;
+		State state;
+		std::string line;        // head, or the chunk size or trailer line so far
+		unsigned long remaining; // of the body, chunk or chunk's CRLF
+		unsigned long size;      // body bytes of the request
+		double first;            // arrival of the request's first byte
+	};
+
+	static const size_t FLUSH_SIZE = 65536;
+	static const time_t FLUSH_INTERVAL = 1; // seconds
+	static const size_t MAX_LINE = 65536;   // a longer head is not followed
+
+	void lineDone(Stream &s, double now);
+	void headDone(Stream &s);
+	void body(Stream &s, const char *data, size_t len);
+	void endRequest(Stream &s, double now);
+	void record(char type, unsigned long conn);
+	void number(unsigned long value);
+	unsigned long micros(double now) const;
+
+	std::string path_;
+	bool bodies_;
+	int fd_;
+	std::string buffer_;
+	time_t flushed_;
+	double start_; // monotonic
+	unsigned long next_id_;
+	std::map<int, Stream> streams_;
+
+	TraceCapture(const TraceCapture &);
+	TraceCapture &operator=(const TraceCapture &);
+};
+
+#endif
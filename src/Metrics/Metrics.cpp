@@ -0,0 +1,205 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Metrics.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/15 10:12:03 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/15 10:12:03 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "Metrics.hpp"
+
+// Seconds, from a cached file to a slow script
+static const double TIME_BOUNDS[] = {0.001, 0.005, 0.01, 0.025, 0.05, 0.1,
+                                     0.25,  0.5,   1,    2.5,   5,    10};
+// Bytes, from an empty answer to a large download
+static const double SIZE_BOUNDS[] = {256, 1024, 4096, 16384, 65536, 262144, 1048576, 4194304,
+                                     16777216};
+
+static const char *TIMEOUT_NAMES[] = {"client", "cgi", "fastcgi", "proxy", "module"};
+
+static std::string number(double value) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.9g", value);
+	return (buf);
+}
+
+Histogram::Histogram(const double *bounds, size_t size)
+    : bounds_(bounds), size_(size), counts_(size + 1, 0), sum_(0), count_(0) {}
+
+void Histogram::observe(double value) {
+	size_t i = 0;
+	while (i < size_ && value > bounds_[i])
+		++i;
+	++counts_[i];
+	sum_ += value;
+	++count_;
+}
+
+uint64_t Histogram::getCount() const { return (count_); }
+
+void Histogram::render(std::string &out, const std::string &name,
+                       const std::string &labels) const {
+	std::string prefix = labels.empty() ? "{" : "{" + labels + ",";
+	uint64_t cumulative = 0;
+	for (size_t i = 0; i <= size_; ++i) {
+		cumulative += counts_[i];
+		out += name + "_bucket" + prefix + "le=\"" + (i < size_ ? number(bounds_[i]) : "+Inf") +
+		       "\"} " + su::to_string(cumulative) + "\n";
+	}
+	std::string braces = labels.empty() ? "" : "{" + labels + "}";
+	out += name + "_sum" + braces + " " + number(sum_) + "\n";
+	out += name + "_count" + braces + " " + su::to_string(count_) + "\n";
+}
+
+Metrics::Series::Series()
+    : latency(TIME_BOUNDS, sizeof(TIME_BOUNDS) / sizeof(*TIME_BOUNDS)),
+      ttfb(TIME_BOUNDS, sizeof(TIME_BOUNDS) / sizeof(*TIME_BOUNDS)),
+      cgi(TIME_BOUNDS, sizeof(TIME_BOUNDS) / sizeof(*TIME_BOUNDS)),
+      size(SIZE_BOUNDS, sizeof(SIZE_BOUNDS) / sizeof(*SIZE_BOUNDS)) {}
+
+Metrics::Metrics()
+    : active_(0), accepted_(0), requests_(0), received_(0), sent_(0), cgi_spawns_(0),
+      parse_errors_(0) {
+	for (size_t i = 0; i < TIMEOUT_KINDS; ++i)
+		timeouts_[i] = 0;
+}
+
+void Metrics::addServer(ServerConfig &server) {
+	std::string name = "server=\"" + server.getHost() + ":" + su::to_string(server.getPort()) +
+	                   "\"";
+	std::string labels = name + ",location=\"\"";
+	servers_[&server] = &series_[labels];
+	servers_[&server]->labels = labels;
+	const std::vector<LocConfig> &locations = server.getLocations();
+	for (size_t i = 0; i < locations.size(); ++i) {
+		labels = name + ",location=\"" + locations[i].getPath() + "\"";
+		locations_[&locations[i]] = &series_[labels];
+		locations_[&locations[i]]->labels = labels;
+	}
+}
+
+void Metrics::removeServer(ServerConfig &server) {
+	servers_.erase(&server);
+	const std::vector<LocConfig> &locations = server.getLocations();
+	for (size_t i = 0; i < locations.size(); ++i)
+		locations_.erase(&locations[i]);
+}
+
+// The series of a location, or of the server if none matched
+Metrics::Series &Metrics::series(const ServerConfig *server, const LocConfig *loc) {
+	if (loc) {
+		std::map<const LocConfig *, Series *>::iterator it = locations_.find(loc);
+		if (it != locations_.end())
+			return (*it->second);
+	} else {
+		std::map<const ServerConfig *, Series *>::iterator it = servers_.find(server);
+		if (it != servers_.end())
+			return (*it->second);
+	}
+	return (series_[""]); // not added
+}
+
+void Metrics::connectionOpened() {
+	++active_;
+	++accepted_;
+}
+
+void Metrics::connectionClosed() {
+	if (active_)
+		--active_;
+}
+
+void Metrics::received(size_t bytes) { received_ += bytes; }
+
+void Metrics::sent(size_t bytes) { sent_ += bytes; }
+
+void Metrics::cgiSpawned() { ++cgi_spawns_; }
+
+void Metrics::timedOut(Timeout kind) { ++timeouts_[kind]; }
+
+void Metrics::parseError() { ++parse_errors_; }
+
+void Metrics::request(const ServerConfig *server, const LocConfig *loc, uint16_t status,
+                      double latency, double ttfb, size_t bytes) {
+	Series &series = this->series(server, loc);
+	++requests_;
+	++series.statuses[status];
+	series.latency.observe(latency);
+	if (ttfb >= 0)
+		series.ttfb.observe(ttfb);
+	series.size.observe(bytes);
+}
+
+void Metrics::cgiFinished(const LocConfig *loc, double duration) {
+	series(NULL, loc).cgi.observe(duration);
+}
+
+size_t Metrics::getActive() const { return (active_); }
+
+uint64_t Metrics::getAccepted() const { return (accepted_); }
+
+uint64_t Metrics::getRequests() const { return (requests_); }
+
+void Metrics::renderCounter(std::string &out, const char *name, const char *help,
+                            uint64_t value) {
+	out += std::string("# HELP ") + name + " " + help + "\n";
+	out += std::string("# TYPE ") + name + " counter\n";
+	out += std::string(name) + " " + su::to_string(value) + "\n";
+}
+
+void Metrics::renderStatuses(std::string &out, const Series &series) {
+	for (std::map<uint16_t, uint64_t>::const_iterator it = series.statuses.begin();
+	     it != series.statuses.end(); ++it)
+		out += "webserv_requests_total{" + series.labels + ",status=\"" +
+		       su::to_string(it->first) + "\"} " + su::to_string(it->second) + "\n";
+}
+
+// One histogram of every series that observed something
+void Metrics::renderHistogram(std::string &out, Histogram Series::*member, const char *name,
+                              const char *help) const {
+	out += std::string("# HELP ") + name + " " + help + "\n";
+	out += std::string("# TYPE ") + name + " histogram\n";
+	for (std::map<std::string, Series>::const_iterator it = series_.begin(); it != series_.end();
+	     ++it)
+		if ((it->second.*member).getCount())
+			(it->second.*member).render(out, name, it->second.labels);
+}
+
+void Metrics::render(std::string &out) const {
+	out += "# HELP webserv_connections_active Open client connections.\n"
+	       "# TYPE webserv_connections_active gauge\n"
+	       "webserv_connections_active " +
+	       su::to_string(active_) + "\n";
+	renderCounter(out, "webserv_connections_accepted_total", "Client connections accepted.",
+	              accepted_);
+	renderCounter(out, "webserv_received_bytes_total", "Bytes read from clients.", received_);
+	renderCounter(out, "webserv_sent_bytes_total", "Bytes sent to clients.", sent_);
+	renderCounter(out, "webserv_cgi_spawns_total", "CGI scripts started.", cgi_spawns_);
+	renderCounter(out, "webserv_parse_errors_total", "Requests rejected with malformed headers.",
+	              parse_errors_);
+
+	out += "# HELP webserv_timeouts_total Connections and upstream calls that timed out.\n"
+	       "# TYPE webserv_timeouts_total counter\n";
+	for (size_t i = 0; i < TIMEOUT_KINDS; ++i)
+		out += std::string("webserv_timeouts_total{kind=\"") + TIMEOUT_NAMES[i] + "\"} " +
+		       su::to_string(timeouts_[i]) + "\n";
+
+	out += "# HELP webserv_requests_total Requests answered, by status.\n"
+	       "# TYPE webserv_requests_total counter\n";
+	for (std::map<std::string, Series>::const_iterator it = series_.begin(); it != series_.end();
+	     ++it)
+		renderStatuses(out, it->second);
+
+	renderHistogram(out, &Series::latency, "webserv_request_duration_seconds",
+	                "Time from the first request byte to the last response byte.");
+	renderHistogram(out, &Series::ttfb, "webserv_time_to_first_byte_seconds",
+	                "Time from the first request byte to the response head.");
+	renderHistogram(out, &Series::cgi, "webserv_cgi_duration_seconds",
+	                "Run time of CGI scripts, from spawn to exit.");
+	renderHistogram(out, &Series::size, "webserv_response_size_bytes",
+	                "Bytes sent per response, head included.");
+}
@@ -0,0 +1,118 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Metrics.hpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/15 10:12:03 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/15 10:12:03 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include "includes/Webserv.hpp"
+#include "src/ConfigParser/Structs/Struct.hpp"
+
+/// Observations counted into fixed buckets, rendered cumulatively like a
+/// Prometheus histogram.
+class Histogram {
+  public:
+	/// \param bounds Upper bounds in ascending order, static storage.
+	Histogram(const double *bounds, size_t size);
+
+	void observe(double value);
+	uint64_t getCount() const;
+
+	/// Appends the _bucket, _sum and _count lines of the series.
+	/// \param labels `name="value"` pairs without braces, may be empty.
+	void render(std::string &out, const std::string &name, const std::string &labels) const;
+
+  private:
+	const double *bounds_;
+	size_t size_;
+	std::vector<uint64_t> counts_; // per bucket, the last one for +Inf
+	double sum_;
+	uint64_t count_;
+};
+
+/// Counters and histograms of the server, the latter per server and location.
+///
+/// Updating one is an increment or a bucket search over a dozen bounds.
+/// render() writes the Prometheus text format: counters and histogram buckets
+/// add up across processes, so a scraper summing several workers' series
+/// gets correct totals.
+class Metrics {
+  public:
+	enum Timeout { CLIENT, CGI, FASTCGI, PROXY, MODULE, TIMEOUT_KINDS };
+
+	Metrics();
+
+	/// Creates the series of every location of a server, before the first request.
+	/// A server reloaded with the same address and locations goes on with their series.
+	void addServer(ServerConfig &server);
+
+	/// Forgets a server of a configuration freed after a reload, its series stay.
+	void removeServer(ServerConfig &server);
+
+	void connectionOpened();
+	void connectionClosed();
+	void received(size_t bytes);
+	void sent(size_t bytes);
+	void cgiSpawned();
+	void timedOut(Timeout kind);
+	void parseError();
+
+	/// Counts a finished request.
+	/// \param loc Its location, NULL if it failed before one was matched.
+	/// \param ttfb Seconds until the response started, negative if it never did.
+	void request(const ServerConfig *server, const LocConfig *loc, uint16_t status,
+	             double latency, double ttfb, size_t bytes);
+
+	/// Counts a script that exited, with its run time in seconds.
+	void cgiFinished(const LocConfig *loc, double duration);
+
+	size_t getActive() const;
+	uint64_t getAccepted() const;
+	uint64_t getRequests() const;
+
+	/// Appends every metric in the Prometheus text exposition format.
+	void render(std::string &out) const;
+
+  private:
+	struct Series {
+		std::string labels; // server="host:port",location="/path"
+		std::map<uint16_t, uint64_t> statuses;
+		Histogram latency;
+		Histogram ttfb;
+		Histogram cgi;
+		Histogram size;
+
+		Series();
+	};
+
+	size_t active_;
+	uint64_t accepted_;
+	uint64_t requests_;
+	uint64_t received_;
+	uint64_t sent_;
+	uint64_t cgi_spawns_;
+	uint64_t parse_errors_;
+	uint64_t timeouts_[TIMEOUT_KINDS];
+
+	std::map<std::string, Series> series_; // by labels, across reloads
+	std::map<const LocConfig *, Series *> locations_;
+	std::map<const ServerConfig *, Series *> servers_; // requests without a location
+
+	Series &series(const ServerConfig *server, const LocConfig *loc);
+
+	static void renderCounter(std::string &out, const char *name, const char *help,
+	                          uint64_t value);
+	static void renderStatuses(std::string &out, const Series &series);
+	void renderHistogram(std::string &out, Histogram Series::*member, const char *name,
+	                     const char *help) const;
+};
+
+#endif
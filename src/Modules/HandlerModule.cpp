@@ -0,0 +1,119 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   HandlerModule.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/09 09:41:17 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/09 09:41:17 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "HandlerModule.hpp"
+#include <dlfcn.h>
+
+/* SERVER SERVICES */
+
+static const char *apiHeader(const ws_request *req, const char *name) {
+	const ClientRequest *request = static_cast<const ClientRequest *>(req->server);
+	std::map<std::string, std::string>::const_iterator it =
+	    request->headers.find(su::to_lower(name));
+	return (it == request->headers.end() ? NULL : it->second.c_str());
+}
+
+static void apiSetStatus(ws_response *resp, int status) {
+	if (status >= 100 && status <= 599)
+		resp->resp.setStatus(status);
+}
+
+// Same rules as CGI headers: framing is the server's business
+static void apiSetHeader(ws_response *resp, const char *name, const char *value) {
+	std::string lname = su::to_lower(name);
+	if (lname == "content-type")
+		resp->resp.setContentType(value);
+	else if (lname != "content-length" && lname != "transfer-encoding" && lname != "connection")
+		resp->resp.setHeader(name, value);
+}
+
+static void apiWrite(ws_response *resp, const void *data, size_t len) {
+	resp->resp.body.append(static_cast<const char *>(data), len);
+}
+
+// Any thread: a pointer-sized write to a pipe is atomic, the event loop picks it up
+static void apiComplete(ws_response *resp) {
+	while (write(resp->notify_fd, &resp, sizeof(resp)) == -1 && errno == EINTR)
+		;
+}
+
+static const ws_server_api server_api = {apiHeader, apiSetStatus, apiSetHeader, apiWrite,
+                                         apiComplete};
+
+/* WS_RESPONSE */
+
+ws_response::ws_response(const ClientRequest &req, Connection *client, HandlerModule *handler,
+                         int fd)
+    : conn(client),
+      request(req),
+      module(handler),
+      notify_fd(fd),
+      start_time(time(NULL)) {
+	view.method = request.method.c_str();
+	view.uri = request.uri.c_str();
+	view.path = request.path.c_str();
+	view.query = request.query.c_str();
+	view.body = request.body.data();
+	view.body_len = request.body.size();
+	view.server = &request;
+	resp.setStatus(200);
+}
+
+/* HANDLERMODULE */
+
+HandlerModule::HandlerModule(const std::string &path, void *handle, const ws_module *module)
+    : path_(path),
+      handle_(handle),
+      module_(module) {}
+
+HandlerModule::~HandlerModule() {
+	if (module_->fini)
+		module_->fini();
+	dlclose(handle_);
+}
+
+HandlerModule *HandlerModule::load(const std::string &path, std::string &error) {
+	void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (!handle) {
+		error = dlerror();
+		return (NULL);
+	}
+	// ISO C++ has no cast from object to function pointer
+	void *symbol = dlsym(handle, WS_MODULE_ENTRY);
+	ws_module_entry entry;
+	std::memcpy(&entry, &symbol, sizeof(entry));
+	const ws_module *module = symbol ? entry() : NULL;
+
+	if (!module || !module->handle) {
+		error = "no " + std::string(WS_MODULE_ENTRY) + "() returning a handler";
+	} else if (module->abi_version != WS_MODULE_ABI) {
+		error = "built for ABI " + su::to_string(module->abi_version) + ", the server has " +
+		        su::to_string(WS_MODULE_ABI);
+	} else if (module->init && module->init(&server_api) != 0) {
+		error = "init() failed";
+	} else {
+		return (new HandlerModule(path, handle, module));
+	}
+	dlclose(handle);
+	return (NULL);
+}
+
+int HandlerModule::handle(ws_response *call) { return (module_->handle(&call->view, call)); }
+
+void HandlerModule::cancel(ws_response *call) {
+	if (module_->cancel)
+		module_->cancel(call);
+}
+
+const std::string &HandlerModule::getPath() const { return (path_); }
+
+const char *HandlerModule::getName() const { return (module_->name ? module_->name : "?"); }
@@ -0,0 +1,73 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   HandlerModule.hpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/09 09:41:17 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/09 09:41:17 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef HANDLERMODULE_HPP
+#define HANDLERMODULE_HPP
+
+#include "includes/Types.hpp"
+#include "includes/Webserv.hpp"
+#include "includes/webserv_module.h"
+#include "src/HttpServer/Structs/Response.hpp"
+
+class HandlerModule;
+
+/// One request handed to a module, seen by the module as the opaque ws_response.
+/// It owns the copy of the request behind the module's view and the response
+/// being built, and lives until the module is done with it.
+struct ws_response {
+	Connection *conn;      ///< Client to answer, NULL once it went away
+	ClientRequest request; ///< Backs `view`
+	ws_request view;
+	Response resp;
+	HandlerModule *module;
+	int notify_fd;         ///< Write end of the server's completion pipe
+	time_t start_time;
+
+	ws_response(const ClientRequest &req, Connection *client, HandlerModule *handler, int fd);
+
+  private:
+	ws_response(const ws_response &);
+	ws_response &operator=(const ws_response &);
+};
+
+/// A native handler module (handler directive), loaded once per shared object.
+///
+/// The object is opened with dlopen() at startup, its ABI version checked
+/// against WS_MODULE_ABI and its init() run with the server's services.
+/// handle() is called from the event loop; asynchronous responses come back
+/// through the completion pipe written by complete().
+class HandlerModule {
+  public:
+	/// Opens a module and initializes it.
+	/// \param error Set to the reason when the module cannot be used.
+	/// \returns The module, NULL on failure.
+	static HandlerModule *load(const std::string &path, std::string &error);
+	/// Runs the module's fini() and unloads it.
+	~HandlerModule();
+
+	/// \returns WS_DONE, WS_ASYNC or an HTTP error status.
+	int handle(ws_response *call);
+	void cancel(ws_response *call);
+	const std::string &getPath() const;
+	const char *getName() const;
+
+  private:
+	std::string path_;
+	void *handle_;
+	const ws_module *module_;
+
+	HandlerModule(const std::string &path, void *handle, const ws_module *module);
+	HandlerModule(const HandlerModule &);
+	HandlerModule &operator=(const HandlerModule &);
+};
+
+#endif
@@ -0,0 +1,323 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Proxy.cpp                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/10 10:04:52 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/10 10:04:52 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "Proxy.hpp"
+#include "src/HttpServer/HttpServer.hpp"
+
+Proxy::Proxy(const std::string &address, int fd, State state)
+    : client(NULL),
+      upstream(NULL),
+      peer(-1),
+      start_time(time(NULL)),
+      last_activity(start_time),
+      reused(false),
+      paused(false),
+      streaming(false),
+      events(0),
+      address_(address),
+      fd_(fd),
+      state_(state),
+      out_offset_(0),
+      replayable_(true),
+      body_done_(true) {
+	clearResponse();
+}
+
+Proxy::~Proxy() {
+	if (fd_ != -1)
+		close(fd_);
+}
+
+void Proxy::beginRequest(const std::string &head, bool has_body) {
+	clearResponse();
+	out_ = head;
+	out_offset_ = 0;
+	replayable_ = true;
+	body_done_ = !has_body;
+	start_time = time(NULL);
+	last_activity = start_time;
+}
+
+void Proxy::sendBody(const std::string &data, bool last) {
+	out_ += data;
+	body_done_ = last;
+}
+
+void Proxy::adopt(const Proxy &failed) {
+	clearResponse();
+	out_ = failed.out_;
+	out_offset_ = 0;
+	replayable_ = true;
+	body_done_ = failed.body_done_;
+	start_time = time(NULL);
+	last_activity = start_time;
+}
+
+ssize_t Proxy::flush() {
+	if (!pendingOutput())
+		return (0);
+	ssize_t written =
+	    send(fd_, out_.data() + out_offset_, out_.size() - out_offset_, MSG_NOSIGNAL);
+	if (written <= 0)
+		return (written);
+	out_offset_ += written;
+	last_activity = time(NULL);
+	// A long body is not kept whole, past this point the request cannot be resent
+	if (out_offset_ > REPLAY_LIMIT) {
+		out_.erase(0, out_offset_);
+		out_offset_ = 0;
+		replayable_ = false;
+	}
+	return (written);
+}
+
+ssize_t Proxy::receive() {
+	char buffer[16384];
+	ssize_t total = 0;
+	ssize_t bytes_read = -1;
+
+	// Bounded per call, like FastCGI::receive()
+	while (total < 4 * static_cast<ssize_t>(sizeof(buffer)) &&
+	       (bytes_read = recv(fd_, buffer, sizeof(buffer), 0)) > 0) {
+		in_.append(buffer, bytes_read);
+		total += bytes_read;
+		received_any_ = true;
+	}
+	int saved_errno = errno;
+	if (!headers_done_)
+		parseHeaders();
+	if (headers_done_ && !ended_ && !protocol_error_)
+		decodeBody();
+	if (bytes_read == 0) {
+		keep_alive_ = false;
+		if (headers_done_ && framing_ == UNTIL_CLOSE)
+			ended_ = true;
+	}
+	if (total > 0)
+		last_activity = time(NULL);
+	errno = saved_errno;
+	return (total > 0 ? total : bytes_read);
+}
+
+// Status line and header fields, interim 1xx responses are skipped
+void Proxy::parseHeaders() {
+	while (!headers_done_ && !protocol_error_) {
+		size_t end = in_.find("\r\n\r\n");
+		if (end == std::string::npos) {
+			protocol_error_ = in_.size() > PROXY_MAX_HEADER_SIZE;
+			return;
+		}
+		std::istringstream lines(in_.substr(0, end + 2));
+		in_.erase(0, end + 4);
+
+		std::string line;
+		std::getline(lines, line);
+		unsigned int status = 0;
+		if (line.compare(0, 7, "HTTP/1.") != 0 || line.size() < 12 ||
+		    std::sscanf(line.c_str() + 9, "%3u", &status) != 1 || status < 100 || status > 599) {
+			protocol_error_ = true;
+			return;
+		}
+		if (status < 200 && status != 101)
+			continue;
+		if (status == 101) { // no protocol switch through the proxy
+			protocol_error_ = true;
+			return;
+		}
+		status_ = status;
+		keep_alive_ = line[7] == '1';
+
+		bool chunked = false;
+		content_length_ = -1;
+		headers_.clear();
+		while (std::getline(lines, line)) {
+			if (!line.empty() && su::back(line) == '\r')
+				line.erase(line.size() - 1);
+			size_t colon = line.find(':');
+			if (colon == std::string::npos || colon == 0)
+				continue;
+			std::string name = su::trim(line.substr(0, colon));
+			std::string value = su::trim(line.substr(colon + 1));
+			std::string lname = su::to_lower(name);
+			if (lname == "connection") {
+				std::string lvalue = su::to_lower(value);
+				if (lvalue.find("close") != std::string::npos)
+					keep_alive_ = false;
+				else if (lvalue.find("keep-alive") != std::string::npos)
+					keep_alive_ = true;
+			} else if (lname == "transfer-encoding") {
+				chunked = su::to_lower(value).find("chunked") != std::string::npos;
+			} else if (lname == "content-length") {
+				if (value.empty() || value.size() > 18 ||
+				    value.find_first_not_of("0123456789") != std::string::npos) {
+					protocol_error_ = true;
+					return;
+				}
+				content_length_ = std::atol(value.c_str());
+			}
+			headers_.push_back(std::make_pair(name, value));
+		}
+
+		if (status_ == 204 || status_ == 304) {
+			framing_ = LENGTH;
+			content_length_ = 0;
+		} else if (chunked) {
+			framing_ = CHUNKED;
+			content_length_ = -1;
+			chunk_state_ = AT_CHUNK_SIZE;
+		} else if (content_length_ >= 0) {
+			framing_ = LENGTH;
+		} else {
+			framing_ = UNTIL_CLOSE;
+			keep_alive_ = false;
+		}
+		remaining_ = content_length_ > 0 ? content_length_ : 0;
+		ended_ = framing_ == LENGTH && remaining_ == 0;
+		headers_done_ = true;
+	}
+}
+
+// Moves the body bytes of in_ to body_, without their chunk framing
+void Proxy::decodeBody() {
+	if (framing_ == UNTIL_CLOSE) {
+		body_ += in_;
+		in_.clear();
+		return;
+	}
+	if (framing_ == LENGTH) {
+		size_t len = std::min(remaining_, in_.size());
+		body_.append(in_, 0, len);
+		in_.erase(0, len);
+		remaining_ -= len;
+		ended_ = remaining_ == 0;
+		return;
+	}
+
+	size_t pos = 0;
+	while (!ended_ && pos < in_.size()) {
+		if (chunk_state_ == AT_CHUNK_DATA) {
+			size_t len = std::min(remaining_, in_.size() - pos);
+			body_.append(in_, pos, len);
+			pos += len;
+			remaining_ -= len;
+			if (remaining_ == 0)
+				chunk_state_ = AT_CHUNK_CRLF;
+			continue;
+		}
+		if (chunk_state_ == AT_CHUNK_CRLF) {
+			if (in_.size() - pos < 2)
+				break;
+			if (in_.compare(pos, 2, "\r\n") != 0) {
+				protocol_error_ = true;
+				return;
+			}
+			pos += 2;
+			chunk_state_ = AT_CHUNK_SIZE;
+			continue;
+		}
+
+		size_t crlf = in_.find("\r\n", pos);
+		if (crlf == std::string::npos) {
+			protocol_error_ = in_.size() - pos > CHUNK_LINE_MAX;
+			break;
+		}
+		std::string line = in_.substr(pos, crlf - pos);
+		pos = crlf + 2;
+		if (chunk_state_ == AT_CHUNK_TRAILER) {
+			ended_ = line.empty();
+			continue;
+		}
+		line = su::trim(line.substr(0, line.find(';')));
+		char *end;
+		errno = 0;
+		long size = std::strtol(line.c_str(), &end, 16);
+		if (end == line.c_str() || *end != '\0' || errno == ERANGE || size < 0) {
+			protocol_error_ = true;
+			return;
+		}
+		remaining_ = size;
+		chunk_state_ = size ? AT_CHUNK_DATA : AT_CHUNK_TRAILER;
+	}
+	in_.erase(0, pos);
+}
+
+void Proxy::clearResponse() {
+	in_.clear();
+	headers_done_ = false;
+	status_ = 0;
+	headers_.clear();
+	framing_ = UNTIL_CLOSE;
+	content_length_ = -1;
+	remaining_ = 0;
+	chunk_state_ = AT_CHUNK_SIZE;
+	body_.clear();
+	ended_ = false;
+	keep_alive_ = false;
+	protocol_error_ = false;
+	received_any_ = false;
+}
+
+void Proxy::reset() {
+	out_.clear();
+	out_offset_ = 0;
+	replayable_ = true;
+	body_done_ = true;
+	clearResponse();
+	client = NULL;
+	upstream = NULL;
+	peer = -1;
+	tried.clear();
+	reused = true;
+	paused = false;
+	streaming = false;
+	state_ = IDLE;
+}
+
+size_t Proxy::pendingOutput() const { return (out_.size() - out_offset_); }
+
+bool Proxy::headersComplete() const { return (headers_done_); }
+
+bool Proxy::responseEnded() const { return (ended_); }
+
+bool Proxy::protocolError() const { return (protocol_error_); }
+
+bool Proxy::receivedAny() const { return (received_any_); }
+
+bool Proxy::replayable() const { return (replayable_); }
+
+bool Proxy::reusable() const {
+	return (keep_alive_ && ended_ && body_done_ && !pendingOutput() && in_.empty());
+}
+
+int Proxy::getStatus() const { return (status_); }
+
+const std::vector<std::pair<std::string, std::string> > &Proxy::getHeaders() const {
+	return (headers_);
+}
+
+ssize_t Proxy::getContentLength() const {
+	return (framing_ == LENGTH ? content_length_ : -1);
+}
+
+std::string Proxy::takeBody() {
+	std::string body;
+	body.swap(body_);
+	return (body);
+}
+
+int Proxy::getFd() const { return (fd_); }
+
+const std::string &Proxy::getAddress() const { return (address_); }
+
+Proxy::State Proxy::getState() const { return (state_); }
+
+void Proxy::setState(State state) { state_ = state; }
@@ -0,0 +1,129 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Proxy.hpp                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/10 10:04:52 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/10 10:04:52 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef PROXY_HPP
+#define PROXY_HPP
+
+#include "includes/Webserv.hpp"
+
+class Connection;
+class Upstream;
+
+/// One HTTP/1.1 connection to an upstream server (proxy_pass).
+///
+/// Carries one request at a time: the head, then the body as the client
+/// sends it, while the response is decoded as it arrives (Content-Length,
+/// chunked or up to the close). A connection whose exchange ended cleanly
+/// goes back to the server's keep-alive pool. Nothing here blocks.
+class Proxy {
+  public:
+	enum State {
+		CONNECTING, ///< Non-blocking connect() in progress
+		ACTIVE,     ///< A request is being sent or answered
+		IDLE        ///< Waiting in the pool for the next request
+	};
+
+	Proxy(const std::string &address, int fd, State state);
+	~Proxy();
+
+	/// Starts a request with its head, the body follows with sendBody().
+	void beginRequest(const std::string &head, bool has_body);
+
+	/// Queues request body bytes, already framed. \param last The body is complete.
+	void sendBody(const std::string &data, bool last);
+
+	/// Takes over the request bytes a failed connection could not deliver.
+	void adopt(const Proxy &failed);
+
+	/// Writes queued request bytes. \returns Bytes written, or -1 with errno set.
+	ssize_t flush();
+
+	/// Reads and decodes available response bytes.
+	/// \returns Bytes read, 0 if the upstream closed the connection, -1 with errno set.
+	ssize_t receive();
+
+	/// Makes the connection reusable once the exchange ended.
+	void reset();
+
+	size_t pendingOutput() const;
+	bool headersComplete() const;
+	bool responseEnded() const;
+	bool protocolError() const;
+	bool receivedAny() const;
+	/// The request can still be sent again from its first byte.
+	bool replayable() const;
+	/// The exchange ended cleanly and the upstream keeps the connection open.
+	bool reusable() const;
+
+	int getStatus() const;
+	const std::vector<std::pair<std::string, std::string> > &getHeaders() const;
+	/// Length of the response body, -1 if chunked or delimited by the close.
+	ssize_t getContentLength() const;
+	std::string takeBody();
+
+	int getFd() const;
+	const std::string &getAddress() const;
+	State getState() const;
+	void setState(State state);
+
+	Connection *client;        ///< Connection waiting for the answer
+	Upstream *upstream;        ///< Balancer the server was picked from
+	int peer;                  ///< Index of the server in it
+	std::vector<int> tried;    ///< Servers that failed this request
+	std::string client_ip;     ///< Hashed by ip_hash when picking again
+	time_t start_time;         ///< When the current request was dispatched
+	time_t last_activity;      ///< Last byte exchanged with the upstream
+	bool reused;               ///< Taken from the pool rather than freshly connected
+	bool paused;               ///< Not read while the client lags behind
+	bool streaming;            ///< The response headers went to the client
+	uint32_t events;           ///< Mask registered in epoll
+
+	static const size_t REPLAY_LIMIT = 65536;   // sent bytes kept to resend a request
+	static const size_t BODY_HIGH_WATER = 65536; // queued body bytes that pause the client
+	static const size_t BODY_LOW_WATER = 16384;  // queued body bytes that resume it
+
+  private:
+	enum Framing { LENGTH, CHUNKED, UNTIL_CLOSE };
+	enum ChunkState { AT_CHUNK_SIZE, AT_CHUNK_DATA, AT_CHUNK_CRLF, AT_CHUNK_TRAILER };
+
+	std::string address_;
+	int fd_;
+	State state_;
+
+	std::string out_; // request bytes, the sent ones kept up to REPLAY_LIMIT
+	size_t out_offset_;
+	bool replayable_;
+	bool body_done_;
+
+	std::string in_; // undecoded response bytes
+	bool headers_done_;
+	int status_;
+	std::vector<std::pair<std::string, std::string> > headers_;
+	Framing framing_;
+	ssize_t content_length_;
+	size_t remaining_; // of the body, or of the current chunk
+	ChunkState chunk_state_;
+	std::string body_;
+	bool ended_;
+	bool keep_alive_;
+	bool protocol_error_;
+	bool received_any_;
+
+	Proxy(const Proxy &);
+	Proxy &operator=(const Proxy &);
+
+	void clearResponse();
+	void parseHeaders();
+	void decodeBody();
+};
+
+#endif
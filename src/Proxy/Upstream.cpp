@@ -0,0 +1,134 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Upstream.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/10 10:04:52 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/10 10:04:52 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "Upstream.hpp"
+
+Upstream::Upstream(const UpstreamConfig &config)
+    : config_(config) {
+	for (size_t i = 0; i < config.servers.size(); ++i) {
+		Peer peer;
+		peer.conf = config.servers[i];
+		peer.current_weight = 0;
+		peer.active = 0;
+		peer.fails = 0;
+		peer.checked = 0;
+		peers_.push_back(peer);
+	}
+}
+
+int Upstream::pick(const std::string &client_ip, const std::vector<int> &tried, time_t now) {
+	if (config_.balance == "ip_hash")
+		return (ipHash(client_ip, tried, now));
+
+	std::vector<int> candidates;
+	for (size_t i = 0; i < peers_.size(); ++i) {
+		if (usable(i, tried, now))
+			candidates.push_back(i);
+	}
+	if (candidates.empty())
+		return (-1);
+	if (config_.balance == "least_conn")
+		return (leastConn(candidates));
+	return (roundRobin(candidates));
+}
+
+// Down servers come back once fail_timeout passed since their last failure
+bool Upstream::usable(int peer, const std::vector<int> &tried, time_t now) const {
+	const Peer &p = peers_[peer];
+	if (std::find(tried.begin(), tried.end(), peer) != tried.end())
+		return (false);
+	// A lone server is never marked down, there is nothing to fall back on
+	return (peers_.size() == 1 || !p.conf.max_fails || p.fails < p.conf.max_fails ||
+	        now - p.checked >= p.conf.fail_timeout);
+}
+
+// Smooth weighted round-robin: weights 5,1,1 give a a b a c a a, not a a a a a b c
+int Upstream::roundRobin(const std::vector<int> &candidates) {
+	int total = 0;
+	int best = -1;
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		Peer &p = peers_[candidates[i]];
+		p.current_weight += p.conf.weight;
+		total += p.conf.weight;
+		if (best == -1 || p.current_weight > peers_[best].current_weight)
+			best = candidates[i];
+	}
+	peers_[best].current_weight -= total;
+	return (best);
+}
+
+// Fewest active requests per weight, ties shared by round-robin
+int Upstream::leastConn(const std::vector<int> &candidates) {
+	std::vector<int> least;
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		const Peer &p = peers_[candidates[i]];
+		if (!least.empty()) {
+			const Peer &l = peers_[least[0]];
+			size_t lhs = p.active * l.conf.weight;
+			size_t rhs = l.active * p.conf.weight;
+			if (lhs > rhs)
+				continue;
+			if (lhs < rhs)
+				least.clear();
+		}
+		least.push_back(candidates[i]);
+	}
+	return (roundRobin(least));
+}
+
+// The same client lands on the same server while it is up, the next one otherwise
+int Upstream::ipHash(const std::string &client_ip, const std::vector<int> &tried, time_t now) {
+	uint32_t hash = 2166136261u; // FNV-1a
+	for (size_t i = 0; i < client_ip.size(); ++i)
+		hash = (hash ^ static_cast<unsigned char>(client_ip[i])) * 16777619u;
+
+	uint32_t total = 0;
+	for (size_t i = 0; i < peers_.size(); ++i)
+		total += peers_[i].conf.weight;
+	uint32_t point = hash % total;
+	size_t first = 0;
+	while (point >= peers_[first].conf.weight)
+		point -= peers_[first++].conf.weight;
+
+	for (size_t i = 0; i < peers_.size(); ++i) {
+		int peer = (first + i) % peers_.size();
+		if (usable(peer, tried, now))
+			return (peer);
+	}
+	return (-1);
+}
+
+void Upstream::acquire(int peer) { peers_[peer].active++; }
+
+void Upstream::release(int peer) {
+	if (peers_[peer].active)
+		peers_[peer].active--;
+}
+
+bool Upstream::failed(int peer, time_t now) {
+	Peer &p = peers_[peer];
+	if (now - p.checked >= p.conf.fail_timeout)
+		p.fails = 0; // a new window
+	p.fails++;
+	p.checked = now;
+	return (peers_.size() > 1 && p.conf.max_fails && p.fails == p.conf.max_fails);
+}
+
+void Upstream::succeeded(int peer) { peers_[peer].fails = 0; }
+
+const std::string &Upstream::getName() const { return (config_.name); }
+
+const UpstreamConfig &Upstream::getConfig() const { return (config_); }
+
+const std::string &Upstream::getAddress(int peer) const { return (peers_[peer].conf.address); }
+
+size_t Upstream::getKeepalive() const { return (config_.keepalive); }
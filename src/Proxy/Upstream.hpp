@@ -0,0 +1,67 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Upstream.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/10 10:04:52 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/10 10:04:52 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef UPSTREAM_HPP
+#define UPSTREAM_HPP
+
+#include "includes/Webserv.hpp"
+#include "src/ConfigParser/Structs/Struct.hpp"
+
+/// Load balancing state of an upstream block (proxy_pass).
+///
+/// Picks the server of each request with smooth weighted round-robin, the
+/// fewest active requests per weight (least_conn) or a hash of the client
+/// address (ip_hash). Health is checked passively: a server failing max_fails
+/// times within fail_timeout seconds is skipped for fail_timeout seconds,
+/// unless it is the only one.
+class Upstream {
+  public:
+	explicit Upstream(const UpstreamConfig &config);
+
+	/// Chooses the server of a request.
+	/// \param client_ip Address hashed by ip_hash.
+	/// \param tried Servers that already failed this request, skipped.
+	/// \returns Its index, -1 if no server is left.
+	int pick(const std::string &client_ip, const std::vector<int> &tried, time_t now);
+
+	/// A request starts or stops using a server (least_conn).
+	void acquire(int peer);
+	void release(int peer);
+
+	/// Counts a failure. \returns True if it marks the server down.
+	bool failed(int peer, time_t now);
+	void succeeded(int peer);
+
+	const std::string &getName() const;
+	const UpstreamConfig &getConfig() const;
+	const std::string &getAddress(int peer) const;
+	size_t getKeepalive() const;
+
+  private:
+	struct Peer {
+		UpstreamServer conf;
+		int current_weight; // smooth weighted round-robin
+		size_t active;      // requests in flight
+		unsigned int fails; // within the current fail_timeout window
+		time_t checked;     // time of the last failure
+	};
+
+	UpstreamConfig config_;
+	std::vector<Peer> peers_;
+
+	bool usable(int peer, const std::vector<int> &tried, time_t now) const;
+	int roundRobin(const std::vector<int> &candidates);
+	int leastConn(const std::vector<int> &candidates);
+	int ipHash(const std::string &client_ip, const std::vector<int> &tried, time_t now);
+};
+
+#endif
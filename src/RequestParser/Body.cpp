@@ -28,7 +28,7 @@ uint16_t RequestParsingUtils::checkNTrimLine(std::string &line, Logger &logger)
 }
 
 uint16_t RequestParsingUtils::parseBody(std::istringstream &stream, ClientRequest &request, Logger &logger) {
-	logger.logWithPrefix(Logger::DEBUG, "HTTP", "Parsing message body");
+	LOG_DEBUG_PREFIX(logger, "HTTP", "Parsing message body");
 
 	const char *content_length_value = findHeader(request, "content-length", logger);
 
@@ -63,7 +63,8 @@ uint16_t RequestParsingUtils::parseBody(std::istringstream &stream, ClientReques
 	std::string body(content_length, '\0');
 	stream.read(&body[0], content_length);
 	std::streamsize actually_read = stream.gcount();
-	std::cout << "____________CONTENT LENGTH: " << content_length << ", ACTUALLY READ: " << actually_read << std::endl;
+	LOG_DEBUG_PREFIX(logger, "HTTP", "Content length: " + su::to_string(content_length) +
+	                                     ", actually read: " + su::to_string(actually_read));
 	if (actually_read != content_length) {
 		logger.logWithPrefix(Logger::WARNING, "HTTP",
 		                     "Body length mismatch: expected " + su::to_string(content_length) +
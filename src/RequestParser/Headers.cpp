@@ -77,7 +77,7 @@ uint16_t RequestParsingUtils::checkHeader(std::string &name, std::string &value,
 /* Parser */
 uint16_t RequestParsingUtils::parseHeaders(std::istringstream &stream, ClientRequest &request, Logger &logger) {
 	std::string line;
-	logger.logWithPrefix(Logger::DEBUG, "HTTP", "Parsing headers");
+	LOG_DEBUG_PREFIX(logger, "HTTP", "Parsing headers");
 	int header_count = 0;
 
 	while (std::getline(stream, line)) {
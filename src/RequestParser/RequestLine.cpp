@@ -168,7 +168,7 @@ uint16_t RequestParsingUtils::checkReqLine(ClientRequest &request, Logger &logge
 uint16_t RequestParsingUtils::parseReqLine(std::istringstream &stream, ClientRequest &request,
                                            Logger &logger) {
 	std::string line;
-	logger.logWithPrefix(Logger::DEBUG, "HTTP", "Parsing request line");
+	LOG_DEBUG_PREFIX(logger, "HTTP", "Parsing request line");
 
 	if (!std::getline(stream, line)) {
 		logger.logWithPrefix(Logger::WARNING, "HTTP", "No request line present");
@@ -172,7 +172,7 @@ uint16_t RequestParsingUtils::parseRequest(const std::string &raw_request, Clien
 		return 400;
 	}
 
-	logger.logWithPrefix(Logger::DEBUG, "HTTP", "Parsing request");
+	LOG_DEBUG_PREFIX(logger, "HTTP", "Parsing request");
 	request.chunked_encoding = false;
 	request.file_upload = false;
 	request.extension = "";
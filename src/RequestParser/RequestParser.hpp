@@ -37,4 +37,8 @@ uint16_t parseRequest(const std::string &raw_request, ClientRequest &request, Lo
 uint16_t parseRequestHeaders(const std::string &raw_request, ClientRequest &request, Logger &logger);
 } // namespace RequestParsingUtils
 
+/// Percent-decodes a request URI into decoded; false on malformed escapes or
+/// control characters.
+bool decodeNValidateUri(const std::string &uri, std::string &decoded);
+
 #endif
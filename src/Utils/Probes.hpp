@@ -0,0 +1,68 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Probes.hpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/18 10:02:11 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/18 10:02:11 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef PROBES_HPP
+#define PROBES_HPP
+
+// USDT static tracepoints of the "webserv" provider, in the SystemTap
+// .note.stapsdt format read by perf, bpftrace, bcc and stap:
+//   bpftrace -e 'usdt:./webserv:webserv:response__sent { @[arg1] = count(); }'
+// Each probe is a nop plus an ELF note; its arguments are 64-bit integers
+// (pointers to C strings for the names), loaded only when traced.
+// Same layout as <sys/sdt.h>, which is not needed to build. Compiled out with
+// WEBSERV_NO_PROBES or on other architectures than x86-64 and AArch64.
+#if !defined(WEBSERV_NO_PROBES) && (defined(__x86_64__) || defined(__aarch64__))
+
+#define WEBSERV_PROBE_NOTE_(name, args)                                                            \
+	"990: nop\n"                                                                                   \
+	".pushsection .note.stapsdt,\"?\",\"note\"\n"                                                  \
+	".balign 4\n"                                                                                  \
+	".4byte 992f-991f, 994f-993f, 3\n"                                                             \
+	"991: .asciz \"stapsdt\"\n"                                                                    \
+	"992: .balign 4\n"                                                                             \
+	"993: .8byte 990b\n"                                                                           \
+	".8byte _.stapsdt.base\n"                                                                      \
+	".8byte 0\n"                                                                                   \
+	".asciz \"webserv\"\n"                                                                         \
+	".asciz \"" #name "\"\n"                                                                       \
+	".asciz \"" args "\"\n"                                                                        \
+	"994: .balign 4\n"                                                                             \
+	".popsection\n"                                                                                \
+	".ifndef _.stapsdt.base\n"                                                                     \
+	".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"                        \
+	".weak _.stapsdt.base\n"                                                                       \
+	".hidden _.stapsdt.base\n"                                                                     \
+	"_.stapsdt.base: .space 1\n"                                                                   \
+	".size _.stapsdt.base, 1\n"                                                                    \
+	".popsection\n"                                                                                \
+	".endif\n"
+
+#define WEBSERV_PROBE1(name, a)                                                                    \
+	__asm__ __volatile__(WEBSERV_PROBE_NOTE_(name, "-8@%0") : : "r"((long)(a)))
+#define WEBSERV_PROBE2(name, a, b)                                                                 \
+	__asm__ __volatile__(WEBSERV_PROBE_NOTE_(name, "-8@%0 -8@%1")                                  \
+	                     :                                                                         \
+	                     : "r"((long)(a)), "r"((long)(b)))
+#define WEBSERV_PROBE3(name, a, b, c)                                                              \
+	__asm__ __volatile__(WEBSERV_PROBE_NOTE_(name, "-8@%0 -8@%1 -8@%2")                            \
+	                     :                                                                         \
+	                     : "r"((long)(a)), "r"((long)(b)), "r"((long)(c)))
+
+#else
+
+#define WEBSERV_PROBE1(name, a) ((void)(a))
+#define WEBSERV_PROBE2(name, a, b) ((void)(a), (void)(b))
+#define WEBSERV_PROBE3(name, a, b, c) ((void)(a), (void)(b), (void)(c))
+
+#endif
+
+#endif
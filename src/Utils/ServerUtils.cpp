@@ -14,6 +14,12 @@
 
 time_t WebServer::getCurrentTime() const { return time(NULL); }
 
+double WebServer::monotonicTime() const {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec + now.tv_nsec / 1e9);
+}
+
 std::string WebServer::getFileContent(std::string path) {
 	std::string content;
 	std::ifstream file;
@@ -27,7 +33,7 @@ std::string WebServer::getFileContent(std::string path) {
 		buffer << file.rdbuf();
 		file.close();
 		content = buffer.str();
-		_lggr.logWithPrefix(Logger::DEBUG, "File Handling",
+		LOG_DEBUG_PREFIX(_lggr, "File Handling",
 							"Read " + su::to_string(content.size()) + " bytes from " + path);
 	}
 	return content;
@@ -151,7 +157,7 @@ bool isPrefixMatch(const std::string &uri, LocConfig &loc, Logger& log) {
 		return false;
 	}
 	if (uri.length() == location_path.length()) {
-		log.debug(" uri : " + uri + " loc : " + location_path);
+		LOG_DEBUG(log, " uri : " + uri + " loc : " + location_path);
 		return true; // Exact match
 	}
 	if (loc.is_exact_()) {
@@ -297,6 +297,28 @@ inline bool iequals(const std::string &str1, const std::string &str2) {
  */
 inline char back(const std::string &s) { return s[s.size() - 1]; }
 
+/**
+ * Parse a byte count with an optional K, M or G suffix (either case)
+ * Returns false on anything else or on overflow
+ */
+inline bool parse_size(const std::string &str, size_t &result) {
+	size_t factor = 1;
+	std::string digits = str;
+	char last = str.empty() ? '\0' : std::tolower(back(str));
+	if (last == 'k' || last == 'm' || last == 'g') {
+		factor = last == 'k' ? 1024 : last == 'm' ? 1024 * 1024 : 1024 * 1024 * 1024;
+		digits = str.substr(0, str.size() - 1);
+	}
+	if (digits.empty() || digits.size() > 12 ||
+	    digits.find_first_not_of("0123456789") != std::string::npos)
+		return false;
+	size_t value;
+	if (!from_string(digits, value) || value > SIZE_MAX / factor)
+		return false;
+	result = value * factor;
+	return true;
+}
+
 inline std::string humanReadableBytes(size_t bytes) {
 	const char *units[] = {"bytes", "KB", "MB", "GB", "TB", "PB"};
 	size_t unitIndex = 0;
@@ -0,0 +1,76 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   main.cpp                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/22 10:05:31 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/22 10:05:31 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+// Apart from the server so its objects link into tests/bench/microbench.cpp
+
+#include "src/ConfigParser/ConfigParser.hpp"
+#include "src/HttpServer/HttpServer.hpp"
+#include "src/HttpServer/Structs/WebServer.hpp"
+#include "src/Utils/ArgumentParser.hpp"
+
+static std::string getCurrentWorkingDirectory() {
+	char cwd[PATH_MAX];
+	if (getcwd(cwd, sizeof(cwd)) == NULL) {
+		std::cerr << "Warning: could not resolve current working directory." << std::endl;
+		return "";
+	}
+	std::string dir(cwd);
+	return dir;
+}
+
+int main(int argc, char *argv[]) {
+	ArgumentParser ap;
+	ServerArgs args;
+
+	try {
+		args = ap.parseArgs(argc, argv);
+		if (args.show_help) {
+			ap.printUsage(argv[0]);
+			return 0;
+		}
+		if (args.show_version) {
+			std::cout << __WEBSERV_VERSION__ << std::endl;
+			return 0;
+		}
+		if (args.prefix_path.empty()) {
+			args.prefix_path = getCurrentWorkingDirectory();
+		}
+		std::cout << "prefix_path: " << args.prefix_path << std::endl;
+	} catch (const std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		std::cerr << "Use --help for usage information." << std::endl;
+		return 1;
+	}
+
+	ConfigParser configparser(args.log_level);
+	std::vector<ServerConfig> servers;
+
+	if (!configparser.loadConfig(args.config_file, servers, args.prefix_path, args.log_level)) {
+		std::cerr << "Error: Failed to open or parse configuration file '" << args.config_file
+		          << "'" << std::endl;
+		std::cerr << "Please check the configuration file syntax and try again." << std::endl;
+		return 1;
+	}
+
+	WebServer webserv(servers, args.prefix_path, args.log_level);
+
+    webserv.log_level = args.log_level;
+	webserv.config_file = args.config_file;
+	webserv.argv.assign(argv, argv + argc);
+	if (!webserv.initialize()) {
+		std::cerr << "Failed to initialize web server." << std::endl;
+		return 1;
+	}
+
+	webserv.run();
+	return 0;
+}
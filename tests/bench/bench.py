@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+"""Benchmark scenarios for webserv, driven by loadgen.
+
+Usage: make bench [BENCH_ARGS="..."]      (from the repository root)
+       tests/bench/bench.py [-d secs] [-o results.jsonl] [scenario...]
+       tests/bench/bench.py --compare old.jsonl new.jsonl
+       tests/bench/bench.py --list
+
+Writes a configuration, static files and CGI scripts to a temporary directory,
+starts ./webserv on it and runs loadgen once per scenario. Each result is one
+JSON line (see tests/bench/loadgen.cpp) appended to the results file with the
+git revision and the scenario name, so runs of two revisions can be compared.
+Build with `make RELEASE=1` first to measure what ships, not the debug logs.
+"""
+import argparse
+import json
+import os
+import resource
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import http.client
+
+ROOT = os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+PORT = 8095
+ADDR = "127.0.0.1:%d" % PORT
+
+CONFIG = """http {
+    server {
+        listen %(addr)s;
+        root %(dir)s/www;
+        client_max_body_size 100m;
+
+        location / {
+            allowed_methods GET;
+        }
+
+        location /cgi/ {
+            root %(dir)s/www/cgi;
+            allowed_methods GET POST;
+            cgi_ext .py %(python)s;
+        }
+    }
+}
+"""
+
+HELLO = """import sys
+sys.stdout.write("Content-Type: text/plain\\r\\n\\r\\nhello\\n")
+"""
+SINK = """import sys
+while sys.stdin.buffer.read(65536):
+    pass
+sys.stdout.write("Content-Type: text/plain\\r\\n\\r\\nstored\\n")
+"""
+
+# name: loadgen options, then the path
+SCENARIOS = [
+    ("static-small", ["-c", "32"], "/small.html"),
+    ("static-small-close", ["-c", "32", "-x"], "/small.html"),
+    ("static-pipelined", ["-c", "32", "-p", "8"], "/small.html"),
+    ("static-open-loop", ["-c", "64", "-r", "5000"], "/small.html"),
+    # One at a time: the file is read whole into memory before it is sent
+    ("download-1g", ["-c", "1", "-d", "30", "-t", "120"], "/big.bin"),
+    ("upload-chunked", ["-c", "8", "-m", "POST", "-b", "1048576", "-k", "65536"], "/cgi/sink.py"),
+    ("not-found-flood", ["-c", "64"], "/missing.html"),
+    ("cgi-get", ["-c", "8"], "/cgi/hello.py"),
+    ("cgi-post", ["-c", "8", "-m", "POST", "-b", "16384"], "/cgi/sink.py"),
+    # Shorter than KEEP_ALIVE_TO, or the server closes the idle ones first
+    ("idle-10k", ["-c", "8", "-i", "10000", "-d", "4"], "/small.html"),
+]
+
+
+def prepare(directory):
+    www = os.path.join(directory, "www")
+    os.makedirs(os.path.join(www, "cgi"))
+    with open(os.path.join(www, "small.html"), "w") as f:
+        f.write("<html><body>" + "x" * 4000 + "</body></html>\n")
+    with open(os.path.join(www, "big.bin"), "wb") as f:
+        f.truncate(1 << 30)  # sparse, read as zeros
+    for name, script in (("hello.py", HELLO), ("sink.py", SINK)):
+        with open(os.path.join(www, "cgi", name), "w") as f:
+            f.write(script)
+    conf = os.path.join(directory, "bench.conf")
+    with open(conf, "w") as f:
+        f.write(CONFIG % {"addr": ADDR, "dir": directory, "python": sys.executable})
+    return conf
+
+
+def raise_fd_limit():
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+
+
+# Before each scenario too: the previous one may leave the server busy
+def wait_ready(seconds=60):
+    for _ in range(int(seconds * 10)):
+        try:
+            conn = http.client.HTTPConnection("127.0.0.1", PORT, timeout=1)
+            conn.request("GET", "/small.html")
+            if conn.getresponse().status == 200:
+                return
+        except OSError:
+            pass
+        time.sleep(0.1)
+    sys.exit("webserv does not answer on %s" % ADDR)
+
+
+def revision():
+    try:
+        return subprocess.check_output(["git", "rev-parse", "--short", "HEAD"], cwd=ROOT,
+                                       stderr=subprocess.DEVNULL).decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def run(args):
+    wanted = [s for s in SCENARIOS if not args.scenarios or s[0] in args.scenarios]
+    unknown = set(args.scenarios) - set(s[0] for s in SCENARIOS)
+    if unknown:
+        sys.exit("unknown scenario(s): %s" % ", ".join(sorted(unknown)))
+    directory = tempfile.mkdtemp(prefix="webserv_bench_")
+    raw = os.path.join(directory, "results.jsonl")
+    log = open(os.path.join(directory, "webserv.log"), "w")
+    server = subprocess.Popen([os.path.join(ROOT, "webserv"), "--log-level", "error",
+                               prepare(directory)], cwd=ROOT, stdout=log, stderr=log,
+                              preexec_fn=raise_fd_limit)
+    try:
+        for name, options, path in wanted:
+            wait_ready()
+            if "-d" not in options:
+                options = options + ["-d", str(args.duration)]
+            subprocess.call([os.path.join(ROOT, "loadgen"), "-n", name, "-o", raw] + options +
+                            [ADDR, path])
+            if server.poll() is not None:
+                sys.exit("webserv exited during %s, see %s" % (name, log.name))
+    finally:
+        server.terminate()
+        server.wait()
+
+    rev = revision()
+    with open(raw) as results, open(args.output, "a") as out:
+        for line in results:
+            result = json.loads(line)
+            result["revision"] = rev
+            out.write(json.dumps(result) + "\n")
+    shutil.rmtree(directory)
+    print("results appended to %s (revision %s)" % (args.output, rev))
+
+
+# Last result of each scenario in a results file
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            result = json.loads(line)
+            results[result["name"]] = result
+    return results
+
+
+def compare(old_path, new_path):
+    old, new = load(old_path), load(new_path)
+    print("%-20s %12s %12s %8s %10s %10s %8s" % ("scenario", "old req/s", "new req/s", "",
+                                                 "old p99", "new p99", ""))
+    for name in [s[0] for s in SCENARIOS if s[0] in old and s[0] in new]:
+        a, b = old[name], new[name]
+        rps = (b["rps"] - a["rps"]) / a["rps"] * 100 if a["rps"] else 0
+        p99a, p99b = a["corrected_us"]["p99"], b["corrected_us"]["p99"]
+        p99 = (p99b - p99a) / p99a * 100 if p99a else 0
+        print("%-20s %12.1f %12.1f %+7.1f%% %8dus %8dus %+7.1f%%" % (name, a["rps"], b["rps"], rps,
+                                                                     p99a, p99b, p99))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="webserv benchmark scenarios")
+    parser.add_argument("scenarios", nargs="*", help="scenarios to run (default all)")
+    parser.add_argument("-d", "--duration", type=float, default=10, help="seconds per scenario")
+    parser.add_argument("-o", "--output", default="bench_results.jsonl", help="results file")
+    parser.add_argument("--compare", nargs=2, metavar=("OLD", "NEW"), help="compare two files")
+    parser.add_argument("--list", action="store_true", help="list the scenarios")
+    args = parser.parse_args()
+    if args.list:
+        for name, options, path in SCENARIOS:
+            print("%-20s loadgen %s %s" % (name, " ".join(options), path))
+    elif args.compare:
+        compare(*args.compare)
+    else:
+        run(args)
+
+
+if __name__ == "__main__":
+    main()
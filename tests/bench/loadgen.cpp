@@ -0,0 +1,1098 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   loadgen.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/19 09:12:40 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/19 09:12:40 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+// HTTP/1.1 load generator: one thread, one epoll loop, many connections.
+//
+//   make loadgen
+//   ./loadgen [options] host:port /path
+//   ./loadgen -R trace [-s speed] [options] host:port
+//
+//   -c N      connections (default 16)
+//   -d S      duration in seconds (default 10)
+//   -r R      open loop: R requests per second in total, sent at fixed
+//             intervals whatever the server does; closed loop without it,
+//             each connection sends its next request once one is answered
+//   -p N      requests in flight per connection, pipelined (default 1)
+//   -x        Connection: close, one request per connection
+//   -m M      method (default GET)
+//   -b N      request body of N bytes, with a Content-Length
+//   -k N      the body in chunks of N bytes (Transfer-Encoding: chunked)
+//   -H h      extra header line, repeatable
+//   -i N      also hold N idle connections open for the whole run
+//   -t S      a request unanswered for S seconds counts as an error (default 30)
+//   -n name   name of the run in the results (default the path)
+//   -o file   appends the results to file as one JSON line
+//   -R trace  replays a capture_trace file instead (see ConfigurationGuide.md):
+//             its connections open and close at their captured times, each
+//             sending its requests in order on the same connection, the next
+//             once the previous is answered and no earlier than it was
+//             captured. -c, -p, -r, -x, -m, -b, -k, -H and -i do not apply;
+//             -d stops the replay early. The name defaults to the trace path
+//   -s X      replays X times faster than captured (default 1)
+//
+// Latencies are in microseconds, in a log-linear histogram with 3 significant
+// digits like HdrHistogram. "latency" runs from the actual send of each
+// request. "corrected" accounts for coordinated omission: in open loop it runs
+// from the time the request was due, so a stalled server is charged for the
+// requests it kept the generator from sending; in closed loop the histogram
+// is backfilled like HdrHistogram's copyCorrectedForCoordinatedOmission, with
+// the mean latency as the expected interval. A replay runs it from the time
+// the request was captured.
+
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <fcntl.h>
+#include <map>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <queue>
+#include <string>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/* ---------------------------------------------------------------- Histogram */
+
+// Values below 2048 have their own bucket, then each power of two is split in
+// 1024 buckets: 1 / 1024 relative precision, up to 2^40 us.
+class Histogram {
+  public:
+	Histogram() : counts_(SIZE, 0), count_(0), sum_(0), min_(0), max_(0) {}
+
+	void record(unsigned long value, unsigned long times = 1) {
+		if (value >= (1UL << 40))
+			value = (1UL << 40) - 1;
+		counts_[index(value)] += times;
+		if (count_ == 0 || value < min_)
+			min_ = value;
+		if (value > max_)
+			max_ = value;
+		count_ += times;
+		sum_ += static_cast<double>(value) * times;
+	}
+
+	// Adds the samples a closed loop missed while a request stalled it: one
+	// every interval, down from the observed value
+	void recordCorrected(unsigned long value, unsigned long times, unsigned long interval) {
+		record(value, times);
+		if (interval == 0)
+			return;
+		for (unsigned long missing = value > interval ? value - interval : 0;
+		     missing >= interval; missing -= interval)
+			record(missing, times);
+	}
+
+	Histogram corrected(unsigned long interval) const {
+		Histogram out;
+		for (size_t i = 0; i < counts_.size(); ++i)
+			if (counts_[i])
+				out.recordCorrected(highest(i), counts_[i], interval);
+		return (out);
+	}
+
+	unsigned long percentile(double q) const {
+		if (count_ == 0)
+			return (0);
+		unsigned long wanted = static_cast<unsigned long>(std::ceil(q / 100 * count_));
+		if (wanted == 0)
+			wanted = 1;
+		unsigned long seen = 0;
+		for (size_t i = 0; i < counts_.size(); ++i) {
+			seen += counts_[i];
+			if (seen >= wanted)
+				return (std::min(highest(i), max_));
+		}
+		return (max_);
+	}
+
+	unsigned long count() const { return (count_); }
+	unsigned long min() const { return (min_); }
+	unsigned long max() const { return (max_); }
+	double mean() const { return (count_ ? sum_ / count_ : 0); }
+
+  private:
+	static const size_t SUB = 1024;
+	static const size_t SIZE = (40 - 10 + 2) * SUB;
+
+	static size_t index(unsigned long value) {
+		int exponent = 0;
+		while ((value >> exponent) >= 2 * SUB)
+			++exponent;
+		return (exponent * SUB + (value >> exponent));
+	}
+
+	// Largest value of a bucket
+	static unsigned long highest(size_t index) {
+		size_t exponent = index < 2 * SUB ? 0 : index / SUB - 1;
+		unsigned long lowest = static_cast<unsigned long>(index - exponent * SUB) << exponent;
+		return (lowest + (1UL << exponent) - 1);
+	}
+
+	std::vector<unsigned long> counts_;
+	unsigned long count_;
+	double sum_;
+	unsigned long min_;
+	unsigned long max_;
+};
+
+/* ------------------------------------------------------------------ Options */
+
+struct Options {
+	std::string host;
+	int port;
+	std::string path;
+	std::string method;
+	std::vector<std::string> headers;
+	int connections;
+	double duration;
+	double rate;
+	int depth;
+	bool close;
+	long body;
+	long chunk;
+	int idle;
+	double timeout;
+	std::string name;
+	std::string output;
+	std::string trace;
+	double speed;
+	bool capped; // -d given
+
+	Options()
+	    : port(0), method("GET"), connections(16), duration(10), rate(0), depth(1), close(false),
+	      body(-1), chunk(0), idle(0), timeout(30), speed(1), capped(false) {}
+};
+
+static void usage() {
+	std::fprintf(stderr, "usage: loadgen [-c conns] [-d secs] [-r rate] [-p depth] [-x] "
+	                     "[-m method] [-b bytes] [-k chunk] [-H header]... [-i idle] "
+	                     "[-t secs] [-n name] [-o results.jsonl] host:port /path\n"
+	                     "       loadgen -R trace [-s speed] [-d secs] [-t secs] [-n name] "
+	                     "[-o results.jsonl] host:port\n");
+	std::exit(2);
+}
+
+static Options parseOptions(int argc, char **argv) {
+	Options opt;
+	int c;
+	while ((c = getopt(argc, argv, "c:d:r:p:xm:b:k:H:i:t:n:o:R:s:")) != -1) {
+		switch (c) {
+			case 'c': opt.connections = std::atoi(optarg); break;
+			case 'd':
+				opt.duration = std::atof(optarg);
+				opt.capped = true;
+				break;
+			case 'r': opt.rate = std::atof(optarg); break;
+			case 'p': opt.depth = std::atoi(optarg); break;
+			case 'x': opt.close = true; break;
+			case 'm': opt.method = optarg; break;
+			case 'b': opt.body = std::atol(optarg); break;
+			case 'k': opt.chunk = std::atol(optarg); break;
+			case 'H': opt.headers.push_back(optarg); break;
+			case 'i': opt.idle = std::atoi(optarg); break;
+			case 't': opt.timeout = std::atof(optarg); break;
+			case 'n': opt.name = optarg; break;
+			case 'o': opt.output = optarg; break;
+			case 'R': opt.trace = optarg; break;
+			case 's': opt.speed = std::atof(optarg); break;
+			default: usage();
+		}
+	}
+	if (argc - optind != (opt.trace.empty() ? 2 : 1))
+		usage();
+	std::string target = argv[optind];
+	size_t colon = target.rfind(':');
+	if (colon == std::string::npos)
+		usage();
+	opt.host = target.substr(0, colon);
+	opt.port = std::atoi(target.c_str() + colon + 1);
+	if (opt.trace.empty())
+		opt.path = argv[optind + 1];
+	if (opt.name.empty())
+		opt.name = opt.trace.empty() ? opt.path : opt.trace;
+	if (opt.connections < 1 || opt.depth < 1 || opt.duration <= 0 || opt.port <= 0 ||
+	    opt.speed <= 0)
+		usage();
+	if (opt.close)
+		opt.depth = 1;
+	if (opt.chunk > 0 && opt.body < 0)
+		opt.body = 0;
+	return (opt);
+}
+
+// The same bytes for every request
+static std::string buildRequest(const Options &opt) {
+	std::string req = opt.method + " " + opt.path + " HTTP/1.1\r\nHost: " + opt.host + "\r\n";
+	if (opt.close)
+		req += "Connection: close\r\n";
+	for (size_t i = 0; i < opt.headers.size(); ++i)
+		req += opt.headers[i] + "\r\n";
+	if (opt.body < 0)
+		return (req + "\r\n");
+	std::string body(opt.body, 'b');
+	if (opt.chunk <= 0) {
+		char len[32];
+		std::snprintf(len, sizeof(len), "%ld", opt.body);
+		return (req + "Content-Length: " + len + "\r\n\r\n" + body);
+	}
+	req += "Transfer-Encoding: chunked\r\n\r\n";
+	for (long off = 0; off < opt.body; off += opt.chunk) {
+		long size = std::min(opt.chunk, opt.body - off);
+		char line[32];
+		std::snprintf(line, sizeof(line), "%lx\r\n", size);
+		req += line + body.substr(off, size) + "\r\n";
+	}
+	return (req + "0\r\n\r\n");
+}
+
+static struct sockaddr_in address(const Options &opt) {
+	struct sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(opt.port);
+	if (inet_pton(AF_INET, opt.host == "localhost" ? "127.0.0.1" : opt.host.c_str(),
+	              &addr.sin_addr) != 1) {
+		std::fprintf(stderr, "loadgen: %s is not an IPv4 address\n", opt.host.c_str());
+		std::exit(2);
+	}
+	return (addr);
+}
+
+// Non-blocking, the connect under way; -1 if it failed at once
+static int openSocket(const struct sockaddr_in &addr) {
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if (fd == -1) {
+		std::perror("socket");
+		std::exit(1);
+	}
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if (connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == -1 &&
+	    errno != EINPROGRESS) {
+		close(fd);
+		return (-1);
+	}
+	return (fd);
+}
+
+/* ------------------------------------------------------------------- Client */
+
+struct Stats {
+	Stats() : sent(0), errors(0), timeouts(0), connects(0), bytes(0) {}
+	unsigned long sent;
+	unsigned long errors;
+	unsigned long timeouts;
+	unsigned long connects;
+	unsigned long bytes;
+	std::map<int, unsigned long> statuses;
+	Histogram latency;   // from the actual send
+	Histogram corrected; // from the due time (open loop)
+};
+
+// One connection, its requests in flight and the parser of their responses
+class Client {
+  public:
+	Client() : fd(-1), connected(false), offset(0), status(0) { resetParser(); }
+
+	int fd;
+	bool connected;
+	std::string out;           // requests not written yet
+	size_t offset;             // of out already written
+	std::deque<double> sent;   // send time of each request in flight
+	std::deque<double> due;    // and the time it was due (open loop)
+
+	// Parses what arrived; completed responses are appended to done
+	void feed(const char *p, size_t n, std::vector<int> &done, bool head_only) {
+		while (n > 0) {
+			if (state == BODY || state == CHUNK_DATA || state == CHUNK_END) {
+				size_t k = std::min(static_cast<unsigned long>(n), remaining);
+				p += k;
+				n -= k;
+				remaining -= k;
+				if (remaining)
+					continue;
+				if (state == BODY)
+					finish(done);
+				else if (state == CHUNK_DATA) {
+					state = CHUNK_END;
+					remaining = 2;
+				} else
+					state = CHUNK_SIZE;
+				continue;
+			}
+			if (state == UNTIL_CLOSE)
+				return;
+			const char *nl = static_cast<const char *>(std::memchr(p, '\n', n));
+			size_t k = nl ? nl - p + 1 : n;
+			line.append(p, k);
+			p += k;
+			n -= k;
+			if (nl)
+				parseLine(done, head_only);
+		}
+	}
+
+	// The server closed: a response delimited by the close is complete
+	bool closedComplete(std::vector<int> &done) {
+		if (state != UNTIL_CLOSE)
+			return (false);
+		finish(done);
+		return (true);
+	}
+
+	void resetParser() {
+		state = STATUS;
+		line.clear();
+		remaining = 0;
+		chunked = false;
+		length = -1;
+		closing = false;
+	}
+
+	bool closing; // the last response asked for Connection: close
+
+  private:
+	enum State { STATUS, HEADERS, BODY, CHUNK_SIZE, CHUNK_DATA, CHUNK_END, TRAILER, UNTIL_CLOSE };
+
+	void parseLine(std::vector<int> &done, bool head_only) {
+		if (state == STATUS) {
+			status = line.size() > 12 ? std::atoi(line.c_str() + 9) : 0;
+			chunked = false;
+			length = -1;
+			closing = false;
+			state = HEADERS;
+		} else if (state == HEADERS && (line == "\r\n" || line == "\n")) {
+			if (head_only || status / 100 == 1 || status == 204 || status == 304 || length == 0)
+				finish(done);
+			else if (chunked)
+				state = CHUNK_SIZE;
+			else if (length > 0) {
+				state = BODY;
+				remaining = length;
+			} else
+				state = UNTIL_CLOSE;
+		} else if (state == HEADERS) {
+			if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0)
+				length = std::atol(line.c_str() + 15);
+			else if (strncasecmp(line.c_str(), "Transfer-Encoding:", 18) == 0)
+				chunked = strstr(line.c_str(), "chunked") != NULL;
+			else if (strncasecmp(line.c_str(), "Connection:", 11) == 0)
+				closing = strcasestr(line.c_str(), "close") != NULL;
+		} else if (state == CHUNK_SIZE) {
+			remaining = std::strtoul(line.c_str(), NULL, 16);
+			state = remaining ? CHUNK_DATA : TRAILER;
+		} else if (state == TRAILER && (line == "\r\n" || line == "\n")) {
+			finish(done);
+		}
+		line.clear();
+	}
+
+	void finish(std::vector<int> &done) {
+		done.push_back(status);
+		bool keep = closing;
+		resetParser();
+		closing = keep;
+	}
+
+	State state;
+	std::string line;
+	unsigned long remaining;
+	int status;
+	bool chunked;
+	long length;
+};
+
+/* ------------------------------------------------------------------- Report */
+
+static void jsonLatency(std::string &out, const char *name, const Histogram &h) {
+	char buf[512];
+	std::snprintf(buf, sizeof(buf),
+	              ",\"%s\":{\"min\":%lu,\"mean\":%.1f,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,"
+	              "\"p99.9\":%lu,\"p99.99\":%lu,\"max\":%lu}",
+	              name, h.min(), h.mean(), h.percentile(50), h.percentile(90),
+	              h.percentile(99), h.percentile(99.9), h.percentile(99.99), h.max());
+	out += buf;
+}
+
+static void printLatency(const char *name, const Histogram &h) {
+	std::printf("  %-10s p50 %8lu  p90 %8lu  p99 %8lu  p99.9 %8lu  max %8lu us\n", name,
+	            h.percentile(50), h.percentile(90), h.percentile(99), h.percentile(99.9),
+	            h.max());
+}
+
+static void report(const Options &opt, const Stats &stats, double elapsed, int idle_open) {
+	Histogram corrected = opt.rate > 0 || !opt.trace.empty()
+	                          ? stats.corrected
+	                          : stats.latency.corrected(
+	                                static_cast<unsigned long>(stats.latency.mean()));
+	unsigned long done = stats.latency.count();
+	std::printf("%s: %lu requests in %.2fs, %.1f req/s, %.2f MB/s, %lu errors (%lu timeouts)"
+	            ", %lu connects\n",
+	            opt.name.c_str(), done, elapsed, done / elapsed,
+	            stats.bytes / elapsed / 1e6, stats.errors, stats.timeouts,
+	            stats.connects);
+	printLatency("latency", stats.latency);
+	printLatency("corrected", corrected);
+	std::string statuses;
+	for (std::map<int, unsigned long>::const_iterator it = stats.statuses.begin();
+	     it != stats.statuses.end(); ++it) {
+		char buf[64];
+		std::snprintf(buf, sizeof(buf), "%s\"%d\":%lu", statuses.empty() ? "" : ",",
+		              it->first, it->second);
+		statuses += buf;
+		std::printf("  status %d: %lu\n", it->first, it->second);
+	}
+	if (opt.idle)
+		std::printf("  idle connections still open: %d/%d\n", idle_open, opt.idle);
+	if (opt.output.empty())
+		return;
+
+	const char *mode = !opt.trace.empty() ? "replay" : opt.rate > 0 ? "open" : "closed";
+	char buf[1024];
+	std::snprintf(buf, sizeof(buf),
+	              "{\"name\":\"%s\",\"time\":%ld,\"mode\":\"%s\",\"connections\":%d,"
+	              "\"depth\":%d,\"keepalive\":%s,\"rate\":%.1f,\"body\":%ld,\"chunk\":%ld,"
+	              "\"idle\":%d,\"idle_open\":%d,\"duration\":%.3f,\"sent\":%lu,"
+	              "\"requests\":%lu,\"rps\":%.1f,\"bytes\":%lu,\"errors\":%lu,"
+	              "\"timeouts\":%lu,\"connects\":%lu,\"status\":{",
+	              opt.name.c_str(), static_cast<long>(time(NULL)),
+	              mode, opt.connections, opt.depth,
+	              opt.close ? "false" : "true", opt.rate, opt.body, opt.chunk, opt.idle,
+	              idle_open, elapsed, stats.sent, done, done / elapsed, stats.bytes,
+	              stats.errors, stats.timeouts, stats.connects);
+	std::string line = buf + statuses + "}";
+	jsonLatency(line, "latency_us", stats.latency);
+	jsonLatency(line, "corrected_us", corrected);
+	line += "}\n";
+	FILE *f = std::fopen(opt.output.c_str(), "a");
+	if (!f || std::fputs(line.c_str(), f) == EOF)
+		std::perror(opt.output.c_str());
+	if (f)
+		std::fclose(f);
+}
+
+/* ---------------------------------------------------------------- Generator */
+
+class Generator {
+  public:
+	Generator(const Options &opt)
+	    : opt_(opt), request_(buildRequest(opt)), clients_(opt.connections),
+	      addr_(address(opt)), epoll_(-1), next_(0), idle_open_(0) {}
+
+	int run() {
+		epoll_ = epoll_create1(0);
+		if (epoll_ == -1)
+			return (std::perror("epoll_create1"), 1);
+		openIdle();
+		for (size_t i = 0; i < clients_.size(); ++i)
+			connectClient(i);
+
+		start_ = now();
+		double end = start_ + opt_.duration;
+		double interval = opt_.rate > 0 ? 1 / opt_.rate : 0;
+		double next_due = start_;
+		double next_check = start_;
+		struct epoll_event events[512];
+		while (true) {
+			double t = now();
+			if (t >= end)
+				break;
+			if (interval) {
+				for (; next_due <= t; next_due += interval)
+					backlog_.push_back(next_due);
+				dispatchBacklog();
+			}
+			if (t >= next_check) {
+				checkTimeouts(t);
+				next_check = t + 0.1;
+			}
+			int wait_ms = interval ? static_cast<int>((next_due - t) * 1000) : 50;
+			int n = epoll_wait(epoll_, events, 512, std::max(0, std::min(wait_ms, 50)));
+			for (int i = 0; i < n; ++i)
+				handle(events[i].data.u32, events[i].events);
+		}
+		elapsed_ = now() - start_;
+		countIdle();
+		report(opt_, stats_, elapsed_, idle_open_);
+		return (0);
+	}
+
+  private:
+	// Clients are numbered from 0, idle connections after them
+	void openIdle() {
+		for (int i = 0; i < opt_.idle; ++i) {
+			int fd = socket(AF_INET, SOCK_STREAM, 0);
+			if (fd == -1 || connect(fd, reinterpret_cast<sockaddr *>(&addr_), sizeof(addr_))) {
+				if (fd != -1)
+					close(fd);
+				++stats_.errors;
+				continue;
+			}
+			fcntl(fd, F_SETFL, O_NONBLOCK);
+			idle_.push_back(fd);
+		}
+	}
+
+	// Still open if the server did not close them: a read would block
+	void countIdle() {
+		char byte;
+		for (size_t i = 0; i < idle_.size(); ++i) {
+			if (recv(idle_[i], &byte, 1, MSG_PEEK) == -1 && errno == EAGAIN)
+				++idle_open_;
+			close(idle_[i]);
+		}
+	}
+
+	void connectClient(size_t i) {
+		Client &c = clients_[i];
+		c.connected = false;
+		c.out.clear();
+		c.offset = 0;
+		c.sent.clear();
+		c.due.clear();
+		c.resetParser();
+		++stats_.connects;
+		c.fd = openSocket(addr_);
+		if (c.fd == -1) {
+			++stats_.errors;
+			return;
+		}
+		struct epoll_event ev;
+		ev.events = EPOLLIN | EPOLLOUT;
+		ev.data.u64 = 0;
+		ev.data.u32 = i;
+		epoll_ctl(epoll_, EPOLL_CTL_ADD, c.fd, &ev);
+	}
+
+	// The requests in flight are lost: errors, unless the run is over
+	void reconnect(size_t i, bool failed) {
+		Client &c = clients_[i];
+		if (failed) {
+			stats_.errors += std::max<size_t>(c.sent.size(), 1);
+			if (opt_.rate > 0)
+				backlog_.insert(backlog_.begin(), c.due.begin(), c.due.end());
+		}
+		if (c.fd != -1)
+			close(c.fd);
+		c.fd = -1;
+		connectClient(i);
+	}
+
+	void queue(Client &c, double due) {
+		c.out += request_;
+		c.sent.push_back(now());
+		c.due.push_back(due);
+		++stats_.sent;
+	}
+
+	void refill(size_t i) {
+		Client &c = clients_[i];
+		if (!c.connected)
+			return;
+		if (opt_.rate == 0)
+			while (static_cast<int>(c.sent.size()) < opt_.depth)
+				queue(c, now());
+		else
+			dispatchBacklog();
+		watch(i);
+	}
+
+	// Open loop: requests due are given to the connections with room for them
+	void dispatchBacklog() {
+		for (size_t tries = 0; !backlog_.empty() && tries < clients_.size(); ++tries) {
+			size_t i = next_++ % clients_.size();
+			Client &c = clients_[i];
+			if (!c.connected || static_cast<int>(c.sent.size()) >= opt_.depth)
+				continue;
+			queue(c, backlog_.front());
+			backlog_.pop_front();
+			watch(i);
+			tries = 0;
+		}
+	}
+
+	void watch(size_t i) {
+		Client &c = clients_[i];
+		struct epoll_event ev;
+		ev.events = EPOLLIN | (c.offset < c.out.size() ? EPOLLOUT : 0U);
+		ev.data.u64 = 0;
+		ev.data.u32 = i;
+		epoll_ctl(epoll_, EPOLL_CTL_MOD, c.fd, &ev);
+	}
+
+	void handle(size_t i, unsigned int events) {
+		Client &c = clients_[i];
+		if (!c.connected && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+			int err = 0;
+			socklen_t len = sizeof(err);
+			getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+			if (err)
+				return (reconnect(i, true));
+			c.connected = true;
+			refill(i);
+			return;
+		}
+		if (events & EPOLLOUT) {
+			ssize_t n = send(c.fd, c.out.data() + c.offset, c.out.size() - c.offset, MSG_NOSIGNAL);
+			if (n == -1 && errno != EAGAIN)
+				return (reconnect(i, true));
+			if (n > 0)
+				c.offset += n;
+			if (c.offset == c.out.size()) {
+				c.out.clear();
+				c.offset = 0;
+				watch(i);
+			}
+		}
+		if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			receive(i);
+	}
+
+	void receive(size_t i) {
+		Client &c = clients_[i];
+		static char buf[256 * 1024];
+		ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+		if (n == -1 && errno == EAGAIN)
+			return;
+		std::vector<int> done;
+		if (n > 0) {
+			stats_.bytes += n;
+			c.feed(buf, n, done, opt_.method == "HEAD");
+		} else if (!c.closedComplete(done)) {
+			return (reconnect(i, !c.sent.empty()));
+		}
+		double t = now();
+		for (size_t k = 0; k < done.size() && !c.sent.empty(); ++k) {
+			++stats_.statuses[done[k]];
+			stats_.latency.record(static_cast<unsigned long>((t - c.sent.front()) * 1e6));
+			stats_.corrected.record(static_cast<unsigned long>((t - c.due.front()) * 1e6));
+			c.sent.pop_front();
+			c.due.pop_front();
+		}
+		if (n <= 0 || (!done.empty() && (opt_.close || c.closing)))
+			return (reconnect(i, !c.sent.empty()));
+		if (!done.empty())
+			refill(i);
+	}
+
+	void checkTimeouts(double t) {
+		for (size_t i = 0; i < clients_.size(); ++i) {
+			Client &c = clients_[i];
+			if (!c.sent.empty() && t - c.sent.front() > opt_.timeout) {
+				++stats_.timeouts;
+				reconnect(i, true);
+			} else if (c.fd == -1) {
+				connectClient(i);
+			}
+		}
+	}
+
+	Options opt_;
+	std::string request_;
+	std::vector<Client> clients_;
+	std::vector<int> idle_;
+	std::deque<double> backlog_; // open loop: due times of requests not sent yet
+	struct sockaddr_in addr_;
+	int epoll_;
+	size_t next_;
+	int idle_open_;
+	double start_;
+	double elapsed_;
+	Stats stats_;
+};
+
+/* ------------------------------------------------------------------- Replay */
+
+struct TraceRequest {
+	TraceRequest() : time(0), size(0), complete(false) {}
+	double time;      // of the first byte, in seconds
+	std::string head;
+	std::string body; // captured, or empty
+	unsigned long size;
+	bool complete;
+};
+
+struct TraceConnection {
+	TraceConnection() : open(0), close(-1) {}
+	double open;
+	double close; // -1 if it outlived the capture
+	std::vector<TraceRequest> requests;
+};
+
+// Unsigned LEB128, as TraceCapture writes them
+static bool readNumber(const std::string &s, size_t &pos, unsigned long &value) {
+	value = 0;
+	for (int shift = 0; pos < s.size() && shift < 64; shift += 7) {
+		unsigned char byte = s[pos++];
+		value |= static_cast<unsigned long>(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return (true);
+	}
+	return (false);
+}
+
+static bool readBytes(const std::string &s, size_t &pos, std::string &out) {
+	unsigned long len;
+	if (!readNumber(s, pos, len) || len > s.size() - pos)
+		return (false);
+	out.assign(s, pos, len);
+	pos += len;
+	return (true);
+}
+
+// Connections whose 'C' is in an earlier file (the capture was reopened) are
+// left out, and so are requests without their 'E'
+static std::vector<TraceConnection> readTrace(const std::string &path) {
+	std::string s;
+	FILE *f = std::fopen(path.c_str(), "rb");
+	if (!f) {
+		std::perror(path.c_str());
+		std::exit(2);
+	}
+	char buf[65536];
+	for (size_t n; (n = std::fread(buf, 1, sizeof(buf), f)) > 0;)
+		s.append(buf, n);
+	std::fclose(f);
+
+	std::vector<TraceConnection> conns;
+	std::map<unsigned long, size_t> ids;
+	size_t pos = 8;
+	unsigned long started;
+	bool ok = s.compare(0, 8, "WSTRACE1") == 0 && readNumber(s, pos, started);
+	while (ok && pos < s.size()) {
+		char type = s[pos++];
+		unsigned long id, time, size;
+		std::string data;
+		ok = readNumber(s, pos, id);
+		std::map<unsigned long, size_t>::iterator it = ids.find(id);
+		TraceConnection *c = it == ids.end() ? NULL : &conns[it->second];
+		TraceRequest *r = c && !c->requests.empty() ? &c->requests.back() : NULL;
+		if (type == 'C' && ok && (ok = readNumber(s, pos, time))) {
+			ids[id] = conns.size();
+			conns.push_back(TraceConnection());
+			conns.back().open = time / 1e6;
+		} else if (type == 'R' && ok && (ok = readNumber(s, pos, time) && readBytes(s, pos, data))) {
+			if (c) {
+				c->requests.push_back(TraceRequest());
+				c->requests.back().time = time / 1e6;
+				c->requests.back().head = data;
+			}
+		} else if (type == 'B' && ok && (ok = readBytes(s, pos, data))) {
+			if (r && !r->complete)
+				r->body += data;
+		} else if (type == 'E' && ok && (ok = readNumber(s, pos, time) && readNumber(s, pos, size))) {
+			if (r && !r->complete) {
+				r->complete = true;
+				r->size = size;
+			}
+		} else if (type == 'X' && ok && (ok = readNumber(s, pos, time))) {
+			if (c)
+				c->close = time / 1e6;
+			ids.erase(id);
+		} else {
+			ok = false;
+		}
+	}
+	if (!ok) {
+		std::fprintf(stderr, "loadgen: %s: not a trace, or cut at byte %lu\n", path.c_str(),
+		             static_cast<unsigned long>(pos));
+		std::exit(2);
+	}
+	for (size_t i = 0; i < conns.size(); ++i) {
+		std::vector<TraceRequest> &reqs = conns[i].requests;
+		while (!reqs.empty() && !reqs.back().complete)
+			reqs.pop_back(); // only the last one can be cut short
+	}
+	return (conns);
+}
+
+// The request as the replay sends it: the captured body, or as many bytes of
+// filler, chunked again if the request was
+static std::string replayRequest(const TraceRequest &r) {
+	std::string body = r.body.size() == r.size ? r.body : std::string(r.size, 'b');
+	std::string lower = r.head;
+	for (size_t i = 0; i < lower.size(); ++i)
+		lower[i] = std::tolower(static_cast<unsigned char>(lower[i]));
+	size_t te = lower.find("\r\ntransfer-encoding:");
+	if (te == std::string::npos || lower.find("chunked", te) > lower.find("\r\n", te + 2))
+		return (r.head + body);
+	std::string req = r.head;
+	for (size_t off = 0; off < body.size(); off += 16384) {
+		size_t size = std::min<size_t>(16384, body.size() - off);
+		char line[32];
+		std::snprintf(line, sizeof(line), "%lx\r\n", static_cast<unsigned long>(size));
+		req += line + body.substr(off, size) + "\r\n";
+	}
+	return (req + "0\r\n\r\n");
+}
+
+class Replayer {
+  public:
+	Replayer(const Options &opt, const std::vector<TraceConnection> &trace)
+	    : opt_(opt), trace_(trace), conns_(trace.size()), addr_(address(opt)), epoll_(-1),
+	      first_(0), remaining_(trace.size()) {
+		for (size_t i = 0; i < trace_.size(); ++i)
+			if (i == 0 || trace_[i].open < first_)
+				first_ = trace_[i].open;
+		opt_.connections = trace_.size();
+	}
+
+	int run() {
+		epoll_ = epoll_create1(0);
+		if (epoll_ == -1)
+			return (std::perror("epoll_create1"), 1);
+		start_ = now();
+		for (size_t i = 0; i < trace_.size(); ++i)
+			schedule(i, at(trace_[i].open));
+
+		double end = start_ + opt_.duration;
+		double next_check = start_;
+		struct epoll_event events[512];
+		while (remaining_ > 0) {
+			double t = now();
+			if (opt_.capped && t >= end)
+				break;
+			while (!events_.empty() && events_.top().first <= t) {
+				size_t i = events_.top().second;
+				events_.pop();
+				step(i);
+			}
+			if (t >= next_check) {
+				checkTimeouts(t);
+				next_check = t + 0.1;
+			}
+			int wait_ms = 50;
+			if (!events_.empty())
+				wait_ms = static_cast<int>(std::ceil((events_.top().first - t) * 1000));
+			int n = epoll_wait(epoll_, events, 512, std::max(0, std::min(wait_ms, 50)));
+			for (int i = 0; i < n; ++i)
+				handle(events[i].data.u32, events[i].events);
+		}
+		report(opt_, stats_, now() - start_, 0);
+		return (0);
+	}
+
+  private:
+	struct Replay {
+		Replay() : next(0), started(false), done(false), head_only(false) {}
+		Client client;
+		size_t next; // first request not sent
+		bool started;
+		bool done;
+		bool head_only; // the request in flight is a HEAD
+	};
+
+	// Wall clock time of a trace time
+	double at(double time) const { return (start_ + (time - first_) / opt_.speed); }
+
+	void schedule(size_t i, double t) { events_.push(std::make_pair(t, i)); }
+
+	// Does what is next for connection i, or schedules it
+	void step(size_t i) {
+		Replay &r = conns_[i];
+		const TraceConnection &tc = trace_[i];
+		Client &c = r.client;
+		if (r.done || !c.sent.empty())
+			return; // waiting for a response
+		double t = now();
+		if (c.fd == -1) {
+			if (r.started && r.next == tc.requests.size())
+				return (finish(i)); // the server closed it
+			if (t < at(tc.open))
+				return (schedule(i, at(tc.open)));
+			return (connectClient(i));
+		}
+		if (!c.connected)
+			return;
+		if (r.next < tc.requests.size()) {
+			const TraceRequest &req = tc.requests[r.next];
+			double due = at(req.time);
+			if (t < due)
+				return (schedule(i, due));
+			c.out += replayRequest(req);
+			c.sent.push_back(t);
+			c.due.push_back(due);
+			r.head_only = req.head.compare(0, 5, "HEAD ") == 0;
+			++r.next;
+			++stats_.sent;
+			return (watch(i));
+		}
+		if (tc.close >= 0 && t < at(tc.close))
+			return (schedule(i, at(tc.close)));
+		finish(i);
+	}
+
+	void connectClient(size_t i) {
+		Replay &r = conns_[i];
+		Client &c = r.client;
+		c.connected = false;
+		c.out.clear();
+		c.offset = 0;
+		c.resetParser();
+		r.started = true;
+		++stats_.connects;
+		c.fd = openSocket(addr_);
+		if (c.fd == -1) {
+			++stats_.errors;
+			return (finish(i));
+		}
+		struct epoll_event ev;
+		ev.events = EPOLLIN | EPOLLOUT;
+		ev.data.u64 = 0;
+		ev.data.u32 = i;
+		epoll_ctl(epoll_, EPOLL_CTL_ADD, c.fd, &ev);
+	}
+
+	// The request in flight is lost, the next ones go on a new connection
+	void drop(size_t i) {
+		Client &c = conns_[i].client;
+		stats_.errors += c.sent.size();
+		c.sent.clear();
+		c.due.clear();
+		if (c.fd != -1)
+			close(c.fd);
+		c.fd = -1;
+		c.connected = false;
+	}
+
+	void finish(size_t i) {
+		drop(i);
+		conns_[i].done = true;
+		--remaining_;
+	}
+
+	void watch(size_t i) {
+		Client &c = conns_[i].client;
+		struct epoll_event ev;
+		ev.events = EPOLLIN | (c.offset < c.out.size() ? EPOLLOUT : 0U);
+		ev.data.u64 = 0;
+		ev.data.u32 = i;
+		epoll_ctl(epoll_, EPOLL_CTL_MOD, c.fd, &ev);
+	}
+
+	void handle(size_t i, unsigned int events) {
+		Client &c = conns_[i].client;
+		if (c.fd == -1)
+			return;
+		if (!c.connected && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+			int err = 0;
+			socklen_t len = sizeof(err);
+			getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+			if (err) {
+				++stats_.errors;
+				return (finish(i));
+			}
+			c.connected = true;
+			watch(i);
+			return (step(i));
+		}
+		if (events & EPOLLOUT) {
+			ssize_t n = send(c.fd, c.out.data() + c.offset, c.out.size() - c.offset, MSG_NOSIGNAL);
+			if (n == -1 && errno != EAGAIN)
+				return (drop(i), step(i));
+			if (n > 0)
+				c.offset += n;
+			if (c.offset == c.out.size()) {
+				c.out.clear();
+				c.offset = 0;
+				watch(i);
+			}
+		}
+		if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+			receive(i);
+	}
+
+	void receive(size_t i) {
+		Replay &r = conns_[i];
+		Client &c = r.client;
+		static char buf[256 * 1024];
+		ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+		if (n == -1 && errno == EAGAIN)
+			return;
+		std::vector<int> done;
+		if (n > 0) {
+			stats_.bytes += n;
+			c.feed(buf, n, done, r.head_only);
+		} else if (!c.closedComplete(done)) {
+			return (drop(i), step(i));
+		}
+		double t = now();
+		for (size_t k = 0; k < done.size() && !c.sent.empty(); ++k) {
+			++stats_.statuses[done[k]];
+			stats_.latency.record(static_cast<unsigned long>((t - c.sent.front()) * 1e6));
+			stats_.corrected.record(static_cast<unsigned long>((t - c.due.front()) * 1e6));
+			c.sent.pop_front();
+			c.due.pop_front();
+		}
+		if (n <= 0 || (!done.empty() && c.closing))
+			drop(i);
+		if (!done.empty() || n <= 0)
+			step(i);
+	}
+
+	void checkTimeouts(double t) {
+		for (size_t i = 0; i < conns_.size(); ++i) {
+			Client &c = conns_[i].client;
+			if (!c.sent.empty() && t - c.sent.front() > opt_.timeout) {
+				++stats_.timeouts;
+				drop(i);
+				step(i);
+			}
+		}
+	}
+
+	typedef std::pair<double, size_t> Event;
+
+	Options opt_;
+	const std::vector<TraceConnection> &trace_;
+	std::vector<Replay> conns_;
+	std::priority_queue<Event, std::vector<Event>, std::greater<Event> > events_;
+	struct sockaddr_in addr_;
+	int epoll_;
+	double first_; // trace time of the first connection
+	double start_;
+	size_t remaining_; // connections not done
+	Stats stats_;
+};
+
+int main(int argc, char **argv) {
+	Options opt = parseOptions(argc, argv);
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	if (!opt.trace.empty()) {
+		std::vector<TraceConnection> trace = readTrace(opt.trace);
+		Replayer replayer(opt, trace);
+		return (replayer.run());
+	}
+	Generator gen(opt);
+	return (gen.run());
+}
@@ -0,0 +1,425 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   microbench.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/22 10:04:18 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/22 10:04:18 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+// Microbenchmarks of the request path, one function at a time, on the request
+// captures of tests/bench/corpus/ (raw bytes as received, CRLF included).
+//
+//   make RELEASE=1 microbench        (after make fclean if built otherwise)
+//   ./microbench [options] [filter...]
+//
+//   -s N      samples per benchmark (default 15)
+//   -t MS     milliseconds per sample (default 20)
+//   -c dir    corpus directory (default tests/bench/corpus)
+//   -o file   appends one JSON line per benchmark to file
+//   filter    runs only the benchmarks whose name contains one of them
+//
+// Each benchmark is warmed up for one sample, then the iteration count is
+// doubled until a sample lasts -t milliseconds, and -s samples are timed.
+// ns/op is given as median, mean, min and standard deviation of the samples.
+// allocs/op counts the calls to operator new (std::string and containers
+// included) through the replacements below. The server's objects are the
+// ones of the last build: a debug build measures its LOG_DEBUG calls too.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "src/CGI/CGI.hpp"
+#include "src/ConfigParser/ConfigParser.hpp"
+#include "src/HttpServer/Structs/Connection.hpp"
+#include "src/HttpServer/Structs/Response.hpp"
+#include "src/HttpServer/Structs/WebServer.hpp"
+#include "src/RequestParser/RequestParser.hpp"
+#include "src/Utils/ServerUtils.hpp"
+
+static unsigned long g_allocs = 0;
+static volatile size_t g_sink = 0; // results go there so the work is not optimized out
+
+void *operator new(size_t size) throw(std::bad_alloc) {
+	++g_allocs;
+	void *p = std::malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return (p);
+}
+
+void *operator new[](size_t size) throw(std::bad_alloc) { return (operator new(size)); }
+
+// Out of line, or GCC pairs the inlined free() with operator new and warns
+__attribute__((noinline)) void operator delete(void *p) throw() { std::free(p); }
+
+__attribute__((noinline)) void operator delete[](void *p) throw() { std::free(p); }
+
+static double now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+/* BENCHMARKS */
+
+class Bench {
+  public:
+	explicit Bench(const std::string &name) : name(name) {}
+	virtual ~Bench() {}
+	virtual void run(size_t iterations) = 0;
+
+	std::string name;
+};
+
+// One operation is one call of the functor, inlined in the loop
+template <class Op> class Loop : public Bench {
+	Op op_;
+
+  public:
+	Loop(const std::string &name, const Op &op) : Bench(name), op_(op) {}
+	void run(size_t iterations) {
+		for (size_t i = 0; i < iterations; ++i)
+			g_sink += op_();
+	}
+};
+
+template <class Op> static Bench *loop(const std::string &name, const Op &op) {
+	return (new Loop<Op>(name, op));
+}
+
+struct ParseHeaders {
+	std::string head;
+	Logger *log;
+	size_t operator()() {
+		ClientRequest req;
+		return (RequestParsingUtils::parseRequestHeaders(head, req, *log) + req.headers.size());
+	}
+};
+
+struct DecodeUri {
+	std::string uri;
+	size_t operator()() {
+		std::string decoded;
+		return (decodeNValidateUri(uri, decoded) + decoded.size());
+	}
+};
+
+struct FindBestMatch {
+	std::string path;
+	std::vector<LocConfig> *locations;
+	Logger *log;
+	size_t operator()() { return (findBestMatch(path, *locations, *log) != NULL); }
+};
+
+struct ContentType {
+	std::vector<std::string> paths;
+	size_t operator()() {
+		size_t n = 0;
+		for (size_t i = 0; i < paths.size(); ++i)
+			n += detectContentType(paths[i]).size();
+		return (n);
+	}
+};
+
+struct Serialize {
+	Response resp;
+	size_t operator()() { return (resp.toString().size()); }
+};
+
+struct CGIEnv {
+	ClientRequest req;
+	LocConfig *loc;
+	size_t operator()() {
+		CGI cgi(req, loc);
+		char **envp = cgi.toEnvp();
+		size_t n = 0;
+		while (envp[n])
+			++n;
+		return (n);
+	}
+};
+
+struct ProcessChunks {
+	WebServer *ws;
+	Connection *conn;
+	std::string body;
+	size_t operator()() { return (chunked::reassemble(*ws, conn, body)); }
+};
+
+struct DecodeChunks {
+	WebServer *ws;
+	Connection *conn;
+	std::string body;
+	std::string out;
+	size_t operator()() { return (chunked::decode(*ws, conn, body, out)); }
+};
+
+/* MEASUREMENT */
+
+struct Result {
+	std::string name;
+	size_t iterations; // per sample
+	double median, mean, min, stddev;
+	double allocs;
+};
+
+static Result measure(Bench &bench, int samples, double sample_ns) {
+	Result r;
+	r.name = bench.name;
+
+	// Warm-up and calibration: caches, branch predictors, allocator pools
+	size_t n = 1;
+	for (;;) {
+		double start = now_ns();
+		bench.run(n);
+		if (now_ns() - start >= sample_ns || n >= (static_cast<size_t>(1) << 40))
+			break;
+		n *= 2;
+	}
+	r.iterations = n;
+
+	std::vector<double> ns;
+	ns.reserve(samples);
+	unsigned long allocs = g_allocs;
+	for (int i = 0; i < samples; ++i) {
+		double start = now_ns();
+		bench.run(n);
+		ns.push_back((now_ns() - start) / n);
+	}
+	r.allocs = static_cast<double>(g_allocs - allocs) / (static_cast<double>(n) * samples);
+
+	std::sort(ns.begin(), ns.end());
+	r.min = ns[0];
+	r.median = ns.size() % 2 ? ns[ns.size() / 2]
+	                         : (ns[ns.size() / 2 - 1] + ns[ns.size() / 2]) / 2;
+	double sum = 0;
+	for (size_t i = 0; i < ns.size(); ++i)
+		sum += ns[i];
+	r.mean = sum / ns.size();
+	double var = 0;
+	for (size_t i = 0; i < ns.size(); ++i)
+		var += (ns[i] - r.mean) * (ns[i] - r.mean);
+	r.stddev = ns.size() > 1 ? std::sqrt(var / (ns.size() - 1)) : 0;
+	return (r);
+}
+
+/* CORPUS */
+
+struct Capture {
+	std::string name; // file name without .http
+	std::string head; // request line and headers, up to the blank line
+	std::string body;
+	ClientRequest req;
+	uint16_t status;  // of parseRequestHeaders
+};
+
+static std::string readFile(const std::string &path) {
+	std::ifstream in(path.c_str(), std::ios::binary);
+	std::ostringstream data;
+	data << in.rdbuf();
+	return (data.str());
+}
+
+static std::vector<Capture> loadCorpus(const std::string &dir, Logger &log) {
+	std::vector<std::string> files;
+	DIR *d = opendir(dir.c_str());
+	if (!d)
+		return (std::vector<Capture>());
+	for (struct dirent *e = readdir(d); e; e = readdir(d)) {
+		std::string file(e->d_name);
+		if (file.size() > 5 && file.compare(file.size() - 5, 5, ".http") == 0)
+			files.push_back(file);
+	}
+	closedir(d);
+	std::sort(files.begin(), files.end());
+
+	std::vector<Capture> corpus;
+	for (size_t i = 0; i < files.size(); ++i) {
+		std::string raw = readFile(dir + "/" + files[i]);
+		size_t end = raw.find("\r\n\r\n");
+		if (end == std::string::npos) {
+			std::fprintf(stderr, "%s: no end of headers, skipped\n", files[i].c_str());
+			continue;
+		}
+		Capture c;
+		c.name = files[i].substr(0, files[i].size() - 5);
+		c.head = raw.substr(0, end + 4);
+		c.body = raw.substr(end + 4);
+		c.status = RequestParsingUtils::parseRequestHeaders(c.head, c.req, log);
+		corpus.push_back(c);
+	}
+	return (corpus);
+}
+
+// The raw request target, before any decoding
+static std::string requestTarget(const std::string &head) {
+	size_t start = head.find(' ') + 1;
+	return (head.substr(start, head.find(' ', start) - start));
+}
+
+static std::string oneByteChunks(size_t count) {
+	std::string body;
+	for (size_t i = 0; i < count; ++i)
+		body += "1\r\nx\r\n";
+	return (body + "0\r\n\r\n");
+}
+
+/* MAIN */
+
+static void usage(const char *prog) {
+	std::fprintf(stderr, "usage: %s [-s samples] [-t ms] [-c corpus] [-o file] [filter...]\n",
+	             prog);
+	std::exit(2);
+}
+
+static bool wanted(const std::string &name, const std::vector<std::string> &filters) {
+	for (size_t i = 0; i < filters.size(); ++i)
+		if (name.find(filters[i]) != std::string::npos)
+			return (true);
+	return (filters.empty());
+}
+
+int main(int argc, char **argv) {
+	int samples = 15;
+	double sample_ms = 20;
+	std::string corpus_dir = "tests/bench/corpus";
+	const char *output = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "s:t:c:o:")) != -1) {
+		if (opt == 's')
+			samples = std::atoi(optarg);
+		else if (opt == 't')
+			sample_ms = std::atof(optarg);
+		else if (opt == 'c')
+			corpus_dir = optarg;
+		else if (opt == 'o')
+			output = optarg;
+		else
+			usage(argv[0]);
+	}
+	if (samples < 1 || sample_ms <= 0)
+		usage(argv[0]);
+	std::vector<std::string> filters(argv + optind, argv + argc);
+
+	Logger log("", Logger::ERROR, false);
+	std::vector<Capture> corpus = loadCorpus(corpus_dir, log);
+	if (corpus.empty()) {
+		std::fprintf(stderr, "no captures (*.http) in %s\n", corpus_dir.c_str());
+		return (1);
+	}
+
+	char cwd[PATH_MAX];
+	std::string prefix(getcwd(cwd, sizeof(cwd)) ? cwd : ".");
+	std::vector<ServerConfig> servers;
+	ConfigParser parser(0);
+	if (!parser.loadConfig(corpus_dir + "/routes.conf", servers, prefix, 0) || servers.empty()) {
+		std::fprintf(stderr, "cannot load %s/routes.conf\n", corpus_dir.c_str());
+		return (1);
+	}
+	std::vector<LocConfig> &locations = servers[0].getLocations();
+	WebServer ws(servers, prefix, 0);
+
+	std::vector<Bench *> benches;
+	ContentType ctype;
+	for (size_t i = 0; i < corpus.size(); ++i) {
+		Capture &c = corpus[i];
+		if (c.status != 0)
+			std::fprintf(stderr, "%s: parsed as %u\n", c.name.c_str(), c.status);
+
+		ParseHeaders parse = {c.head, &log};
+		benches.push_back(loop("parseRequestHeaders/" + c.name, parse));
+		DecodeUri uri = {requestTarget(c.head)};
+		benches.push_back(loop("decodeNValidateUri/" + c.name, uri));
+		if (c.status == 0) {
+			FindBestMatch match = {c.req.path, &locations, &log};
+			benches.push_back(loop("findBestMatch/" + c.name, match));
+			ctype.paths.push_back(c.req.path);
+		}
+	}
+	benches.push_back(loop("detectContentType/corpus paths", ctype));
+
+	Serialize ok = {Response(200, std::string(4096, 'x'))};
+	ok.resp.setContentType("text/html");
+	ok.resp.setContentLength(ok.resp.body.size());
+	ok.resp.setHeader("Connection", "keep-alive");
+	ok.resp.setHeader("Last-Modified", "Tue, 16 Apr 2024 09:12:44 GMT");
+	ok.resp.setHeader("ETag", "\"662e3f1c-1000\"");
+	benches.push_back(loop("Response::toString/200 4KiB", ok));
+	Serialize missing = {Response(404, std::string("<html><body><h1>404 Not Found</h1></body></html>"))};
+	missing.resp.setContentType("text/html");
+	missing.resp.setContentLength(missing.resp.body.size());
+	benches.push_back(loop("Response::toString/404", missing));
+
+	std::vector<Connection *> connections;
+	for (size_t i = 0; i < corpus.size(); ++i) {
+		Capture &c = corpus[i];
+		if (c.status != 0)
+			continue;
+		LocConfig *loc = findBestMatch(c.req.path, locations, log);
+		if (c.req.chunked_encoding) {
+			connections.push_back(chunked::newConnection(servers[0], loc, c.head));
+			ProcessChunks chunks = {&ws, connections.back(), c.body};
+			benches.push_back(loop("processChunkSize/" + c.name, chunks));
+			DecodeChunks decode = {&ws, connections.back(), c.body, std::string()};
+			benches.push_back(loop("decodeChunkedBody/" + c.name, decode));
+
+			// Adversarial: as many chunk size lines as body bytes
+			chunks.body = decode.body = oneByteChunks(1024);
+			benches.push_back(loop("processChunkSize/1-byte chunks x1024", chunks));
+			benches.push_back(loop("decodeChunkedBody/1-byte chunks x1024", decode));
+		}
+		if (loc && loc->acceptExtension(getExtension(c.req.path))) {
+			CGIEnv env = {c.req, loc};
+			env.req.body = c.body;
+			env.req.extension = getExtension(c.req.path);
+			loc->setFullPath(prefix + "/cgi-bin" + c.req.path.substr(loc->getPath().size() - 1));
+			benches.push_back(loop("CGI::toEnvp/" + c.name, env));
+		}
+	}
+
+	FILE *out = output ? std::fopen(output, "a") : NULL;
+	if (output && !out) {
+		std::perror(output);
+		return (1);
+	}
+	std::printf("%-46s %10s %10s %10s %8s %10s\n", "benchmark", "median", "mean", "min", "stddev",
+	            "allocs/op");
+	for (size_t i = 0; i < benches.size(); ++i) {
+		if (!wanted(benches[i]->name, filters))
+			continue;
+		Result r = measure(*benches[i], samples, sample_ms * 1e6);
+		std::printf("%-46s %8.1fns %8.1fns %8.1fns %7.1f%% %10.1f\n", r.name.c_str(), r.median,
+		            r.mean, r.min, r.mean ? r.stddev / r.mean * 100 : 0, r.allocs);
+		std::fflush(stdout);
+		if (out)
+			std::fprintf(out,
+			             "{\"name\":\"%s\",\"iterations\":%lu,\"samples\":%d,\"ns_per_op\":"
+			             "{\"median\":%.1f,\"mean\":%.1f,\"min\":%.1f,\"stddev\":%.1f},"
+			             "\"allocs_per_op\":%.2f}\n",
+			             r.name.c_str(), static_cast<unsigned long>(r.iterations), samples,
+			             r.median, r.mean, r.min, r.stddev, r.allocs);
+	}
+	if (out)
+		std::fclose(out);
+
+	for (size_t i = 0; i < benches.size(); ++i)
+		delete benches[i];
+	for (size_t i = 0; i < connections.size(); ++i)
+		chunked::deleteConnection(connections[i]);
+	return (0);
+}
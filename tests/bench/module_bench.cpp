@@ -0,0 +1,115 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   module_bench.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/09 09:41:17 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/09 09:41:17 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+// Compares the latency of the sample handler module with its CGI twin, one
+// request at a time over a kept-alive connection, against a running server.
+//
+//   make webserv modules module_bench
+//   ./webserv tests/modules/module.conf &
+//   ./module_bench [requests] [port]
+//
+// The module answers from the event loop, the script costs a spawn and an
+// interpreter start per request.
+
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static double now_us() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1e6 + tv.tv_usec);
+}
+
+static int connectTo(int port) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1)
+		return (-1);
+	struct sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == -1) {
+		close(fd);
+		return (-1);
+	}
+	return (fd);
+}
+
+// One GET on a kept-alive connection, read up to the end of the body
+// (Content-Length, or the last chunk of a chunked one)
+static bool fetch(int fd, const char *path) {
+	std::string request = std::string("GET ") + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	if (write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size()))
+		return (false);
+	std::string response;
+	char buffer[4096];
+	ssize_t n;
+	size_t header_end = std::string::npos;
+	size_t length = 0;
+	bool chunked = false;
+	while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+		response.append(buffer, n);
+		if (header_end == std::string::npos) {
+			header_end = response.find("\r\n\r\n");
+			if (header_end == std::string::npos)
+				continue;
+			header_end += 4;
+			size_t cl = response.find("Content-Length: ");
+			if (cl != std::string::npos && cl < header_end)
+				length = std::strtoul(response.c_str() + cl + 16, NULL, 10);
+			else
+				chunked = true;
+		}
+		if (chunked ? response.compare(response.size() - 5, 5, "0\r\n\r\n") == 0
+		            : response.size() >= header_end + length)
+			break;
+	}
+	return (n > 0 && response.compare(0, 12, "HTTP/1.1 200") == 0);
+}
+
+static double bench(int port, const char *path, int requests) {
+	int fd = connectTo(port);
+	double start = now_us();
+	for (int i = 0; i < requests; ++i) {
+		if (fd == -1 || !fetch(fd, path)) {
+			std::fprintf(stderr, "GET %s failed, is the server running?\n", path);
+			if (fd != -1)
+				close(fd);
+			return (-1);
+		}
+	}
+	double elapsed = now_us() - start;
+	close(fd);
+	return (elapsed / requests);
+}
+
+int main(int argc, char **argv) {
+	int requests = argc > 1 ? std::atoi(argv[1]) : 500;
+	int port = argc > 2 ? std::atoi(argv[2]) : 8090;
+
+	double module = bench(port, "/status/", requests);
+	double cgi = bench(port, "/cgi/status.py", requests);
+	if (module < 0 || cgi < 0)
+		return (1);
+	std::printf("%-12s %12s %12s\n", "handler", "latency (us)", "req/s");
+	std::printf("%-12s %12.1f %12.0f\n", "module", module, 1e6 / module);
+	std::printf("%-12s %12.1f %12.0f\n", "cgi", cgi, 1e6 / cgi);
+	return (0);
+}
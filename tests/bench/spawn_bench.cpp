@@ -0,0 +1,100 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   spawn_bench.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/04 11:20:05 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/04 11:20:05 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+// Compares the latency of fork()+execve() and posix_spawn() while the calling
+// process holds a growing amount of touched memory, like a busy server does.
+//
+//   make spawn_bench && ./spawn_bench [iterations] [MB ...]
+//
+// fork() has to copy the page tables of the whole footprint, posix_spawn()
+// (clone with CLONE_VM|CLONE_VFORK in glibc) does not.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <spawn.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+extern char **environ;
+
+static const char *CHILD = "/bin/true";
+
+static double now_us() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1e6 + tv.tv_usec);
+}
+
+static double bench_fork(int iterations) {
+	char *argv[] = {(char *)CHILD, NULL};
+	double start = now_us();
+	for (int i = 0; i < iterations; ++i) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			execve(CHILD, argv, environ);
+			_exit(127);
+		}
+		waitpid(pid, NULL, 0);
+	}
+	return ((now_us() - start) / iterations);
+}
+
+static double bench_spawn(int iterations) {
+	char *argv[] = {(char *)CHILD, NULL};
+	double start = now_us();
+	for (int i = 0; i < iterations; ++i) {
+		pid_t pid;
+		if (posix_spawn(&pid, CHILD, NULL, NULL, argv, environ) != 0)
+			return (-1);
+		waitpid(pid, NULL, 0);
+	}
+	return ((now_us() - start) / iterations);
+}
+
+int main(int argc, char **argv) {
+	int iterations = argc > 1 ? std::atoi(argv[1]) : 200;
+	std::vector<size_t> sizes;
+	for (int i = 2; i < argc; ++i)
+		sizes.push_back(std::strtoul(argv[i], NULL, 10));
+	if (sizes.empty()) {
+		sizes.push_back(0);
+		sizes.push_back(64);
+		sizes.push_back(256);
+		sizes.push_back(1024);
+	}
+
+	std::printf("%10s %16s %16s\n", "footprint", "fork+exec (us)", "posix_spawn (us)");
+	std::vector<char *> blocks;
+	size_t held = 0;
+	for (size_t i = 0; i < sizes.size(); ++i) {
+		// Grow the footprint and touch every page so it is really mapped
+		while (held < sizes[i]) {
+			char *block = static_cast<char *>(std::malloc(1024 * 1024));
+			if (!block) {
+				std::fprintf(stderr, "allocation failed at %lu MB\n", (unsigned long)held);
+				return (1);
+			}
+			std::memset(block, 1, 1024 * 1024);
+			blocks.push_back(block);
+			++held;
+		}
+		double f = bench_fork(iterations);
+		double s = bench_spawn(iterations);
+		std::printf("%7lu MB %16.1f %16.1f\n", (unsigned long)held, f, s);
+	}
+	for (size_t i = 0; i < blocks.size(); ++i)
+		std::free(blocks[i]);
+	return (0);
+}
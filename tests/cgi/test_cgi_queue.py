@@ -0,0 +1,242 @@
+#!/usr/bin/env python3
+"""CGI requests started after their validation, end-to-end test.
+
+Usage: tests/cgi/test_cgi_queue.py      (from the repository root, after make)
+
+Starts webserv on a generated configuration listening on 8097 whose locations
+hold requests back: a cgi_max_concurrency queue, also for POST bodies streamed
+to the script, a POST routed once its body arrived, cgi_coalesce waiters run
+again when their leader cannot answer them, and cgi_cache entries stored when
+a queued script is done. Requests for different scripts of one location wait
+there together, and each client must get the output of the script it asked
+for, not of the last one validated. The server's output goes to
+webserv_cgi_queue.log in the temporary directory.
+"""
+import http.client
+import os
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+PORT = 8097
+failures = 0
+
+CONFIG = """http {
+    server {
+        listen 127.0.0.1:%(port)d;
+        root %(dir)s/www;
+
+        location /queue/ {
+            root %(dir)s/cgi;
+            allowed_methods GET;
+            cgi_ext .py %(python)s;
+            cgi_max_concurrency 1;
+        }
+
+        location /stream/ {
+            root %(dir)s/cgi;
+            allowed_methods GET POST;
+            cgi_ext .py %(python)s .php /bin/sh;
+            cgi_max_concurrency 1;
+            cgi_request_buffering off;
+        }
+
+        location /buffered/ {
+            root %(dir)s/cgi;
+            allowed_methods GET POST;
+            cgi_ext .py %(python)s .php /bin/sh;
+        }
+
+        location /coalesce/ {
+            root %(dir)s/cgi;
+            allowed_methods GET;
+            cgi_ext .py %(python)s;
+            cgi_max_concurrency 1;
+            cgi_coalesce on;
+            cgi_coalesce_key method;
+        }
+
+        location /cache/ {
+            root %(dir)s/cgi;
+            allowed_methods GET;
+            cgi_ext .py %(python)s;
+            cgi_max_concurrency 1;
+            cgi_cache 1M;
+            cgi_cache_valid 60;
+            cgi_cache_key method;
+        }
+    }
+}
+"""
+
+SCRIPT = """import os, sys, time
+time.sleep(float(os.environ.get("QUERY_STRING") or 0))
+body = sys.stdin.read() if os.environ["REQUEST_METHOD"] == "POST" else ""
+print("Content-Type: text/plain\\r\\n\\r\\nI am %s" + (", got " + body if body else ""))
+"""
+
+# Past what coalesced waiters are held for
+BIG = """import time
+time.sleep(1)
+print("Content-Type: text/plain\\r\\n\\r\\n" + "A" * 1500000)
+"""
+
+# Run by /bin/sh as the .php interpreter, so that the location has two
+SHELL = """printf 'Content-Type: text/plain\\r\\n\\r\\nI am C\\n'
+"""
+
+
+def check(name, condition, detail=""):
+    global failures
+    print("%s %s%s" % ("PASS" if condition else "FAIL", name, "" if condition else ": " + detail))
+    if not condition:
+        failures += 1
+
+
+def request(path, body=None, headers=None):
+    conn = http.client.HTTPConnection("127.0.0.1", PORT, timeout=10)
+    conn.request("GET" if body is None else "POST", path, body)
+    resp = conn.getresponse()
+    if headers is not None:
+        headers.update(resp.getheaders())
+    return resp.status, resp.read().decode()
+
+
+def wait_port():
+    for _ in range(50):
+        try:
+            socket.create_connection(("127.0.0.1", PORT), timeout=1).close()
+            return
+        except OSError:
+            time.sleep(0.1)
+    sys.exit("nothing listens on %d" % PORT)
+
+
+def in_order(paths, delay=0.3):
+    """Sends the requests delay apart, each on its own connection, and returns the
+    answers. A path is a GET, a (path, body) pair a POST"""
+    results = [None] * len(paths)
+
+    def run(i):
+        try:
+            results[i] = request(*paths[i]) if isinstance(paths[i], tuple) else request(paths[i])
+        except OSError as e:
+            results[i] = repr(e)
+
+    threads = []
+    for i in range(len(paths)):
+        threads.append(threading.Thread(target=run, args=(i,)))
+        threads[-1].start()
+        time.sleep(delay)
+    for thread in threads:
+        thread.join()
+    return results
+
+
+def queued():
+    a1, a2, b = in_order(["/queue/a.py?1", "/queue/a.py", "/queue/b.py"])
+    check("running script answered", a1 == (200, "I am A\n"), repr(a1))
+    check("queued script runs its own file", a2 == (200, "I am A\n"), repr(a2))
+    check("script validated last runs its own file", b == (200, "I am B\n"), repr(b))
+
+
+def streamed():
+    a1, a2, c = in_order(["/stream/a.py?1", ("/stream/a.py", "hello"), "/stream/c.php"])
+    check("running script answered", a1 == (200, "I am A\n"), repr(a1))
+    check("queued streamed body goes to its own script", a2 == (200, "I am A, got hello\n"),
+          repr(a2))
+    check("other interpreter runs its own file", c == (200, "I am C\n"), repr(c))
+
+
+def buffered():
+    post = socket.create_connection(("127.0.0.1", PORT), timeout=10)
+    post.sendall(b"POST /buffered/a.py HTTP/1.1\r\nHost: localhost\r\nContent-Length: 5\r\n\r\n")
+    time.sleep(0.3)
+    c = request("/buffered/c.php")
+    post.sendall(b"hello")
+    resp = http.client.HTTPResponse(post)
+    resp.begin()
+    a = resp.status, resp.read().decode()
+    post.close()
+    check("request validated meanwhile answered", c == (200, "I am C\n"), repr(c))
+    check("buffered body routed to its own script", a == (200, "I am A, got hello\n"), repr(a))
+
+
+def redispatched():
+    # cgi_coalesce_key method: the script is what tells requests apart
+    big, waiter, b = in_order(["/coalesce/big.py", "/coalesce/big.py", "/coalesce/b.py?2"])
+    check("leader streams its large output", big == (200, "A" * 1500000 + "\n"), repr(big)[:80])
+    check("waiter of a large output runs its own script", waiter == big, repr(waiter)[:80])
+    check("request in flight meanwhile answered", b == (200, "I am B\n"), repr(b))
+
+    # The client of a queued leader hangs up, its waiter takes the lead
+    results = {}
+    thread = threading.Thread(target=lambda: results.update(b=request("/coalesce/b.py?2")))
+    thread.start()
+    time.sleep(0.3)
+    leader = socket.create_connection(("127.0.0.1", PORT), timeout=10)
+    leader.sendall(b"GET /coalesce/a.py?1 HTTP/1.1\r\nHost: localhost\r\n\r\n")
+    threading.Timer(0.9, leader.close).start()
+    waiter, b = in_order(["/coalesce/a.py?1", "/coalesce/b.py?2"])
+    thread.join()
+    check("waiter of a gone leader runs its own script", waiter == (200, "I am A\n"),
+          repr(waiter))
+    check("requests in flight meanwhile answered",
+          b == results["b"] == (200, "I am B\n"), repr((b, results["b"])))
+
+
+def cached():
+    # cgi_cache_key method: the script is what tells responses apart
+    check("script cached", request("/cache/b.py") == (200, "I am B\n"))
+    d, a, b = in_order(["/cache/d.py?1", "/cache/a.py", "/cache/b.py"])
+    check("running script answered", d == (200, "I am D\n"), repr(d))
+    check("queued script answered", a == (200, "I am A\n"), repr(a))
+    check("cached script answered meanwhile", b == (200, "I am B\n"), repr(b))
+    for name in ("a", "b"):
+        headers = {}
+        answer = request("/cache/%s.py" % name, headers=headers)
+        check("%s.py served its own cached output" % name,
+              answer == (200, "I am %s\n" % name.upper()) and headers.get("X-Cache") == "HIT",
+              repr((answer, headers.get("X-Cache"))))
+
+
+def main():
+    directory = tempfile.mkdtemp(prefix="webserv_cgi_queue_")
+    for name in ("www", "cgi"):
+        os.mkdir(os.path.join(directory, name))
+    for name in ("a", "b", "d"):
+        with open(os.path.join(directory, "cgi", name + ".py"), "w") as f:
+            f.write(SCRIPT % name.upper())
+    with open(os.path.join(directory, "cgi", "c.php"), "w") as f:
+        f.write(SHELL)
+    with open(os.path.join(directory, "cgi", "big.py"), "w") as f:
+        f.write(BIG)
+    conf = os.path.join(directory, "cgi_queue.conf")
+    with open(conf, "w") as f:
+        f.write(CONFIG % {"dir": directory, "port": PORT, "python": sys.executable})
+
+    log = open(os.path.join(tempfile.gettempdir(), "webserv_cgi_queue.log"), "w")
+    server = subprocess.Popen([os.path.join(ROOT, "webserv"), conf], cwd=ROOT, stdout=log,
+                              stderr=log)
+    try:
+        wait_port()
+        queued()
+        streamed()
+        buffered()
+        redispatched()
+        cached()
+    finally:
+        server.terminate()
+        server.wait()
+        shutil.rmtree(directory)
+    print("%d failure(s)" % failures)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
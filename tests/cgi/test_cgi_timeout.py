@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""CGI scripts running past the idle connection timeout, end-to-end test.
+
+Usage: tests/cgi/test_cgi_timeout.py    (from the repository root, after make)
+
+Starts webserv on a generated configuration listening on 8098 and runs, side
+by side, scripts that take longer than the 30 seconds a connection may stay
+idle: one streaming its output all along, and silent ones finishing within
+their cgi_timeout of 40 seconds or past it. Each must be governed by its
+location's cgi_timeout, not by the idle sweep. Takes about 45 seconds. The
+server's output goes to webserv_cgi_timeout.log in the temporary directory.
+"""
+import http.client
+import os
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+PORT = 8098
+failures = 0
+
+CONFIG = """http {
+    server {
+        listen 127.0.0.1:%(port)d;
+        root %(dir)s/www;
+
+        location /long/ {
+            root %(dir)s/cgi;
+            allowed_methods GET;
+            cgi_ext .py %(python)s;
+            cgi_timeout 120;
+        }
+
+        location /bounded/ {
+            root %(dir)s/cgi;
+            allowed_methods GET;
+            cgi_ext .py %(python)s;
+            cgi_timeout 40;
+        }
+    }
+}
+"""
+
+# Writes a line every 5 seconds for 40 seconds
+STREAM = """import sys, time
+sys.stdout.write("Content-Type: text/plain\\r\\n\\r\\n")
+for i in range(8):
+    sys.stdout.write("line %d\\n" % i)
+    sys.stdout.flush()
+    time.sleep(5)
+"""
+
+# Silent for as many seconds as its query string says, then answers
+SLEEP = """import os, time
+time.sleep(int(os.environ["QUERY_STRING"]))
+print("Content-Type: text/plain\\r\\n\\r\\nslept " + os.environ["QUERY_STRING"])
+"""
+
+
+def check(name, condition, detail=""):
+    global failures
+    print("%s %s%s" % ("PASS" if condition else "FAIL", name, "" if condition else ": " + detail))
+    if not condition:
+        failures += 1
+
+
+def request(path):
+    conn = http.client.HTTPConnection("127.0.0.1", PORT, timeout=90)
+    conn.request("GET", path)
+    resp = conn.getresponse()
+    return resp.status, resp.read().decode()
+
+
+def wait_port():
+    for _ in range(50):
+        try:
+            socket.create_connection(("127.0.0.1", PORT), timeout=1).close()
+            return
+        except OSError:
+            time.sleep(0.1)
+    sys.exit("nothing listens on %d" % PORT)
+
+
+def side_by_side(paths):
+    """Sends the GETs at once, each on its own connection, and returns the answers"""
+    results = {}
+
+    def run(path):
+        try:
+            results[path] = request(path)
+        except (OSError, http.client.HTTPException) as e:
+            results[path] = repr(e)
+
+    threads = [threading.Thread(target=run, args=(path,)) for path in paths]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    return results
+
+
+def main():
+    directory = tempfile.mkdtemp(prefix="webserv_cgi_timeout_")
+    for name in ("www", "cgi"):
+        os.mkdir(os.path.join(directory, name))
+    with open(os.path.join(directory, "cgi", "stream.py"), "w") as f:
+        f.write(STREAM)
+    with open(os.path.join(directory, "cgi", "sleep.py"), "w") as f:
+        f.write(SLEEP)
+    conf = os.path.join(directory, "cgi_timeout.conf")
+    with open(conf, "w") as f:
+        f.write(CONFIG % {"dir": directory, "port": PORT, "python": sys.executable})
+
+    log = open(os.path.join(tempfile.gettempdir(), "webserv_cgi_timeout.log"), "w")
+    server = subprocess.Popen([os.path.join(ROOT, "webserv"), conf], cwd=ROOT, stdout=log,
+                              stderr=log)
+    try:
+        wait_port()
+        results = side_by_side(["/long/stream.py", "/bounded/sleep.py?35",
+                                "/bounded/sleep.py?50"])
+        expected = "".join("line %d\n" % i for i in range(8))
+        check("output streamed for 40s delivered whole",
+              results["/long/stream.py"] == (200, expected), repr(results["/long/stream.py"]))
+        check("script silent for 35s answered within cgi_timeout",
+              results["/bounded/sleep.py?35"] == (200, "slept 35\n"),
+              repr(results["/bounded/sleep.py?35"]))
+        late = results["/bounded/sleep.py?50"]
+        check("script past cgi_timeout answered 504", late[0] == 504, repr(late)[:80])
+    finally:
+        server.terminate()
+        server.wait()
+        shutil.rmtree(directory)
+    print("%d failure(s)" % failures)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Minimal FastCGI responder used as a stand-in for php-fpm.
+
+Usage: fcgi_app.py [host:port | unix:/path]   (default 127.0.0.1:9000)
+
+Answers every request with a small text page listing the received params and
+the request body size. Connections opened with FCGI_KEEP_CONN stay open, so
+the server's connection pool can be observed through the "conn" counter.
+"""
+import os
+import socket
+import struct
+import sys
+import threading
+
+BEGIN_REQUEST, END_REQUEST, PARAMS, STDIN, STDOUT = 1, 3, 4, 5, 6
+HEADER = struct.Struct("!BBHHBx")
+connections = 0
+
+
+def read_exact(sock, n):
+    data = b""
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            raise EOFError
+        data += chunk
+    return data
+
+
+def read_record(sock):
+    version, rtype, req_id, length, padding = HEADER.unpack(read_exact(sock, 8))
+    content = read_exact(sock, length) if length else b""
+    if padding:
+        read_exact(sock, padding)
+    return rtype, req_id, content
+
+
+def write_record(sock, rtype, req_id, content):
+    for i in range(0, max(len(content), 1), 65535):
+        part = content[i:i + 65535]
+        sock.sendall(HEADER.pack(1, rtype, req_id, len(part), 0) + part)
+
+
+def decode_length(data, pos):
+    if data[pos] < 128:
+        return data[pos], pos + 1
+    return struct.unpack("!I", data[pos:pos + 4])[0] & 0x7fffffff, pos + 4
+
+
+def decode_params(data):
+    params, pos = {}, 0
+    while pos < len(data):
+        nlen, pos = decode_length(data, pos)
+        vlen, pos = decode_length(data, pos)
+        params[data[pos:pos + nlen].decode()] = data[pos + nlen:pos + nlen + vlen].decode()
+        pos += nlen + vlen
+    return params
+
+
+def serve(sock, conn_id):
+    served = 0
+    try:
+        while True:
+            rtype, req_id, content = read_record(sock)
+            if rtype != BEGIN_REQUEST:
+                continue
+            keep_conn = content[2] & 1
+            params_raw, body = b"", b""
+            while True:
+                rtype, _, content = read_record(sock)
+                if rtype == PARAMS:
+                    params_raw += content
+                elif rtype == STDIN:
+                    if not content:
+                        break
+                    body += content
+            params = decode_params(params_raw)
+            served += 1
+            page = "conn=%d request=%d pid=%d\n" % (conn_id, served, os.getpid())
+            page += "".join("%s=%s\n" % kv for kv in sorted(params.items()))
+            page += "body_length=%d\n" % len(body)
+            out = ("Status: 200 OK\r\nContent-Type: text/plain\r\n"
+                   "X-FastCGI-Conn: %d\r\n\r\n" % conn_id + page).encode()
+            write_record(sock, STDOUT, req_id, out)
+            write_record(sock, STDOUT, req_id, b"")
+            write_record(sock, END_REQUEST, req_id, struct.pack("!IB3x", 0, 0))
+            if not keep_conn:
+                break
+    except EOFError:
+        pass
+    finally:
+        sock.close()
+
+
+def main():
+    global connections
+    address = sys.argv[1] if len(sys.argv) > 1 else "127.0.0.1:9000"
+    if address.startswith("unix:"):
+        path = address[5:]
+        if os.path.exists(path):
+            os.unlink(path)
+        server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        server.bind(path)
+    else:
+        host, port = address.rsplit(":", 1)
+        server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        server.bind((host, int(port)))
+    server.listen(64)
+    print("FastCGI stand-in listening on", address, flush=True)
+    while True:
+        sock, _ = server.accept()
+        connections += 1
+        threading.Thread(target=serve, args=(sock, connections), daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()
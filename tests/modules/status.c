@@ -0,0 +1,100 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   status.c                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: jalombar <jalombar@student.42.fr>          +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/09/09 09:41:17 by jalombar          #+#    #+#             */
+/*   Updated: 2025/09/09 09:41:17 by jalombar         ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+ * Sample handler module: a JSON status endpoint, the same as status.py.
+ *
+ *   make modules    ->  tests/modules/status.so
+ *   location /status/ { handler tests/modules/status.so; }
+ *
+ * GET /status/           {"status":"ok","uptime":12,"requests":3}
+ * GET /status/?delay=N   the same, answered asynchronously after N ms
+ *                        from a helper thread
+ * A request with an X-Token header other than "secret" gets 401.
+ */
+
+#include "webserv_module.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const ws_server_api *api;
+static time_t started;
+static unsigned long requests;
+
+struct delayed {
+	ws_response *resp;
+	unsigned int delay_ms;
+	char body[128];
+};
+
+static int status_init(const ws_server_api *server) {
+	api = server;
+	started = time(NULL);
+	return (0);
+}
+
+static void *answer_later(void *arg) {
+	struct delayed *job = arg;
+	usleep(job->delay_ms * 1000);
+	api->write(job->resp, job->body, strlen(job->body));
+	api->complete(job->resp);
+	free(job);
+	return (NULL);
+}
+
+static int status_handle(const ws_request *req, ws_response *resp) {
+	const char *token = api->header(req, "X-Token");
+	char body[128];
+	const char *delay;
+	struct delayed *job;
+	pthread_t thread;
+
+	if (token && strcmp(token, "secret") != 0)
+		return (401);
+
+	++requests;
+	snprintf(body, sizeof(body), "{\"status\":\"ok\",\"uptime\":%ld,\"requests\":%lu}\n",
+	         (long)(time(NULL) - started), requests);
+	api->set_header(resp, "Content-Type", "application/json");
+	api->set_header(resp, "Cache-Control", "no-store");
+
+	delay = strstr(req->query, "delay=");
+	if (!delay) {
+		api->write(resp, body, strlen(body));
+		return (WS_DONE);
+	}
+	job = malloc(sizeof(*job));
+	if (!job)
+		return (500);
+	job->resp = resp;
+	job->delay_ms = (unsigned int)atoi(delay + 6);
+	memcpy(job->body, body, sizeof(body));
+	if (pthread_create(&thread, NULL, answer_later, job) != 0) {
+		free(job);
+		return (503);
+	}
+	pthread_detach(thread);
+	return (WS_ASYNC);
+}
+
+/* The helper thread completes the response anyway, nothing to stop */
+static void status_cancel(ws_response *resp) { (void)resp; }
+
+static const ws_module module = {WS_MODULE_ABI, "status", status_init, status_handle,
+                                 status_cancel, NULL};
+
+const ws_module *webserv_module(void) { return (&module); }
@@ -0,0 +1,5 @@
+#!/usr/bin/python3
+# CGI twin of status.c, the baseline of module_bench. A script has no uptime
+# nor request count of its own, it answers the same shape of document.
+body = '{"status":"ok","uptime":0,"requests":1}\n'
+print("Content-Type: application/json\r\nCache-Control: no-store\r\n\r\n" + body, end="")
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""Small keep-alive HTTP/1.1 backend for the proxy_pass tests.
+
+Usage: backend.py port [name]
+
+GET  /whoami        "<name> conn=<C> req=<R>": C counts the connections
+                    accepted so far, R the requests on this connection, so
+                    balancing and upstream keep-alive can be observed
+POST /echo          the request body back (Content-Length or chunked)
+GET  /big?n=N       N bytes with a Content-Length
+GET  /chunked?n=N   N bytes in 1000-byte chunks
+GET  /slow?s=S      answers after S seconds
+GET  /close         answers with Connection: close
+Other paths answer the request line and the received headers.
+"""
+import socket
+import sys
+import threading
+import time
+
+connections = 0
+lock = threading.Lock()
+
+
+def read_request(conn, buf):
+    while b"\r\n\r\n" not in buf:
+        data = conn.recv(65536)
+        if not data:
+            return None, buf
+        buf += data
+    head, buf = buf.split(b"\r\n\r\n", 1)
+    lines = head.decode("latin-1").split("\r\n")
+    method, target, _ = lines[0].split(" ", 2)
+    headers = {}
+    for line in lines[1:]:
+        name, value = line.split(":", 1)
+        headers[name.strip().lower()] = value.strip()
+
+    body = b""
+    if headers.get("transfer-encoding", "").lower() == "chunked":
+        while True:
+            while b"\r\n" not in buf:
+                buf += conn.recv(65536)
+            size, buf = buf.split(b"\r\n", 1)
+            size = int(size.split(b";")[0], 16)
+            while len(buf) < size + 2:
+                buf += conn.recv(65536)
+            body += buf[:size]
+            buf = buf[size + 2:]
+            if size == 0:
+                break
+    else:
+        length = int(headers.get("content-length", "0"))
+        while len(buf) < length:
+            data = conn.recv(65536)
+            if not data:
+                return None, buf
+            buf += data
+        body, buf = buf[:length], buf[length:]
+    return (method, target, headers, body), buf
+
+
+def respond(conn, status, body, extra=None):
+    head = "HTTP/1.1 %s\r\nContent-Length: %d\r\n" % (status, len(body))
+    for name, value in (extra or []):
+        head += "%s: %s\r\n" % (name, value)
+    conn.sendall(head.encode() + b"\r\n" + body)
+
+
+def serve(conn, name, conn_id):
+    buf = b""
+    served = 0
+    while True:
+        request, buf = read_request(conn, buf)
+        if request is None:
+            return
+        method, target, headers, body = request
+        served += 1
+        path, _, query = target.partition("?")
+        args = dict(p.split("=", 1) for p in query.split("&") if "=" in p)
+
+        if path.endswith("/whoami"):
+            respond(conn, "200 OK", ("%s conn=%d req=%d" % (name, conn_id, served)).encode(),
+                    [("X-Backend", name)])
+        elif path.endswith("/echo"):
+            respond(conn, "200 OK", body, [("Content-Type", "application/octet-stream")])
+        elif path.endswith("/big"):
+            respond(conn, "200 OK", b"x" * int(args.get("n", "1000000")))
+        elif path.endswith("/chunked"):
+            n = int(args.get("n", "100000"))
+            out = b"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+            while n > 0:
+                size = min(n, 1000)
+                out += b"%x\r\n" % size + b"y" * size + b"\r\n"
+                n -= size
+            conn.sendall(out + b"0\r\n\r\n")
+        elif path.endswith("/slow"):
+            time.sleep(float(args.get("s", "1")))
+            respond(conn, "200 OK", b"slow")
+        elif path.endswith("/close"):
+            respond(conn, "200 OK", b"bye", [("Connection", "close")])
+            return
+        else:
+            lines = ["%s %s" % (method, target)]
+            lines += ["%s: %s" % item for item in sorted(headers.items())]
+            respond(conn, "200 OK", ("\n".join(lines) + "\n").encode())
+
+
+def handle(conn, name):
+    global connections
+    with lock:
+        connections += 1
+        conn_id = connections
+    try:
+        serve(conn, name, conn_id)
+    except (OSError, ValueError):
+        pass
+    finally:
+        conn.close()
+
+
+def main():
+    port = int(sys.argv[1])
+    name = sys.argv[2] if len(sys.argv) > 2 else str(port)
+    listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind(("127.0.0.1", port))
+    listener.listen(64)
+    while True:
+        conn, _ = listener.accept()
+        threading.Thread(target=handle, args=(conn, name), daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+"""proxy_pass end-to-end test.
+
+Usage: tests/proxy/test_proxy.py        (from the repository root, after make)
+
+Starts three backend.py servers (a on 9101, b on 9102, c on 9103) and webserv
+with tests/proxy/proxy.conf, then checks balancing, upstream keep-alive,
+bodies streamed both ways, retries and failure answers, Server-Timing, then the
+metrics, the connection table, the slow_log, the access_log lines and their reopening on SIGUSR1. The server's output goes to
+webserv_proxy.log in the temporary directory.
+"""
+import http.client
+import json
+import os
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+HERE = os.path.join(ROOT, "tests", "proxy")
+ACCESS_LOG = "/tmp/webserv_proxy_access.log"
+SLOW_LOG = "/tmp/webserv_proxy_slow.log"
+failures = 0
+
+
+def check(name, condition, detail=""):
+    global failures
+    print("%s %s%s" % ("PASS" if condition else "FAIL", name, "" if condition else ": " + detail))
+    if not condition:
+        failures += 1
+
+
+def client():
+    return http.client.HTTPConnection("127.0.0.1", 8091, timeout=10)
+
+
+def get(path, conn=None):
+    conn = conn or client()
+    conn.request("GET", path)
+    resp = conn.getresponse()
+    return resp.status, resp.read(), resp
+
+
+def whoami(path):
+    status, body, _ = get(path)
+    return body.decode().split()[0] if status == 200 else status
+
+
+def wait_port(port):
+    for _ in range(50):
+        try:
+            http.client.HTTPConnection("127.0.0.1", port, timeout=1).connect()
+            return
+        except OSError:
+            time.sleep(0.1)
+    sys.exit("nothing listens on %d" % port)
+
+
+def main():
+    procs = [subprocess.Popen([sys.executable, os.path.join(HERE, "backend.py"), str(port), name])
+             for port, name in ((9101, "a"), (9102, "b"), (9103, "c"))]
+    for path in (ACCESS_LOG, ACCESS_LOG + ".1", SLOW_LOG):
+        if os.path.exists(path):
+            os.remove(path)
+    log = open(os.path.join(tempfile.gettempdir(), "webserv_proxy.log"), "w")
+    procs.append(subprocess.Popen([os.path.join(ROOT, "webserv"), "tests/proxy/proxy.conf"],
+                                  cwd=ROOT, stdout=log, stderr=log))
+    try:
+        for port in (9101, 9102, 9103, 8091):
+            wait_port(port)
+        run()
+        metrics()
+        connections()
+        slow_log()
+        access_log(procs[-1])
+    finally:
+        for proc in procs:
+            proc.terminate()
+    print("%d failure(s)" % failures)
+    sys.exit(1 if failures else 0)
+
+
+def run():
+    # Smooth weighted round-robin, weight 1 against 2
+    names = [whoami("/rr/whoami") for _ in range(6)]
+    check("round-robin", sorted(names) == list("aabbbb"), str(names))
+
+    # The upstream connections are reused: few of them for many requests
+    bodies = [get("/rr/whoami")[1].decode() for _ in range(12)]
+    check("upstream keep-alive", any(not b.endswith(" req=1") for b in bodies), str(bodies[-3:]))
+
+    status, body, _ = get("/rr/headers?x=%2F1")
+    lines = body.decode().splitlines()
+    check("uri replaced", status == 200 and lines[0] == "GET /headers?x=/1", lines[0])
+    check("forwarded headers", "x-forwarded-for: 127.0.0.1" in lines and
+          "x-real-ip: 127.0.0.1" in lines and "host: 127.0.0.1:8091" in lines, str(lines))
+    check("hop-by-hop dropped", not any(l.startswith("connection:") for l in lines), str(lines))
+
+    names = set(whoami("/sticky/whoami") for _ in range(5))
+    check("ip_hash", len(names) == 1, str(names))
+
+    # A slow request keeps one server busy, least_conn sends the others elsewhere
+    slow = {}
+    busy = threading.Thread(target=lambda: slow.update(r=get("/least/slow?s=2")))
+    busy.start()
+    time.sleep(0.5)
+    first = whoami("/least/whoami")
+    second = whoami("/least/whoami")
+    busy.join()
+    check("least_conn", first == second and slow["r"][0] == 200, "%s %s" % (first, second))
+
+    # Bodies both ways, larger than every buffer on the path
+    payload = os.urandom(3 * 1024 * 1024)
+    conn = client()
+    conn.request("POST", "/direct/echo", body=payload)
+    resp = conn.getresponse()
+    check("content-length upload", resp.status == 200 and resp.read() == payload)
+
+    chunks = (payload[i:i + 70000] for i in range(0, len(payload), 70000))
+    conn.request("POST", "/direct/echo", body=chunks, encode_chunked=True)
+    resp = conn.getresponse()
+    check("chunked upload", resp.status == 200 and resp.read() == payload)
+
+    status, body, resp = get("/direct/big?n=20000000", conn)
+    check("content-length download", status == 200 and len(body) == 20000000 and
+          resp.getheader("Content-Length") == "20000000")
+    status, body, resp = get("/direct/chunked?n=300000", conn)
+    check("chunked download", status == 200 and body == b"y" * 300000 and
+          resp.getheader("Transfer-Encoding") == "chunked")
+
+    # A response closing the upstream connection does not close the client's
+    status, body, _ = get("/direct/close", conn)
+    status2, _, _ = get("/direct/whoami", conn)
+    check("upstream close", status == 200 and body == b"bye" and status2 == 200)
+
+    # Connect failures are retried on the next server, the dead one is marked down
+    names = [whoami("/flaky/whoami") for _ in range(4)]
+    check("retry on connect failure", names == ["c"] * 4, str(names))
+
+    status, _, _ = get("/dead/whoami")
+    check("unreachable upstream", status == 502, str(status))
+
+    _, _, resp = get("/rr/whoami")
+    timing = dict(t.split(";dur=") for t in (resp.getheader("Server-Timing") or "").split(", "))
+    check("server timing", set(["read", "handler", "upstream", "total"]) <= set(timing) and
+          float(timing["total"]) >= float(timing["upstream"]), str(timing))
+
+
+
+def metrics():
+    status, body, resp = get("/metrics")
+    lines = body.decode().splitlines()
+    rr = 'webserv_requests_total{server="127.0.0.1:8091",location="/rr/",status="200"} 20'
+    check("metrics requests", status == 200 and rr in lines, str(lines[-3:]))
+    check("metrics upstream timeout", 'webserv_timeouts_total{kind="proxy"} 0' in lines)
+    check("metrics histogram", any(l.startswith('webserv_request_duration_seconds_count{'
+                                                'server="127.0.0.1:8091",location="/direct/"}')
+                                   for l in lines))
+
+
+def connections():
+    # A client stuck in its header block, seen by the filters
+    stuck = socket.create_connection(("127.0.0.1", 8091))
+    stuck.sendall(b"GET /rr/whoami HTTP/1.1\r\nHost: x\r\n")
+    time.sleep(1.2)
+    status, body, resp = get("/connections?state=READING_HEADERS&idle=1")
+    table = json.loads(body)
+    check("connection table", status == 200 and table["shown"] == 1 and
+          table["total"] >= 2 and table["connections"][0]["buffered_in"] > 0 and
+          resp.getheader("Content-Type") == "application/json", str(table))
+    _, body, _ = get("/connections?state=REQUEST_COMPLETE")
+    rows = json.loads(body)["connections"]
+    check("connection table request", [r["location"] for r in rows] == ["/connections"], str(rows))
+    stuck.close()
+
+
+def access_lines(path):
+    time.sleep(1.5)  # flushed once a second
+    with open(path) as f:
+        return [json.loads(line) for line in f]
+
+
+def slow_log():
+    time.sleep(1.5)
+    with open(SLOW_LOG) as f:
+        lines = f.read().splitlines()
+    check("slow log", len(lines) == 1 and '"GET /least/slow?s=2 HTTP/1.1" 200 ' in lines[0] and
+          " upstream=" in lines[0], str(lines))
+
+
+def access_log(server):
+    lines = access_lines(ACCESS_LOG)
+    check("one line per request", len(lines) >= 30, str(len(lines)))
+    rr = [l for l in lines if l["uri"] == "/rr/whoami"]
+    check("upstream time", rr and all(l["status"] == 200 and l["upstream_time"] is not None and
+                                      l["request_time"] >= l["upstream_time"] for l in rr),
+          str(rr[:1]))
+    big = [l for l in lines if l["uri"] == "/direct/big?n=20000000"]
+    check("bytes sent", big and big[0]["bytes"] > 20000000, str(big))
+    check("connection requests", any(l["requests"] > 1 for l in lines))
+    dead = [l for l in lines if l["uri"] == "/dead/whoami"]
+    check("error logged", dead and dead[0]["status"] == 502, str(dead))
+
+    # Rotation: the file is moved away, SIGUSR1 opens a new one
+    os.rename(ACCESS_LOG, ACCESS_LOG + ".1")
+    server.send_signal(signal.SIGUSR1)
+    time.sleep(0.2)
+    get("/rr/whoami?rotated")
+    lines = access_lines(ACCESS_LOG) if os.path.exists(ACCESS_LOG) else []
+    check("reopened on SIGUSR1", [l["uri"] for l in lines] == ["/rr/whoami?rotated"], str(lines))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""Configuration reload (SIGHUP) end-to-end test.
+
+Usage: tests/reload/test_reload.py      (from the repository root, after make)
+
+Starts webserv on a generated configuration listening on 8093 and 8094, keeps
+a connection alive and a slow CGI request running, then reloads a configuration
+serving another root on 8093 and 8095 instead of 8094. Checks the request in
+flight finishes on the old configuration, the kept-alive connection moves to the
+new one, the listeners follow, and an invalid file leaves the server as it was.
+The server's output goes to webserv_reload.log in the temporary directory.
+"""
+import http.client
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+failures = 0
+
+CONFIG = """http {
+    server {
+        listen 127.0.0.1:8093;
+        root %(dir)s/%(root)s;
+
+        location / {
+            allowed_methods GET;
+        }
+
+        location /cgi/ {
+            root %(dir)s/cgi;
+            allowed_methods GET;
+            cgi_ext .py %(python)s;
+        }
+    }
+
+    server {
+        listen 127.0.0.1:%(port)d;
+        root %(dir)s/%(root)s;
+
+        location / {
+            allowed_methods GET;
+        }
+    }
+}
+"""
+
+SLOW = """import time
+time.sleep(1.5)
+print("Content-Type: text/plain\\r\\n\\r\\nslow done")
+"""
+
+
+def check(name, condition, detail=""):
+    global failures
+    print("%s %s%s" % ("PASS" if condition else "FAIL", name, "" if condition else ": " + detail))
+    if not condition:
+        failures += 1
+
+
+def get(port, path, conn=None):
+    conn = conn or http.client.HTTPConnection("127.0.0.1", port, timeout=10)
+    conn.request("GET", path)
+    resp = conn.getresponse()
+    return resp.status, resp.read().decode()
+
+
+def refused(port):
+    try:
+        socket.create_connection(("127.0.0.1", port), timeout=1).close()
+        return False
+    except OSError:
+        return True
+
+
+def wait_port(port):
+    for _ in range(50):
+        if not refused(port):
+            return
+        time.sleep(0.1)
+    sys.exit("nothing listens on %d" % port)
+
+
+def write_config(path, directory, root, port):
+    with open(path, "w") as f:
+        f.write(CONFIG % {"dir": directory, "root": root, "port": port,
+                          "python": sys.executable})
+
+
+def run(server, directory, conf):
+    kept = http.client.HTTPConnection("127.0.0.1", 8093, timeout=10)
+    check("old root served", get(8093, "/index.html", kept) == (200, "old\n"))
+    check("second listener", get(8094, "/index.html")[0] == 200)
+
+    slow = {}
+    thread = threading.Thread(target=lambda: slow.update(r=get(8093, "/cgi/slow.py")))
+    thread.start()
+    time.sleep(0.5)  # the script runs
+
+    write_config(conf, directory, "new", 8095)
+    server.send_signal(signal.SIGHUP)
+    time.sleep(0.5)
+    check("new root on a new connection", get(8093, "/index.html") == (200, "new\n"))
+    check("kept-alive connection moved to the new configuration",
+          get(8093, "/index.html", kept) == (200, "new\n"))
+    check("dropped listener closed", refused(8094))
+    check("added listener", get(8095, "/index.html") == (200, "new\n"))
+    thread.join()
+    check("request in flight finished", slow.get("r") == (200, "slow done\n"), repr(slow))
+
+    with open(conf, "w") as f:
+        f.write("http {\n    server {\n        listen 127.0.0.1:8093\n")
+    server.send_signal(signal.SIGHUP)
+    time.sleep(0.5)
+    check("invalid file ignored", server.poll() is None and
+          get(8093, "/index.html", kept) == (200, "new\n"))
+    check("listeners kept", get(8095, "/index.html")[0] == 200 and refused(8094))
+
+
+def main():
+    directory = tempfile.mkdtemp(prefix="webserv_reload_")
+    for name in ("old", "new", "cgi"):
+        os.mkdir(os.path.join(directory, name))
+    for name in ("old", "new"):
+        with open(os.path.join(directory, name, "index.html"), "w") as f:
+            f.write(name + "\n")
+    with open(os.path.join(directory, "cgi", "slow.py"), "w") as f:
+        f.write(SLOW)
+    conf = os.path.join(directory, "reload.conf")
+    write_config(conf, directory, "old", 8094)
+
+    log = open(os.path.join(tempfile.gettempdir(), "webserv_reload.log"), "w")
+    server = subprocess.Popen([os.path.join(ROOT, "webserv"), conf], cwd=ROOT, stdout=log,
+                              stderr=log)
+    try:
+        wait_port(8093)
+        run(server, directory, conf)
+    finally:
+        server.terminate()
+        server.wait()
+        shutil.rmtree(directory)
+    print("%d failure(s)" % failures)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()
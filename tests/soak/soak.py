@@ -0,0 +1,332 @@
+#!/usr/bin/env python3
+"""Soak test: hours of mixed load, failing when the server's footprint drifts.
+
+Usage: make soak [SOAK_ARGS="..."]               (from the repository root)
+       tests/soak/soak.py [-D 4h] [-i 60] [--max-rss-slope KiB] [...]
+
+Starts ./webserv on a generated configuration and, for each interval, runs
+loadgen workloads side by side (static files with and without keep-alive, 404s,
+CGI GETs and chunked POSTs) while a thread abandons requests halfway: clients
+that close during a CGI script, in the middle of their headers or of their
+body. Once the load stops and idle keep-alive connections have timed out, it
+samples from /proc the server's RSS (VmRSS), open fds and child processes, and
+takes the p99 latency (corrected for coordinated omission) of each workload.
+
+The slope of each series is fitted by least squares after the warm-up samples
+and compared with its limit per hour. The samples are appended to
+soak_samples.jsonl as they are taken and soak_report.md gets the verdict and
+the time series, to attach to release notes. The exit status is 1 when a
+slope passes its limit or the server exits. Slopes are extrapolated to an hour,
+so a run of minutes only catches gross leaks: soak for hours before a release.
+"""
+import argparse
+import json
+import os
+import resource
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import http.client
+
+ROOT = os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+PORT = 8097
+ADDR = "127.0.0.1:%d" % PORT
+
+CONFIG = """http {
+    server {
+        listen %(addr)s;
+        root %(dir)s/www;
+        client_max_body_size 10m;
+
+        location / {
+            allowed_methods GET;
+        }
+
+        location /cgi/ {
+            root %(dir)s/www/cgi;
+            allowed_methods GET POST;
+            cgi_ext .py %(python)s;
+        }
+    }
+}
+"""
+
+HELLO = """import sys
+sys.stdout.write("Content-Type: text/plain\\r\\n\\r\\nhello\\n")
+"""
+SINK = """import sys
+while sys.stdin.buffer.read(65536):
+    pass
+sys.stdout.write("Content-Type: text/plain\\r\\n\\r\\nstored\\n")
+"""
+SLOW = """import sys, time
+time.sleep(2)
+sys.stdout.write("Content-Type: text/plain\\r\\n\\r\\nlate\\n")
+"""
+
+# name: loadgen options, then the path; the first one is the latency reference
+WORKLOAD = [
+    ("static", ["-c", "16"], "/small.html"),
+    ("static-close", ["-c", "4", "-x"], "/small.html"),
+    ("not-found", ["-c", "4"], "/missing.html"),
+    ("cgi-get", ["-c", "2"], "/cgi/hello.py"),
+    ("cgi-post-chunked", ["-c", "2", "-m", "POST", "-b", "65536", "-k", "8192"], "/cgi/sink.py"),
+]
+
+# Requests sent partly, then the client goes away
+ABANDONED = [
+    b"GET /cgi/slow.py HTTP/1.1\r\nHost: soak\r\n\r\n",
+    b"GET /small.html HTTP/1.1\r\nHost: so",
+    b"POST /cgi/sink.py HTTP/1.1\r\nHost: soak\r\nContent-Length: 100000\r\n\r\n" + b"x" * 1000,
+    b"POST /cgi/sink.py HTTP/1.1\r\nHost: soak\r\nTransfer-Encoding: chunked\r\n\r\n400\r\n" +
+    b"x" * 512,
+]
+
+METRICS = [
+    # key, label, unit of the slope, default limit per hour
+    ("rss_kib", "RSS", "KiB/h", 4096),
+    ("fds", "open fds", "fds/h", 2),
+    ("children", "child processes", "children/h", 1),
+    ("p99_ms", "p99 latency (%s)" % WORKLOAD[0][0], "ms/h", 10),
+]
+
+
+def prepare(directory):
+    www = os.path.join(directory, "www")
+    os.makedirs(os.path.join(www, "cgi"))
+    with open(os.path.join(www, "small.html"), "w") as f:
+        f.write("<html><body>" + "x" * 4000 + "</body></html>\n")
+    for name, script in (("hello.py", HELLO), ("sink.py", SINK), ("slow.py", SLOW)):
+        with open(os.path.join(www, "cgi", name), "w") as f:
+            f.write(script)
+    conf = os.path.join(directory, "soak.conf")
+    with open(conf, "w") as f:
+        f.write(CONFIG % {"addr": ADDR, "dir": directory, "python": sys.executable})
+    return conf
+
+
+def duration(text):
+    units = {"s": 1, "m": 60, "h": 3600, "d": 86400}
+    if text and text[-1] in units:
+        return float(text[:-1]) * units[text[-1]]
+    return float(text)
+
+
+def wait_ready(seconds=30):
+    for _ in range(int(seconds * 10)):
+        try:
+            conn = http.client.HTTPConnection("127.0.0.1", PORT, timeout=1)
+            conn.request("GET", "/small.html")
+            if conn.getresponse().status == 200:
+                return
+        except OSError:
+            pass
+        time.sleep(0.1)
+    sys.exit("webserv does not answer on %s" % ADDR)
+
+
+def abandon(stop):
+    i = 0
+    while not stop.wait(0.2):
+        try:
+            sock = socket.create_connection(("127.0.0.1", PORT), timeout=2)
+            sock.sendall(ABANDONED[i % len(ABANDONED)])
+            time.sleep(0.05)
+            sock.close()
+        except OSError:
+            pass
+        i += 1
+
+
+def status_kib(pid, field):
+    with open("/proc/%d/status" % pid) as f:
+        for line in f:
+            if line.startswith(field + ":"):
+                return int(line.split()[1])
+    return 0
+
+
+def children(pid):
+    count = 0
+    for entry in os.listdir("/proc"):
+        if not entry.isdigit():
+            continue
+        try:
+            with open("/proc/%s/stat" % entry) as f:
+                stat = f.read()
+        except OSError:
+            continue
+        if int(stat[stat.rindex(")") + 2:].split()[1]) == pid:
+            count += 1
+    return count
+
+
+def sample(pid, start, results):
+    ref = results.get(WORKLOAD[0][0], {})
+    return {
+        "time": int(time.time()),
+        "elapsed": round(time.time() - start, 1),
+        "rss_kib": status_kib(pid, "VmRSS"),
+        "fds": len(os.listdir("/proc/%d/fd" % pid)),
+        "children": children(pid),
+        "p99_ms": ref.get("corrected_us", {}).get("p99", 0) / 1000.0,
+        "requests": sum(r.get("requests", 0) for r in results.values()),
+        "errors": sum(r.get("errors", 0) + r.get("timeouts", 0) for r in results.values()),
+        "p99_ms_by_workload": dict((name, r.get("corrected_us", {}).get("p99", 0) / 1000.0)
+                                   for name, r in results.items()),
+    }
+
+
+def run_interval(directory, seconds):
+    raw = os.path.join(directory, "interval.jsonl")
+    if os.path.exists(raw):
+        os.remove(raw)
+    procs = [subprocess.Popen([os.path.join(ROOT, "loadgen"), "-n", name, "-o", raw, "-d",
+                               str(seconds)] + options + [ADDR, path],
+                              stdout=subprocess.DEVNULL)
+             for name, options, path in WORKLOAD]
+    # Only during the load, the sample is taken once everything settled
+    stop = threading.Event()
+    abandoner = threading.Thread(target=abandon, args=(stop,))
+    abandoner.start()
+    for proc in procs:
+        proc.wait()
+    stop.set()
+    abandoner.join()
+    results = {}
+    if os.path.exists(raw):
+        with open(raw) as f:
+            for line in f:
+                result = json.loads(line)
+                results[result["name"]] = result
+    return results
+
+
+# Least squares slope of the series, per hour
+def slope(points):
+    n = len(points)
+    mx = sum(x for x, _ in points) / n
+    my = sum(y for _, y in points) / n
+    sxx = sum((x - mx) ** 2 for x, _ in points)
+    if not sxx:
+        return 0.0
+    return sum((x - mx) * (y - my) for x, y in points) / sxx * 3600
+
+
+def verdict(samples, args):
+    steady = samples[args.warmup:]
+    rows = []
+    for key, label, unit, _ in METRICS:
+        limit = getattr(args, "max_" + key.split("_")[0] + "_slope")
+        if len(steady) < 3:
+            rows.append((label, None, limit, unit, None))
+            continue
+        value = slope([(s["elapsed"], s[key]) for s in steady])
+        rows.append((label, value, limit, unit, value <= limit))
+    return rows
+
+
+def revision():
+    try:
+        return subprocess.check_output(["git", "rev-parse", "--short", "HEAD"], cwd=ROOT,
+                                       stderr=subprocess.DEVNULL).decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def report(path, samples, rows, args, outcome):
+    with open(path, "w") as f:
+        f.write("# webserv soak report\n\n")
+        f.write("Revision %s, %s, %d samples every %ds (the first %d are warm-up). %s\n\n" % (
+            revision(), time.strftime("%Y-%m-%d %H:%M", time.localtime(samples[0]["time"]
+                                                                       if samples else 0)),
+            len(samples), args.interval, args.warmup, outcome))
+        f.write("Workload, run side by side each interval, plus abandoned requests:\n\n")
+        for name, options, path_ in WORKLOAD:
+            f.write("- `%s`: `loadgen %s %s`\n" % (name, " ".join(options), path_))
+        f.write("\n| Metric | Slope | Limit | Result |\n|---|---:|---:|---|\n")
+        for label, value, limit, unit, ok in rows:
+            f.write("| %s | %s | %g %s | %s |\n" % (
+                label, "-" if value is None else "%.2f %s" % (value, unit), limit, unit,
+                "not enough samples" if ok is None else ("pass" if ok else "**FAIL**")))
+        f.write("\n| Elapsed | RSS (KiB) | fds | Children | p99 %s (ms) | Requests | Errors |\n"
+                "|---:|---:|---:|---:|---:|---:|---:|\n" % WORKLOAD[0][0])
+        for s in samples:
+            f.write("| %s | %d | %d | %d | %.2f | %d | %d |\n" % (
+                time.strftime("%H:%M:%S", time.gmtime(s["elapsed"])), s["rss_kib"], s["fds"],
+                s["children"], s["p99_ms"], s["requests"], s["errors"]))
+
+
+def raise_fd_limit():
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="webserv soak test")
+    parser.add_argument("-D", "--duration", type=duration, default=3600,
+                        help="total run, like 90m or 4h (default 1h)")
+    parser.add_argument("-i", "--interval", type=int, default=60, help="seconds between samples")
+    parser.add_argument("--settle", type=int, default=6,
+                        help="seconds between the end of the load and the sample, longer than "
+                             "the keep-alive timeout (default 6)")
+    parser.add_argument("--warmup", type=int, default=3, help="samples left out of the slopes")
+    for key, label, unit, limit in METRICS:
+        parser.add_argument("--max-%s-slope" % key.split("_")[0], type=float, default=limit,
+                            help="%s limit in %s (default %g)" % (label, unit, limit))
+    parser.add_argument("--samples", default="soak_samples.jsonl", help="samples file")
+    parser.add_argument("--report", default="soak_report.md", help="report file")
+    args = parser.parse_args()
+    if args.interval <= args.settle:
+        sys.exit("the interval must be longer than --settle")
+
+    directory = tempfile.mkdtemp(prefix="webserv_soak_")
+    log = open(os.path.join(directory, "webserv.log"), "w")
+    server = subprocess.Popen([os.path.join(ROOT, "webserv"), "--log-level", "error",
+                               prepare(directory)], cwd=ROOT, stdout=log, stderr=log,
+                              preexec_fn=raise_fd_limit)
+    samples = []
+    outcome = "The run completed."
+    try:
+        wait_ready()
+        start = time.time()
+        with open(args.samples, "a") as out:
+            while time.time() - start < args.duration:
+                results = run_interval(directory, args.interval - args.settle)
+                time.sleep(args.settle)
+                if server.poll() is not None:
+                    outcome = "webserv exited (status %d) after %ds." % (server.returncode,
+                                                                         time.time() - start)
+                    break
+                s = sample(server.pid, start, results)
+                samples.append(s)
+                out.write(json.dumps(s) + "\n")
+                out.flush()
+                print("%8.0fs rss %7d KiB  fds %4d  children %2d  p99 %7.2f ms  errors %d" % (
+                    s["elapsed"], s["rss_kib"], s["fds"], s["children"], s["p99_ms"],
+                    s["errors"]))
+    finally:
+        server.terminate()
+        server.wait()
+
+    rows = verdict(samples, args)
+    report(args.report, samples, rows, args, outcome)
+    failed = outcome != "The run completed."
+    for label, value, limit, unit, ok in rows:
+        print("%-28s %s" % (label, "not enough samples" if ok is None else
+                            "%.2f %s (limit %g) %s" % (value, unit, limit,
+                                                       "pass" if ok else "FAIL")))
+        failed = failed or ok is False
+    print("report in %s, samples in %s, server log in %s" % (args.report, args.samples,
+                                                             log.name))
+    if not failed:
+        shutil.rmtree(directory)
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+"""Binary upgrade (SIGUSR2) and socket activation (LISTEN_FDS) end-to-end test.
+
+Usage: tests/upgrade/test_upgrade.py      (from the repository root, after make)
+
+Starts a copy of webserv on a generated configuration listening on 8096, with a
+slow CGI request running, a kept-alive idle connection and clients connecting
+all along, then sends SIGUSR2. Checks the new process takes over without a
+refused connection, the old one closes the idle connection, finishes the slow
+request and exits. Then starts webserv the way systemd would, with the socket
+already listening as fd 3, and checks it is served without binding again.
+The servers' output goes to webserv_upgrade.log in the temporary directory.
+"""
+import http.client
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+PORT = 8096
+failures = 0
+
+CONFIG = """http {
+    server {
+        listen 127.0.0.1:%(port)d;
+        root %(dir)s/www;
+
+        location / {
+            allowed_methods GET;
+        }
+
+        location /cgi/ {
+            root %(dir)s/cgi;
+            allowed_methods GET;
+            cgi_ext .py %(python)s;
+        }
+    }
+}
+"""
+
+SLOW = """import time
+time.sleep(2)
+print("Content-Type: text/plain\\r\\n\\r\\nslow done")
+"""
+
+
+def check(name, condition, detail=""):
+    global failures
+    print("%s %s%s" % ("PASS" if condition else "FAIL", name, "" if condition else ": " + detail))
+    if not condition:
+        failures += 1
+
+
+def get(path):
+    conn = http.client.HTTPConnection("127.0.0.1", PORT, timeout=10)
+    conn.request("GET", path)
+    resp = conn.getresponse()
+    return resp.status, resp.read().decode()
+
+
+def wait_port():
+    for _ in range(50):
+        try:
+            socket.create_connection(("127.0.0.1", PORT), timeout=1).close()
+            return
+        except OSError:
+            time.sleep(0.1)
+    sys.exit("nothing listens on %d" % PORT)
+
+
+def children(pid):
+    found = []
+    for entry in os.listdir("/proc"):
+        try:
+            with open("/proc/%s/stat" % entry) as f:
+                fields = f.read().rsplit(")", 1)[1].split()
+        except (OSError, IndexError):
+            continue
+        if int(fields[1]) == pid:
+            found.append(int(entry))
+    return found
+
+
+def hammer(stop, results):
+    while not stop.is_set():
+        try:
+            results.append(get("/index.html")[0])
+        except OSError as e:
+            results.append(repr(e))
+        time.sleep(0.01)
+
+
+def upgrade(binary, conf, log):
+    old = subprocess.Popen([binary, "--log-level=info", conf], cwd=ROOT, stdout=log, stderr=log)
+    wait_port()
+    idle = socket.create_connection(("127.0.0.1", PORT))
+    idle.sendall(b"GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n")
+    idle.settimeout(10)
+    check("kept-alive connection served", b"200" in idle.recv(4096))
+
+    slow = {}
+    thread = threading.Thread(target=lambda: slow.update(r=get("/cgi/slow.py")))
+    thread.start()
+    stop = threading.Event()
+    results = []
+    clients = threading.Thread(target=hammer, args=(stop, results))
+    clients.start()
+    time.sleep(0.5)  # the script runs
+
+    old.send_signal(signal.SIGUSR2)
+    time.sleep(1)
+    new = [pid for pid in children(old.pid) if os.path.basename(os.readlink(
+        "/proc/%d/exe" % pid)) == os.path.basename(binary)]
+    check("new binary started", len(new) == 1, repr(new))
+    check("idle connection closed by the old process", idle.recv(4096) == b"")
+    thread.join()
+    check("request in flight finished", slow.get("r") == (200, "slow done\n"), repr(slow))
+    try:
+        old.wait(timeout=5)
+        check("old process exited once drained", old.returncode == 0, repr(old.returncode))
+    except subprocess.TimeoutExpired:
+        check("old process exited once drained", False, "still running")
+        old.kill()
+    time.sleep(0.5)
+    stop.set()
+    clients.join()
+    errors = [r for r in results if r != 200]
+    check("no client refused during the upgrade", len(results) > 50 and not errors,
+          "%d requests, %r" % (len(results), errors[:3]))
+    check("new process serving", get("/index.html") == (200, "upgraded\n"))
+    for pid in new:
+        os.kill(pid, signal.SIGTERM)
+    for _ in range(50):
+        if not any(os.path.exists("/proc/%d" % pid) and
+                   open("/proc/%d/stat" % pid).read().split()[2] != "Z" for pid in new):
+            break
+        time.sleep(0.1)
+
+
+def activation(binary, conf, log, log_path):
+    listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind(("127.0.0.1", PORT))
+    listener.listen(16)
+    start = os.path.getsize(log_path)
+    # LISTEN_PID is the shell's pid, which exec keeps
+    command = 'LISTEN_PID=$$ LISTEN_FDS=1 exec "$0" --log-level=info "$1"'
+    server = subprocess.Popen(["sh", "-c", command, binary, conf], cwd=ROOT, stdout=log,
+                              stderr=log, close_fds=False,
+                              preexec_fn=lambda: os.dup2(listener.fileno(), 3))
+    listener.close()
+    try:
+        wait_port()
+        check("socket-activated server serving", get("/index.html") == (200, "upgraded\n"))
+        log.flush()
+        with open(log_path) as f:
+            f.seek(start)
+            output = f.read()
+        check("listening socket adopted, not bound again",
+              "initialized on an inherited socket" in output)
+    finally:
+        server.terminate()
+        server.wait()
+
+
+def main():
+    directory = tempfile.mkdtemp(prefix="webserv_upgrade_")
+    for name in ("www", "cgi"):
+        os.mkdir(os.path.join(directory, name))
+    with open(os.path.join(directory, "www", "index.html"), "w") as f:
+        f.write("upgraded\n")
+    with open(os.path.join(directory, "cgi", "slow.py"), "w") as f:
+        f.write(SLOW)
+    conf = os.path.join(directory, "upgrade.conf")
+    with open(conf, "w") as f:
+        f.write(CONFIG % {"dir": directory, "port": PORT, "python": sys.executable})
+    binary = os.path.join(directory, "webserv")
+    shutil.copy(os.path.join(ROOT, "webserv"), binary)
+
+    log_path = os.path.join(tempfile.gettempdir(), "webserv_upgrade.log")
+    log = open(log_path, "w")
+    try:
+        upgrade(binary, conf, log)
+        activation(binary, conf, log, log_path)
+    finally:
+        shutil.rmtree(directory)
+    print("%d failure(s)" % failures)
+    sys.exit(1 if failures else 0)
+
+
+if __name__ == "__main__":
+    main()